@@ -0,0 +1,471 @@
+#ifndef ACCESS_LOG_FILE_H
+#define ACCESS_LOG_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "AccessLogRecord.h"
+#include "Crc32.h"
+#include "StorageCipher.h"
+
+#define ACCESS_LOG_PATH_LEN 48
+#define LOG_FRAME_MAGIC     0xA10C
+#define LOG_FRAME_MAGIC_ENC 0xA10E  // Record and CRC encrypted (StorageCipher)
+#define LOG_FRAME_MAGIC_HEAD 0xA1E0 // + slot: encrypted head frame written by rewrite()
+#define LOG_HEAD_SLOTS      4       // Head frames one rewrite() can write
+#define LOG_RECOVERY_FRAMES 64      // Backward scan bound at begin(): two commit batches
+
+struct AccessLogStats {
+    uint32_t appends;         // Records accepted
+    uint32_t commits;         // Group commits (one write + sync each; ring: record writes)
+    uint32_t opens;           // File opens, including rotation and clear (ring: sector erases)
+    uint32_t bytesWritten;
+    uint32_t maxBatch;        // Largest group commit, in records
+};
+
+// What begin() found at the end of the file (torn tail after a brownout)
+struct LogRecoveryStats {
+    uint32_t framesScanned;   // Frames checked by the backward scan
+    uint32_t framesCut;       // Invalid frames truncated from the tail
+    uint32_t bytesCut;        // Including a partial frame
+    uint32_t badReads;        // Frames that failed the check when read later
+};
+
+// Cipher IV domain of each log's frames
+inline uint32_t logCipherDomain(const AccessLogRecord&) { return CIPHER_DOMAIN_TAPS; }
+inline uint32_t logCipherDomain(const AccessLog&) { return CIPHER_DOMAIN_LOGS; }
+
+// On-disk record: magic, size and CRC make a torn or stray frame detectable;
+// `seq` is the log sequence number the record was appended with.
+// Encoded with a cipher, `rec` and `crc` are encrypted under (domain, seq):
+// the header stays readable for recovery, and as the CRC is of the
+// plaintext, a frame read with the wrong key fails like a damaged one.
+// Head frames take the numbers of records already written, so they are
+// sealed under (domain, seq, 1 + slot) instead: a nonce no appended record
+// uses, and one that only ever seals the same head record (slot 0 is the
+// SEQ record stating its own number, slot 1 the roster in effect after it).
+template <typename Record>
+struct LogFrame {
+    uint16_t magic;           // LOG_FRAME_MAGIC, LOG_FRAME_MAGIC_ENC or LOG_FRAME_MAGIC_HEAD + slot
+    uint16_t size;            // sizeof(Record)
+    uint32_t seq;
+    Record rec;
+    uint32_t crc;             // CRC32 of everything above (ESP32 ROM on device)
+
+    static const size_t SEALED = sizeof(Record) + sizeof(uint32_t);   // rec + crc
+
+    bool sealed() const {
+        return magic == LOG_FRAME_MAGIC_ENC || (uint16_t)(magic - LOG_FRAME_MAGIC_HEAD) < LOG_HEAD_SLOTS;
+    }
+
+    void crypt(const StorageCipher* cipher) {
+        uint32_t nonce = magic == LOG_FRAME_MAGIC_ENC ? 0 : 1u + (uint16_t)(magic - LOG_FRAME_MAGIC_HEAD);
+        cipher->apply(logCipherDomain(rec), seq, nonce, (uint8_t*)this + offsetof(LogFrame, rec), SEALED);
+    }
+
+    // `sealAs` is LOG_FRAME_MAGIC_HEAD + slot for a head frame
+    void encode(const Record& r, uint32_t s, const StorageCipher* cipher = nullptr,
+                uint16_t sealAs = LOG_FRAME_MAGIC_ENC) {
+        magic = cipher ? sealAs : LOG_FRAME_MAGIC;
+        size = (uint16_t)sizeof(Record);
+        seq = s;
+        rec = r;
+        crc = crc32Update(0, this, offsetof(LogFrame, crc));
+        if (cipher) crypt(cipher);
+    }
+
+    // The record, if the frame passes its check. Plaintext frames (written
+    // before encryption was on) read with or without a cipher.
+    bool decode(Record& out, const StorageCipher* cipher = nullptr) const {
+        if (size != sizeof(Record)) return false;
+        if (sealed()) {
+            if (!cipher) return false;
+            LogFrame f = *this;
+            f.crypt(cipher);
+            if (f.crc != crc32Update(0, &f, offsetof(LogFrame, crc))) return false;
+            out = f.rec;
+            return true;
+        }
+        if (magic != LOG_FRAME_MAGIC || crc != crc32Update(0, this, offsetof(LogFrame, crc))) return false;
+        out = rec;
+        return true;
+    }
+
+    bool valid(const StorageCipher* cipher = nullptr) const {
+        Record r;
+        return decode(r, cipher);
+    }
+};
+
+static_assert(offsetof(LogFrame<AccessLogRecord>, crc) == offsetof(LogFrame<AccessLogRecord>, rec) + sizeof(AccessLogRecord),
+              "LogFrame encrypts rec and crc as one run");
+static_assert(offsetof(LogFrame<AccessLog>, crc) == offsetof(LogFrame<AccessLog>, rec) + sizeof(AccessLog),
+              "LogFrame encrypts rec and crc as one run");
+
+// =============================================================================
+// ACCESS LOG FILE
+// Append-only file of fixed-size framed records with a persistent handle.
+// Storage keeps each log as segments of these (AccessLogSegments.h);
+// AccessLogFile (below) is the single-file variant.
+// Features:
+// - One open per boot: size and record count are cached, not re-read
+// - Group commit: records are buffered in RAM and written with one write +
+//   sync when `commitRecords` are pending or the oldest is `commitMs` old
+//   (poll() drives the timer). flush() commits now - call it before the
+//   file is read by anyone else and before a restart.
+// - Rotation to `oldPath` when a commit would pass `maxSize`; with no
+//   `oldPath` the file stops accepting records there instead
+// - Every record is a LogFrame (magic, sequence number, CRC32). begin()
+//   cuts a torn tail with a backward scan from the end, bounded to
+//   LOG_RECOVERY_FRAMES, so boot time does not grow with the file. A bad
+//   frame further in fails read() and is skipped; it cannot shift the
+//   frames after it.
+// - With setCipher(), records are encrypted as they are appended (see
+//   LogFrame); older plaintext frames still read
+// - Plain C stdio: LittleFS is mounted in the VFS on the device (see
+//   Storage::vfsPath), and the same code runs on the host for tests.
+// A power cut loses at most the uncommitted batch.
+// Not thread-safe: Storage serializes access.
+// =============================================================================
+template <typename Record>
+class LogFile {
+public:
+    typedef LogFrame<Record> Frame;
+    static const size_t MAX_BATCH = 32;
+    static const size_t FRAME_SIZE = sizeof(Frame);
+
+private:
+    char _path[ACCESS_LOG_PATH_LEN] = {0};
+    char _oldPath[ACCESS_LOG_PATH_LEN] = {0};
+    FILE* _file = nullptr;
+    size_t _size = 0;                // Committed bytes
+    size_t _maxSize = 0;
+    uint32_t _commitMs = 0;
+    size_t _commitRecords = 1;
+    uint32_t _nextSeq = 0;           // Sequence number of the next append
+    const StorageCipher* _cipher = nullptr;
+
+    Frame _pending[MAX_BATCH];
+    size_t _pendingCount = 0;
+    uint32_t _pendingSince = 0;      // Arrival of the oldest pending record
+    AccessLogStats _stats = {};
+    LogRecoveryStats _recovery = {};
+
+    bool open() {
+        _file = fopen(_path, "a+b");
+        if (!_file) return false;
+        _stats.opens++;
+        fseek(_file, 0, SEEK_END);
+        long end = ftell(_file);
+        _size = end > 0 ? (size_t)end : 0;
+        return true;
+    }
+
+    void close() {
+        if (_file) fclose(_file);
+        _file = nullptr;
+    }
+
+    bool readFrame(size_t index, Frame& f) {
+        return _file &&
+               fseek(_file, (long)(index * FRAME_SIZE), SEEK_SET) == 0 &&
+               fread(&f, 1, FRAME_SIZE, _file) == FRAME_SIZE;
+    }
+
+    // Cut a torn tail (power cut mid-commit): a partial frame, then invalid
+    // frames back to the last valid one. Only the last commit can be torn,
+    // so the scan stops after LOG_RECOVERY_FRAMES; what is behind that is
+    // left for read() to reject frame by frame.
+    bool recover() {
+        size_t frames = _size / FRAME_SIZE;
+        size_t keep = frames;
+        size_t scanned = 0;
+        size_t sealed = 0;
+        bool found = false;
+        Frame f;
+        _nextSeq = 0;
+        while (keep > 0 && scanned < LOG_RECOVERY_FRAMES) {
+            scanned++;
+            if (readFrame(keep - 1, f)) {
+                if (f.valid(_cipher)) {
+                    _nextSeq = f.seq + 1;
+                    found = true;
+                    break;
+                }
+                if (f.sealed() && f.size == sizeof(Record)) sealed++;
+            }
+            keep--;
+        }
+        _recovery.framesScanned += (uint32_t)scanned;
+        if (!found && keep > 0) keep = frames;  // Not a torn commit: leave them to read()
+        // Encrypted frames failing past one batch: the key is wrong (NVS
+        // secret lost), not a torn commit - never cut what may be readable
+        if (sealed > 0 && (!found || sealed > MAX_BATCH)) keep = frames;
+        if (keep * FRAME_SIZE == _size) return true;
+        _recovery.framesCut += (uint32_t)(frames - keep);
+        _recovery.bytesCut += (uint32_t)(_size - keep * FRAME_SIZE);
+        return truncateTo(keep);
+    }
+
+    bool truncateTo(size_t frames) {
+        fflush(_file);
+        if (ftruncate(fileno(_file), (off_t)(frames * FRAME_SIZE)) == 0) {
+            _size = frames * FRAME_SIZE;
+            return true;
+        }
+        return rewrite(nullptr, 0, 0, frames);  // No truncate: copy what stays
+    }
+
+    bool rotate() {
+        close();
+        remove(_oldPath);
+        if (rename(_path, _oldPath) != 0) {
+            remove(_path);  // Better to lose old logs than new ones
+        }
+        return open();
+    }
+
+public:
+    ~LogFile() { end(); }
+
+    // Encrypt records appended from now on (nullptr: plaintext). Set it
+    // before begin(): recovery and reads need it for encrypted frames.
+    void setCipher(const StorageCipher* cipher) { _cipher = cipher; }
+
+    bool begin(const char* path, const char* oldPath, size_t maxSize,
+               uint32_t commitMs, size_t commitRecords) {
+        end();
+        int n = snprintf(_path, sizeof(_path), "%s", path);
+        int m = snprintf(_oldPath, sizeof(_oldPath), "%s", oldPath ? oldPath : "");
+        if (n <= 0 || n >= (int)sizeof(_path) || m < 0 || m >= (int)sizeof(_oldPath)) return false;
+
+        _maxSize = maxSize;
+        _commitMs = commitMs;
+        _commitRecords = commitRecords < 1 ? 1 : (commitRecords > MAX_BATCH ? MAX_BATCH : commitRecords);
+        _pendingCount = 0;
+        if (!open()) return false;
+        return recover();
+    }
+
+    // Commits anything pending and closes the handle
+    void end() {
+        if (!_file) return;
+        flush();
+        close();
+    }
+
+    // Buffers one record; commits when the batch is full
+    bool append(const Record& rec, uint32_t nowMs) {
+        if (!_file) return false;
+        if (_pendingCount >= MAX_BATCH && !flush()) return false;  // Earlier commit failed
+        if (_pendingCount == 0) _pendingSince = nowMs;
+        _pending[_pendingCount++].encode(rec, _nextSeq++, _cipher);
+        _stats.appends++;
+        if (_pendingCount >= _commitRecords) return flush();
+        return true;
+    }
+
+    // Commits when the oldest pending record has waited `commitMs`
+    bool poll(uint32_t nowMs) {
+        if (_pendingCount == 0 || nowMs - _pendingSince < _commitMs) return true;
+        return flush();
+    }
+
+    // Writes all pending records in one write and makes them durable
+    bool flush() {
+        if (_pendingCount == 0) return true;
+        if (!_file) return false;
+
+        size_t bytes = _pendingCount * FRAME_SIZE;
+        if (_size + bytes > _maxSize && _size > 0) {
+            if (_oldPath[0] == '\0') return false;  // Full until records are trimmed
+            rotate();
+        }
+        if (!_file) return false;
+
+        fseek(_file, 0, SEEK_END);  // Required between a read and a write on one stream
+        bool ok = fwrite(_pending, 1, bytes, _file) == bytes &&
+                  fflush(_file) == 0 && fsync(fileno(_file)) == 0;
+        if (!ok) {
+            // Keep the batch for a retry; cut off whatever part did land
+            fseek(_file, 0, SEEK_END);
+            long end = ftell(_file);
+            size_t landed = end > 0 ? (size_t)end : 0;
+            if (landed > _size) truncateTo(_size / FRAME_SIZE);
+            return false;
+        }
+
+        _size += bytes;
+        _stats.commits++;
+        _stats.bytesWritten += bytes;
+        if (_pendingCount > _stats.maxBatch) _stats.maxBatch = _pendingCount;
+        _pendingCount = 0;
+        return true;
+    }
+
+    // Deletes committed and pending records (numbering continues)
+    bool clear() {
+        _pendingCount = 0;
+        close();
+        if (remove(_path) != 0) {
+            FILE* f = fopen(_path, "rb");
+            if (f) {
+                fclose(f);
+                open();
+                return false;  // Exists but could not be removed
+            }
+        }
+        return open();
+    }
+
+    // Replaces the committed records with `head` followed by committed
+    // frames [from, to), atomically (temp file + rename). Copied frames keep
+    // their sequence numbers; `head` takes the ones just before. Pending
+    // records stay pending.
+    bool rewrite(const Record* head, size_t headCount, size_t from, size_t to = (size_t)-1) {
+        if (!_file) return false;
+        size_t committed = _size / FRAME_SIZE;
+        if (to > committed) to = committed;
+        if (from > to || headCount > LOG_HEAD_SLOTS) return false;
+
+        char tmpPath[ACCESS_LOG_PATH_LEN + 4];
+        snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", _path);
+        FILE* tmp = fopen(tmpPath, "wb");
+        if (!tmp) return false;
+
+        Frame f;
+        uint32_t seq = from < to && readFrame(from, f) && f.valid(_cipher) ? f.seq : _nextSeq;
+        seq -= (uint32_t)headCount;
+        bool ok = true;
+        for (size_t i = 0; ok && i < headCount; i++) {
+            f.encode(head[i], seq++, _cipher, (uint16_t)(LOG_FRAME_MAGIC_HEAD + i));
+            ok = fwrite(&f, 1, FRAME_SIZE, tmp) == FRAME_SIZE;
+        }
+        for (size_t i = from; ok && i < to; i++) {
+            ok = readFrame(i, f) && fwrite(&f, 1, FRAME_SIZE, tmp) == FRAME_SIZE;
+        }
+        ok = ok && fflush(tmp) == 0 && fsync(fileno(tmp)) == 0;
+        fclose(tmp);
+        close();
+        if (!ok || rename(tmpPath, _path) != 0) {
+            remove(tmpPath);
+            open();
+            return false;
+        }
+        return open();
+    }
+
+    // Reads committed records first, then pending ones. False for a frame
+    // that fails its check (skip it: the next one is still aligned).
+    bool read(size_t index, Record& rec, uint32_t* seq = nullptr) {
+        size_t committed = _size / FRAME_SIZE;
+        Frame buf;
+        const Frame* f = &buf;
+        if (index >= committed) {
+            if (index - committed >= _pendingCount) return false;
+            f = &_pending[index - committed];
+        } else if (!readFrame(index, buf)) {
+            return false;
+        }
+        if (!f->decode(rec, _cipher)) {
+            _recovery.badReads++;
+            return false;
+        }
+        if (seq) *seq = f->seq;
+        return true;
+    }
+
+    // Reads up to `n` records from `index` with one seek (committed frames,
+    // then pending ones); ok[i] is false for a frame that fails its check.
+    // Returns how many were read.
+    size_t readBlock(size_t index, Record* out, bool* ok, size_t n) {
+        size_t committed = _size / FRAME_SIZE;
+        size_t got = 0;
+        if (index < committed) {
+            if (!_file || fseek(_file, (long)(index * FRAME_SIZE), SEEK_SET) != 0) return 0;
+            Frame f;
+            for (; got < n && index + got < committed; got++) {
+                if (fread(&f, 1, FRAME_SIZE, _file) != FRAME_SIZE) return got;
+                ok[got] = f.decode(out[got], _cipher);
+                if (!ok[got]) _recovery.badReads++;
+            }
+        }
+        for (; got < n && index + got - committed < _pendingCount; got++) {
+            ok[got] = _pending[index + got - committed].decode(out[got], _cipher);
+        }
+        return got;
+    }
+
+    // Sequence number given to the next append (continues from the last
+    // valid frame at begin())
+    void setNextSeq(uint32_t seq) { _nextSeq = seq; }
+    uint32_t nextSeq() const { return _nextSeq; }
+
+    size_t count() const { return _size / FRAME_SIZE + _pendingCount; }
+    size_t size() const { return _size + _pendingCount * FRAME_SIZE; }
+    size_t pending() const { return _pendingCount; }
+    bool isOpen() const { return _file != nullptr; }
+    const char* path() const { return _path; }
+    const AccessLogStats& stats() const { return _stats; }
+    const LogRecoveryStats& recovery() const { return _recovery; }
+};
+
+typedef LogFile<AccessLog> ExpandedLogFile;
+
+// =============================================================================
+// COMPACT ACCESS LOG FILE
+// LogFile of AccessLogRecords with stable sequence numbers: record i has
+// seqAt(i) = first + i, where `first` comes from a SEQ record at the start
+// of the file (0 for a file without one). trim() drops acknowledged records
+// and rewrites the head so the rest keep their numbers. Open it without an
+// `oldPath`: rotation would restart the numbering.
+// Same trim()/seqAt()/context() interface as AccessLogRing.
+// =============================================================================
+class AccessLogFile : public LogFile<AccessLogRecord> {
+private:
+    uint32_t _firstSeq = 0;
+
+public:
+    bool begin(const char* path, const char* oldPath, size_t maxSize,
+               uint32_t commitMs, size_t commitRecords) {
+        _firstSeq = 0;
+        if (!LogFile<AccessLogRecord>::begin(path, oldPath, maxSize, commitMs, commitRecords)) return false;
+        AccessLogRecord head;
+        if (read(0, head) && head.method == LOG_METHOD_SEQ) _firstSeq = head.timestamp;
+        return true;
+    }
+
+    uint32_t seqAt(size_t index) const { return _firstSeq + (uint32_t)index; }
+
+    // Roster generation in effect at index 0 that no record states
+    // (always 0 here: trim() keeps it in the file as a ROSTER record)
+    uint32_t context() const { return 0; }
+
+    // Drops records before `index`; the rest keep their sequence numbers.
+    // `context` is the roster generation in effect at `index` (0 = none).
+    bool trim(size_t index, uint32_t context) {
+        flush();  // Fails when the file is full: trim what is committed
+        size_t committed = count() - pending();
+        if (index > committed) index = committed;  // Acked pending ones are resent (and deduplicated)
+        if (index == 0) return true;
+
+        AccessLogRecord head[2];
+        size_t n = 0;
+        memset(&head[n++], 0, sizeof(AccessLogRecord));
+        head[0].method = LOG_METHOD_SEQ;
+        if (context != 0) head[n++] = accessLogRosterMarker(context);
+        uint32_t first = seqAt(index) - (uint32_t)n;  // Head records take the dropped numbers
+        head[0].timestamp = first;
+
+        if (!rewrite(head, n, index)) return false;
+        _firstSeq = first;
+        return true;
+    }
+
+    // Drops every record; numbering continues
+    bool clear() { return trim(count(), 0); }
+};
+
+#endif // ACCESS_LOG_FILE_H
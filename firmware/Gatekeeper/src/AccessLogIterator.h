@@ -0,0 +1,121 @@
+#ifndef ACCESS_LOG_ITERATOR_H
+#define ACCESS_LOG_ITERATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "AccessLogRecord.h"
+
+#define LOG_READ_BLOCK  16      // Records fetched per readBlock() (and per lock)
+
+// Timestamp a time filter applies to; false for records without one
+// (roster markers and other bookkeeping records, which are always returned)
+inline bool logRecordTime(const AccessLogRecord& rec, uint32_t& t) {
+    if (!accessLogIsTap(rec)) return false;
+    t = rec.timestamp;
+    return true;
+}
+
+inline bool logRecordTime(const AccessLog& log, uint32_t& t) {
+    t = log.timestamp;
+    return true;
+}
+
+// No locking: the caller owns the log
+struct LogNoLock {};
+
+// =============================================================================
+// ACCESS LOG ITERATOR
+// Bulk reads over any log with count(), seqAt() and readBlock() (LogFile,
+// SegmentedLog, AccessLogRing), for dumps and inspection.
+// Features:
+// - Reads LOG_READ_BLOCK records at a time: one seek per block on a file
+//   log instead of one per record
+// - Forward from the oldest record or backward from the newest; seek() to
+//   continue from a sequence number
+// - Time filter [from, to] on taps; markers are always returned so the
+//   caller can track the roster (AccessLogExpander)
+// - Frames that fail their check are skipped and counted
+// - Positions are sequence numbers, so records appended or trimmed between
+//   blocks do not shift it. `Lock` is held per block only (Storage: its log
+//   mutex), never across the caller's work on a record.
+// =============================================================================
+template <typename Log, typename Record, typename Lock = LogNoLock>
+class LogIterator {
+private:
+    Log& _log;
+    bool _reverse;
+    uint32_t _from;
+    uint32_t _to;
+    Record _block[LOG_READ_BLOCK];
+    bool _ok[LOG_READ_BLOCK];
+    uint32_t _blockSeq = 0;          // Sequence number of _block[0]
+    size_t _blockLen = 0;
+    uint32_t _seq = 0;               // Next to look at
+    bool _done = false;
+    uint32_t _blocks = 0;
+    uint32_t _bad = 0;
+
+    bool inBlock(uint32_t seq) const { return _blockLen > 0 && seq - _blockSeq < _blockLen; }
+
+    bool refill() {
+        [[maybe_unused]] Lock lock;
+        uint32_t first = _log.seqAt(0);
+        uint32_t end = _log.seqAt(_log.count());
+        size_t n;
+        if (_reverse) {
+            if ((int32_t)(_seq - first) < 0) return false;   // Past the oldest (or trimmed away)
+            n = _seq - first + 1 < LOG_READ_BLOCK ? _seq - first + 1 : LOG_READ_BLOCK;
+            _blockSeq = _seq - (uint32_t)(n - 1);
+        } else {
+            if ((int32_t)(_seq - first) < 0) _seq = first;   // Trimmed meanwhile: skip ahead
+            if ((int32_t)(end - _seq) <= 0) return false;
+            n = end - _seq < LOG_READ_BLOCK ? end - _seq : LOG_READ_BLOCK;
+            _blockSeq = _seq;
+        }
+        _blockLen = _log.readBlock(_blockSeq - first, _block, _ok, n);
+        _blocks++;
+        return _blockLen == n;
+    }
+
+public:
+    LogIterator(Log& log, bool reverse = false, uint32_t from = 0, uint32_t to = 0xFFFFFFFF)
+        : _log(log), _reverse(reverse), _from(from), _to(to) {
+        [[maybe_unused]] Lock lock;
+        _seq = reverse ? _log.seqAt(_log.count()) - 1 : _log.seqAt(0);
+    }
+
+    // Continue from sequence number `seq` (returned next if still in the log)
+    void seek(uint32_t seq) {
+        _seq = seq;
+        _blockLen = 0;
+        _done = false;
+    }
+
+    // Next record in order that passes the filter; false at the end
+    bool next(Record& rec, uint32_t* seq = nullptr) {
+        while (!_done) {
+            if (!inBlock(_seq) && !refill()) {
+                _done = true;
+                break;
+            }
+            size_t i = _seq - _blockSeq;
+            uint32_t s = _seq;
+            _seq = _reverse ? _seq - 1 : _seq + 1;
+            if (!_ok[i]) {
+                _bad++;
+                continue;
+            }
+            uint32_t t;
+            if (logRecordTime(_block[i], t) && (t < _from || t > _to)) continue;
+            rec = _block[i];
+            if (seq) *seq = s;
+            return true;
+        }
+        return false;
+    }
+
+    uint32_t blocks() const { return _blocks; }      // readBlock() calls so far
+    uint32_t badFrames() const { return _bad; }      // Skipped: failed their check
+};
+
+#endif // ACCESS_LOG_ITERATOR_H
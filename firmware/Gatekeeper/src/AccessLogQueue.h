@@ -0,0 +1,77 @@
+#ifndef ACCESS_LOG_QUEUE_H
+#define ACCESS_LOG_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// =============================================================================
+// ACCESS LOG QUEUE
+// RAM staging between the tap (openDoor on the main loop) and the flash
+// writer task, so a LittleFS commit or block erase never delays a tap.
+// Features:
+// - Single producer / single consumer, lock-free: the producer never
+//   blocks, whatever the consumer is doing (indexes are free-running
+//   counters, slot = index % N)
+// - Several tasks may drain as long as they take turns (Storage drains under
+//   its log mutex)
+// - push() fails when full; the caller decides (Storage writes through)
+// - Plain C++ (no Arduino dependencies) so it can be tested on the host
+// =============================================================================
+
+// A tap as handed to Storage::appendLog, waiting to be written
+struct PendingLog {
+    uint32_t timestamp;
+    uint32_t generation;       // Roster the card was looked up in
+    uint16_t userIdx;
+    uint8_t method;            // AccessLogMethod
+    uint8_t flags;             // LOG_FLAG_*
+    char userId[32];           // For the expanded path (roster replaced meanwhile)
+};
+
+template <typename T, size_t N>
+class SpscQueue {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+private:
+    std::atomic<uint32_t> _head{0};   // Next to pop (consumer)
+    std::atomic<uint32_t> _tail{0};   // Next to push (producer)
+    T _slots[N];
+    uint32_t _highWater = 0;          // Producer-side statistics
+    uint32_t _full = 0;
+
+public:
+    // Producer only
+    bool push(const T& item) {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        uint32_t used = tail - _head.load(std::memory_order_acquire);
+        if (used >= N) {
+            _full++;
+            return false;
+        }
+        _slots[tail % N] = item;
+        _tail.store(tail + 1, std::memory_order_release);
+        if (used + 1 > _highWater) _highWater = used + 1;
+        return true;
+    }
+
+    // Consumer only
+    bool pop(T& item) {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) return false;
+        item = _slots[head % N];
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+    static constexpr size_t capacity() { return N; }
+
+    uint32_t highWater() const { return _highWater; }   // Most items ever queued at once
+    uint32_t fullCount() const { return _full; }        // push() calls refused
+};
+
+#endif // ACCESS_LOG_QUEUE_H
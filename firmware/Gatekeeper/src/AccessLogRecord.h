@@ -0,0 +1,120 @@
+#ifndef ACCESS_LOG_RECORD_H
+#define ACCESS_LOG_RECORD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// =============================================================================
+// ACCESS LOG RECORDS
+// Taps are stored as 8-byte AccessLogRecords that point into the whitelist
+// user table, and expanded to AccessLog (server user ID + method name) only
+// when they are uploaded.
+// - A ROSTER marker (timestamp = roster generation) precedes the taps logged
+//   against each roster, so an index is never resolved against a different
+//   user table: those taps fail to resolve instead of naming the wrong user.
+// - Before a new roster goes live, Storage expands the taps still pending
+//   into the AccessLog file (/logs.bin) - the format the log used before,
+//   so files left by older firmware upload unchanged.
+// - Every record has a device sequence number (its position in the log
+//   since the device started logging), sent with each upload so the server
+//   can acknowledge a range and drop retried duplicates.
+// =============================================================================
+
+// Expanded record: as uploaded, and the /logs.bin file format
+struct AccessLog {
+    uint32_t timestamp;
+    char userId[32];     // 31 chars + null terminator
+    char method[12];     // 11 chars + null terminator ("NFC", "NFC+BIO", "FACE", "VEIN")
+};
+
+enum AccessLogMethod : uint8_t {
+    LOG_METHOD_NFC       = 0x01,
+    LOG_METHOD_NFC_BIO   = 0x02,
+    LOG_METHOD_FACE      = 0x03,
+    LOG_METHOD_VEIN      = 0x04,
+    LOG_METHOD_SEQ       = 0x7D,   // File backend, first record: its sequence number is `timestamp`
+    LOG_METHOD_TRIM      = 0x7E,   // Ring backend: records before this one are cleared
+    LOG_METHOD_ROSTER    = 0x7F,   // Marker: later taps use roster generation `timestamp`
+};
+
+#define LOG_FLAG_LOCAL_TIME  0x01  // Clock was not NTP-synced at the tap
+#define LOG_FLAG_DENIED      0x02  // Access refused (taps are only logged when granted today)
+
+struct AccessLogRecord {
+    uint32_t timestamp;       // Epoch seconds (ROSTER: generation)
+    uint16_t userIdx;         // Index into the roster's user table
+    uint8_t method;           // AccessLogMethod
+    uint8_t flags;            // LOG_FLAG_*
+};
+
+static_assert(sizeof(AccessLogRecord) == 8, "AccessLogRecord must stay 8 bytes");
+
+inline const char* accessLogMethodName(uint8_t method) {
+    switch (method) {
+        case LOG_METHOD_NFC:     return "NFC";
+        case LOG_METHOD_NFC_BIO: return "NFC+BIO";
+        case LOG_METHOD_FACE:    return "FACE";
+        case LOG_METHOD_VEIN:    return "VEIN";
+        default:                 return "";
+    }
+}
+
+inline bool accessLogIsTap(const AccessLogRecord& rec) {
+    return rec.method != LOG_METHOD_ROSTER && rec.method != LOG_METHOD_TRIM && rec.method != LOG_METHOD_SEQ;
+}
+
+inline AccessLogRecord accessLogRosterMarker(uint32_t generation) {
+    AccessLogRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.timestamp = generation;
+    rec.method = LOG_METHOD_ROSTER;
+    return rec;
+}
+
+// User ID of `userIdx` in roster generation `generation`; false if that
+// roster is no longer live
+typedef bool (*AccessLogUserResolver)(uint32_t generation, uint16_t userIdx, char* out, size_t size);
+
+// =============================================================================
+// ACCESS LOG EXPANDER
+// Walks compact records in log order, tracking the roster generation from
+// markers, and turns taps back into AccessLogs.
+// =============================================================================
+class AccessLogExpander {
+private:
+    AccessLogUserResolver _resolve;
+    uint32_t _generation = 0;        // 0 = no marker seen yet
+    uint32_t _unresolved = 0;
+
+public:
+    // `generation`: roster in effect before the first record read (the log's context())
+    explicit AccessLogExpander(AccessLogUserResolver resolve, uint32_t generation = 0)
+        : _resolve(resolve), _generation(generation) {}
+
+    // True with `out` filled for a tap that resolves; false for markers and
+    // for taps whose roster is gone (counted in unresolved())
+    bool expand(const AccessLogRecord& rec, AccessLog& out) {
+        if (rec.method == LOG_METHOD_ROSTER) {
+            _generation = rec.timestamp;
+            return false;
+        }
+        if (!accessLogIsTap(rec)) return false;
+
+        memset(&out, 0, sizeof(out));
+        if (_generation == 0 || !_resolve(_generation, rec.userIdx, out.userId, sizeof(out.userId)) ||
+            out.userId[0] == '\0') {
+            _unresolved++;
+            return false;
+        }
+        out.userId[sizeof(out.userId) - 1] = '\0';
+        out.timestamp = rec.timestamp;
+        strncpy(out.method, accessLogMethodName(rec.method), sizeof(out.method) - 1);
+        return true;
+    }
+
+    uint32_t unresolved() const { return _unresolved; }
+    uint32_t generation() const { return _generation; }  // In effect for the next record
+};
+
+#endif // ACCESS_LOG_RECORD_H
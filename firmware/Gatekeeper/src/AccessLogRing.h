@@ -0,0 +1,347 @@
+#ifndef ACCESS_LOG_RING_H
+#define ACCESS_LOG_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "AccessLogFile.h"
+#include "FlashPartition.h"
+#include "Crc32.h"
+
+// =============================================================================
+// ACCESS LOG RING
+// Alternative access log backend on the raw `accesslog` partition
+// (partitions.csv), selected with LOG_RAW_PARTITION. Same API as
+// AccessLogFile, no filesystem: a tap is one 16-byte flash program, with no
+// metadata commit.
+// Layout: the partition is a ring of 4 KB sectors, used in order.
+//   [sector header][252 x record]
+// - Sector header: sectorSeq (never reused), erase count, trim point, CRC
+// - Record: seq, AccessLogRecord, CRC. seq = sectorSeq * 252 + slot, so a
+//   record is located by arithmetic, and a slot torn by a power cut is a
+//   hole that fails its CRC (read() returns false) rather than a shift.
+// - When the head sector is full the next one is erased and opened; if it
+//   held the oldest records they are dropped (like file rotation). Sectors
+//   are erased strictly in turn, so wear is level across the partition.
+// - trim() and clear() write a TRIM record (LOG_METHOD_TRIM) instead of
+//   erasing: it names how many records before it are kept (userIdx) and the
+//   roster generation in effect for the first of them (timestamp); older
+//   ones are gone. Each new sector header carries the trim point forward.
+// - A record's sequence number is its seq, so seqAt() is stable across
+//   trims, like AccessLogFile's.
+// Boot recovery (begin):
+// - Head: binary search over sector headers for the end of the run whose
+//   sectorSeq rises by one per sector from sector 0 (linear scan if
+//   sector 0 itself was being erased)
+// - Tail: binary search backwards from the head over the same run
+// - Head fill: binary search for the first erased slot, then one read of
+//   the head sector for the newest TRIM record
+// Not thread-safe: Storage serializes access.
+// =============================================================================
+
+#define LOG_RING_MAGIC      0x474C5241  // "ARLG"
+#define LOG_RING_FORMAT     2   // 2: compact AccessLogRecords
+
+struct AccessLogRingSector {
+    uint32_t magic;
+    uint16_t format;
+    uint16_t headerSize;
+    uint32_t sectorSeq;       // 1, 2, 3... one per sector opened
+    uint32_t eraseCount;      // Erases of this sector, carried across reuse
+    uint32_t trimSeq;         // Records below this seq were cleared when the sector opened
+    uint32_t trimContext;     // Roster generation in effect at trimSeq (0xFFFFFFFF = none)
+    uint8_t reserved[36];
+    uint32_t crc;             // CRC32 of the fields above
+};
+
+struct AccessLogRingRecord {
+    uint32_t seq;
+    AccessLogRecord rec;      // method LOG_METHOD_TRIM: records with a lower seq are cleared
+    uint32_t crc;             // CRC32 of the fields above
+};
+
+static_assert(sizeof(AccessLogRingSector) == 64, "Ring sector header must stay 64 bytes");
+static_assert(sizeof(AccessLogRingRecord) == 16, "Ring records must stay 16 bytes");
+
+#define LOG_RING_SLOTS ((FLASH_SECTOR_SIZE - sizeof(AccessLogRingSector)) / sizeof(AccessLogRingRecord))
+
+class AccessLogRing {
+private:
+    FlashPartition* _part = nullptr;
+    uint32_t _sectors = 0;
+
+    uint32_t _head = 0;              // Sector being filled
+    uint32_t _headSeq = 0;           // Its sectorSeq (0 = ring empty)
+    uint32_t _headUsed = LOG_RING_SLOTS;
+    uint32_t _validSectors = 0;      // Run of sectors ending at the head
+    uint32_t _trimSeq = 0;
+    uint32_t _trimContext = 0;
+    uint32_t _headerReads = 0;       // Boot recovery cost
+    AccessLogStats _stats = {};
+
+    static uint32_t sectorCrc(const AccessLogRingSector& h) {
+        return crc32Update(0, &h, offsetof(AccessLogRingSector, crc));
+    }
+
+    static uint32_t recordCrc(const AccessLogRingRecord& r) {
+        return crc32Update(0, &r, offsetof(AccessLogRingRecord, crc));
+    }
+
+    size_t sectorOffset(uint32_t sector) const { return (size_t)sector * FLASH_SECTOR_SIZE; }
+
+    size_t slotOffset(uint32_t sector, uint32_t slot) const {
+        return sectorOffset(sector) + sizeof(AccessLogRingSector) + slot * sizeof(AccessLogRingRecord);
+    }
+
+    // Sequence number of a sector, or 0 if its header is missing or torn
+    uint32_t readSectorSeq(uint32_t sector, AccessLogRingSector* out = nullptr) {
+        AccessLogRingSector h;
+        _headerReads++;
+        if (!_part->read(sectorOffset(sector), &h, sizeof(h))) return 0;
+        if (h.magic != LOG_RING_MAGIC || h.format != LOG_RING_FORMAT || h.crc != sectorCrc(h)) return 0;
+        if (out) *out = h;
+        return h.sectorSeq;
+    }
+
+    bool slotErased(uint32_t sector, uint32_t slot) {
+        AccessLogRingRecord r;
+        if (!_part->read(slotOffset(sector, slot), &r, sizeof(r))) return false;
+        const uint8_t* p = (const uint8_t*)&r;
+        for (size_t i = 0; i < sizeof(r); i++) {
+            if (p[i] != 0xFF) return false;
+        }
+        return true;
+    }
+
+    uint32_t nextSeq() const { return _headSeq * LOG_RING_SLOTS + _headUsed; }
+
+    uint32_t firstSeq() const {
+        if (_validSectors == 0) return nextSeq();
+        uint32_t oldest = (_headSeq - (_validSectors - 1)) * LOG_RING_SLOTS;
+        return _trimSeq > oldest ? _trimSeq : oldest;
+    }
+
+    // Erase the next sector and write its header
+    bool openSector() {
+        uint32_t next = _headSeq == 0 ? 0 : (_head + 1) % _sectors;
+        bool overwrites = _validSectors == _sectors;  // Next sector holds the oldest records
+
+        AccessLogRingSector prev;
+        uint32_t erases = readSectorSeq(next, &prev) ? prev.eraseCount : 0;
+        if (!_part->erase(sectorOffset(next), FLASH_SECTOR_SIZE)) return false;
+        _stats.opens++;
+
+        AccessLogRingSector h;
+        memset(&h, 0xFF, sizeof(h));
+        h.magic = LOG_RING_MAGIC;
+        h.format = LOG_RING_FORMAT;
+        h.headerSize = sizeof(AccessLogRingSector);
+        h.sectorSeq = _headSeq + 1;
+        h.eraseCount = erases + 1;
+        h.trimSeq = _trimSeq;
+        h.trimContext = _trimContext ? _trimContext : 0xFFFFFFFF;
+        h.crc = sectorCrc(h);
+
+        // The erase already dropped the oldest sector, even if the header fails
+        if (overwrites) _validSectors--;
+        if (!_part->write(sectorOffset(next), &h, sizeof(h))) return false;  // Retried on the next append
+
+        _head = next;
+        _headSeq++;
+        _headUsed = 0;
+        _validSectors++;
+        return true;
+    }
+
+    bool writeRecord(const AccessLogRecord& rec) {
+        if (_headUsed >= LOG_RING_SLOTS && !openSector()) return false;
+
+        AccessLogRingRecord r;
+        r.seq = nextSeq();
+        r.rec = rec;
+        r.crc = recordCrc(r);
+
+        uint32_t slot = _headUsed++;  // A failed program still uses the slot
+        if (!_part->write(slotOffset(_head, slot), &r, sizeof(r))) return false;
+        _stats.commits++;
+        _stats.bytesWritten += sizeof(r);
+        return true;
+    }
+
+    // Find the head sector; returns false if no sector has a valid header
+    bool findHead() {
+        uint32_t seq0 = readSectorSeq(0);
+        if (seq0 != 0) {
+            // Sectors 0..head continue sector 0's sequence; the rest are older or erased
+            uint32_t lo = 0, hi = _sectors - 1;
+            while (lo < hi) {
+                uint32_t mid = lo + (hi - lo + 1) / 2;
+                if (readSectorSeq(mid) == seq0 + mid) lo = mid;
+                else hi = mid - 1;
+            }
+            _head = lo;
+            _headSeq = seq0 + lo;
+            return true;
+        }
+
+        // Sector 0 was being erased (wrap-around power cut) or the ring is new
+        _headSeq = 0;
+        for (uint32_t s = 1; s < _sectors; s++) {
+            uint32_t seq = readSectorSeq(s);
+            if (seq > _headSeq) {
+                _headSeq = seq;
+                _head = s;
+            }
+        }
+        return _headSeq != 0;
+    }
+
+    // Length of the run of sectors ending at the head
+    uint32_t findRun() {
+        uint32_t lo = 0, hi = _sectors - 1;  // Steps back from the head that still match
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo + 1) / 2;
+            uint32_t sector = (_head + _sectors - mid) % _sectors;
+            if (mid < _headSeq && readSectorSeq(sector) == _headSeq - mid) lo = mid;
+            else hi = mid - 1;
+        }
+        return lo + 1;
+    }
+
+    // Slots used in the head sector, and the newest trim point in it
+    void scanHead(const AccessLogRingSector& header) {
+        uint32_t lo = 0, hi = LOG_RING_SLOTS;  // First erased slot
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            if (slotErased(_head, mid)) hi = mid;
+            else lo = mid + 1;
+        }
+        _headUsed = lo;
+        _trimSeq = header.trimSeq;
+        _trimContext = header.trimContext == 0xFFFFFFFF ? 0 : header.trimContext;
+
+        AccessLogRingRecord r;
+        for (uint32_t slot = 0; slot < _headUsed; slot++) {
+            if (!_part->read(slotOffset(_head, slot), &r, sizeof(r))) continue;
+            if (r.crc != recordCrc(r) || r.rec.method != LOG_METHOD_TRIM) continue;
+            uint32_t kept = r.rec.userIdx ? r.seq - r.rec.userIdx : r.seq + 1;
+            if (kept >= _trimSeq) {
+                _trimSeq = kept;
+                _trimContext = r.rec.timestamp;
+            }
+        }
+    }
+
+public:
+    bool begin(FlashPartition& part) {
+        _part = &part;
+        _sectors = (uint32_t)(part.size() / FLASH_SECTOR_SIZE);
+        if (_sectors < 2) return false;
+
+        _headerReads = 0;
+        _head = 0;
+        _headSeq = 0;
+        _headUsed = LOG_RING_SLOTS;
+        _validSectors = 0;
+        _trimSeq = 0;
+        _trimContext = 0;
+        _stats = {};
+        if (!findHead()) return true;  // Empty ring: sector 0 opens on the first append
+
+        AccessLogRingSector header;
+        readSectorSeq(_head, &header);
+        _validSectors = findRun();
+        scanHead(header);
+        return true;
+    }
+
+    // Same signatures as AccessLogFile; every append is written through
+    bool append(const AccessLogRecord& rec, uint32_t nowMs) {
+        (void)nowMs;
+        if (!_part || rec.method == LOG_METHOD_TRIM) return false;
+        _stats.appends++;
+        _stats.maxBatch = 1;
+        return writeRecord(rec);
+    }
+
+    bool poll(uint32_t nowMs) { (void)nowMs; return true; }
+    bool flush() { return true; }
+    void end() {}
+
+    // Drops records before `index`; the rest keep their sequence numbers.
+    // `context` is the roster generation in effect at `index` (0 = none).
+    bool trim(size_t index, uint32_t context) {
+        if (!_part) return false;
+        if (index == 0) return true;
+        if (index > count()) index = count();
+        size_t keep = count() - index;
+        if (keep > UINT16_MAX) return false;
+
+        uint32_t kept = firstSeq() + (uint32_t)index;
+        AccessLogRecord trim;
+        memset(&trim, 0, sizeof(trim));
+        trim.timestamp = context;
+        trim.userIdx = (uint16_t)keep;
+        trim.method = LOG_METHOD_TRIM;
+        if (!writeRecord(trim)) return false;
+        // A full clear also drops the trim record itself
+        _trimSeq = keep == 0 ? nextSeq() : kept;
+        _trimContext = context;
+        return true;
+    }
+
+    bool clear() { return count() == 0 || trim(count(), 0); }
+
+    uint32_t seqAt(size_t index) const { return firstSeq() + (uint32_t)index; }
+
+    // Roster generation in effect at index 0 that no record states: the
+    // last trim's, unless the ring has since overwritten that point
+    uint32_t context() const { return firstSeq() == _trimSeq ? _trimContext : 0; }
+
+    // index 0 is the oldest record; torn slots read as false
+    bool read(size_t index, AccessLogRecord& rec) {
+        if (!_part || index >= count()) return false;
+        uint32_t seq = firstSeq() + (uint32_t)index;
+        uint32_t sectorSeq = seq / LOG_RING_SLOTS;
+        uint32_t sector = (_head + _sectors - (_headSeq - sectorSeq)) % _sectors;
+
+        AccessLogRingRecord r;
+        if (!_part->read(slotOffset(sector, seq % LOG_RING_SLOTS), &r, sizeof(r))) return false;
+        if (r.crc != recordCrc(r) || r.seq != seq || r.rec.method == LOG_METHOD_TRIM) return false;
+        rec = r.rec;
+        return true;
+    }
+
+    // Up to `n` records from `index` for LogIterator; ok[i] is false for a
+    // torn slot. Slots are read straight from the partition: there is no
+    // file position to save here.
+    size_t readBlock(size_t index, AccessLogRecord* out, bool* ok, size_t n) {
+        size_t got = 0;
+        for (; got < n && index + got < count(); got++) ok[got] = read(index + got, out[got]);
+        return got;
+    }
+
+    // Slots between the tail and the head, torn ones included
+    size_t count() const { return nextSeq() - firstSeq(); }
+    size_t size() const { return count() * sizeof(AccessLogRingRecord); }
+    size_t pending() const { return 0; }
+    size_t capacity() const { return (size_t)(_sectors - 1) * LOG_RING_SLOTS; }
+    uint32_t sectors() const { return _sectors; }
+    uint32_t headerReads() const { return _headerReads; }  // Since begin()
+    const AccessLogStats& stats() const { return _stats; }
+
+    // Lowest and highest erase count over sectors with a header (reads every header)
+    void eraseCounts(uint32_t& minErases, uint32_t& maxErases) {
+        minErases = UINT32_MAX;
+        maxErases = 0;
+        for (uint32_t s = 0; s < _sectors; s++) {
+            AccessLogRingSector h;
+            if (!readSectorSeq(s, &h)) continue;
+            if (h.eraseCount < minErases) minErases = h.eraseCount;
+            if (h.eraseCount > maxErases) maxErases = h.eraseCount;
+        }
+        if (minErases > maxErases) minErases = 0;
+    }
+};
+
+#endif // ACCESS_LOG_RING_H
@@ -0,0 +1,445 @@
+#ifndef ACCESS_LOG_SEGMENTS_H
+#define ACCESS_LOG_SEGMENTS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "AccessLogFile.h"
+#include "Crc32.h"
+
+#define LOG_MANIFEST_MAGIC    0x4745534C  // "LSEG"
+#define LOG_MANIFEST_VERSION  1
+
+// <base>.man: which segment is the oldest and how much of it is uploaded.
+// Replaced atomically (temp file + rename), never edited in place.
+struct LogManifest {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t oldest;          // Number of the oldest segment file
+    uint32_t skip;            // Records at its start already acknowledged
+    uint32_t firstSeq;        // Sequence number of the first record kept
+    uint32_t context;         // Roster generation in effect there (0 = none)
+    uint32_t crc;             // CRC32 of the fields above
+};
+
+// Sequence number stated by a record: the SEQ head of a /taps.bin written by
+// earlier firmware (adopted on upgrade). Expanded logs carry none.
+inline bool logRecordSeq(const AccessLogRecord& rec, uint32_t& seq) {
+    if (rec.method != LOG_METHOD_SEQ) return false;
+    seq = rec.timestamp;
+    return true;
+}
+
+inline bool logRecordSeq(const AccessLog&, uint32_t&) { return false; }
+
+// Whether the filesystem has room for `bytes` more (Storage: LittleFS free
+// space above LOG_FS_RESERVE)
+typedef bool (*LogSpaceCheck)(size_t bytes);
+
+// =============================================================================
+// SEGMENTED ACCESS LOG
+// A log kept as numbered segment files <base>.<n> plus a manifest, instead
+// of one file that rotates its oldest half away.
+// Features:
+// - Appends go to the newest segment (a LogFile, so group commit, CRC
+//   framing, encryption and torn-tail recovery are unchanged); a new one
+//   starts at `segmentSize`. Only the newest can be torn, so boot checks
+//   only its tail.
+// - Index 0 is the oldest record kept, so uploads drain oldest first
+// - trim() deletes whole acknowledged segments and records the offset into
+//   the oldest one in the manifest - no record is copied
+// - Capacity: at most `maxSegments`, and only while `hasSpace` agrees; a
+//   full log refuses new records instead of deleting unsent ones
+// - Stable sequence numbers: seqAt(i) = firstSeq + i, across trims and
+//   reboots. Same trim()/seqAt()/context() interface as AccessLogRing.
+// - Power cuts: segments are found by probing <base>.<oldest>,
+//   <oldest+1>, ... so a new segment needs no manifest write; the manifest
+//   is written before acknowledged segments are deleted, and leftovers
+//   below `oldest` are removed at begin(). Without a manifest the lowest
+//   segment on disk is the oldest, and its first frame gives the numbering.
+// Not thread-safe: Storage serializes access.
+// =============================================================================
+template <typename Record>
+class SegmentedLog {
+public:
+    typedef LogFrame<Record> Frame;
+    static const size_t MAX_SEGMENTS = 64;
+    static const size_t FRAME_SIZE = sizeof(Frame);
+
+private:
+    char _base[ACCESS_LOG_PATH_LEN - 12] = {0};   // Leaves room for ".<n>"
+    LogFile<Record> _head;                 // Newest segment
+    uint32_t _oldest = 1;                  // Segments are [_oldest, _oldest + _segments)
+    size_t _segments = 0;
+    uint32_t _counts[MAX_SEGMENTS];        // Records per segment, except the head
+    size_t _skip = 0;                      // Acknowledged records at the start of _oldest
+    uint32_t _firstSeq = 0;
+    uint32_t _context = 0;
+    size_t _segmentSize = 0;
+    size_t _maxSegments = 1;
+    uint32_t _commitMs = 0;
+    size_t _commitRecords = 1;
+    LogSpaceCheck _hasSpace = nullptr;
+    FILE* _reader = nullptr;               // Last older segment read (uploads read in order)
+    uint32_t _readerSeg = 0;
+    uint32_t _deleted = 0;
+    uint32_t _refused = 0;
+    uint32_t _badReads = 0;                // Frames in older segments that failed their check
+    const StorageCipher* _cipher = nullptr;
+
+    void segmentPath(uint32_t n, char* out, size_t size) const {
+        snprintf(out, size, "%s.%lu", _base, (unsigned long)n);
+    }
+
+    static bool fileSize(const char* path, size_t& bytes) {
+        FILE* f = fopen(path, "rb");
+        if (!f) return false;
+        fseek(f, 0, SEEK_END);
+        long end = ftell(f);
+        fclose(f);
+        bytes = end > 0 ? (size_t)end : 0;
+        return true;
+    }
+
+    uint32_t newest() const { return _oldest + (uint32_t)_segments - 1; }
+
+    // Records in segment `i` (0 = oldest), including the head's pending ones
+    size_t countOf(size_t i) const { return i + 1 == _segments ? _head.count() : _counts[i]; }
+
+    void closeReader() {
+        if (_reader) fclose(_reader);
+        _reader = nullptr;
+    }
+
+    // Position the reader of older segment `n` at frame `index`
+    bool seekSegment(uint32_t n, size_t index) {
+        if (!_reader || _readerSeg != n) {
+            closeReader();
+            char path[ACCESS_LOG_PATH_LEN];
+            segmentPath(n, path, sizeof(path));
+            _reader = fopen(path, "rb");
+            if (!_reader) return false;
+            _readerSeg = n;
+        }
+        return fseek(_reader, (long)(index * FRAME_SIZE), SEEK_SET) == 0;
+    }
+
+    bool readSegment(uint32_t n, size_t index, Record& rec, uint32_t* seq) {
+        Frame f;
+        if (!seekSegment(n, index) || fread(&f, 1, FRAME_SIZE, _reader) != FRAME_SIZE) return false;
+        if (!f.decode(rec, _cipher)) {
+            _badReads++;
+            return false;
+        }
+        if (seq) *seq = f.seq;
+        return true;
+    }
+
+    // Lowest segment number on disk (0 if none): where to start probing
+    // when the manifest is lost
+    uint32_t findOldest() const {
+        const char* slash = strrchr(_base, '/');
+        char dir[ACCESS_LOG_PATH_LEN];
+        snprintf(dir, sizeof(dir), "%.*s", slash ? (int)(slash - _base) : 1, slash ? _base : ".");
+        const char* name = slash ? slash + 1 : _base;
+        size_t len = strlen(name);
+        DIR* d = opendir(dir[0] ? dir : "/");
+        if (!d) return 0;
+        uint32_t oldest = 0;
+        struct dirent* e;
+        while ((e = readdir(d)) != nullptr) {
+            if (strncmp(e->d_name, name, len) != 0 || e->d_name[len] != '.') continue;
+            char* end;
+            unsigned long n = strtoul(e->d_name + len + 1, &end, 10);
+            if (*end == '\0' && n > 0 && (oldest == 0 || n < oldest)) oldest = (uint32_t)n;
+        }
+        closedir(d);
+        return oldest;
+    }
+
+    bool loadManifest(LogManifest& m) const {
+        char path[ACCESS_LOG_PATH_LEN];
+        snprintf(path, sizeof(path), "%s.man", _base);
+        FILE* f = fopen(path, "rb");
+        if (!f) return false;
+        bool ok = fread(&m, 1, sizeof(m), f) == sizeof(m);
+        fclose(f);
+        return ok && m.magic == LOG_MANIFEST_MAGIC && m.version == LOG_MANIFEST_VERSION &&
+               m.oldest > 0 && m.crc == crc32Update(0, &m, offsetof(LogManifest, crc));
+    }
+
+    bool saveManifest(uint32_t oldest, size_t skip, uint32_t firstSeq, uint32_t context) {
+        LogManifest m;
+        memset(&m, 0, sizeof(m));
+        m.magic = LOG_MANIFEST_MAGIC;
+        m.version = LOG_MANIFEST_VERSION;
+        m.oldest = oldest;
+        m.skip = (uint32_t)skip;
+        m.firstSeq = firstSeq;
+        m.context = context;
+        m.crc = crc32Update(0, &m, offsetof(LogManifest, crc));
+
+        char path[ACCESS_LOG_PATH_LEN], tmpPath[ACCESS_LOG_PATH_LEN];
+        snprintf(path, sizeof(path), "%s.man", _base);
+        snprintf(tmpPath, sizeof(tmpPath), "%s.man.tmp", _base);
+        FILE* f = fopen(tmpPath, "wb");
+        if (!f) return false;
+        bool ok = fwrite(&m, 1, sizeof(m), f) == sizeof(m) &&
+                  fflush(f) == 0 && fsync(fileno(f)) == 0;
+        fclose(f);
+        if (!ok || rename(tmpPath, path) != 0) {
+            remove(tmpPath);
+            return false;
+        }
+        return true;
+    }
+
+    bool openHead() {
+        char path[ACCESS_LOG_PATH_LEN];
+        segmentPath(newest(), path, sizeof(path));
+        // No rotation: append() starts a new segment before this one is full
+        if (!_head.begin(path, nullptr, _segmentSize, _commitMs, _commitRecords)) return false;
+        _head.setNextSeq(seqAt(count()));
+        return true;
+    }
+
+    // Start a new head segment; false when the log is at capacity
+    bool roll() {
+        if (_segments >= _maxSegments || _segments >= MAX_SEGMENTS) return false;
+        if (_hasSpace && !_hasSpace(_segmentSize)) return false;
+        if (!_head.flush()) return false;
+        _counts[_segments - 1] = (uint32_t)_head.count();
+        _head.end();
+        _segments++;
+        if (openHead()) return true;
+        _segments--;  // Keep appending where we were (until it is full)
+        openHead();
+        return false;
+    }
+
+public:
+    ~SegmentedLog() { end(); }
+
+    // Encrypt records appended from now on (see LogFile::setCipher); set it
+    // before begin()
+    void setCipher(const StorageCipher* cipher) {
+        _cipher = cipher;
+        _head.setCipher(cipher);
+    }
+
+    bool begin(const char* base, size_t segmentSize, size_t maxSegments,
+               uint32_t commitMs, size_t commitRecords, LogSpaceCheck hasSpace = nullptr) {
+        end();
+        int n = snprintf(_base, sizeof(_base), "%s", base);
+        if (n <= 0 || n >= (int)sizeof(_base) || segmentSize < FRAME_SIZE) return false;
+        _segmentSize = segmentSize;
+        _maxSegments = maxSegments < 1 ? 1 : (maxSegments > MAX_SEGMENTS ? MAX_SEGMENTS : maxSegments);
+        _commitMs = commitMs;
+        _commitRecords = commitRecords;
+        _hasSpace = hasSpace;
+
+        LogManifest m;
+        bool haveManifest = loadManifest(m);
+        _oldest = haveManifest ? m.oldest : findOldest();
+        if (_oldest == 0) _oldest = 1;
+        _skip = haveManifest ? m.skip : 0;
+        _firstSeq = haveManifest ? m.firstSeq : 0;
+        _context = haveManifest ? m.context : 0;
+
+        // Segments the manifest already dropped (power cut before they were removed)
+        char path[ACCESS_LOG_PATH_LEN];
+        size_t bytes;
+        for (uint32_t s = _oldest - 1; s > 0; s--) {
+            segmentPath(s, path, sizeof(path));
+            if (remove(path) != 0) break;
+        }
+
+        _segments = 0;
+        while (_segments < MAX_SEGMENTS) {
+            segmentPath(_oldest + (uint32_t)_segments, path, sizeof(path));
+            if (!fileSize(path, bytes)) break;
+            _counts[_segments++] = (uint32_t)(bytes / FRAME_SIZE);
+        }
+        if (_segments == 0) {
+            _segments = 1;
+            _skip = 0;
+        }
+        if (!openHead()) return false;
+        if (_skip > countOf(0)) _skip = countOf(0);
+        if (!haveManifest) {
+            // Manifest lost: the oldest frame still knows its number
+            Record rec;
+            uint32_t seq;
+            if (read(0, rec, &seq)) _firstSeq = seq;
+            _head.setNextSeq(seqAt(count()));
+        }
+        return haveManifest || saveManifest(_oldest, _skip, _firstSeq, _context);
+    }
+
+    // Commits anything pending and closes the files
+    void end() {
+        closeReader();
+        _head.end();
+    }
+
+    // Take over a file of raw records written before records were framed
+    // and the log segmented (/taps.bin, /logs.bin). Its records are
+    // appended, so call oldest file first, before any other append. What
+    // does not fit is dropped; the file is removed either way.
+    bool adopt(const char* path) {
+        FILE* f = fopen(path, "rb");
+        if (!f) return true;  // Nothing to take over
+        bool first = count() == 0;
+        bool ok = true;
+        Record rec;
+        while (ok && fread(&rec, 1, sizeof(rec), f) == sizeof(rec)) {
+            uint32_t seq;
+            if (first && logRecordSeq(rec, seq) && saveManifest(_oldest, _skip, seq, _context)) {
+                // Keep the numbering the SEQ head gave these records
+                _firstSeq = seq;
+                _head.setNextSeq(seq);
+            }
+            first = false;
+            ok = append(rec, 0);
+        }
+        fclose(f);
+        ok = flush() && ok;
+        remove(path);
+        return ok;
+    }
+
+    // Buffers one record; starts a new segment when the head is full.
+    // False when the log is at capacity (nothing is deleted to make room).
+    bool append(const Record& rec, uint32_t nowMs) {
+        if (_head.size() + FRAME_SIZE > _segmentSize && _head.count() > 0 && !roll()) {
+            _refused++;
+            return false;
+        }
+        return _head.append(rec, nowMs);
+    }
+
+    bool poll(uint32_t nowMs) { return _head.poll(nowMs); }
+    bool flush() { return _head.flush(); }
+
+    // Oldest first; committed records, then the head's pending ones. False
+    // for a frame that fails its check. `seq` (optional) is the number the
+    // frame was written with, which matches seqAt(index).
+    bool read(size_t index, Record& rec, uint32_t* seq = nullptr) {
+        size_t i = index + _skip;
+        for (size_t s = 0; s < _segments; s++) {
+            if (s + 1 == _segments) return _head.read(i, rec, seq);
+            if (i < _counts[s]) return readSegment(_oldest + (uint32_t)s, i, rec, seq);
+            i -= _counts[s];
+        }
+        return false;
+    }
+
+    // Up to `n` records from `index` (see LogFile::readBlock): one seek
+    // per segment the block spans
+    size_t readBlock(size_t index, Record* out, bool* ok, size_t n) {
+        size_t i = index + _skip;
+        size_t got = 0;
+        for (size_t s = 0; s < _segments && got < n; s++) {
+            if (s + 1 == _segments) return got + _head.readBlock(i, out + got, ok + got, n - got);
+            if (i >= _counts[s]) {
+                i -= _counts[s];
+                continue;
+            }
+            if (!seekSegment(_oldest + (uint32_t)s, i)) return got;
+            Frame f;
+            for (; got < n && i < _counts[s]; got++, i++) {
+                if (fread(&f, 1, FRAME_SIZE, _reader) != FRAME_SIZE) return got;
+                ok[got] = f.decode(out[got], _cipher);
+                if (!ok[got]) _badReads++;
+            }
+            i = 0;
+        }
+        return got;
+    }
+
+    uint32_t seqAt(size_t index) const { return _firstSeq + (uint32_t)index; }
+
+    // Roster generation in effect at index 0 that no record states
+    uint32_t context() const { return _context; }
+
+    // Drops records before `index`: whole segments are deleted, the rest of
+    // the oldest is skipped. The others keep their sequence numbers.
+    // `context` is the roster generation in effect at `index` (0 = none).
+    bool trim(size_t index, uint32_t context) {
+        flush();  // If this fails, trim what is committed
+        size_t committed = count() - _head.pending();
+        if (index > committed) index = committed;  // Acked pending ones are resent (and deduplicated)
+        if (index == 0) return true;
+
+        uint32_t first = seqAt(index);
+        size_t skip = _skip + index;
+        size_t drop = 0;
+        while (drop + 1 < _segments && skip >= _counts[drop]) {
+            skip -= _counts[drop];
+            drop++;
+        }
+        // Everything acknowledged: the head goes too and the next record starts a new one
+        bool empty = drop + 1 == _segments && skip == _head.count();
+        uint32_t oldest = empty ? newest() + 1 : _oldest + (uint32_t)drop;
+        if (empty) skip = 0;
+
+        if (!saveManifest(oldest, skip, first, context)) return false;
+        closeReader();
+        if (empty) _head.end();
+        char path[ACCESS_LOG_PATH_LEN];
+        for (uint32_t s = _oldest; s < oldest; s++) {
+            segmentPath(s, path, sizeof(path));
+            remove(path);
+            _deleted++;
+        }
+
+        memmove(_counts, _counts + drop, (_segments - drop) * sizeof(_counts[0]));
+        _segments = empty ? 1 : _segments - drop;
+        _oldest = oldest;
+        _skip = skip;
+        _firstSeq = first;
+        _context = context;
+        return !empty || openHead();
+    }
+
+    // Drops every record; numbering continues
+    bool clear() { return trim(count(), 0); }
+
+    size_t count() const {
+        size_t n = _head.count();
+        for (size_t s = 0; s + 1 < _segments; s++) n += _counts[s];
+        return n - _skip;
+    }
+
+    // Bytes on flash, including acknowledged records not yet deleted
+    size_t size() const {
+        size_t n = _head.size();
+        for (size_t s = 0; s + 1 < _segments; s++) n += _counts[s] * FRAME_SIZE;
+        return n;
+    }
+
+    size_t pending() const { return _head.pending(); }
+    size_t segments() const { return _segments; }
+    size_t maxSegments() const { return _maxSegments; }
+    uint32_t deletedSegments() const { return _deleted; }
+    uint32_t refused() const { return _refused; }       // Appends refused while full
+    bool isOpen() const { return _head.isOpen(); }
+    const AccessLogStats& stats() const { return _head.stats(); }
+
+    // Boot recovery of the newest segment, plus bad frames read anywhere
+    LogRecoveryStats recovery() const {
+        LogRecoveryStats r = _head.recovery();
+        r.badReads += _badReads;
+        return r;
+    }
+};
+
+typedef SegmentedLog<AccessLogRecord> AccessLogSegments;
+typedef SegmentedLog<AccessLog> ExpandedLogSegments;
+
+#endif // ACCESS_LOG_SEGMENTS_H
@@ -0,0 +1,77 @@
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+// =============================================================================
+// CARD UID BLOOM FILTER
+// Membership pre-check in front of the whitelist search.
+// - No false negatives: a "no" is final, the card is denied immediately
+// - Double hashing (Kirsch-Mitzenmacher) from one 64-bit FNV-1a hash
+// - Operates on a caller-owned bit array (RAM or memory-mapped flash)
+// =============================================================================
+
+#define BLOOM_BITS_PER_ENTRY 10   // ~0.8% false positives with 7 hashes
+#define BLOOM_HASHES         7
+#define BLOOM_MIN_BITS       64
+
+class BloomFilter {
+private:
+    static void hash(const uint8_t* uid, uint8_t uidLen, uint32_t& h1, uint32_t& h2) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (uint8_t i = 0; i < uidLen; i++) {
+            h ^= uid[i];
+            h *= 0x100000001b3ULL;
+        }
+        h ^= uidLen;
+        h *= 0x100000001b3ULL;
+        // Final avalanche so short UIDs spread across both halves
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h1 = (uint32_t)h;
+        h2 = (uint32_t)(h >> 32) | 1;
+    }
+
+public:
+    // Bit count for `n` entries, rounded up to whole 32-bit words
+    static uint32_t bitsFor(size_t n) {
+        uint64_t bits = (uint64_t)n * BLOOM_BITS_PER_ENTRY;
+        if (bits < BLOOM_MIN_BITS) bits = BLOOM_MIN_BITS;
+        return (uint32_t)((bits + 31) & ~31ULL);
+    }
+
+    static size_t bytesFor(uint32_t bits) { return bits / 8; }
+
+    static void add(uint8_t* bits, uint32_t m, uint8_t k, const uint8_t* uid, uint8_t uidLen) {
+        uint32_t h1, h2;
+        hash(uid, uidLen, h1, h2);
+        for (uint8_t i = 0; i < k; i++) {
+            uint32_t bit = (h1 + i * h2) % m;
+            bits[bit >> 3] |= (uint8_t)(1u << (bit & 7));
+        }
+    }
+
+    static bool mightContain(const uint8_t* bits, uint32_t m, uint8_t k, const uint8_t* uid, uint8_t uidLen) {
+        if (!bits || m == 0) return true;  // No filter - fall through to the search
+        uint32_t h1, h2;
+        hash(uid, uidLen, h1, h2);
+        for (uint8_t i = 0; i < k; i++) {
+            uint32_t bit = (h1 + i * h2) % m;
+            if (!(bits[bit >> 3] & (1u << (bit & 7)))) return false;
+        }
+        return true;
+    }
+
+    // Expected false-positive rate: (1 - e^(-kn/m))^k
+    static float falsePositiveRate(size_t n, uint32_t m, uint8_t k) {
+        if (m == 0) return 1.0f;
+        if (n == 0) return 0.0f;
+        return powf(1.0f - expf(-(float)k * (float)n / (float)m), (float)k);
+    }
+};
+
+#endif // BLOOM_FILTER_H
@@ -0,0 +1,598 @@
+#ifndef CLOUD_LINK_H
+#define CLOUD_LINK_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "LatencyHistogram.h"
+
+#ifdef ESP_PLATFORM
+#include <esp_timer.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+#else
+#include <chrono>
+#endif
+
+#define CLOUD_HOST_LEN   64
+#define CLOUD_RX_BUFFER  512    // Read-ahead for response heads and bodies
+#define CLOUD_HEAD_LINE  160    // Longest response status/header line kept
+#define CLOUD_ETAG_LEN   80
+#define CLOUD_TYPE_LEN   48
+
+inline uint64_t cloudNowUs() {
+#ifdef ESP_PLATFORM
+    return (uint64_t)esp_timer_get_time();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct CloudLinkStats {
+    uint32_t requests;        // Requests sent
+    uint32_t reused;          // ... on a connection kept from an earlier request
+    uint32_t handshakes;      // Connections opened (TLS handshakes)
+    uint32_t resumed;         // ... that resumed the previous session (abbreviated)
+    uint32_t connectFailures;
+    uint32_t dropped;         // Kept connections the server had closed meanwhile
+};
+
+// Head of the response being read
+struct CloudResponse {
+    int status;
+    long contentLength;       // -1: none (chunked, or until close)
+    bool chunked;
+    bool close;               // Server ends the connection after this response
+    char etag[CLOUD_ETAG_LEN];
+    char contentType[CLOUD_TYPE_LEN];
+};
+
+// =============================================================================
+// CLOUD LINK
+// The one HTTPS connection every cloud call goes through, owned by the
+// NetworkTask. Replaces a new TLS client (and a full handshake, and a
+// re-parse of the CA chain) per call.
+// Features:
+// - HTTP/1.1 keep-alive: back-to-back requests (config, whitelist, each
+//   log batch) share one connection. A connection idle for `idleMs`, or
+//   found closed by the server, is replaced before the request is sent.
+// - Reconnects go through the transport, which offers the previous TLS
+//   session (ID or ticket) so they are abbreviated handshakes
+// - Requests with a small body (request()), or written by the caller
+//   (beginRequest() + write(), e.g. LogUploadStream's chunked body)
+// - Response head parsed into CloudResponse; bodies streamed to a sink
+//   (Content-Length, chunked, or until close) without being buffered
+// - Stats: requests, reuse, handshakes, resumption, and latency from
+//   request start to response head (handshake included when there was one)
+// - Plain C++ over a Transport, so it runs on the host with a TCP socket:
+//     bool connect(host, port, timeoutMs, bool& resumed)
+//     bool alive()                     // still open, peer has not closed
+//     int write(const uint8_t*, size_t) / int read(uint8_t*, size_t)
+//     void close()
+// The device transport is MbedTlsTransport (below).
+// Not thread-safe: one task owns it.
+// =============================================================================
+template <typename Transport>
+class CloudLink {
+private:
+    Transport _transport;
+    char _host[CLOUD_HOST_LEN] = {0};
+    uint16_t _port = 443;
+    uint32_t _timeoutMs = 10000;
+    uint32_t _idleMs = 30000;
+    bool _open = false;
+    bool _ok = true;                 // No transport error in this request
+    bool _headPending = false;       // Response head not read yet
+    bool _bodyPending = false;       // Response body not fully read
+    bool _closeAfter = false;        // Response said Connection: close
+    bool _chunked = false;
+    long _remaining = -1;            // Content-Length still to read (-1: none)
+    uint64_t _lastUsedUs = 0;
+    uint64_t _startUs = 0;
+
+    uint8_t _rx[CLOUD_RX_BUFFER];
+    size_t _rxPos = 0;
+    size_t _rxLen = 0;
+
+    CloudLinkStats _stats = {};
+    LatencyHistogram _handshakeUs;
+    LatencyHistogram _requestUs;
+
+    bool fill() {
+        if (_rxPos < _rxLen) return true;
+        int n = _open ? _transport.read(_rx, sizeof(_rx)) : -1;
+        if (n <= 0) {
+            _ok = false;
+            return false;
+        }
+        _rxPos = 0;
+        _rxLen = (size_t)n;
+        return true;
+    }
+
+    bool readByte(char& c) {
+        if (!fill()) return false;
+        c = (char)_rx[_rxPos++];
+        return true;
+    }
+
+    // One CRLF-terminated line (CRLF stripped, truncated to `size`)
+    bool readLine(char* line, size_t size) {
+        size_t n = 0;
+        char c;
+        while (readByte(c)) {
+            if (c == '\n') {
+                if (n > 0 && line[n - 1] == '\r') n--;
+                line[n] = '\0';
+                return true;
+            }
+            if (n + 1 < size) line[n++] = c;
+        }
+        return false;
+    }
+
+    static bool startsWithNoCase(const char* s, const char* prefix) {
+        for (; *prefix; s++, prefix++) {
+            char a = *s, b = *prefix;
+            if (a >= 'A' && a <= 'Z') a += 'a' - 'A';
+            if (a != b) return false;
+        }
+        return true;
+    }
+
+    static const char* headerValue(const char* line, size_t nameLen) {
+        const char* v = line + nameLen;
+        while (*v == ' ' || *v == '\t') v++;
+        return v;
+    }
+
+    static void copyValue(char* out, size_t size, const char* v) {
+        size_t n = strnlen(v, size - 1);
+        memcpy(out, v, n);
+        out[n] = '\0';
+    }
+
+    // Up to `len` bytes to the sink, straight from the read-ahead buffer
+    template <typename Sink>
+    bool deliver(size_t len, Sink& sink, long& total) {
+        while (len > 0) {
+            if (!fill()) return false;
+            size_t n = _rxLen - _rxPos;
+            if (n > len) n = len;
+            bool accepted = sink((const char*)_rx + _rxPos, n);
+            _rxPos += n;
+            len -= n;
+            total += (long)n;
+            if (!accepted) return false;
+        }
+        return true;
+    }
+
+    bool connect() {
+        bool resumed = false;
+        uint64_t t0 = cloudNowUs();
+        if (!_transport.connect(_host, _port, _timeoutMs, resumed)) {
+            _stats.connectFailures++;
+            return false;
+        }
+        _handshakeUs.record((uint32_t)(cloudNowUs() - t0));
+        _stats.handshakes++;
+        if (resumed) _stats.resumed++;
+        _open = true;
+        _rxPos = _rxLen = 0;
+        return true;
+    }
+
+public:
+    ~CloudLink() { close(); }
+
+    Transport& transport() { return _transport; }
+
+    // Server to talk to; a different one drops the kept connection
+    void begin(const char* host, uint16_t port, uint32_t timeoutMs, uint32_t idleMs) {
+        if (strcmp(host, _host) != 0 || port != _port) close();
+        snprintf(_host, sizeof(_host), "%s", host);
+        _port = port;
+        _timeoutMs = timeoutMs;
+        _idleMs = idleMs;
+    }
+
+    const char* host() const { return _host; }
+
+    // Drops the connection; the transport keeps the session for the next one
+    void close() {
+        if (_open) _transport.close();
+        _open = false;
+        _rxPos = _rxLen = 0;
+    }
+
+    // Make sure a connection is up for a new request: the kept one if it is
+    // fresh and still open, else a new one
+    bool beginRequest() {
+        _ok = true;
+        _headPending = true;
+        _bodyPending = false;
+        _closeAfter = false;
+        _startUs = cloudNowUs();
+        if (_open && (_startUs - _lastUsedUs > (uint64_t)_idleMs * 1000 || _rxPos < _rxLen)) {
+            close();                       // Server may have dropped it; stray bytes
+        } else if (_open && !_transport.alive()) {
+            _stats.dropped++;
+            close();
+        }
+        if (_open) {
+            _stats.reused++;
+        } else if (!connect()) {
+            _ok = false;
+            return false;
+        }
+        _stats.requests++;
+        return true;
+    }
+
+    size_t write(const uint8_t* data, size_t len) {
+        size_t sent = 0;
+        while (_ok && sent < len) {
+            int n = _transport.write(data + sent, len - sent);
+            if (n <= 0) _ok = false;
+            else sent += (size_t)n;
+        }
+        return sent;
+    }
+
+    size_t print(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+
+    // Reads exactly `len` bytes (LogUploadStream reads its response this way)
+    size_t readBytes(char* out, size_t len) {
+        size_t got = 0;
+        while (got < len && fill()) {
+            size_t n = _rxLen - _rxPos;
+            if (n > len - got) n = len - got;
+            memcpy(out + got, _rx + _rxPos, n);
+            _rxPos += n;
+            got += n;
+        }
+        return got;
+    }
+
+    // Whole request with an optional body. `headers`: zero or more
+    // CRLF-terminated lines (Host and Content-Length are added).
+    bool request(const char* method, const char* path, const char* headers,
+                 const char* body = nullptr, size_t bodyLen = 0) {
+        if (!beginRequest()) return false;
+        char line[CLOUD_HEAD_LINE + CLOUD_HOST_LEN];
+        int n = snprintf(line, sizeof(line), "%s %s HTTP/1.1\r\nHost: %s\r\n", method, path, _host);
+        if (n <= 0 || n >= (int)sizeof(line)) {
+            _ok = false;
+            return false;
+        }
+        write((const uint8_t*)line, (size_t)n);
+        if (headers) print(headers);
+        if (body || strcmp(method, "POST") == 0) {
+            n = snprintf(line, sizeof(line), "Content-Length: %u\r\n", (unsigned)bodyLen);
+            write((const uint8_t*)line, (size_t)n);
+        }
+        print("\r\n");
+        if (bodyLen > 0) write((const uint8_t*)body, bodyLen);
+        return _ok;
+    }
+
+    // Status line and headers; the status code, or -1 if none arrived
+    int readHead(CloudResponse& res) {
+        memset(&res, 0, sizeof(res));
+        res.status = -1;
+        res.contentLength = -1;
+        char line[CLOUD_HEAD_LINE];
+        do {   // Skip 1xx interim responses
+            if (!_ok || !readLine(line, sizeof(line)) || sscanf(line, "HTTP/%*d.%*d %d", &res.status) != 1) {
+                _ok = false;
+                return res.status = -1;
+            }
+            bool http10 = strncmp(line, "HTTP/1.0", 8) == 0;
+            res.close = http10;
+            while (readLine(line, sizeof(line)) && line[0] != '\0') {
+                if (startsWithNoCase(line, "content-length:")) {
+                    res.contentLength = strtol(headerValue(line, 15), nullptr, 10);
+                } else if (startsWithNoCase(line, "transfer-encoding:")) {
+                    res.chunked = strstr(line, "chunked") != nullptr;
+                } else if (startsWithNoCase(line, "connection:")) {
+                    const char* v = headerValue(line, 11);
+                    if (startsWithNoCase(v, "close")) res.close = true;
+                    else if (startsWithNoCase(v, "keep-alive")) res.close = false;
+                } else if (startsWithNoCase(line, "etag:")) {
+                    copyValue(res.etag, sizeof(res.etag), headerValue(line, 5));
+                } else if (startsWithNoCase(line, "content-type:")) {
+                    copyValue(res.contentType, sizeof(res.contentType), headerValue(line, 13));
+                }
+            }
+            if (!_ok) return res.status = -1;
+        } while (res.status >= 100 && res.status < 200);
+
+        _requestUs.record((uint32_t)(cloudNowUs() - _startUs));
+        _headPending = false;
+        _closeAfter = res.close;
+        bool noBody = res.status == 204 || res.status == 304 || (!res.chunked && res.contentLength == 0);
+        if (!noBody && !res.chunked && res.contentLength < 0) res.close = _closeAfter = true;  // Until close
+        _bodyPending = !noBody;
+        if (res.chunked) res.contentLength = -1;
+        _chunked = res.chunked;
+        _remaining = res.contentLength;
+        return res.status;
+    }
+
+    // Streams the body to `sink(const char* data, size_t len)`, which
+    // returns false to stop. Bytes delivered, or -1 if the body was cut
+    // short or the sink stopped (the connection is then not reused).
+    template <typename Sink>
+    long readBody(Sink sink) {
+        long total = 0;
+        if (!_bodyPending) return 0;
+        bool ok = true;
+        if (_chunked) {
+            char line[CLOUD_HEAD_LINE];
+            while ((ok = readLine(line, sizeof(line)))) {
+                long chunk = strtol(line, nullptr, 16);
+                if (chunk < 0) {
+                    ok = false;
+                    break;
+                }
+                if (chunk == 0) {
+                    while ((ok = readLine(line, sizeof(line))) && line[0] != '\0') {}  // Trailers
+                    break;
+                }
+                if (!(ok = deliver((size_t)chunk, sink, total) && readLine(line, sizeof(line)))) break;
+            }
+        } else if (_remaining >= 0) {
+            ok = deliver((size_t)_remaining, sink, total);
+        } else {
+            while (fill() && (ok = deliver(_rxLen - _rxPos, sink, total))) {}
+            _ok = true;   // Close ends the body; the connection goes anyway
+        }
+        if (!ok) {
+            _ok = false;
+            return -1;
+        }
+        _bodyPending = false;
+        return total;
+    }
+
+    // Body into `out` (truncated to size - 1, the rest read and dropped)
+    long readBody(char* out, size_t size) {
+        size_t used = 0;
+        long n = readBody([&](const char* data, size_t len) {
+            for (size_t i = 0; i < len && used + 1 < size; i++) out[used++] = data[i];
+            return true;
+        });
+        if (size > 0) out[used] = '\0';
+        return n;
+    }
+
+    // The caller read the response itself (LogUploadStream): counts its
+    // latency; endRequest() then decides on the caller's word
+    void responseRead() {
+        _requestUs.record((uint32_t)(cloudNowUs() - _startUs));
+        _headPending = false;
+    }
+
+    // Done with the request. The connection is kept only if the response
+    // was read to its end, nothing failed, the server allows it, and the
+    // caller says so.
+    void endRequest(bool reusable = true) {
+        if (_open && reusable && _ok && !_headPending && !_bodyPending && !_closeAfter) {
+            _lastUsedUs = cloudNowUs();
+        } else {
+            close();
+        }
+        _headPending = _bodyPending = false;
+    }
+
+    bool isOpen() const { return _open; }
+    bool ok() const { return _ok; }
+    const CloudLinkStats& stats() const { return _stats; }
+    const LatencyHistogram& handshakeLatency() const { return _handshakeUs; }
+    const LatencyHistogram& requestLatency() const { return _requestUs; }
+};
+
+#ifdef ESP_PLATFORM
+#ifndef MBEDTLS_PRIVATE
+#define MBEDTLS_PRIVATE(member) member     // mbedTLS 2.x: session fields are public
+#endif
+
+// =============================================================================
+// MBEDTLS TRANSPORT
+// TLS for CloudLink on mbedTLS directly (WiFiClientSecure re-parses the CA
+// chain and starts a full handshake on every connect, and cannot resume):
+// - CA chain, RNG and TLS config set up once in begin() and shared by
+//   every connection
+// - The session of each connection is saved and offered on the next
+//   (session ID, or ticket when the server issues one): a resumed
+//   handshake skips the certificate chain and key exchange. Resumption is
+//   detected by the master secret carrying over.
+// - Blocking socket with send/receive timeouts; the AES/SHA/bignum
+//   peripherals accelerate mbedTLS as usual
+// =============================================================================
+class MbedTlsTransport {
+private:
+    mbedtls_x509_crt _ca;
+    mbedtls_entropy_context _entropy;
+    mbedtls_ctr_drbg_context _drbg;
+    mbedtls_ssl_config _conf;
+    mbedtls_ssl_context _ssl;
+    mbedtls_net_context _net;
+    mbedtls_ssl_session _session;
+    bool _ready = false;
+    bool _haveSession = false;
+    bool _open = false;
+    char _sessionHost[CLOUD_HOST_LEN] = {0};
+
+    static int openSocket(const char* host, uint16_t port, uint32_t timeoutMs) {
+        char portStr[6];
+        snprintf(portStr, sizeof(portStr), "%u", port);
+        struct addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* res = nullptr;
+        if (getaddrinfo(host, portStr, &hints, &res) != 0 || !res) return -1;
+        int fd = socket(res->ai_family, SOCK_STREAM, IPPROTO_TCP);
+        if (fd >= 0) {
+            // Non-blocking connect bounded by the timeout, then blocking I/O
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+            int rc = ::connect(fd, res->ai_addr, res->ai_addrlen);
+            if (rc != 0 && errno == EINPROGRESS) {
+                fd_set wr;
+                FD_ZERO(&wr);
+                FD_SET(fd, &wr);
+                struct timeval tv = {(time_t)(timeoutMs / 1000), (suseconds_t)((timeoutMs % 1000) * 1000)};
+                int err = 0;
+                socklen_t len = sizeof(err);
+                rc = select(fd + 1, nullptr, &wr, nullptr, &tv) == 1 &&
+                     getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0 ? 0 : -1;
+            }
+            if (rc == 0) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+                struct timeval tv = {(time_t)(timeoutMs / 1000), (suseconds_t)((timeoutMs % 1000) * 1000)};
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            } else {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(res);
+        return fd;
+    }
+
+public:
+    MbedTlsTransport() {
+        mbedtls_x509_crt_init(&_ca);
+        mbedtls_entropy_init(&_entropy);
+        mbedtls_ctr_drbg_init(&_drbg);
+        mbedtls_ssl_config_init(&_conf);
+        mbedtls_ssl_session_init(&_session);
+        mbedtls_net_init(&_net);
+    }
+
+    ~MbedTlsTransport() {
+        close();
+        mbedtls_ssl_session_free(&_session);
+        mbedtls_ssl_config_free(&_conf);
+        mbedtls_ctr_drbg_free(&_drbg);
+        mbedtls_entropy_free(&_entropy);
+        mbedtls_x509_crt_free(&_ca);
+    }
+
+    MbedTlsTransport(const MbedTlsTransport&) = delete;
+    MbedTlsTransport& operator=(const MbedTlsTransport&) = delete;
+
+    // Parse the CA chain (PEM) and set up the shared TLS config - once
+    bool begin(const char* caPem) {
+        if (_ready) return true;
+        static const char pers[] = "gatekeeper-cloud";
+        _ready = mbedtls_ctr_drbg_seed(&_drbg, mbedtls_entropy_func, &_entropy,
+                                       (const unsigned char*)pers, sizeof(pers) - 1) == 0 &&
+                 mbedtls_x509_crt_parse(&_ca, (const unsigned char*)caPem, strlen(caPem) + 1) >= 0 &&
+                 mbedtls_ssl_config_defaults(&_conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                             MBEDTLS_SSL_PRESET_DEFAULT) == 0;
+        if (!_ready) return false;
+        mbedtls_ssl_conf_authmode(&_conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+        mbedtls_ssl_conf_ca_chain(&_conf, &_ca, nullptr);
+        mbedtls_ssl_conf_rng(&_conf, mbedtls_ctr_drbg_random, &_drbg);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+        mbedtls_ssl_conf_session_tickets(&_conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+        return true;
+    }
+
+    bool connect(const char* host, uint16_t port, uint32_t timeoutMs, bool& resumed) {
+        close();
+        resumed = false;
+        if (!_ready) return false;
+        _net.fd = openSocket(host, port, timeoutMs);
+        if (_net.fd < 0) return false;
+
+        mbedtls_ssl_init(&_ssl);
+        _open = true;
+        bool offered = _haveSession && strcmp(host, _sessionHost) == 0;
+        if (mbedtls_ssl_setup(&_ssl, &_conf) != 0 || mbedtls_ssl_set_hostname(&_ssl, host) != 0 ||
+            (offered && mbedtls_ssl_set_session(&_ssl, &_session) != 0)) {
+            close();
+            return false;
+        }
+        mbedtls_ssl_set_bio(&_ssl, &_net, mbedtls_net_send, mbedtls_net_recv, nullptr);
+        int rc;
+        while ((rc = mbedtls_ssl_handshake(&_ssl)) != 0) {
+            if (rc != MBEDTLS_ERR_SSL_WANT_READ && rc != MBEDTLS_ERR_SSL_WANT_WRITE) {
+                close();
+                return false;
+            }
+        }
+
+        mbedtls_ssl_session fresh;
+        mbedtls_ssl_session_init(&fresh);
+        if (mbedtls_ssl_get_session(&_ssl, &fresh) == 0) {
+            resumed = offered && memcmp(fresh.MBEDTLS_PRIVATE(master), _session.MBEDTLS_PRIVATE(master),
+                                        sizeof(fresh.MBEDTLS_PRIVATE(master))) == 0;
+            mbedtls_ssl_session_free(&_session);
+            _session = fresh;              // Owns the copy now
+            _haveSession = true;
+            snprintf(_sessionHost, sizeof(_sessionHost), "%s", host);
+        } else {
+            mbedtls_ssl_session_free(&fresh);
+        }
+        return true;
+    }
+
+    // False once the server has closed (FIN, or a close_notify waiting)
+    bool alive() {
+        if (!_open) return false;
+        char c;
+        int n = recv(_net.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+
+    int write(const uint8_t* data, size_t len) {
+        int rc;
+        do {
+            rc = mbedtls_ssl_write(&_ssl, data, len);
+        } while (rc == MBEDTLS_ERR_SSL_WANT_WRITE || rc == MBEDTLS_ERR_SSL_WANT_READ);
+        return rc;
+    }
+
+    int read(uint8_t* out, size_t len) {
+        int rc;
+        do {
+            rc = mbedtls_ssl_read(&_ssl, out, len);
+        } while (rc == MBEDTLS_ERR_SSL_WANT_READ || rc == MBEDTLS_ERR_SSL_WANT_WRITE);
+        return rc;   // 0 or MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY: closed
+    }
+
+    void close() {
+        if (!_open) return;
+        mbedtls_ssl_close_notify(&_ssl);
+        mbedtls_net_free(&_net);        // Closes the socket
+        mbedtls_ssl_free(&_ssl);
+        _open = false;
+    }
+
+    // Forget the saved session (next connect is a full handshake)
+    void forgetSession() {
+        mbedtls_ssl_session_free(&_session);
+        mbedtls_ssl_session_init(&_session);
+        _haveSession = false;
+    }
+};
+#endif
+
+#endif // CLOUD_LINK_H
@@ -0,0 +1,327 @@
+#ifndef CLOUD_SYNC_H
+#define CLOUD_SYNC_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// =============================================================================
+// CLOUD SYNC
+// One POST /api/sync per network cycle in place of /api/logs,
+// /api/whitelist, /api/config and /api/heartbeat: one request, one device
+// lookup on the server (mobile/convex hardware.ts sync; envelope encoder
+// lib/sync.ts encodeSyncResponse).
+// Features:
+// - The request body is a LogUploadStream batch (JSON or LGB1, possibly
+//   empty); SyncHeaders adds the roster/config validators, which sections
+//   are due (X-Sync-Want), firmware version and health counters as header
+//   lines
+// - SyncResponseReader splits the reply envelope as it streams off the
+//   socket: the log reply and config are collected in one bounded buffer,
+//   the roster is passed through to the whitelist decoders unbuffered
+// - Sections not wanted, or already held, are left out by the server; unknown
+//   ones are skipped; a body without its END section is incomplete
+// - Plain C++ (no Arduino dependencies) so it can be tested on the host
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+// Reply envelope. Little-endian.
+//
+//   header   u32 magic "SYN1"
+//   section  u8 kind | u32 length | length bytes
+//            1 LOGS       JSON reply of /api/logs ({ success, count, duplicates, acked? })
+//            2 CONFIG     u8 etagLen | etag | JSON body of /api/config
+//            3 WHITELIST  u8 etagLen | etag | u8 wire (0 JSON, 1 WLB1) | /api/whitelist body
+//            0 END        length 0
+// -----------------------------------------------------------------------------
+#define SYNC_MAGIC             0x314E5953  // "SYN1"
+#define SYNC_SECTION_END       0
+#define SYNC_SECTION_LOGS      1
+#define SYNC_SECTION_CONFIG    2
+#define SYNC_SECTION_WHITELIST 3
+
+#define SYNC_JSON_MAX    1024   // Largest log reply / config section kept
+#define SYNC_ETAG_LEN    80     // Longest validator kept (+ terminator)
+#define SYNC_HEADERS_LEN 512    // Request header lines
+#define SYNC_HEALTH_LEN  160    // X-Device-Health value
+
+// Validators, firmware and health counters as request header lines
+class SyncHeaders {
+private:
+    char _buf[SYNC_HEADERS_LEN];
+    size_t _len = 0;
+    char _health[SYNC_HEALTH_LEN];
+    size_t _healthLen = 0;
+    bool _ok = true;
+
+    void append(char* buf, size_t size, size_t& len, const char* fmt, ...) {
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(buf + len, size - len, fmt, args);
+        va_end(args);
+        if (n < 0 || (size_t)n >= size - len) {
+            buf[len] = '\0';   // Drop the whole field, not half of it
+            _ok = false;
+            return;
+        }
+        len += (size_t)n;
+    }
+
+public:
+    SyncHeaders() {
+        _buf[0] = '\0';
+        _health[0] = '\0';
+    }
+
+    // Roster held: deltas from `since` (0 = none), `etag` if it still
+    // describes the live image; `binary` asks for the WLB1 roster
+    void whitelist(uint32_t since, const char* etag, bool binary) {
+        if (since > 0) append(_buf, sizeof(_buf), _len, "X-Whitelist-Since: %lu\r\n", (unsigned long)since);
+        if (etag && *etag) append(_buf, sizeof(_buf), _len, "X-Whitelist-Match: %s\r\n", etag);
+        if (binary) append(_buf, sizeof(_buf), _len, "Accept: application/octet-stream\r\n");
+    }
+
+    void config(const char* etag) {
+        if (etag && *etag) append(_buf, sizeof(_buf), _len, "X-Config-Match: %s\r\n", etag);
+    }
+
+    // Sections whose refresh is due; the server checks only these
+    // validators, so a plain log upload costs no roster/config lookup
+    void want(bool whitelist, bool config) {
+        if (!whitelist && !config) return;
+        append(_buf, sizeof(_buf), _len, "X-Sync-Want: %s%s%s\r\n", whitelist ? "whitelist" : "",
+               whitelist && config ? "," : "", config ? "config" : "");
+    }
+
+    void firmware(const char* version) {
+        append(_buf, sizeof(_buf), _len, "X-Firmware: %s\r\n", version);
+    }
+
+    // One counter of X-Device-Health (names: lib/sync.ts deviceHealth)
+    void health(const char* key, long value) {
+        append(_health, sizeof(_health), _healthLen, "%s%s=%ld", _healthLen ? ";" : "", key, value);
+    }
+
+    // All lines, CRLF-terminated
+    const char* str() {
+        if (_healthLen > 0) {
+            append(_buf, sizeof(_buf), _len, "X-Device-Health: %s\r\n", _health);
+            _healthLen = 0;
+            _health[0] = '\0';
+        }
+        return _buf;
+    }
+
+    // False if a field did not fit (it was left out)
+    bool ok() const { return _ok; }
+};
+
+// Receives the sections of a reply as they are read. Returning false
+// stops reading (the reply is then incomplete).
+class SyncSink {
+public:
+    virtual ~SyncSink() {}
+    virtual bool onLogReply(const char*, size_t) { return true; }
+    virtual bool onConfig(const char*, const char*, size_t) { return true; }
+    virtual bool onWhitelistBegin(const char*, bool) { return true; }
+    virtual bool onWhitelistData(const char* data, size_t len) = 0;
+    virtual bool onWhitelistEnd() { return true; }
+};
+
+class SyncResponseReader {
+private:
+    enum State : uint8_t {
+        ST_MAGIC, ST_HEAD,
+        ST_ETAG_LEN, ST_ETAG, ST_WIRE,
+        ST_JSON, ST_ROSTER, ST_SKIP,
+        ST_DONE
+    };
+
+    SyncSink* _sink;
+    State _state = ST_MAGIC;
+    uint8_t _head[5];
+    size_t _need = 4;
+    size_t _have = 0;
+    uint8_t _kind = 0;
+    uint32_t _remaining = 0;   // Bytes left in the current section
+    uint8_t _seen = 0;         // Bit per section kind received
+    char _etag[SYNC_ETAG_LEN];
+    char _json[SYNC_JSON_MAX];
+    size_t _jsonLen = 0;
+    bool _error = false;
+
+    static uint32_t rd32(const uint8_t* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    void fail() { _error = true; }
+
+    void nextSection() {
+        _state = ST_HEAD;
+        _need = sizeof(_head);
+        _have = 0;
+    }
+
+    // Body of a LOGS or CONFIG section, collected whole
+    void beginJson() {
+        if (_remaining >= sizeof(_json)) return fail();
+        _jsonLen = 0;
+        _state = ST_JSON;
+        if (_remaining == 0) endSection();
+    }
+
+    void endSection() {
+        bool ok = true;
+        if (_state == ST_JSON) {
+            _json[_jsonLen] = '\0';
+            ok = _kind == SYNC_SECTION_LOGS ? _sink->onLogReply(_json, _jsonLen)
+                                            : _sink->onConfig(_etag, _json, _jsonLen);
+        } else if (_state == ST_ROSTER) {
+            ok = _sink->onWhitelistEnd();
+        }
+        if (!ok) return fail();
+        _seen |= (uint8_t)(1u << _kind);
+        nextSection();
+    }
+
+    void onHead() {
+        _kind = _head[0];
+        _remaining = rd32(_head + 1);
+        switch (_kind) {
+        case SYNC_SECTION_END:
+            if (_remaining != 0) return fail();
+            _state = ST_DONE;
+            return;
+        case SYNC_SECTION_LOGS:
+            return beginJson();
+        case SYNC_SECTION_CONFIG:
+        case SYNC_SECTION_WHITELIST:
+            if (_remaining == 0) return fail();
+            _state = ST_ETAG_LEN;
+            return;
+        default:
+            _state = ST_SKIP;   // Newer server: not for this firmware
+            if (_remaining == 0) nextSection();
+            return;
+        }
+    }
+
+    void onEtag() {
+        _etag[_have] = '\0';
+        if (_kind == SYNC_SECTION_CONFIG) return beginJson();
+        if (_remaining == 0) return fail();
+        _state = ST_WIRE;
+    }
+
+public:
+    explicit SyncResponseReader(SyncSink& sink) : _sink(&sink) { _etag[0] = '\0'; }
+
+    // Incremental: any split of the body works. False once the body is
+    // malformed or a sink stopped.
+    bool feed(const uint8_t* data, size_t len) {
+        while (len > 0 && !_error) {
+            switch (_state) {
+            case ST_MAGIC:
+            case ST_HEAD: {
+                size_t n = _need - _have;
+                if (n > len) n = len;
+                memcpy(_head + _have, data, n);
+                _have += n;
+                data += n;
+                len -= n;
+                if (_have < _need) break;
+                if (_state == ST_MAGIC) {
+                    if (rd32(_head) != SYNC_MAGIC) fail();
+                    else nextSection();
+                } else {
+                    onHead();
+                }
+                break;
+            }
+            case ST_ETAG_LEN:
+                _need = *data++;
+                len--;
+                _remaining--;
+                _have = 0;
+                if (_need >= sizeof(_etag) || _need > _remaining) fail();
+                else if (_need == 0) onEtag();
+                else _state = ST_ETAG;
+                break;
+            case ST_ETAG: {
+                size_t n = _need - _have;
+                if (n > len) n = len;
+                memcpy(_etag + _have, data, n);
+                _have += n;
+                data += n;
+                len -= n;
+                _remaining -= (uint32_t)n;
+                if (_have == _need) onEtag();
+                break;
+            }
+            case ST_WIRE: {
+                bool binary = *data++ == 1;
+                len--;
+                _remaining--;
+                if (!_sink->onWhitelistBegin(_etag, binary)) fail();
+                else _state = ST_ROSTER;
+                if (!_error && _remaining == 0) endSection();
+                break;
+            }
+            case ST_JSON:
+            case ST_ROSTER:
+            case ST_SKIP: {
+                size_t n = _remaining < len ? _remaining : len;
+                if (_state == ST_JSON) {
+                    memcpy(_json + _jsonLen, data, n);
+                    _jsonLen += n;
+                } else if (_state == ST_ROSTER && !_sink->onWhitelistData((const char*)data, n)) {
+                    fail();
+                    break;
+                }
+                data += n;
+                len -= n;
+                _remaining -= (uint32_t)n;
+                if (_remaining == 0) {
+                    if (_state == ST_SKIP) nextSection();
+                    else endSection();
+                }
+                break;
+            }
+            case ST_DONE:
+                fail();   // Bytes after END
+                break;
+            }
+        }
+        return !_error;
+    }
+
+    bool feed(const char* data, size_t len) { return feed((const uint8_t*)data, len); }
+
+    // END section reached and nothing failed
+    bool complete() const { return _state == ST_DONE && !_error; }
+    bool failed() const { return _error; }
+
+    // Whether a section of `kind` was received in full
+    bool received(uint8_t kind) const { return kind < 8 && (_seen & (1u << kind)) != 0; }
+};
+
+// Settles a read reply in the only safe order. Applying a roster moves every
+// pending compact tap into the expanded log (Storage::expandLogs), the batch
+// just stored included, and empties the compact log - so the acknowledged
+// batch is trimmed first, and the cursor then starts over on the new logs
+// rather than trimming the new log by indexes into the old one.
+// Cursor: ack(), trim(), reload(). Sink: logsStored, rosterSent, finish().
+// Returns whether the batch was stored.
+template <typename Cursor, typename Sink>
+bool settleSyncReply(Cursor& logs, Sink& sink) {
+    if (sink.logsStored) logs.ack();
+    if (sink.rosterSent) {
+        logs.trim();
+        sink.finish();
+        logs.reload();
+    }
+    return sink.logsStored;
+}
+
+#endif // CLOUD_SYNC_H
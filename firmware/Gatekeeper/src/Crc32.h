@@ -0,0 +1,41 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// =============================================================================
+// CRC32 (IEEE 802.3)
+// Uses the ESP32 ROM implementation on device, a table-driven fallback on
+// the host (fast enough that host benchmarks are not CRC-bound).
+// Chainable: crc32Update(crc32Update(0, a, n), b, m) == crc32 of a||b
+// =============================================================================
+
+#ifdef ESP_PLATFORM
+#include <esp_rom_crc.h>
+
+inline uint32_t crc32Update(uint32_t crc, const void* data, size_t len) {
+    return esp_rom_crc32_le(crc, (const uint8_t*)data, len);
+}
+#else
+struct Crc32Table {
+    uint32_t entries[256];
+    Crc32Table() {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int i = 0; i < 8; i++) c = (c >> 1) ^ (0xEDB88320u & (0u - (c & 1u)));
+            entries[n] = c;
+        }
+    }
+};
+
+inline uint32_t crc32Update(uint32_t crc, const void* data, size_t len) {
+    static const Crc32Table table;
+    const uint8_t* p = (const uint8_t*)data;
+    crc = ~crc;
+    while (len--) crc = (crc >> 8) ^ table.entries[(crc ^ *p++) & 0xFF];
+    return ~crc;
+}
+#endif
+
+#endif // CRC32_H
@@ -0,0 +1,204 @@
+#ifndef FLASH_PARTITION_H
+#define FLASH_PARTITION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// =============================================================================
+// RAW FLASH PARTITION
+// Thin wrapper over a data partition: erase / write / read / memory-map.
+// - Device: esp_partition_* API, reads go through the flash cache (zero-copy)
+// - Host: file-backed mmap so partition layouts can be tested off-device.
+//   Writes behave like NOR flash (they can only clear bits), and
+//   cutPowerAfter() stops writes and erases part-way for crash tests.
+// =============================================================================
+
+#define FLASH_SECTOR_SIZE 4096
+
+#ifdef ESP_PLATFORM
+#include <esp_partition.h>
+#include <esp_spi_flash.h>
+
+struct FlashMapping {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    spi_flash_mmap_handle_t handle = 0;
+};
+
+class FlashPartition {
+private:
+    const esp_partition_t* _part = nullptr;
+
+public:
+    // Find a data partition by label (see partitions.csv)
+    bool begin(const char* label) {
+        _part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+        return _part != nullptr;
+    }
+
+    size_t size() const { return _part ? _part->size : 0; }
+
+    // Offset and size must be sector aligned
+    bool erase(size_t offset, size_t len) {
+        return _part && esp_partition_erase_range(_part, offset, len) == ESP_OK;
+    }
+
+    bool write(size_t offset, const void* data, size_t len) {
+        return _part && esp_partition_write(_part, offset, data, len) == ESP_OK;
+    }
+
+    bool read(size_t offset, void* data, size_t len) const {
+        return _part && esp_partition_read(_part, offset, data, len) == ESP_OK;
+    }
+
+    // Map a region into the data address space. Remap after writing to it.
+    bool map(size_t offset, size_t len, FlashMapping& out) {
+        if (!_part) return false;
+        const void* ptr = nullptr;
+        if (esp_partition_mmap(_part, offset, len, SPI_FLASH_MMAP_DATA, &ptr, &out.handle) != ESP_OK) {
+            return false;
+        }
+        out.data = (const uint8_t*)ptr;
+        out.size = len;
+        return true;
+    }
+
+    void unmap(FlashMapping& m) {
+        if (m.data) spi_flash_munmap(m.handle);
+        m = FlashMapping();
+    }
+};
+
+#else
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+struct FlashMapping {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    void* base = nullptr;
+    size_t baseSize = 0;
+};
+
+class FlashPartition {
+private:
+    int _fd = -1;
+    size_t _size = 0;
+    long _powerBudget = -1;          // Bytes left before the simulated power cut (-1 = none)
+    uint32_t* _erases = nullptr;     // Per-sector erase counts
+    uint32_t _writes = 0;
+
+    // Bytes of an operation that land before the power cut
+    size_t powered(size_t len) {
+        if (_powerBudget < 0) return len;
+        size_t n = (size_t)_powerBudget < len ? (size_t)_powerBudget : len;
+        _powerBudget -= (long)n;
+        return n;
+    }
+
+public:
+    ~FlashPartition() { end(); }
+
+    // Open (or create) a file that stands in for the partition
+    bool begin(const char* path, size_t size) {
+        end();
+        _fd = open(path, O_RDWR | O_CREAT, 0644);
+        if (_fd < 0) return false;
+
+        off_t existing = lseek(_fd, 0, SEEK_END);
+        if (existing < (off_t)size) {
+            // Fresh flash reads as erased (0xFF)
+            uint8_t blank[FLASH_SECTOR_SIZE];
+            memset(blank, 0xFF, sizeof(blank));
+            for (size_t off = existing; off < size; off += sizeof(blank)) {
+                size_t n = size - off < sizeof(blank) ? size - off : sizeof(blank);
+                if (pwrite(_fd, blank, n, off) != (ssize_t)n) return false;
+            }
+        }
+        _size = size;
+        _erases = (uint32_t*)calloc(size / FLASH_SECTOR_SIZE + 1, sizeof(uint32_t));
+        _powerBudget = -1;
+        return _erases != nullptr;
+    }
+
+    void end() {
+        if (_fd >= 0) close(_fd);
+        _fd = -1;
+        _size = 0;
+        free(_erases);
+        _erases = nullptr;
+    }
+
+    // Simulated power cut: after `bytes` more bytes are written or erased,
+    // the operation in flight stops part-way and every later one fails.
+    // Reopen with begin() to "reboot".
+    void cutPowerAfter(size_t bytes) { _powerBudget = (long)bytes; }
+    bool powerLost() const { return _powerBudget == 0; }
+
+    uint32_t eraseCount(size_t sector) const {
+        return _erases && sector < _size / FLASH_SECTOR_SIZE ? _erases[sector] : 0;
+    }
+    uint32_t writeCount() const { return _writes; }
+
+    size_t size() const { return _size; }
+
+    bool erase(size_t offset, size_t len) {
+        if (_fd < 0 || offset % FLASH_SECTOR_SIZE || len % FLASH_SECTOR_SIZE) return false;
+        if (offset + len > _size) return false;
+        uint8_t blank[FLASH_SECTOR_SIZE];
+        memset(blank, 0xFF, sizeof(blank));
+        for (size_t off = offset; off < offset + len; off += sizeof(blank)) {
+            size_t n = powered(sizeof(blank));
+            if (n && pwrite(_fd, blank, n, off) != (ssize_t)n) return false;
+            if (n < sizeof(blank)) return false;
+            _erases[off / FLASH_SECTOR_SIZE]++;
+        }
+        return true;
+    }
+
+    // NOR semantics: programming ANDs into what is there (only 1 -> 0)
+    bool write(size_t offset, const void* data, size_t len) {
+        if (_fd < 0 || offset + len > _size) return false;
+        const uint8_t* src = (const uint8_t*)data;
+        uint8_t buf[256];
+        size_t n = powered(len);
+        for (size_t done = 0; done < n; ) {
+            size_t chunk = n - done < sizeof(buf) ? n - done : sizeof(buf);
+            if (pread(_fd, buf, chunk, offset + done) != (ssize_t)chunk) return false;
+            for (size_t i = 0; i < chunk; i++) buf[i] &= src[done + i];
+            if (pwrite(_fd, buf, chunk, offset + done) != (ssize_t)chunk) return false;
+            done += chunk;
+        }
+        _writes++;
+        return n == len;
+    }
+
+    bool read(size_t offset, void* data, size_t len) const {
+        if (_fd < 0 || offset + len > _size) return false;
+        return pread(_fd, data, len, offset) == (ssize_t)len;
+    }
+
+    bool map(size_t offset, size_t len, FlashMapping& out) {
+        if (_fd < 0 || offset + len > _size) return false;
+        // mmap offsets must be page aligned; sector alignment (4 KB) covers that
+        size_t pageOff = offset % (size_t)sysconf(_SC_PAGESIZE);
+        void* base = mmap(nullptr, len + pageOff, PROT_READ, MAP_SHARED, _fd, offset - pageOff);
+        if (base == MAP_FAILED) return false;
+        out.base = base;
+        out.baseSize = len + pageOff;
+        out.data = (const uint8_t*)base + pageOff;
+        out.size = len;
+        return true;
+    }
+
+    void unmap(FlashMapping& m) {
+        if (m.base) munmap(m.base, m.baseSize);
+        m = FlashMapping();
+    }
+};
+#endif
+
+#endif // FLASH_PARTITION_H
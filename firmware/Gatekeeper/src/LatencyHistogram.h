@@ -0,0 +1,69 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+// =============================================================================
+// LATENCY HISTOGRAM
+// Power-of-two microsecond buckets: bucket 0 is < 2 us, bucket i is
+// [2^i, 2^(i+1)) us, the last one everything from ~8 s up. 128 bytes,
+// O(1) record(), no allocation - cheap enough to leave on in the tap path.
+// Percentiles are reported as the upper bound of their bucket.
+// Not thread-safe: record and read from the same task.
+// =============================================================================
+
+#define LATENCY_BUCKETS 24
+
+class LatencyHistogram {
+private:
+    uint32_t _buckets[LATENCY_BUCKETS] = {};
+    uint32_t _count = 0;
+    uint32_t _max = 0;
+    uint64_t _total = 0;
+
+public:
+    static int bucketOf(uint32_t us) {
+        int b = 0;
+        while (us > 1 && b < LATENCY_BUCKETS - 1) {
+            us >>= 1;
+            b++;
+        }
+        return b;
+    }
+
+    // Largest value counted in bucket `b`
+    static uint32_t bucketLimit(int b) {
+        return b >= 31 ? 0xFFFFFFFFu : (2u << b) - 1;
+    }
+
+    void record(uint32_t us) {
+        _buckets[bucketOf(us)]++;
+        _count++;
+        _total += us;
+        if (us > _max) _max = us;
+    }
+
+    // Upper bound (us) under which a fraction `p` (0..1) of the samples fall
+    uint32_t percentile(float p) const {
+        if (_count == 0) return 0;
+        uint32_t rank = (uint32_t)(p * (_count - 1)) + 1;
+        uint32_t seen = 0;
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            seen += _buckets[b];
+            if (seen >= rank) {
+                uint32_t limit = bucketLimit(b);
+                return limit < _max ? limit : _max;
+            }
+        }
+        return _max;
+    }
+
+    void reset() { *this = LatencyHistogram(); }
+
+    uint32_t count() const { return _count; }
+    uint32_t max() const { return _max; }
+    uint32_t mean() const { return _count ? (uint32_t)(_total / _count) : 0; }
+    uint32_t bucket(int b) const { return b >= 0 && b < LATENCY_BUCKETS ? _buckets[b] : 0; }
+};
+
+#endif // LATENCY_HISTOGRAM_H
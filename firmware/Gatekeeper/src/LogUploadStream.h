@@ -0,0 +1,399 @@
+#ifndef LOG_UPLOAD_STREAM_H
+#define LOG_UPLOAD_STREAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "AccessLogRecord.h"
+
+// =============================================================================
+// LOG UPLOAD STREAM
+// Writes a POST /api/logs request straight to the socket. The body is
+// generated one log at a time as the caller reads them from flash and is
+// sent with chunked transfer encoding, so neither a JSON tree nor the body
+// is held in RAM.
+// Features:
+// - Fixed memory: one LOG_UPLOAD_CHUNK buffer (plus a hash per binary
+//   dictionary entry), whatever the batch size
+// - JSON body as before: { chipId, logs: [...], batch? }; the same body
+//   goes to POST /api/sync with the sync headers added (CloudSync.h)
+// - Or, with `binary`, the compact format below (decoder:
+//   mobile/convex/lib/logs.ts decodeLogBatchBinary)
+// - Reads the status code and a bounded copy of the response body
+//   (Content-Length or chunked); keepAlive() tells whether the connection
+//   can carry the next request (the request itself does not ask for close)
+// - Plain C++ (no Arduino dependencies) so it can be tested on the host.
+//   Client needs write(const uint8_t*, size_t) and readBytes(char*, size_t)
+//   (CloudLink, or a host socket).
+// =============================================================================
+
+// -----------------------------------------------------------------------------
+// Binary log batch ("LGB1"), sent as application/octet-stream. Little-endian;
+// varints are LEB128, deltas are zigzag varints (int32 wrap-around).
+//
+//   header   u32 magic "LGB1" | u8 format | u8 chipIdLen | chipId
+//   log      u8 flags | user | varint timestamp delta | [varint seq delta]
+//            flags: bits 0-2 method (1 NFC, 2 NFC+BIO, 3 FACE, 4 VEIN,
+//                   7 = name follows as [u8 len][bytes]; 0 = trailer)
+//                   bit 3 local time, bit 4 denied, bit 5 new user,
+//                   bit 6 seq present
+//            user:  new -> [u8 len][bytes], appended to the dictionary;
+//                   else varint dictionary index
+//            timestamp: delta from the previous log's (0 before the first)
+//            seq: delta from the previous seq + 1 (0 before the first)
+//   trailer  u8 0 | u8 flags (bit 0 = batch range) | [varint first | varint last]
+//
+// action is ATTENDANCE for every log; result and timestampType follow from
+// the flags. A body without its trailer is rejected (truncated upload).
+// -----------------------------------------------------------------------------
+#define LOG_WIRE_MAGIC         0x3142474C  // "LGB1"
+#define LOG_WIRE_FORMAT        1
+#define LOG_WIRE_CONTENT_TYPE  "application/octet-stream"
+#define LOG_WIRE_METHOD_NAMED  0x07
+#define LOG_WIRE_LOCAL_TIME    0x08
+#define LOG_WIRE_DENIED        0x10
+#define LOG_WIRE_NEW_USER      0x20
+#define LOG_WIRE_HAS_SEQ       0x40
+#define LOG_WIRE_TRAILER_RANGE 0x01
+
+#define LOG_UPLOAD_CHUNK 512    // Body bytes per chunk (stack buffer)
+#define LOG_UPLOAD_LINE  96     // Longest response status/header line kept
+#define LOG_WIRE_USERS   32     // User IDs the binary encoder can refer back to
+
+template <typename Client>
+class LogUploadStream {
+private:
+    Client& _client;
+    bool _binary;
+    char _buf[LOG_UPLOAD_CHUNK];
+    size_t _len = 0;
+    bool _ok = true;
+    uint32_t _logs = 0;
+    uint32_t _bodyBytes = 0;
+    uint32_t _chunks = 0;
+    bool _keepAlive = false;         // Response read to its end, server did not close
+
+    // Binary encoder state
+    uint64_t _users[LOG_WIRE_USERS]; // FNV-1a of each interned user ID (the server keeps the strings)
+    uint32_t _userCount = 0;         // Dictionary size on the server (may exceed LOG_WIRE_USERS)
+    uint32_t _prevTime = 0;
+    uint32_t _nextSeq = 0;
+
+    bool writeRaw(const char* data, size_t len) {
+        if (!_ok) return false;
+        if (len > 0 && _client.write((const uint8_t*)data, len) != len) _ok = false;
+        return _ok;
+    }
+
+    // One chunk: hex size, CRLF, data, CRLF
+    bool flushChunk() {
+        if (_len == 0) return _ok;
+        char head[12];
+        int n = snprintf(head, sizeof(head), "%X\r\n", (unsigned)_len);
+        writeRaw(head, (size_t)n);
+        writeRaw(_buf, _len);
+        writeRaw("\r\n", 2);
+        _bodyBytes += _len;
+        _chunks++;
+        _len = 0;
+        return _ok;
+    }
+
+    void put(const char* data, size_t len) {
+        while (len > 0 && _ok) {
+            size_t n = sizeof(_buf) - _len;
+            if (n > len) n = len;
+            memcpy(_buf + _len, data, n);
+            _len += n;
+            data += n;
+            len -= n;
+            if (_len == sizeof(_buf)) flushChunk();
+        }
+    }
+
+    void put(const char* s) { put(s, strlen(s)); }
+
+    void putUInt(uint32_t value) {
+        char num[12];
+        int n = snprintf(num, sizeof(num), "%lu", (unsigned long)value);
+        put(num, (size_t)n);
+    }
+
+    void putByte(uint8_t b) { put((const char*)&b, 1); }
+
+    void putVarint(uint32_t value) {
+        uint8_t out[5];
+        size_t n = 0;
+        do {
+            out[n] = value & 0x7F;
+            value >>= 7;
+            if (value) out[n] |= 0x80;
+            n++;
+        } while (value);
+        put((const char*)out, n);
+    }
+
+    void putDelta(uint32_t value, uint32_t base) {
+        int32_t d = (int32_t)(value - base);
+        putVarint(((uint32_t)d << 1) ^ (uint32_t)(d >> 31));
+    }
+
+    // [u8 len][bytes], at most 255
+    void putShortString(const char* s) {
+        size_t n = strlen(s);
+        if (n > 255) n = 255;
+        putByte((uint8_t)n);
+        put(s, n);
+    }
+
+    static uint8_t methodCode(const char* method) {
+        for (uint8_t m = LOG_METHOD_NFC; m <= LOG_METHOD_VEIN; m++) {
+            if (strcmp(method, accessLogMethodName(m)) == 0) return m;
+        }
+        return LOG_WIRE_METHOD_NAMED;
+    }
+
+    static uint64_t userHash(const char* userId) {
+        uint64_t h = 14695981039346656037ULL;
+        for (const char* p = userId; *p; p++) {
+            h ^= (uint8_t)*p;
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    // Dictionary index of the user with hash `h`, or -1 (then it is sent
+    // and interned)
+    int findUser(uint64_t h) const {
+        uint32_t kept = _userCount < LOG_WIRE_USERS ? _userCount : LOG_WIRE_USERS;
+        for (uint32_t i = 0; i < kept; i++) {
+            if (_users[i] == h) return (int)i;
+        }
+        return -1;
+    }
+
+    void addBinary(const AccessLog& log, bool localTime, bool denied, bool hasSeq, uint32_t seq) {
+        uint8_t method = methodCode(log.method);
+        uint64_t h = userHash(log.userId);
+        int user = findUser(h);
+        uint8_t flags = method;
+        if (localTime) flags |= LOG_WIRE_LOCAL_TIME;
+        if (denied) flags |= LOG_WIRE_DENIED;
+        if (user < 0) flags |= LOG_WIRE_NEW_USER;
+        if (hasSeq) flags |= LOG_WIRE_HAS_SEQ;
+        putByte(flags);
+        if (method == LOG_WIRE_METHOD_NAMED) putShortString(log.method);
+        if (user < 0) {
+            putShortString(log.userId);
+            if (_userCount < LOG_WIRE_USERS) _users[_userCount] = h;
+            _userCount++;
+        } else {
+            putVarint((uint32_t)user);
+        }
+        putDelta(log.timestamp, _prevTime);
+        _prevTime = log.timestamp;
+        if (hasSeq) {
+            putDelta(seq, _nextSeq);
+            _nextSeq = seq + 1;
+        }
+    }
+
+    // Quoted and escaped JSON string
+    void putString(const char* s) {
+        put("\"", 1);
+        for (; *s; s++) {
+            unsigned char c = (unsigned char)*s;
+            if (c == '"' || c == '\\') {
+                char esc[2] = {'\\', (char)c};
+                put(esc, 2);
+            } else if (c < 0x20) {
+                char esc[8];
+                int n = snprintf(esc, sizeof(esc), "\\u%04x", c);
+                put(esc, (size_t)n);
+            } else {
+                put((const char*)&c, 1);
+            }
+        }
+        put("\"", 1);
+    }
+
+    // One CRLF-terminated line (CRLF stripped, truncated to `size`); false on timeout
+    bool readLine(char* line, size_t size) {
+        size_t n = 0;
+        char c;
+        while (_client.readBytes(&c, 1) == 1) {
+            if (c == '\n') {
+                if (n > 0 && line[n - 1] == '\r') n--;
+                line[n] = '\0';
+                return true;
+            }
+            if (n + 1 < size) line[n++] = c;
+        }
+        return false;
+    }
+
+    static bool startsWithNoCase(const char* s, const char* prefix) {
+        for (; *prefix; s++, prefix++) {
+            char a = *s, b = *prefix;
+            if (a >= 'A' && a <= 'Z') a += 'a' - 'A';
+            if (a != b) return false;
+        }
+        return true;
+    }
+
+    // Up to `len` body bytes into out[*used...]; the rest is read and dropped
+    bool readBody(size_t len, char* out, size_t size, size_t& used) {
+        char c;
+        for (size_t i = 0; i < len; i++) {
+            if (_client.readBytes(&c, 1) != 1) return false;
+            if (used + 1 < size) out[used++] = c;
+        }
+        return true;
+    }
+
+public:
+    // `binary`: send the LGB1 format instead of JSON
+    explicit LogUploadStream(Client& client, bool binary = false) : _client(client), _binary(binary) {}
+
+    // Request line, headers and the start of the body. `extraHeaders`:
+    // more CRLF-terminated header lines (POST /api/sync: SyncHeaders)
+    bool begin(const char* host, const char* path, const char* token, const char* chipId,
+               const char* extraHeaders = nullptr) {
+        char line[160];
+        int n = snprintf(line, sizeof(line), "POST %s HTTP/1.1\r\nHost: %s\r\n", path, host);
+        if (n <= 0 || n >= (int)sizeof(line)) return false;
+        writeRaw(line, (size_t)n);
+        writeRaw("Authorization: Bearer ", 22);
+        writeRaw(token, strlen(token));
+        const char* type = _binary ? LOG_WIRE_CONTENT_TYPE : "application/json";
+        writeRaw("\r\nContent-Type: ", 16);
+        writeRaw(type, strlen(type));
+        writeRaw("\r\n", 2);
+        if (extraHeaders) writeRaw(extraHeaders, strlen(extraHeaders));
+        static const char headers[] =
+            "Transfer-Encoding: chunked\r\n\r\n";
+        writeRaw(headers, sizeof(headers) - 1);
+
+        if (_binary) {
+            uint8_t magic[4] = {(uint8_t)LOG_WIRE_MAGIC, (uint8_t)(LOG_WIRE_MAGIC >> 8),
+                                (uint8_t)(LOG_WIRE_MAGIC >> 16), (uint8_t)(LOG_WIRE_MAGIC >> 24)};
+            put((const char*)magic, sizeof(magic));
+            putByte(LOG_WIRE_FORMAT);
+            putShortString(chipId);
+            return _ok;
+        }
+        put("{\"chipId\":");
+        putString(chipId);
+        put(",\"logs\":[");
+        return _ok;
+    }
+
+    // One log entry; `seq` is sent when `hasSeq`
+    bool add(const AccessLog& log, bool localTime, bool denied, bool hasSeq, uint32_t seq) {
+        if (_binary) {
+            addBinary(log, localTime, denied, hasSeq, seq);
+            _logs++;
+            return _ok;
+        }
+        if (_logs > 0) put(",", 1);
+        put("{\"userId\":");
+        putString(log.userId);
+        put(",\"method\":");
+        putString(log.method);
+        put(",\"action\":\"ATTENDANCE\",\"result\":");
+        put(denied ? "\"denied\"" : "\"success\"");
+        put(",\"timestamp\":");
+        putUInt(log.timestamp);
+        put(",\"timestampType\":");
+        put(localTime ? "\"local\"" : "\"ntp\"");
+        if (hasSeq) {
+            put(",\"seq\":");
+            putUInt(seq);
+        }
+        put("}", 1);
+        _logs++;
+        return _ok;
+    }
+
+    // Closes the body (with the batch range when `hasRange`) and the chunk stream
+    bool finish(bool hasRange, uint32_t first, uint32_t last) {
+        if (_binary) {
+            putByte(0);
+            putByte(hasRange ? LOG_WIRE_TRAILER_RANGE : 0);
+            if (hasRange) {
+                putVarint(first);
+                putVarint(last);
+            }
+            flushChunk();
+            writeRaw("0\r\n\r\n", 5);
+            return _ok;
+        }
+        put("]", 1);
+        if (hasRange) {
+            put(",\"batch\":{\"first\":");
+            putUInt(first);
+            put(",\"last\":");
+            putUInt(last);
+            put("}", 1);
+        }
+        put("}", 1);
+        flushChunk();
+        writeRaw("0\r\n\r\n", 5);
+        return _ok;
+    }
+
+    // Status code (-1 if none arrived); the body, truncated to size - 1, in `body`
+    int readResponse(char* body, size_t size) {
+        if (size > 0) body[0] = '\0';
+        char line[LOG_UPLOAD_LINE];
+        int status = -1;
+        if (!readLine(line, sizeof(line)) || sscanf(line, "HTTP/%*d.%*d %d", &status) != 1) return -1;
+
+        long contentLength = -1;
+        bool chunked = false;
+        bool close = strncmp(line, "HTTP/1.0", 8) == 0;
+        bool headDone = false;
+        while ((headDone = readLine(line, sizeof(line))) && line[0] != '\0') {
+            if (startsWithNoCase(line, "content-length:")) {
+                contentLength = strtol(line + 15, nullptr, 10);
+            } else if (startsWithNoCase(line, "transfer-encoding:") && strstr(line, "chunked")) {
+                chunked = true;
+            } else if (startsWithNoCase(line, "connection:")) {
+                close = strstr(line, "close") != nullptr;
+            }
+        }
+
+        size_t used = 0;
+        if (chunked) {
+            bool done = false;
+            while (readLine(line, sizeof(line))) {
+                long chunk = strtol(line, nullptr, 16);
+                if (chunk == 0 && line[0] == '0') {
+                    while ((done = readLine(line, sizeof(line))) && line[0] != '\0') {}  // Trailers
+                    break;
+                }
+                if (chunk <= 0 || !readBody((size_t)chunk, body, size, used)) break;
+                readLine(line, sizeof(line));  // CRLF after the data
+            }
+            _keepAlive = headDone && done && !close;
+        } else if (contentLength >= 0) {
+            _keepAlive = headDone && readBody((size_t)contentLength, body, size, used) && !close;
+        } else {
+            char c;  // Until the server closes
+            while (_client.readBytes(&c, 1) == 1) {
+                if (used + 1 < size) body[used++] = c;
+            }
+        }
+        if (size > 0) body[used] = '\0';
+        return status;
+    }
+
+    bool ok() const { return _ok; }
+    bool keepAlive() const { return _keepAlive; }
+    uint32_t logs() const { return _logs; }
+    uint32_t bodyBytes() const { return _bodyBytes; }
+    uint32_t chunks() const { return _chunks; }
+};
+
+#endif // LOG_UPLOAD_STREAM_H
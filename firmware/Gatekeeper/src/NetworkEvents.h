@@ -0,0 +1,138 @@
+#ifndef NETWORK_EVENTS_H
+#define NETWORK_EVENTS_H
+
+#include <stdint.h>
+
+// =============================================================================
+// NETWORK EVENTS
+// Work items for NetworkTask, which sleeps until one is posted instead of
+// waking every few seconds to compare millis() against "last*" timestamps.
+// Features:
+// - Items are bits of the task's notification value: openDoor and the WiFi
+//   event handler post them (xTaskNotify eSetBits), repeats of the same
+//   item before the task wakes coalesce into one
+// - NetworkTimers keeps the recurring items (logs, roster, config, watchman
+//   heartbeat, NTP) as deadlines; the task sleeps exactly until the nearest
+//   one, so an idle link costs one wakeup per due item and no polling
+// - Deadlines compare by signed difference: millis() wrapping after ~49
+//   days does not stall or fire them
+// - Plain C++ (no Arduino dependencies) so it can be tested on the host
+// =============================================================================
+
+#define NET_EVENT_WIFI_UP       (1u << 0)   // Got an IP
+#define NET_EVENT_WIFI_DOWN     (1u << 1)   // Lost the AP
+#define NET_EVENT_LOG_READY     (1u << 2)   // A tap was logged (openDoor)
+#define NET_EVENT_LOGS_DUE      (1u << 3)   // Upload logs (sync exchange with CLOUD_SYNC)
+#define NET_EVENT_WHITELIST_DUE (1u << 4)   // Refresh the roster
+#define NET_EVENT_CONFIG_DUE    (1u << 5)   // Refresh the system config
+#define NET_EVENT_HEARTBEAT_DUE (1u << 6)   // ESP-NOW heartbeat to the watchman
+#define NET_EVENT_NTP_DUE       (1u << 7)   // NTP update
+
+#define NET_TIMER_SLOTS 8
+#define NET_TIMER_NONE  0xFFFFFFFFu          // untilNext(): nothing armed
+
+// Deadlines for recurring and one-off work items. One task only.
+class NetworkTimers {
+private:
+    struct Slot {
+        uint32_t event;     // NET_EVENT_* bit (0 = free)
+        uint32_t due;       // millis()
+        uint32_t period;    // 0 = one-shot
+    };
+
+    Slot _slots[NET_TIMER_SLOTS] = {};
+
+    static bool reached(uint32_t due, uint32_t now) { return (int32_t)(now - due) >= 0; }
+
+    Slot* find(uint32_t event) {
+        for (Slot& s : _slots) {
+            if (s.event == event) return &s;
+        }
+        return nullptr;
+    }
+
+    Slot* slotFor(uint32_t event) {
+        Slot* s = find(event);
+        if (s) return s;
+        for (Slot& f : _slots) {
+            if (f.event == 0) {
+                f.event = event;
+                return &f;
+            }
+        }
+        return nullptr;
+    }
+
+public:
+    // `event` every `period` ms, first after `first` ms. Re-arming an
+    // armed event restarts it from `now`.
+    bool every(uint32_t event, uint32_t period, uint32_t now, uint32_t first) {
+        Slot* s = slotFor(event);
+        if (!s || period == 0) return false;
+        s->due = now + first;
+        s->period = period;
+        return true;
+    }
+
+    bool every(uint32_t event, uint32_t period, uint32_t now) { return every(event, period, now, period); }
+
+    // `event` within `delay` ms: pulls an armed deadline earlier, never later.
+    // A recurring event keeps its period from the new deadline.
+    bool within(uint32_t event, uint32_t delay, uint32_t now) {
+        Slot* s = find(event);
+        if (s) {
+            if ((int32_t)(s->due - (now + delay)) > 0) s->due = now + delay;
+            return true;
+        }
+        s = slotFor(event);
+        if (!s) return false;
+        s->due = now + delay;
+        s->period = 0;
+        return true;
+    }
+
+    void cancel(uint32_t events) {
+        for (Slot& s : _slots) {
+            if (s.event & events) s = Slot{};
+        }
+    }
+
+    bool armed(uint32_t event) const {
+        for (const Slot& s : _slots) {
+            if (s.event == event) return true;
+        }
+        return false;
+    }
+
+    // Bits of every event due at `now`. Recurring ones move on by whole
+    // periods (no drift from late wakeups, no burst after a long sync);
+    // one-shots are dropped.
+    uint32_t expire(uint32_t now) {
+        uint32_t events = 0;
+        for (Slot& s : _slots) {
+            if (s.event == 0 || !reached(s.due, now)) continue;
+            events |= s.event;
+            if (s.period == 0) {
+                s = Slot{};
+                continue;
+            }
+            uint32_t late = now - s.due;
+            s.due += (late / s.period + 1) * s.period;
+        }
+        return events;
+    }
+
+    // ms until the nearest deadline (0 if one is due), NET_TIMER_NONE if none
+    uint32_t untilNext(uint32_t now) const {
+        uint32_t next = NET_TIMER_NONE;
+        for (const Slot& s : _slots) {
+            if (s.event == 0) continue;
+            if (reached(s.due, now)) return 0;
+            uint32_t wait = s.due - now;
+            if (wait < next) next = wait;
+        }
+        return next;
+    }
+};
+
+#endif // NETWORK_EVENTS_H
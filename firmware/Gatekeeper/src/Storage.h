@@ -4,30 +4,184 @@
 #include <Arduino.h>
 #include <LittleFS.h>
 #include <ArduinoJson.h>
+#include <Preferences.h>
+#include <mbedtls/md.h>
+#include <esp_mac.h>
 #include "config.h"
+#include "StorageCipher.h"
+#include "AccessLogSegments.h"
+#include "AccessLogQueue.h"
+#include "AccessLogIterator.h"
 
-// =============================================================================
-// ACCESS LOG STRUCTURE
-// Fixed-size binary structure for efficient storage
-// =============================================================================
-struct AccessLog {
-    uint32_t timestamp;
-    char userId[32];     // 31 chars + null terminator
-    char method[12];     // 11 chars + null terminator ("NFC", "NFC+BIO", "FACE", "VEIN")
-};
+#if LOG_RAW_PARTITION
+#include "AccessLogRing.h"
+typedef AccessLogRing AccessLogBackend;
+#else
+typedef AccessLogSegments AccessLogBackend;
+#endif
+
+#if STORAGE_CIPHER_SOFTWARE
+typedef CtrCipher<SoftAes128> AtRestCipher;
+#else
+typedef CtrCipher<MbedAes128> AtRestCipher;   // AES peripheral
+#endif
 
 // =============================================================================
 // SECURE STORAGE CLASS
 // Features:
 // - Proper bounds checking on all string operations
-// - Log file rotation when size limit exceeded
+// - Logs are numbered segment files with a manifest (AccessLogSegments):
+//   oldest first, whole segments deleted once uploaded, capacity bounded by
+//   LOG_MAX_SEGMENTS and LittleFS free space. Nothing unsent is rotated away.
 // - Error handling with return values
-// - Thread-safe file operations (using critical sections)
+// - Thread-safe log access (one recursive mutex around the open log files;
+//   LogHold keeps taps out across a roster swap)
+// - Logs are group-committed (AccessLogFile): call pollLogs() from the
+//   main loop, flushLogs() before a restart. With LOG_RAW_PARTITION they
+//   go to a sector ring on the `accesslog` partition instead (AccessLogRing).
+// - Taps are 8-byte AccessLogRecords (/taps.<n>) naming a roster user index.
+//   Call setLogRoster() whenever a roster goes live and expandLogs() just
+//   before it is replaced; expanded and legacy AccessLogs are in /logs.<n>.
+// - Uploads trim what the server acknowledged (trimLogs) instead of clearing,
+//   so taps logged during an upload are kept. Compact records keep their
+//   sequence numbers (getLogSeq) across trims and reboots.
+// - Bulk reads go through readTaps()/readExpandedLogs() iterators: a block
+//   of records per seek and per lock, instead of readLog() per record.
+// - With LOG_WRITER_TASK (after startLogWriter()) appendLog() only queues
+//   the tap in RAM and a background task writes it, so a commit or block
+//   erase never stalls the door. flushLogs() drains the queue first: call
+//   it before a restart or deep sleep.
+// - With STORAGE_ENCRYPTION, log records are encrypted as they are framed
+//   (AES-128-CTR on the AES peripheral, StorageCipher.h) under a key bound
+//   to this chip; cipher() hands the same key to the whitelist stores.
+//   The compact ring (LOG_RAW_PARTITION) stays plaintext: it holds roster
+//   indexes, not IDs.
 // =============================================================================
 class Storage {
+private:
+    static AccessLogBackend _log;          // Compact taps
+    static ExpandedLogSegments _expanded;  // AccessLogs awaiting upload
+    static SemaphoreHandle_t _logMutex;
+    static uint32_t _rosterGen;            // Live roster (setLogRoster)
+    static uint32_t _logGen;               // Roster of the last marker in _log (0 = none)
+    static SpscQueue<PendingLog, LOG_QUEUE_SLOTS> _queue;   // appendLog -> writer task
+    static TaskHandle_t _writerTask;
+    static uint32_t _logBootUs;            // Opening (and recovering) the logs at begin()
+    static StorageCipher* _cipher;         // At-rest encryption (nullptr: plaintext)
+#if LOG_RAW_PARTITION
+    static FlashPartition _logPartition;
+#endif
+
+    // Room on LittleFS for another log segment, keeping LOG_FS_RESERVE free
+    static bool hasLogSpace(size_t bytes) {
+        return LittleFS.usedBytes() + bytes + LOG_FS_RESERVE <= LittleFS.totalBytes();
+    }
+
+    // At-rest key: HMAC-SHA256 of the chip's factory MAC (eFuse) under a
+    // random secret made in NVS on first boot, so files copied off the
+    // filesystem do not decrypt elsewhere. Keeping the secret itself from a
+    // full flash dump needs NVS encryption (flash encryption) on top.
+    static bool loadCipherKey(uint8_t key[STORAGE_KEY_LEN]) {
+        uint8_t secret[32];
+        uint8_t mac[6];
+        uint8_t digest[32];
+        Preferences nvs;
+        if (!nvs.begin("storage", false)) return false;
+        bool ok = nvs.getBytesLength("atrest") == sizeof(secret) &&
+                  nvs.getBytes("atrest", secret, sizeof(secret)) == sizeof(secret);
+        if (!ok) {
+            esp_fill_random(secret, sizeof(secret));
+            ok = nvs.putBytes("atrest", secret, sizeof(secret)) == sizeof(secret);
+        }
+        nvs.end();
+        ok = ok && esp_efuse_mac_get_default(mac) == ESP_OK &&
+             mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+                             secret, sizeof(secret), mac, sizeof(mac), digest) == 0;
+        if (ok) memcpy(key, digest, STORAGE_KEY_LEN);
+        memset(secret, 0, sizeof(secret));
+        memset(digest, 0, sizeof(digest));
+        return ok;
+    }
+
+    struct LogLock {
+        LogLock() { if (_logMutex) xSemaphoreTakeRecursive(_logMutex, portMAX_DELAY); }
+        ~LogLock() { if (_logMutex) xSemaphoreGiveRecursive(_logMutex); }
+    };
+
+    // Write one tap to flash (caller holds LogLock). If the roster the card
+    // was looked up in has been replaced since, `userIdx` is meaningless and
+    // the tap is stored expanded.
+    static bool writeLog(const PendingLog& tap) {
+        bool ok;
+        if (tap.generation == 0 || tap.generation != _rosterGen) {
+            AccessLog log;
+            memset(&log, 0, sizeof(AccessLog));  // Zero-initialize
+            log.timestamp = tap.timestamp;
+            const char* method = accessLogMethodName(tap.method);
+            memcpy(log.userId, tap.userId, strnlen(tap.userId, sizeof(log.userId) - 1));
+            memcpy(log.method, method, strnlen(method, sizeof(log.method) - 1));
+            ok = _expanded.append(log, millis());
+        } else {
+            // The marker tells the uploader which user table the indexes belong to
+            ok = _logGen == tap.generation || _log.append(accessLogRosterMarker(tap.generation), millis());
+            if (ok) _logGen = tap.generation;
+
+            AccessLogRecord rec;
+            rec.timestamp = tap.timestamp;
+            rec.userIdx = tap.userIdx;
+            rec.method = tap.method;
+            rec.flags = tap.flags;
+            ok = ok && _log.append(rec, millis());
+        }
+        if (!ok) {
+            DEBUG_PRINTLN("[STORAGE] Failed to write log entry");
+            return false;
+        }
+
+        DEBUG_PRINTF("[STORAGE] Log saved: %s via %s at %lu\n", tap.userId, accessLogMethodName(tap.method), tap.timestamp);
+        return true;
+    }
+
+    // Write out every queued tap, in order (caller holds LogLock, which also
+    // keeps the queue's consumer side to one task at a time)
+    static bool drainLogs() {
+        bool ok = true;
+        PendingLog tap;
+        while (_queue.pop(tap)) ok = writeLog(tap) && ok;
+        return ok;
+    }
+
+    static void writerTask(void* pvParameters) {
+        for (;;) {
+            // Woken by appendLog; the timeout keeps the commit interval running
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOG_WRITER_POLL_MS));
+            LogLock lock;
+            drainLogs();
+            if (!_log.poll(millis()) || !_expanded.poll(millis())) {
+                DEBUG_PRINTLN("[STORAGE] Log commit failed");
+            }
+        }
+    }
+
 public:
+    // Holds off the log writer (and in-place appendLog()) in other tasks
+    // while held, e.g. across a roster swap
+    struct LogHold : LogLock {};
+
     // Initialize filesystem
     static bool begin() {
+        // The whitelist stores need the key even if the filesystem is lost
+#if STORAGE_ENCRYPTION
+        if (!_cipher) {
+            uint8_t key[STORAGE_KEY_LEN];
+            if (loadCipherKey(key)) {
+                _cipher = new AtRestCipher(key);
+            } else {
+                DEBUG_PRINTLN("[STORAGE] No at-rest key, writing plaintext");
+            }
+            memset(key, 0, sizeof(key));
+        }
+#endif
         if (!LittleFS.begin(false)) {  // Don't format on fail
             DEBUG_PRINTLN("[STORAGE] Mount failed, attempting format...");
             if (!LittleFS.format()) {
@@ -40,127 +194,296 @@ public:
             }
         }
         DEBUG_PRINTLN("[STORAGE] Filesystem mounted OK");
+
+        if (!_logMutex) _logMutex = xSemaphoreCreateRecursiveMutex();
+        LogLock lock;
+        uint32_t logStart = micros();
+#if LOG_RAW_PARTITION
+        bool logOk = _logPartition.begin("accesslog") && _log.begin(_logPartition);
+#else
+        // The single files of older firmware become the first segments
+        _log.setCipher(_cipher);
+        bool logOk = _log.begin(vfsPath("/taps").c_str(), LOG_SEGMENT_SIZE, LOG_MAX_SEGMENTS,
+                                LOG_COMMIT_INTERVAL_MS, LOG_COMMIT_RECORDS, hasLogSpace) &&
+                     _log.adopt(vfsPath("/taps.bin").c_str());
+#endif
+        _expanded.setCipher(_cipher);
+        logOk = _expanded.begin(vfsPath("/logs").c_str(), LOG_SEGMENT_SIZE, LOG_MAX_SEGMENTS,
+                                LOG_COMMIT_INTERVAL_MS, LOG_COMMIT_RECORDS, hasLogSpace) &&
+                _expanded.adopt(vfsPath("/logs.old.bin").c_str()) &&
+                _expanded.adopt(vfsPath("/logs.bin").c_str()) && logOk;
+        _logBootUs = micros() - logStart;
+        _logGen = 0;
+        if (!_logMutex || !logOk) {
+            DEBUG_PRINTLN("[STORAGE] Failed to open log file");
+            return false;
+        }
         return true;
     }
 
-    // Append a log entry with proper bounds checking
-    static bool appendLog(const char* userId, const char* method, uint32_t timestamp) {
-        if (!userId || !method) {
+    // At-rest cipher for the whitelist stores (setCipher() before their
+    // begin()); nullptr when STORAGE_ENCRYPTION is off or there is no key
+    static const StorageCipher* cipher() { return _cipher; }
+
+    static const char* cipherName() {
+        if (!_cipher) return "off";
+        return STORAGE_CIPHER_SOFTWARE ? "AES-128-CTR (software)" : "AES-128-CTR (AES peripheral)";
+    }
+
+    // Roster generation that taps are logged against from now on
+    static void setLogRoster(uint32_t generation) {
+        LogLock lock;
+        _rosterGen = generation;
+    }
+
+    // Start the background writer (LOG_WRITER_TASK): from now on appendLog()
+    // only queues. Runs on core 0 at the lowest application priority, away
+    // from the tap loop. Without it appendLog() writes in the caller.
+    static bool startLogWriter() {
+#if LOG_WRITER_TASK
+        if (_writerTask) return true;
+        if (xTaskCreatePinnedToCore(writerTask, "LogWriter", 4096, NULL,
+                                    tskIDLE_PRIORITY + 1, &_writerTask, 0) != pdPASS) {
+            _writerTask = NULL;
+            DEBUG_PRINTLN("[STORAGE] Log writer task failed, writing in place");
+            return false;
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Append a tap. Call from one task (the tap loop). With the writer
+    // running the tap is only queued; either way it is durable after the
+    // next group commit (LOG_COMMIT_RECORDS or LOG_COMMIT_INTERVAL_MS) or
+    // flushLogs(). `generation` is the roster the card was looked up in.
+    static bool appendLog(uint16_t userIdx, const char* userId, uint8_t method, uint8_t flags,
+                          uint32_t timestamp, uint32_t generation) {
+        if (!userId) {
             DEBUG_PRINTLN("[STORAGE] appendLog: null parameter");
             return false;
         }
 
-        // Check if rotation needed
-        if (getLogFileSize() >= MAX_LOG_FILE_SIZE) {
-            if (!rotateLogs()) {
-                DEBUG_PRINTLN("[STORAGE] Log rotation failed");
-                // Continue anyway - better to lose old logs than new ones
+        PendingLog tap;
+        memset(&tap, 0, sizeof(tap));
+        tap.timestamp = timestamp;
+        tap.generation = generation;
+        tap.userIdx = userIdx;
+        tap.method = method;
+        tap.flags = flags;
+        memcpy(tap.userId, userId, strnlen(userId, sizeof(tap.userId) - 1));
+
+        if (_writerTask) {
+            if (_queue.push(tap)) {
+                xTaskNotifyGive(_writerTask);
+                return true;
             }
+            DEBUG_PRINTLN("[STORAGE] Log queue full, writing in place");
         }
+        // No writer, or it has fallen behind: write here, after anything queued
+        LogLock lock;
+        drainLogs();
+        return writeLog(tap);
+    }
 
-        File file = LittleFS.open("/logs.bin", FILE_APPEND);
-        if (!file) {
-            DEBUG_PRINTLN("[STORAGE] Failed to open log file for appending");
+    // Move the pending taps into the expanded file while their roster is
+    // still live. Call under LogHold, immediately before a roster swap.
+    static bool expandLogs(AccessLogUserResolver resolve) {
+        LogLock lock;
+        drainLogs();
+        _log.flush();
+        size_t count = _log.count();
+        bool ok = true;
+        AccessLogExpander expander(resolve);
+        for (size_t i = 0; i < count && ok; i++) {
+            AccessLogRecord rec;
+            AccessLog log;
+            if (!_log.read(i, rec)) continue;  // Frame failed its CRC
+            if (expander.expand(rec, log)) ok = _expanded.append(log, millis());
+        }
+        if (!ok || !_expanded.flush()) {
+            DEBUG_PRINTLN("[STORAGE] Log expansion failed");
             return false;
         }
+        if (expander.unresolved() > 0) {
+            DEBUG_PRINTF("[STORAGE] %u taps name a roster that is gone\n", expander.unresolved());
+        }
+        return clearLogs();
+    }
 
-        AccessLog log;
-        memset(&log, 0, sizeof(AccessLog));  // Zero-initialize
-        log.timestamp = timestamp;
-        
-        // Safe string copy with explicit null termination
-        strncpy(log.userId, userId, sizeof(log.userId) - 1);
-        log.userId[sizeof(log.userId) - 1] = '\0';
-        
-        strncpy(log.method, method, sizeof(log.method) - 1);
-        log.method[sizeof(log.method) - 1] = '\0';
-
-        size_t written = file.write((const uint8_t*)&log, sizeof(AccessLog));
-        file.close();
-
-        if (written != sizeof(AccessLog)) {
-            DEBUG_PRINTLN("[STORAGE] Failed to write complete log entry");
-            return false;
+    // Commit buffered logs whose interval has passed (call from the main
+    // loop; a no-op while the writer task does it)
+    static void pollLogs() {
+        if (_writerTask) return;
+        LogLock lock;
+        if (!_log.poll(millis()) || !_expanded.poll(millis())) {
+            DEBUG_PRINTLN("[STORAGE] Log commit failed");
         }
+    }
 
-        DEBUG_PRINTF("[STORAGE] Log saved: %s via %s at %lu\n", log.userId, log.method, log.timestamp);
-        return true;
+    // Write out the queue and commit buffered logs now: the durability point
+    // (before reading the file elsewhere, a restart or deep sleep)
+    static bool flushLogs() {
+        LogLock lock;
+        bool ok = drainLogs();
+        ok = _log.flush() && ok;
+        return _expanded.flush() && ok;
     }
 
-    // Get number of log entries
+    // Get number of log entries, compact and expanded (cached, including
+    // queued and uncommitted ones and roster markers)
     static int getLogCount() {
-        File file = LittleFS.open("/logs.bin", FILE_READ);
-        if (!file) {
-            return 0;  // File doesn't exist = 0 logs
-        }
-        size_t size = file.size();
-        file.close();
-        return size / sizeof(AccessLog);
+        LogLock lock;
+        return (int)(_log.count() + _expanded.count() + _queue.size());
     }
 
-    // Get log file size in bytes
+    // Get log size in bytes on flash (cached, including uncommitted entries)
     static size_t getLogFileSize() {
-        File file = LittleFS.open("/logs.bin", FILE_READ);
-        if (!file) {
-            return 0;
-        }
-        size_t size = file.size();
-        file.close();
-        return size;
+        LogLock lock;
+        return _log.size() + _expanded.size();
+    }
+
+    static AccessLogStats getLogStats() {
+        LogLock lock;
+        return _log.stats();
     }
 
-    // Clear all logs
+    // Taps waiting for the writer now, the most ever waiting, and how many
+    // were written in place because the queue was full
+    static void getLogQueue(uint32_t& queued, uint32_t& highWater, uint32_t& full) {
+        queued = (uint32_t)_queue.size();
+        highWater = _queue.highWater();
+        full = _queue.fullCount();
+    }
+
+    // Segment files in use per log (compact taps: 0 with LOG_RAW_PARTITION)
+    // and how many have been deleted after upload
+    static void getLogSegments(size_t& compact, size_t& expanded, size_t& maxSegments, uint32_t& deleted) {
+        LogLock lock;
+#if LOG_RAW_PARTITION
+        compact = 0;
+        deleted = _expanded.deletedSegments();
+#else
+        compact = _log.segments();
+        deleted = _log.deletedSegments() + _expanded.deletedSegments();
+#endif
+        expanded = _expanded.segments();
+        maxSegments = _expanded.maxSegments();
+    }
+
+    // What the boot-time scan cut from torn log tails, frames that failed
+    // their CRC since, and how long opening the logs took (compact taps:
+    // zero with LOG_RAW_PARTITION, whose ring checks itself)
+    static void getLogRecovery(LogRecoveryStats& compact, LogRecoveryStats& expanded, uint32_t& bootUs) {
+        LogLock lock;
+#if LOG_RAW_PARTITION
+        compact = LogRecoveryStats();
+#else
+        compact = _log.recovery();
+#endif
+        expanded = _expanded.recovery();
+        bootUs = _logBootUs;
+    }
+
+#if LOG_RAW_PARTITION
+    // Lowest and highest sector erase counts of the log ring
+    static void getLogWear(uint32_t& minErases, uint32_t& maxErases) {
+        LogLock lock;
+        _log.eraseCounts(minErases, maxErases);
+    }
+#endif
+
+    // Clear the compact taps (the next tap writes a fresh roster marker)
     static bool clearLogs() {
-        if (LittleFS.exists("/logs.bin")) {
-            if (!LittleFS.remove("/logs.bin")) {
-                DEBUG_PRINTLN("[STORAGE] Failed to remove logs.bin");
-                return false;
-            }
+        LogLock lock;
+        _logGen = 0;
+        if (!_log.clear()) {
+            DEBUG_PRINTLN("[STORAGE] Failed to clear taps");
+            return false;
         }
         DEBUG_PRINTLN("[STORAGE] Logs cleared");
         return true;
     }
 
-    // Rotate logs - archive old, start fresh
-    static bool rotateLogs() {
-        DEBUG_PRINTLN("[STORAGE] Rotating logs...");
-        
-        // Remove old backup if exists
-        if (LittleFS.exists("/logs.old.bin")) {
-            LittleFS.remove("/logs.old.bin");
-        }
-        
-        // Rename current to old
-        if (LittleFS.exists("/logs.bin")) {
-            if (!LittleFS.rename("/logs.bin", "/logs.old.bin")) {
-                DEBUG_PRINTLN("[STORAGE] Failed to rename logs.bin");
-                // Try to just delete it
-                LittleFS.remove("/logs.bin");
-            }
-        }
-        
-        DEBUG_PRINTLN("[STORAGE] Log rotation complete");
-        return true;
+    // Iterators over the compact taps and the expanded logs, forward or
+    // newest first, optionally only taps in [from, to] (AccessLogIterator.h).
+    // The log mutex is held per block, not across the caller's loop.
+    typedef LogIterator<AccessLogBackend, AccessLogRecord, LogLock> TapIterator;
+    typedef LogIterator<ExpandedLogSegments, AccessLog, LogLock> ExpandedIterator;
+
+    static TapIterator readTaps(bool reverse = false, uint32_t from = 0, uint32_t to = 0xFFFFFFFF) {
+        return TapIterator(_log, reverse, from, to);
+    }
+
+    static ExpandedIterator readExpandedLogs(bool reverse = false, uint32_t from = 0, uint32_t to = 0xFFFFFFFF) {
+        return ExpandedIterator(_expanded, reverse, from, to);
     }
 
-    // Read a specific log entry by index
-    static bool readLog(int index, AccessLog& log) {
-        File file = LittleFS.open("/logs.bin", FILE_READ);
-        if (!file) {
+    // Read a specific compact record by index (taps and roster markers)
+    static bool readLog(int index, AccessLogRecord& rec) {
+        if (index < 0) return false;
+        LogLock lock;
+        return _log.read((size_t)index, rec);
+    }
+
+    // Device sequence number of compact record `index` (stable across trims)
+    static uint32_t getLogSeq(int index) {
+        LogLock lock;
+        return _log.seqAt((size_t)index);
+    }
+
+    // Roster generation in effect before compact record 0 (for AccessLogExpander)
+    static uint32_t getLogContext() {
+        LogLock lock;
+        return _log.context();
+    }
+
+    // Drop compact records before `index` once the server has acknowledged
+    // them. `context` is the roster generation in effect at `index`. Records
+    // appended meanwhile are kept.
+    static bool trimLogs(int index, uint32_t context) {
+        if (index <= 0) return true;
+        LogLock lock;
+        if (!_log.trim((size_t)index, context)) {
+            DEBUG_PRINTLN("[STORAGE] Failed to trim taps");
             return false;
         }
-        
-        int count = file.size() / sizeof(AccessLog);
-        if (index < 0 || index >= count) {
-            file.close();
+        return true;
+    }
+
+    static int getCompactLogCount() {
+        LogLock lock;
+        return (int)_log.count();
+    }
+
+    // Expanded AccessLogs (/logs.<n>): upload these before the compact taps
+    static int getExpandedLogCount() {
+        LogLock lock;
+        return (int)_expanded.count();
+    }
+
+    static bool readExpandedLog(int index, AccessLog& log) {
+        if (index < 0) return false;
+        LogLock lock;
+        return _expanded.read((size_t)index, log);
+    }
+
+    // Drop the first `count` expanded logs (uploaded); later ones are kept
+    static bool trimExpandedLogs(int count) {
+        if (count <= 0) return true;
+        LogLock lock;
+        if (!_expanded.trim((size_t)count, 0)) {
+            DEBUG_PRINTLN("[STORAGE] Failed to trim expanded logs");
             return false;
         }
-        
-        file.seek(index * sizeof(AccessLog));
-        size_t read = file.read((uint8_t*)&log, sizeof(AccessLog));
-        file.close();
-        
-        return read == sizeof(AccessLog);
+        return true;
+    }
+
+    // The same file as seen through the VFS, for plain C stdio users
+    // (LittleFS.begin() mounts at "/littlefs" by default)
+    static String vfsPath(const char* path) {
+        return String("/littlefs") + path;
     }
 
     // Get filesystem info
@@ -173,4 +496,17 @@ public:
     }
 };
 
+inline AccessLogBackend Storage::_log;
+inline ExpandedLogSegments Storage::_expanded;
+inline SemaphoreHandle_t Storage::_logMutex = NULL;
+inline uint32_t Storage::_rosterGen = 0;
+inline uint32_t Storage::_logGen = 0;
+inline SpscQueue<PendingLog, LOG_QUEUE_SLOTS> Storage::_queue;
+inline TaskHandle_t Storage::_writerTask = NULL;
+inline uint32_t Storage::_logBootUs = 0;
+inline StorageCipher* Storage::_cipher = nullptr;
+#if LOG_RAW_PARTITION
+inline FlashPartition Storage::_logPartition;
+#endif
+
 #endif // STORAGE_H
@@ -0,0 +1,208 @@
+#ifndef STORAGE_CIPHER_H
+#define STORAGE_CIPHER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include <mbedtls/aes.h>
+#include <esp_random.h>
+#else
+#include <random>
+#endif
+
+#define STORAGE_KEY_LEN 16      // AES-128
+
+// IV domains: no two stores ever share a keystream
+#define CIPHER_DOMAIN_TAPS      0x53504154  // "TAPS" compact log frames
+#define CIPHER_DOMAIN_LOGS      0x53474F4C  // "LOGS" expanded log frames
+#define CIPHER_DOMAIN_WL_IMAGE  0x4D494C57  // "WLIM" user IDs in the partition image
+#define CIPHER_DOMAIN_WL_BLOCK  0x55434C57  // "WLCU" user IDs in the campus .usr file
+
+// Random 32 bits for per-stage nonces (hardware RNG on the device)
+inline uint32_t storageCipherNonce() {
+#ifdef ESP_PLATFORM
+    return esp_random();
+#else
+    static std::random_device rd;
+    return rd();
+#endif
+}
+
+// =============================================================================
+// STORAGE CIPHER
+// Encryption at rest for the logs and the whitelist user-ID tables: AES-128
+// in counter mode, so any record can be read or written on its own and the
+// ciphertext is exactly as long as the plaintext (offsets do not move).
+// The counter block is [domain][a][b][block], big-endian: each store picks
+// (a, b) so they never repeat for different contents - a log frame uses its
+// sequence number, a user ID its table position and a per-stage nonce.
+// apply() both encrypts and decrypts. Safe to call from several tasks.
+// Implementations: CtrCipher<MbedAes128> (the ESP32 AES peripheral, which
+// ESP-IDF puts behind mbedtls_aes_*) and CtrCipher<SoftAes128> (portable,
+// used on the host and for comparison).
+// =============================================================================
+class StorageCipher {
+public:
+    virtual ~StorageCipher() {}
+    virtual void apply(uint32_t domain, uint32_t a, uint32_t b, void* data, size_t len) const = 0;
+};
+
+// FIPS-197 AES-128, encryption direction only (counter mode never runs the
+// inverse cipher). One 1 KB round table, built on first use.
+class SoftAes128 {
+private:
+    uint32_t _rk[44];
+
+    struct Tables {
+        uint8_t sbox[256];
+        uint32_t te[256];      // S-box column times (2, 1, 1, 3); the others are rotations
+
+        Tables() {
+            // S-box from the multiplicative inverse and affine map (FIPS-197 5.1.1)
+            uint8_t p = 1, q = 1;
+            do {
+                p = (uint8_t)(p ^ (p << 1) ^ ((p & 0x80) ? 0x1B : 0));
+                q ^= (uint8_t)(q << 1);
+                q ^= (uint8_t)(q << 2);
+                q ^= (uint8_t)(q << 4);
+                if (q & 0x80) q ^= 0x09;
+                sbox[p] = (uint8_t)(q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3) ^ rotl8(q, 4) ^ 0x63);
+            } while (p != 1);
+            sbox[0] = 0x63;
+            for (int i = 0; i < 256; i++) {
+                uint8_t s = sbox[i];
+                uint8_t s2 = (uint8_t)((s << 1) ^ ((s & 0x80) ? 0x1B : 0));
+                te[i] = ((uint32_t)s2 << 24) | ((uint32_t)s << 16) | ((uint32_t)s << 8) | (uint8_t)(s2 ^ s);
+            }
+        }
+
+        static uint8_t rotl8(uint8_t x, int n) { return (uint8_t)((x << n) | (x >> (8 - n))); }
+    };
+
+    static const Tables& tables() {
+        static const Tables t;
+        return t;
+    }
+
+    static uint32_t ror(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+    static uint32_t load32(const uint8_t* p) {
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+    static void store32(uint8_t* p, uint32_t v) {
+        p[0] = (uint8_t)(v >> 24);
+        p[1] = (uint8_t)(v >> 16);
+        p[2] = (uint8_t)(v >> 8);
+        p[3] = (uint8_t)v;
+    }
+
+public:
+    void setKey(const uint8_t key[STORAGE_KEY_LEN]) {
+        const uint8_t* s = tables().sbox;
+        uint8_t rcon = 1;
+        for (int i = 0; i < 4; i++) _rk[i] = load32(key + 4 * i);
+        for (int i = 4; i < 44; i++) {
+            uint32_t t = _rk[i - 1];
+            if (i % 4 == 0) {
+                t = ((uint32_t)s[(t >> 16) & 0xFF] << 24) | ((uint32_t)s[(t >> 8) & 0xFF] << 16) |
+                    ((uint32_t)s[t & 0xFF] << 8) | s[t >> 24];
+                t ^= (uint32_t)rcon << 24;
+                rcon = (uint8_t)((rcon << 1) ^ ((rcon & 0x80) ? 0x1B : 0));
+            }
+            _rk[i] = _rk[i - 4] ^ t;
+        }
+    }
+
+    void encryptBlock(const uint8_t in[16], uint8_t out[16]) const {
+        const Tables& t = tables();
+        const uint32_t* te = t.te;
+        const uint8_t* s = t.sbox;
+        uint32_t s0 = load32(in) ^ _rk[0], s1 = load32(in + 4) ^ _rk[1];
+        uint32_t s2 = load32(in + 8) ^ _rk[2], s3 = load32(in + 12) ^ _rk[3];
+        for (int r = 1; r < 10; r++) {
+            const uint32_t* k = _rk + 4 * r;
+            uint32_t t0 = te[s0 >> 24] ^ ror(te[(s1 >> 16) & 0xFF], 8) ^ ror(te[(s2 >> 8) & 0xFF], 16) ^ ror(te[s3 & 0xFF], 24) ^ k[0];
+            uint32_t t1 = te[s1 >> 24] ^ ror(te[(s2 >> 16) & 0xFF], 8) ^ ror(te[(s3 >> 8) & 0xFF], 16) ^ ror(te[s0 & 0xFF], 24) ^ k[1];
+            uint32_t t2 = te[s2 >> 24] ^ ror(te[(s3 >> 16) & 0xFF], 8) ^ ror(te[(s0 >> 8) & 0xFF], 16) ^ ror(te[s1 & 0xFF], 24) ^ k[2];
+            uint32_t t3 = te[s3 >> 24] ^ ror(te[(s0 >> 16) & 0xFF], 8) ^ ror(te[(s1 >> 8) & 0xFF], 16) ^ ror(te[s2 & 0xFF], 24) ^ k[3];
+            s0 = t0;
+            s1 = t1;
+            s2 = t2;
+            s3 = t3;
+        }
+        const uint32_t* k = _rk + 40;
+        store32(out,      (((uint32_t)s[s0 >> 24] << 24) | ((uint32_t)s[(s1 >> 16) & 0xFF] << 16) |
+                           ((uint32_t)s[(s2 >> 8) & 0xFF] << 8) | s[s3 & 0xFF]) ^ k[0]);
+        store32(out + 4,  (((uint32_t)s[s1 >> 24] << 24) | ((uint32_t)s[(s2 >> 16) & 0xFF] << 16) |
+                           ((uint32_t)s[(s3 >> 8) & 0xFF] << 8) | s[s0 & 0xFF]) ^ k[1]);
+        store32(out + 8,  (((uint32_t)s[s2 >> 24] << 24) | ((uint32_t)s[(s3 >> 16) & 0xFF] << 16) |
+                           ((uint32_t)s[(s0 >> 8) & 0xFF] << 8) | s[s1 & 0xFF]) ^ k[2]);
+        store32(out + 12, (((uint32_t)s[s3 >> 24] << 24) | ((uint32_t)s[(s0 >> 16) & 0xFF] << 16) |
+                           ((uint32_t)s[(s1 >> 8) & 0xFF] << 8) | s[s2 & 0xFF]) ^ k[3]);
+    }
+
+    // Counter mode from a block boundary: XORs `len` bytes of keystream into
+    // `data` and advances `counter` (big-endian) past the blocks used
+    void ctr(uint8_t counter[16], uint8_t* data, size_t len) const {
+        uint8_t stream[16];
+        while (len > 0) {
+            encryptBlock(counter, stream);
+            for (int i = 15; i >= 0 && ++counter[i] == 0; i--) {}
+            size_t n = len < 16 ? len : 16;
+            for (size_t i = 0; i < n; i++) data[i] ^= stream[i];
+            data += n;
+            len -= n;
+        }
+    }
+};
+
+#ifdef ESP_PLATFORM
+// The ESP32 AES peripheral: ESP-IDF builds mbedtls_aes_* on it, and the
+// driver takes the peripheral lock per call
+class MbedAes128 {
+private:
+    mutable mbedtls_aes_context _ctx;
+
+public:
+    MbedAes128() { mbedtls_aes_init(&_ctx); }
+    ~MbedAes128() { mbedtls_aes_free(&_ctx); }
+    MbedAes128(const MbedAes128&) = delete;
+    MbedAes128& operator=(const MbedAes128&) = delete;
+
+    void setKey(const uint8_t key[STORAGE_KEY_LEN]) { mbedtls_aes_setkey_enc(&_ctx, key, 128); }
+
+    void ctr(uint8_t counter[16], uint8_t* data, size_t len) const {
+        size_t off = 0;
+        uint8_t stream[16];
+        mbedtls_aes_crypt_ctr(&_ctx, len, &off, counter, stream, data, data);
+    }
+};
+#endif
+
+template <typename Aes>
+class CtrCipher : public StorageCipher {
+private:
+    Aes _aes;
+
+    static void put32(uint8_t* p, uint32_t v) {
+        p[0] = (uint8_t)(v >> 24);
+        p[1] = (uint8_t)(v >> 16);
+        p[2] = (uint8_t)(v >> 8);
+        p[3] = (uint8_t)v;
+    }
+
+public:
+    explicit CtrCipher(const uint8_t key[STORAGE_KEY_LEN]) { _aes.setKey(key); }
+
+    void apply(uint32_t domain, uint32_t a, uint32_t b, void* data, size_t len) const override {
+        uint8_t counter[16];
+        put32(counter, domain);
+        put32(counter + 4, a);
+        put32(counter + 8, b);
+        put32(counter + 12, 0);
+        _aes.ctr(counter, (uint8_t*)data, len);
+    }
+};
+
+#endif // STORAGE_CIPHER_H
@@ -0,0 +1,196 @@
+#ifndef WHITELIST_BINARY_H
+#define WHITELIST_BINARY_H
+
+#include <stdint.h>
+#include <string.h>
+#include "WhitelistIndex.h"
+#include "WhitelistStream.h"
+
+// =============================================================================
+// WHITELIST BINARY WIRE FORMAT
+// Compact alternative to the JSON /api/whitelist response, served when the
+// request carries "Accept: application/octet-stream" (encoder:
+// mobile/convex/lib/whitelist.ts encodeWhitelistBinary). Little-endian.
+//
+//   header   u32 magic "WLB1" | u16 headerLen | u8 format | u8 flags (bit0 = full)
+//            u32 version | u32 userCount | u32 entryCount | u32 removeCount
+//   users    userCount  x [u8 len][len bytes]            interned user IDs
+//   entries  entryCount x [u8 uidLen][uid][u8 role][u16 bioId][u16 userIdx]
+//   removes  removeCount x [u8 uidLen][uid]
+//
+// Entries of a full roster are in image order, and users in order of first
+// use, so both stream straight into the flash image (see WhitelistImage.h).
+// The decoder is incremental and uses one fixed field buffer.
+// =============================================================================
+
+#define WL_WIRE_MAGIC        0x31424C57  // "WLB1"
+#define WL_WIRE_FORMAT       1
+#define WL_WIRE_HEADER_LEN   24
+#define WL_WIRE_FLAG_FULL    0x01
+#define WL_WIRE_CONTENT_TYPE "application/octet-stream"
+
+class WhitelistBinaryDecoder {
+private:
+    enum State : uint8_t {
+        ST_HEADER, ST_HEADER_EXTRA,
+        ST_USER_LEN, ST_USER,
+        ST_ENTRY_LEN, ST_ENTRY,
+        ST_REMOVE_LEN, ST_REMOVE,
+        ST_DONE
+    };
+
+    WhitelistStreamSink* _sink;
+    State _state = ST_HEADER;
+    uint8_t _buf[255];       // Largest field: a length-prefixed string
+    size_t _need = WL_WIRE_HEADER_LEN;
+    size_t _have = 0;
+
+    uint16_t _headerLen = 0;
+    uint8_t _flags = 0;
+    uint32_t _version = 0;
+    uint32_t _users = 0;
+    uint32_t _entries = 0;
+    uint32_t _removes = 0;
+    uint32_t _index = 0;     // Item within the current section
+    bool _error = false;
+
+    static uint16_t rd16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+    static uint32_t rd32(const uint8_t* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    WhitelistSection rosterSection() const {
+        return (_flags & WL_WIRE_FLAG_FULL) ? WL_SECTION_ENTRIES : WL_SECTION_ADDS;
+    }
+
+    void expect(State state, size_t bytes) {
+        _state = state;
+        _need = bytes;
+        _have = 0;
+    }
+
+    // Move to the first non-empty section at or after `state`
+    void nextSection(State state) {
+        _index = 0;
+        if (state == ST_USER_LEN && _users == 0) state = ST_ENTRY_LEN;
+        if (state == ST_ENTRY_LEN && _entries == 0) state = ST_REMOVE_LEN;
+        if (state == ST_REMOVE_LEN && _removes == 0) state = ST_DONE;
+        expect(state, state == ST_DONE ? 0 : 1);
+    }
+
+    bool fail() {
+        _error = true;
+        return false;
+    }
+
+    // `_buf` holds a complete field for the current state
+    bool field() {
+        switch (_state) {
+            case ST_HEADER:
+                if (rd32(_buf) != WL_WIRE_MAGIC || _buf[6] != WL_WIRE_FORMAT) return fail();
+                _headerLen = rd16(_buf + 4);
+                if (_headerLen < WL_WIRE_HEADER_LEN) return fail();
+                _flags = _buf[7];
+                _version = rd32(_buf + 8);
+                _users = rd32(_buf + 12);
+                _entries = rd32(_buf + 16);
+                _removes = rd32(_buf + 20);
+                if (_users > _entries) return fail();
+                // Later formats may append header fields - skip them
+                if (_headerLen > WL_WIRE_HEADER_LEN) {
+                    expect(ST_HEADER_EXTRA, _headerLen - WL_WIRE_HEADER_LEN);
+                } else {
+                    nextSection(ST_USER_LEN);
+                }
+                return true;
+
+            case ST_HEADER_EXTRA:
+                nextSection(ST_USER_LEN);
+                return true;
+
+            case ST_USER_LEN:
+                if (_buf[0] == 0 || _buf[0] >= WL_USER_ID_LEN) return fail();
+                expect(ST_USER, _buf[0]);
+                return true;
+
+            case ST_USER: {
+                char sid[WL_USER_ID_LEN];
+                memcpy(sid, _buf, _need);
+                sid[_need] = '\0';
+                if (!_sink->onUser(rosterSection(), sid)) return fail();
+                if (++_index < _users) expect(ST_USER_LEN, 1);
+                else nextSection(ST_ENTRY_LEN);
+                return true;
+            }
+
+            case ST_ENTRY_LEN:
+                if (_buf[0] == 0 || _buf[0] > WL_UID_MAX_LEN) return fail();
+                expect(ST_ENTRY, _buf[0] + 5);
+                return true;
+
+            case ST_ENTRY: {
+                WhitelistStreamEntry entry;
+                memset(&entry, 0, sizeof(entry));
+                entry.uidLen = (uint8_t)(_need - 5);
+                memcpy(entry.uid, _buf, entry.uidLen);
+                const uint8_t* p = _buf + entry.uidLen;
+                // Device-only roles (WL_ROLE_LEGACY) are not taken off the wire
+                entry.role = p[0] <= WL_ROLE_ADMIN ? (uint8_t)p[0] : (uint8_t)WL_ROLE_NONE;
+                entry.bioId = rd16(p + 1);
+                entry.userIdx = rd16(p + 3);
+                if (entry.userIdx >= _users) return fail();
+                if (!_sink->onEntry(rosterSection(), entry)) return fail();
+                if (++_index < _entries) expect(ST_ENTRY_LEN, 1);
+                else nextSection(ST_REMOVE_LEN);
+                return true;
+            }
+
+            case ST_REMOVE_LEN:
+                if (_buf[0] == 0 || _buf[0] > WL_UID_MAX_LEN) return fail();
+                expect(ST_REMOVE, _buf[0]);
+                return true;
+
+            case ST_REMOVE:
+                if (!_sink->onRemove(_buf, (uint8_t)_need)) return fail();
+                if (++_index < _removes) expect(ST_REMOVE_LEN, 1);
+                else nextSection(ST_DONE);
+                return true;
+
+            case ST_DONE:
+                break;
+        }
+        return fail();
+    }
+
+public:
+    explicit WhitelistBinaryDecoder(WhitelistStreamSink& sink) : _sink(&sink) {}
+
+    // Decode the next chunk. Returns false once the input is malformed or the sink aborted.
+    bool feed(const uint8_t* data, size_t len) {
+        while (len > 0 && !_error) {
+            if (_state == ST_DONE) return fail();  // Trailing bytes
+
+            // Header extension bytes are skipped, never buffered
+            size_t n = _need - _have < len ? _need - _have : len;
+            if (_state != ST_HEADER_EXTRA) memcpy(_buf + _have, data, n);
+            _have += n;
+            data += n;
+            len -= n;
+
+            if (_have == _need) field();
+        }
+        return !_error;
+    }
+
+    bool feed(const char* data, size_t len) { return feed((const uint8_t*)data, len); }
+
+    // True once every declared section was read without errors
+    bool complete() const { return _state == ST_DONE && !_error; }
+    bool failed() const { return _error; }
+
+    uint32_t version() const { return _version; }
+    bool full() const { return (_flags & WL_WIRE_FLAG_FULL) != 0; }
+    bool sawEntries() const { return full() && _headerLen > 0; }
+};
+
+#endif // WHITELIST_BINARY_H
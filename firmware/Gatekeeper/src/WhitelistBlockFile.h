@@ -0,0 +1,618 @@
+#ifndef WHITELIST_BLOCK_FILE_H
+#define WHITELIST_BLOCK_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "WhitelistIndex.h"
+#include "Crc32.h"
+#include "StorageCipher.h"
+
+// =============================================================================
+// CAMPUS WHITELIST BLOCK FILE
+// Campus-wide rosters (20k-50k cards) kept on LittleFS instead of the
+// `whitelist` partition image: ~48 bytes per card, doubled while a new
+// roster is staged, so 50k cards need the 16MB partitions_campus.csv.
+// Two files:
+//   <base>.blk  [header, padded to a block][blocks][sparse index]
+//   <base>.usr  [users header][userCount x 32-byte user IDs]
+// Each 4 KB block holds up to WL_BLOCK_RECORDS sorted WhitelistRecords and a
+// CRC. The sparse index is the first key of every block - ~8 bytes per 255
+// cards - and is the only part kept in RAM.
+// Features:
+// - A lookup is one search of the RAM index plus one block read (the
+//   user ID, read only on a hit, is one more 32-byte read)
+// - Boot reads the header and index only; cost grows with blocks, not cards
+// - Staging writes <base>.blk.new / .usr.new, header last; activate() swaps
+//   them in. begin() finishes a swap that a power cut interrupted.
+// - With setCipher(), the user IDs are stored encrypted (card UIDs, which
+//   the index and blocks are searched by, stay plaintext)
+// - Plain C stdio: LittleFS is mounted in the VFS on the device (see
+//   Storage::vfsPath), and the same code runs on the host for tests.
+// Not thread-safe: the caller serializes lookups with activate().
+// =============================================================================
+
+#define WL_BLOCK_MAGIC    0x42434C57  // "WLCB"
+#define WL_BLOCK_USERS    0x55434C57  // "WLCU"
+#define WL_BLOCK_FORMAT   1
+#define WL_BLOCK_SIZE     4096
+#define WL_BLOCK_PATH_LEN 48
+
+struct WhitelistBlockHeader {
+    uint16_t count;           // Records used in this block
+    uint16_t reserved;
+    uint32_t crc;             // CRC32 of records[0..count)
+};
+
+#define WL_BLOCK_RECORDS ((WL_BLOCK_SIZE - sizeof(WhitelistBlockHeader)) / sizeof(WhitelistRecord))
+
+struct WhitelistBlock {
+    WhitelistBlockHeader hdr;
+    WhitelistRecord records[WL_BLOCK_RECORDS];
+    uint8_t pad[WL_BLOCK_SIZE - sizeof(WhitelistBlockHeader) - WL_BLOCK_RECORDS * sizeof(WhitelistRecord)];
+};
+
+static_assert(sizeof(WhitelistBlock) == WL_BLOCK_SIZE, "WhitelistBlock must fill one block");
+
+// First key of a block
+struct WhitelistBlockKey {
+    uint8_t uid[WL_UID_MAX_LEN];
+    uint8_t uidLen;
+};
+
+struct WhitelistBlockFileHeader {
+    uint32_t magic;
+    uint16_t format;
+    uint16_t headerSize;
+    uint32_t generation;      // Incremented on every commit, matched by the users file
+    uint32_t version;         // Server whitelist version (0 = unknown)
+    uint32_t count;           // Records
+    uint32_t blockCount;
+    uint32_t userCount;
+    uint32_t indexOffset;     // Sparse index: blockCount x WhitelistBlockKey
+    uint32_t indexCrc;
+    uint32_t headerCrc;       // CRC32 of the fields above
+};
+
+struct WhitelistUsersHeader {
+    uint32_t magic;
+    uint32_t generation;
+    uint32_t count;
+    uint32_t idNonce;         // Nonzero: IDs are under StorageCipher with this in the IV
+};
+
+class WhitelistBlockStore {
+private:
+    char _blkPath[WL_BLOCK_PATH_LEN] = {0};
+    char _usrPath[WL_BLOCK_PATH_LEN] = {0};
+    char _blkNewPath[WL_BLOCK_PATH_LEN] = {0};
+    char _usrNewPath[WL_BLOCK_PATH_LEN] = {0};
+
+    // Live files
+    FILE* _blocks = nullptr;
+    FILE* _users = nullptr;
+    WhitelistBlockFileHeader _hdr;
+    uint32_t _idNonce = 0;
+    bool _valid = false;
+    WhitelistBlockKey* _index = nullptr;
+    WhitelistBlock _block;           // Last block read
+    int32_t _cached = -1;
+    uint32_t _blockReads = 0;
+    uint32_t _cacheHits = 0;
+
+    // Files being staged
+    FILE* _wrBlocks = nullptr;
+    FILE* _wrUsers = nullptr;
+    WhitelistBlockFileHeader _wrHdr;
+    WhitelistBlock _wrBlock;
+    WhitelistBlockKey* _wrIndex = nullptr;
+    size_t _wrIndexCap = 0;
+    size_t _wrCount = 0;
+    size_t _wrUserCount = 0;
+    uint32_t _wrIdNonce = 0;
+    bool _wrFailed = false;
+    bool _staging = false;
+    bool _staged = false;
+    WhitelistRecord _wrLast;
+    const StorageCipher* _cipher = nullptr;
+
+    // Decrypt a user ID read from a file with `idNonce` (0: plaintext)
+    static bool openUserId(const StorageCipher* cipher, uint32_t idNonce, uint16_t userIdx, char* id) {
+        if (idNonce != 0) {
+            if (!cipher) return false;
+            cipher->apply(CIPHER_DOMAIN_WL_BLOCK, idNonce, userIdx, id, WL_USER_ID_LEN);
+        }
+        id[WL_USER_ID_LEN - 1] = '\0';
+        return true;
+    }
+
+    static bool makePath(char* out, const char* base, const char* suffix) {
+        int n = snprintf(out, WL_BLOCK_PATH_LEN, "%s%s", base, suffix);
+        return n > 0 && n < WL_BLOCK_PATH_LEN;
+    }
+
+    static int compareBlockKey(const uint8_t* key, uint8_t keyLen, const WhitelistBlockKey& k) {
+        int c = memcmp(key, k.uid, WL_UID_MAX_LEN);
+        if (c != 0) return c;
+        return (int)keyLen - (int)k.uidLen;
+    }
+
+    static bool readAt(FILE* f, size_t offset, void* data, size_t len) {
+        return f && fseek(f, (long)offset, SEEK_SET) == 0 && fread(data, 1, len, f) == len;
+    }
+
+    static bool writeAt(FILE* f, size_t offset, const void* data, size_t len) {
+        return f && fseek(f, (long)offset, SEEK_SET) == 0 && fwrite(data, 1, len, f) == len;
+    }
+
+    static bool fileExists(const char* path) {
+        FILE* f = fopen(path, "rb");
+        if (!f) return false;
+        fclose(f);
+        return true;
+    }
+
+    static bool validHeader(const WhitelistBlockFileHeader& h) {
+        if (h.magic != WL_BLOCK_MAGIC || h.format != WL_BLOCK_FORMAT) return false;
+        if (h.headerSize != sizeof(WhitelistBlockFileHeader)) return false;
+        if (h.headerCrc != crc32Update(0, &h, offsetof(WhitelistBlockFileHeader, headerCrc))) return false;
+        if ((uint64_t)h.count > (uint64_t)h.blockCount * WL_BLOCK_RECORDS) return false;
+        if (h.indexOffset != (uint64_t)(h.blockCount + 1) * WL_BLOCK_SIZE) return false;
+        if (h.userCount > h.count) return false;
+        return true;
+    }
+
+    static bool readHeader(const char* path, WhitelistBlockFileHeader& h) {
+        FILE* f = fopen(path, "rb");
+        if (!f) return false;
+        bool ok = readAt(f, 0, &h, sizeof(h)) && validHeader(h);
+        fclose(f);
+        return ok;
+    }
+
+    void closeLive() {
+        if (_blocks) fclose(_blocks);
+        if (_users) fclose(_users);
+        _blocks = nullptr;
+        _users = nullptr;
+        free(_index);
+        _index = nullptr;
+        _valid = false;
+        _cached = -1;
+    }
+
+    // Open the live files and load the sparse index
+    bool load() {
+        closeLive();
+        _blocks = fopen(_blkPath, "rb");
+        _users = fopen(_usrPath, "rb");
+        if (!_blocks || !_users) {
+            closeLive();
+            return false;
+        }
+
+        WhitelistBlockFileHeader& h = _hdr;
+        WhitelistUsersHeader u;
+        if (!readAt(_blocks, 0, &h, sizeof(h)) || !validHeader(h) ||
+            !readAt(_users, 0, &u, sizeof(u)) ||
+            u.magic != WL_BLOCK_USERS || u.generation != h.generation || u.count != h.userCount) {
+            closeLive();
+            return false;
+        }
+        _idNonce = u.idNonce;
+
+        size_t indexBytes = h.blockCount * sizeof(WhitelistBlockKey);
+        _index = (WhitelistBlockKey*)malloc(indexBytes ? indexBytes : 1);
+        if (!_index || !readAt(_blocks, h.indexOffset, _index, indexBytes) ||
+            crc32Update(0, _index, indexBytes) != h.indexCrc) {
+            closeLive();
+            return false;
+        }
+        _valid = true;
+        return true;
+    }
+
+    // Block `b` into the cache, CRC checked
+    bool readBlock(uint32_t b) {
+        if (_cached == (int32_t)b) {
+            _cacheHits++;
+            return true;
+        }
+        _cached = -1;
+        _blockReads++;
+        if (!readAt(_blocks, (size_t)(b + 1) * WL_BLOCK_SIZE, &_block, WL_BLOCK_SIZE)) return false;
+        if (_block.hdr.count > WL_BLOCK_RECORDS ||
+            _block.hdr.crc != crc32Update(0, _block.records, _block.hdr.count * sizeof(WhitelistRecord))) {
+            return false;
+        }
+        _cached = (int32_t)b;
+        return true;
+    }
+
+    // Finish a swap that activate() started before a reset
+    void recover() {
+        WhitelistBlockFileHeader h;
+        if (readHeader(_blkNewPath, h)) {
+            if (fileExists(_usrNewPath)) {
+                remove(_usrPath);
+                rename(_usrNewPath, _usrPath);
+            }
+            remove(_blkPath);
+            rename(_blkNewPath, _blkPath);
+        } else {
+            remove(_blkNewPath);
+            remove(_usrNewPath);
+        }
+    }
+
+    bool flushBlock() {
+        size_t n = _wrCount % WL_BLOCK_RECORDS;
+        if (n == 0) n = WL_BLOCK_RECORDS;
+        _wrBlock.hdr.count = (uint16_t)n;
+        _wrBlock.hdr.reserved = 0;
+        _wrBlock.hdr.crc = crc32Update(0, _wrBlock.records, n * sizeof(WhitelistRecord));
+        if (n < WL_BLOCK_RECORDS) {
+            memset(&_wrBlock.records[n], 0, (WL_BLOCK_RECORDS - n) * sizeof(WhitelistRecord));
+        }
+        return fwrite(&_wrBlock, 1, WL_BLOCK_SIZE, _wrBlocks) == WL_BLOCK_SIZE;
+    }
+
+    // Same contract as WhitelistStore: 1 = use `out`, 0 = repeated card
+    // (skip), -1 = out of order or failed
+    int nextRecord(const uint8_t* uid, uint8_t uidLen, WhitelistRecord*& out) {
+        if (!_staging || _wrFailed) return -1;
+        if (!uid || uidLen == 0 || uidLen > WL_UID_MAX_LEN) return -1;
+
+        size_t slot = _wrCount % WL_BLOCK_RECORDS;
+        WhitelistRecord& rec = _wrBlock.records[slot];
+        memset(&rec, 0, sizeof(rec));
+        memcpy(rec.uid, uid, uidLen);
+        rec.uidLen = uidLen;
+        if (_wrCount > 0) {
+            int c = WhitelistIndex::compareKey(rec.uid, rec.uidLen, _wrLast);
+            if (c == 0) return 0;
+            if (c < 0) {
+                _wrFailed = true;
+                return -1;
+            }
+        }
+        if (_wrCount > UINT16_MAX) {  // Keep the same limit as userIdx
+            _wrFailed = true;
+            return -1;
+        }
+        out = &rec;
+        return 1;
+    }
+
+    bool pushRecord(const WhitelistRecord& rec) {
+        size_t slot = _wrCount % WL_BLOCK_RECORDS;
+        if (slot == 0) {
+            size_t block = _wrCount / WL_BLOCK_RECORDS;
+            if (block >= _wrIndexCap) {
+                size_t cap = _wrIndexCap ? _wrIndexCap * 2 : 16;
+                WhitelistBlockKey* grown = (WhitelistBlockKey*)realloc(_wrIndex, cap * sizeof(WhitelistBlockKey));
+                if (!grown) {
+                    _wrFailed = true;
+                    return false;
+                }
+                _wrIndex = grown;
+                _wrIndexCap = cap;
+            }
+            memcpy(_wrIndex[block].uid, rec.uid, WL_UID_MAX_LEN);
+            _wrIndex[block].uidLen = rec.uidLen;
+        }
+        _wrLast = rec;
+        _wrCount++;
+        if (slot == WL_BLOCK_RECORDS - 1 && !flushBlock()) {
+            _wrFailed = true;
+            return false;
+        }
+        return true;
+    }
+
+    void closeStage() {
+        if (_wrBlocks) fclose(_wrBlocks);
+        if (_wrUsers) fclose(_wrUsers);
+        _wrBlocks = nullptr;
+        _wrUsers = nullptr;
+        free(_wrIndex);
+        _wrIndex = nullptr;
+        _wrIndexCap = 0;
+        _staging = false;
+    }
+
+public:
+    // Sequential read of the live roster (delta merges). Uses its own file
+    // handles, so lookups can run while it is open.
+    class Cursor {
+    private:
+        FILE* _blocks = nullptr;
+        FILE* _users = nullptr;
+        WhitelistBlock* _block = nullptr;
+        const StorageCipher* _cipher;
+        uint32_t _idNonce;
+        uint32_t _blockCount = 0;
+        uint32_t _next = 0;      // Next block to read
+        uint16_t _pos = 0;       // Position in the current block
+        bool _error = false;
+
+    public:
+        explicit Cursor(const WhitelistBlockStore& store) : _cipher(store._cipher), _idNonce(store._idNonce) {
+            if (!store._valid) return;
+            _blocks = fopen(store._blkPath, "rb");
+            _users = fopen(store._usrPath, "rb");
+            _block = (WhitelistBlock*)malloc(sizeof(WhitelistBlock));
+            _blockCount = store._hdr.blockCount;
+            if (!_blocks || !_users || !_block) _error = true;
+            if (_block) _block->hdr.count = 0;
+        }
+        ~Cursor() {
+            if (_blocks) fclose(_blocks);
+            if (_users) fclose(_users);
+            free(_block);
+        }
+
+        Cursor(const Cursor&) = delete;
+        Cursor& operator=(const Cursor&) = delete;
+
+        // Next record in key order with its user ID. False at the end or on a read error.
+        bool next(WhitelistRecord& rec, char* userId) {
+            if (_error || !_block) return false;
+            while (_pos >= _block->hdr.count) {
+                if (_next >= _blockCount) return false;
+                if (!readAt(_blocks, (size_t)(_next + 1) * WL_BLOCK_SIZE, _block, WL_BLOCK_SIZE) ||
+                    _block->hdr.count > WL_BLOCK_RECORDS ||
+                    _block->hdr.crc != crc32Update(0, _block->records, _block->hdr.count * sizeof(WhitelistRecord))) {
+                    _error = true;
+                    return false;
+                }
+                _next++;
+                _pos = 0;
+            }
+            rec = _block->records[_pos++];
+            if (!readAt(_users, sizeof(WhitelistUsersHeader) + (size_t)rec.userIdx * WL_USER_ID_LEN,
+                        userId, WL_USER_ID_LEN) ||
+                !openUserId(_cipher, _idNonce, rec.userIdx, userId)) {
+                _error = true;
+                return false;
+            }
+            return true;
+        }
+
+        bool failed() const { return _error; }
+    };
+
+    WhitelistBlockStore() {
+        memset(&_hdr, 0, sizeof(_hdr));
+        memset(&_wrHdr, 0, sizeof(_wrHdr));
+    }
+    ~WhitelistBlockStore() {
+        abortStage();
+        closeLive();
+    }
+
+    WhitelistBlockStore(const WhitelistBlockStore&) = delete;
+    WhitelistBlockStore& operator=(const WhitelistBlockStore&) = delete;
+
+    // Encrypt the user IDs of rosters staged from now on (nullptr:
+    // plaintext) and decrypt those of encrypted ones. Set it before begin().
+    void setCipher(const StorageCipher* cipher) { _cipher = cipher; }
+
+    // `base` is a VFS path without extension, e.g. "/littlefs/campus"
+    bool begin(const char* base) {
+        if (!makePath(_blkPath, base, ".blk") || !makePath(_usrPath, base, ".usr") ||
+            !makePath(_blkNewPath, base, ".blk.new") || !makePath(_usrNewPath, base, ".usr.new")) {
+            return false;
+        }
+        recover();
+        load();
+        return true;
+    }
+
+    // Copy out the record for a card. One index search and at most one block read.
+    bool find(const uint8_t* uid, uint8_t uidLen, WhitelistRecord& out) {
+        if (!_valid || !uid || uidLen == 0 || uidLen > WL_UID_MAX_LEN) return false;
+
+        uint8_t key[WL_UID_MAX_LEN] = {0};
+        memcpy(key, uid, uidLen);
+
+        // Last block whose first key is <= key
+        size_t lo = 0, hi = _hdr.blockCount;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (compareBlockKey(key, uidLen, _index[mid]) < 0) hi = mid;
+            else lo = mid + 1;
+        }
+        if (lo == 0 || !readBlock((uint32_t)(lo - 1))) return false;
+
+        const WhitelistRecord* rec = WhitelistIndex::search(_block.records, _block.hdr.count, uid, uidLen);
+        if (!rec) return false;
+        out = *rec;
+        return true;
+    }
+
+    // User ID for a record returned by find()
+    bool userId(uint16_t userIdx, char* out, size_t size) {
+        if (!_valid || userIdx >= _hdr.userCount || size == 0) return false;
+        char id[WL_USER_ID_LEN];
+        if (!readAt(_users, sizeof(WhitelistUsersHeader) + (size_t)userIdx * WL_USER_ID_LEN, id, sizeof(id)) ||
+            !openUserId(_cipher, _idNonce, userIdx, id)) {
+            return false;
+        }
+        size_t n = strnlen(id, size - 1);
+        memcpy(out, id, n);
+        out[n] = '\0';
+        return true;
+    }
+
+    // Start a new roster in the .new files. Follow with append() in sorted
+    // order, then commitStage(). `maxEntries` is a hint only.
+    bool beginStage(size_t maxEntries) {
+        abortStage();
+        if (maxEntries > (size_t)UINT16_MAX + 1) return false;  // userIdx is 16 bits
+        _staged = false;
+
+        _wrBlocks = fopen(_blkNewPath, "wb");
+        _wrUsers = fopen(_usrNewPath, "wb");
+        if (!_wrBlocks || !_wrUsers) {
+            closeStage();
+            return false;
+        }
+
+        WhitelistBlockFileHeader& h = _wrHdr;
+        memset(&h, 0, sizeof(h));
+        h.magic = WL_BLOCK_MAGIC;
+        h.format = WL_BLOCK_FORMAT;
+        h.headerSize = sizeof(WhitelistBlockFileHeader);
+        h.generation = (_valid ? _hdr.generation : 0) + 1;
+
+        _wrCount = 0;
+        _wrUserCount = 0;
+        _wrIdNonce = 0;
+        while (_cipher && _wrIdNonce == 0) _wrIdNonce = storageCipherNonce();
+        _wrFailed = false;
+        _staging = true;
+
+        // Placeholders - an unfinished file never has a valid header
+        memset(&_wrBlock, 0, sizeof(_wrBlock));
+        WhitelistUsersHeader u;
+        memset(&u, 0, sizeof(u));
+        if (fwrite(&_wrBlock, 1, WL_BLOCK_SIZE, _wrBlocks) != WL_BLOCK_SIZE ||
+            fwrite(&u, 1, sizeof(u), _wrUsers) != sizeof(u)) {
+            abortStage();
+            return false;
+        }
+        return true;
+    }
+
+    bool append(const uint8_t* uid, uint8_t uidLen, const char* userId, uint16_t bioId, uint8_t role) {
+        if (!userId) return false;
+        WhitelistRecord* rec = nullptr;
+        int next = nextRecord(uid, uidLen, rec);
+        if (next <= 0) return next == 0;
+        if (!appendUser(userId)) return false;
+        rec->userIdx = (uint16_t)(_wrUserCount - 1);
+        rec->bioId = bioId;
+        rec->role = role;
+        rec->flags = whitelistFlagsForRole(role);
+        return pushRecord(*rec);
+    }
+
+    bool appendUser(const char* userId) {
+        if (!_staging || _wrFailed || !userId) return false;
+        if (_wrUserCount > UINT16_MAX) {
+            _wrFailed = true;
+            return false;
+        }
+        char id[WL_USER_ID_LEN] = {0};
+        memcpy(id, userId, strnlen(userId, WL_USER_ID_LEN - 1));
+        if (_wrIdNonce != 0) _cipher->apply(CIPHER_DOMAIN_WL_BLOCK, _wrIdNonce, (uint32_t)_wrUserCount, id, sizeof(id));
+        if (fwrite(id, 1, sizeof(id), _wrUsers) != sizeof(id)) {
+            _wrFailed = true;
+            return false;
+        }
+        _wrUserCount++;
+        return true;
+    }
+
+    bool appendRecord(const uint8_t* uid, uint8_t uidLen, uint16_t userIdx, uint16_t bioId, uint8_t role) {
+        if (userIdx >= _wrUserCount) {
+            _wrFailed = true;
+            return false;
+        }
+        WhitelistRecord* rec = nullptr;
+        int next = nextRecord(uid, uidLen, rec);
+        if (next <= 0) return next == 0;
+        rec->userIdx = userIdx;
+        rec->bioId = bioId;
+        rec->role = role;
+        rec->flags = whitelistFlagsForRole(role);
+        return pushRecord(*rec);
+    }
+
+    // Write the last block, the sparse index and both headers (block file
+    // header last). Does not change the live roster.
+    bool commitStage(uint32_t version) {
+        if (!_staging) return false;
+        if (_wrFailed || _wrUserCount > _wrCount ||
+            (_wrCount % WL_BLOCK_RECORDS != 0 && !flushBlock())) {
+            abortStage();
+            return false;
+        }
+
+        WhitelistBlockFileHeader& h = _wrHdr;
+        h.version = version;
+        h.count = _wrCount;
+        h.blockCount = (_wrCount + WL_BLOCK_RECORDS - 1) / WL_BLOCK_RECORDS;
+        h.userCount = _wrUserCount;
+        h.indexOffset = (h.blockCount + 1) * WL_BLOCK_SIZE;
+        size_t indexBytes = h.blockCount * sizeof(WhitelistBlockKey);
+        h.indexCrc = crc32Update(0, _wrIndex, indexBytes);
+        h.headerCrc = crc32Update(0, &h, offsetof(WhitelistBlockFileHeader, headerCrc));
+
+        WhitelistUsersHeader u;
+        memset(&u, 0, sizeof(u));
+        u.magic = WL_BLOCK_USERS;
+        u.generation = h.generation;
+        u.count = _wrUserCount;
+        u.idNonce = _wrIdNonce;
+
+        bool ok = (indexBytes == 0 || fwrite(_wrIndex, 1, indexBytes, _wrBlocks) == indexBytes) &&
+                  writeAt(_wrUsers, 0, &u, sizeof(u)) && fflush(_wrUsers) == 0;
+        ok = fclose(_wrUsers) == 0 && ok;
+        _wrUsers = nullptr;
+        // Header last - a valid .blk.new means both files are complete
+        ok = ok && writeAt(_wrBlocks, 0, &h, sizeof(h)) && fflush(_wrBlocks) == 0;
+        ok = fclose(_wrBlocks) == 0 && ok;
+        _wrBlocks = nullptr;
+        closeStage();
+        if (!ok) {
+            remove(_blkNewPath);
+            remove(_usrNewPath);
+            return false;
+        }
+        _staged = true;
+        return true;
+    }
+
+    // Drop a partly written roster. The live files are untouched.
+    void abortStage() {
+        bool had = _staging;
+        closeStage();
+        if (had) {
+            remove(_blkNewPath);
+            remove(_usrNewPath);
+        }
+        _wrFailed = false;
+    }
+
+    size_t stagedCount() const { return _staging ? _wrCount : 0; }
+
+    // Swap the staged files in. The caller must keep find()/userId() out
+    // until this returns.
+    bool activate() {
+        if (!_staged) return false;
+        _staged = false;
+        closeLive();
+        recover();
+        return load();
+    }
+
+    bool hasImage() const { return _valid; }
+    size_t slotCapacity() const { return (size_t)UINT16_MAX + 1; }
+    size_t count() const { return _valid ? _hdr.count : 0; }
+    uint32_t version() const { return _valid ? _hdr.version : 0; }
+    uint32_t generation() const { return _valid ? _hdr.generation : 0; }
+    uint32_t blockCount() const { return _valid ? _hdr.blockCount : 0; }
+    size_t indexBytes() const { return blockCount() * sizeof(WhitelistBlockKey); }
+    size_t fileBytes() const {
+        if (!_valid) return 0;
+        return _hdr.indexOffset + indexBytes() + sizeof(WhitelistUsersHeader) + (size_t)_hdr.userCount * WL_USER_ID_LEN;
+    }
+    uint32_t blockReads() const { return _blockReads; }
+    uint32_t cacheHits() const { return _cacheHits; }
+};
+
+#endif // WHITELIST_BLOCK_FILE_H
@@ -0,0 +1,650 @@
+#ifndef WHITELIST_IMAGE_H
+#define WHITELIST_IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include "WhitelistIndex.h"
+#include "BloomFilter.h"
+#include "FlashPartition.h"
+#include "Crc32.h"
+#include "StorageCipher.h"
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <thread>
+#endif
+
+// =============================================================================
+// WHITELIST FLASH IMAGE
+// One immutable, sorted binary image per slot in the `whitelist` partition.
+// Layout:  [header][records: max * WhitelistRecord][user IDs: max * 32][bloom]
+// (`max` is the capacity chosen when staging; `count` records are used)
+// Features:
+// - Two slots (A/B). Sync writes the inactive slot, header last.
+// - Records are appended in sorted order and flushed in small batches, so a
+//   roster streams into flash without being held in RAM.
+// - The valid header with the highest generation is live after reboot.
+// - Lookups binary search the memory-mapped image (no copy into RAM).
+// - Bloom filter of all UIDs, copied to RAM at mount, rejects strangers
+//   without touching flash.
+// - Lock-free reads: taps pin the live slot with a per-slot reader count and
+//   the writer flips one atomic slot index (see WhitelistStore::Reader).
+// - With setCipher(), user IDs are stored encrypted (WL_IMAGE_ENCRYPTED_IDS)
+//   and userId() decrypts the one asked for. Card UIDs stay plaintext: the
+//   binary search and bloom filter run on them.
+// =============================================================================
+
+#define WL_IMAGE_MAGIC  0x4D494C57  // "WLIM"
+#define WL_IMAGE_FORMAT 4
+
+#define WL_IMAGE_ENCRYPTED_IDS 0x01  // Header flag: user IDs under StorageCipher
+
+#define WL_WRITE_BATCH      16     // Records buffered per flash write
+#define WL_MAX_SLOT_SECTORS 1024   // Erase-tracking limit (4 MB slot)
+
+struct WhitelistImageHeader {
+    uint32_t magic;
+    uint16_t format;
+    uint16_t headerSize;
+    uint32_t generation;      // Incremented on every commit
+    uint32_t version;         // Server whitelist version this image reflects (0 = unknown)
+    uint32_t count;           // Number of records
+    uint32_t recordsOffset;   // From start of slot
+    uint32_t userIdsOffset;   // From start of slot; the table runs up to bloomOffset
+    uint32_t bloomOffset;     // From start of slot
+    uint32_t bloomBits;       // Filter size in bits (multiple of 32)
+    uint8_t bloomHashes;      // Hash functions per key
+    uint8_t flags;            // WL_IMAGE_* (0 in images written before there were any)
+    uint16_t idNonce;         // Random per stage; with generation, the user-ID cipher IV
+    uint32_t imageSize;       // Header + body, in bytes
+    uint32_t bodyCrc;         // CRC32 of the record, user ID and bloom region CRCs
+    uint32_t headerCrc;       // CRC32 of the fields above
+};
+
+// Read-only view over a mapped image
+class WhitelistImage {
+private:
+    const WhitelistImageHeader* _hdr = nullptr;
+    const WhitelistRecord* _records = nullptr;
+    const char* _userIds = nullptr;
+    const uint8_t* _bloom = nullptr;
+    size_t _count = 0;
+    size_t _users = 0;        // User ID table slots (can exceed _count, see commitStage)
+    const StorageCipher* _cipher = nullptr;
+
+public:
+    // Cheap structural check - the body CRC is verified once, at commit time
+    static bool validHeader(const WhitelistImageHeader& h, size_t slotSize) {
+        if (h.magic != WL_IMAGE_MAGIC || h.format != WL_IMAGE_FORMAT) return false;
+        if (h.headerSize != sizeof(WhitelistImageHeader)) return false;
+        if (h.headerCrc != crc32Update(0, &h, offsetof(WhitelistImageHeader, headerCrc))) return false;
+        if (h.imageSize > slotSize) return false;
+        if (h.recordsOffset + (uint64_t)h.count * sizeof(WhitelistRecord) > h.imageSize) return false;
+        if (h.userIdsOffset > h.bloomOffset) return false;
+        if (h.userIdsOffset + (uint64_t)h.count * WL_USER_ID_LEN > h.bloomOffset) return false;
+        if (h.bloomBits % 32 || h.bloomOffset + (uint64_t)h.bloomBits / 8 > h.imageSize) return false;
+        return true;
+    }
+
+    // `cipher` decrypts the user IDs of an image that has them encrypted
+    bool attach(const uint8_t* base, size_t size, const StorageCipher* cipher = nullptr) {
+        detach();
+        if (!base || size < sizeof(WhitelistImageHeader)) return false;
+        const WhitelistImageHeader* h = (const WhitelistImageHeader*)base;
+        if (!validHeader(*h, size)) return false;
+        _hdr = h;
+        _cipher = cipher;
+        _records = (const WhitelistRecord*)(base + h->recordsOffset);
+        _userIds = (const char*)(base + h->userIdsOffset);
+        _bloom = base + h->bloomOffset;
+        _count = h->count;
+        _users = (h->bloomOffset - h->userIdsOffset) / WL_USER_ID_LEN;
+        return true;
+    }
+
+    void detach() {
+        _hdr = nullptr;
+        _records = nullptr;
+        _userIds = nullptr;
+        _bloom = nullptr;
+        _count = 0;
+        _users = 0;
+        _cipher = nullptr;
+    }
+
+    // Cipher IV of user ID `userIdx` (see WhitelistStore::appendUser)
+    static uint32_t idIv(uint16_t idNonce, uint16_t userIdx) { return ((uint32_t)idNonce << 16) | userIdx; }
+
+    // Point the filter at a RAM copy of the bloom bits (same contents)
+    void useBloomCopy(const uint8_t* bits) { if (_hdr && bits) _bloom = bits; }
+
+    // False = definitely not whitelisted. True = run find().
+    bool mightContain(const uint8_t* uid, uint8_t uidLen) const {
+        if (!_hdr) return false;
+        return BloomFilter::mightContain(_bloom, _hdr->bloomBits, _hdr->bloomHashes, uid, uidLen);
+    }
+
+    bool isValid() const { return _hdr != nullptr; }
+
+    const WhitelistRecord* find(const uint8_t* uid, uint8_t uidLen) const {
+        return WhitelistIndex::search(_records, _count, uid, uidLen);
+    }
+
+    // Copy out (and decrypt) the user ID of a record. False, with `out`
+    // empty, if there is none or it is encrypted and no cipher was given.
+    bool userId(const WhitelistRecord* rec, char* out, size_t size) const {
+        if (!rec) {
+            if (size > 0) out[0] = '\0';
+            return false;
+        }
+        return userIdAt(rec->userIdx, out, size);
+    }
+
+    // User ID by table index (as logged in an AccessLogRecord)
+    bool userIdAt(uint16_t userIdx, char* out, size_t size) const {
+        if (size == 0) return false;
+        out[0] = '\0';
+        if (userIdx >= _users) return false;
+        char id[WL_USER_ID_LEN];
+        memcpy(id, _userIds + (size_t)userIdx * WL_USER_ID_LEN, sizeof(id));
+        if (_hdr->flags & WL_IMAGE_ENCRYPTED_IDS) {
+            if (!_cipher) return false;
+            _cipher->apply(CIPHER_DOMAIN_WL_IMAGE, _hdr->generation, idIv(_hdr->idNonce, userIdx), id, sizeof(id));
+        }
+        id[sizeof(id) - 1] = '\0';
+        size_t n = strnlen(id, size - 1);
+        memcpy(out, id, n);
+        out[n] = '\0';
+        return true;
+    }
+
+    size_t count() const { return _count; }
+    const WhitelistRecord* records() const { return _records; }
+    uint32_t generation() const { return _hdr ? _hdr->generation : 0; }
+    uint32_t version() const { return _hdr ? _hdr->version : 0; }
+    uint32_t imageSize() const { return _hdr ? _hdr->imageSize : 0; }
+    uint32_t bloomBits() const { return _hdr ? _hdr->bloomBits : 0; }
+    uint8_t bloomHashes() const { return _hdr ? _hdr->bloomHashes : 0; }
+    bool encryptedIds() const { return _hdr && (_hdr->flags & WL_IMAGE_ENCRYPTED_IDS); }
+    float bloomFalsePositiveRate() const {
+        return _hdr ? BloomFilter::falsePositiveRate(_count, _hdr->bloomBits, _hdr->bloomHashes) : 0.0f;
+    }
+};
+
+// A/B slot manager over the raw partition.
+// One writer (the sync task) stages and activates; any number of readers
+// look up through Reader without locks.
+class WhitelistStore {
+private:
+    FlashPartition& _part;
+    size_t _slotSize = 0;
+    FlashMapping _maps[2];
+    WhitelistImage _images[2];
+    uint8_t* _bloomRam[2] = {nullptr, nullptr};
+    int _active = -1;                      // Writer's view
+    int _staged = -1;
+    std::atomic<int> _live{-1};            // Readers' view, flipped by activate()
+    std::atomic<uint32_t> _readers[2];     // Readers currently pinning each slot
+    const StorageCipher* _cipher = nullptr;
+
+    // Image being written (see beginStage)
+    int _wrSlot = -1;
+    WhitelistImageHeader _wrHdr;
+    size_t _wrMax = 0;
+    size_t _wrCount = 0;
+    size_t _wrFlushed = 0;
+    size_t _wrUsers = 0;
+    size_t _wrUsersFlushed = 0;
+    bool _wrFailed = false;
+    uint32_t _wrRecordsCrc = 0;
+    uint32_t _wrUserIdsCrc = 0;
+    WhitelistRecord _wrLast;
+    WhitelistRecord _wrRecords[WL_WRITE_BATCH];
+    char _wrUserIds[WL_WRITE_BATCH][WL_USER_ID_LEN];
+    uint32_t _erased[WL_MAX_SLOT_SECTORS / 32];
+
+    size_t slotOffset(int slot) const { return (size_t)slot * _slotSize; }
+
+    // Pin the live slot. The re-check closes the race with a flip that
+    // happened between the load and the increment.
+    int pin() {
+        for (;;) {
+            int slot = _live.load();
+            if (slot < 0) return -1;
+            _readers[slot].fetch_add(1);
+            if (_live.load() == slot) return slot;
+            _readers[slot].fetch_sub(1);
+        }
+    }
+
+    void unpin(int slot) {
+        if (slot >= 0) _readers[slot].fetch_sub(1);
+    }
+
+    // Readers finish in microseconds; the writer only waits after a flip
+    void waitForReaders(int slot) {
+        while (_readers[slot].load() != 0) {
+#ifdef ESP_PLATFORM
+            vTaskDelay(1);
+#else
+            std::this_thread::yield();
+#endif
+        }
+    }
+
+    void unmapSlot(int slot) {
+        _part.unmap(_maps[slot]);
+        _images[slot].detach();
+        free(_bloomRam[slot]);
+        _bloomRam[slot] = nullptr;
+    }
+
+    bool mapSlot(int slot) {
+        unmapSlot(slot);
+
+        WhitelistImageHeader h;
+        if (!_part.read(slotOffset(slot), &h, sizeof(h))) return false;
+        if (!WhitelistImage::validHeader(h, _slotSize)) return false;
+        if (!_part.map(slotOffset(slot), h.imageSize, _maps[slot])) return false;
+        if (!_images[slot].attach(_maps[slot].data, _maps[slot].size, _cipher)) return false;
+
+        // Keep the (small) bloom filter in RAM; fall back to the mapped copy
+        size_t bloomBytes = h.bloomBits / 8;
+        _bloomRam[slot] = (uint8_t*)malloc(bloomBytes ? bloomBytes : 1);
+        if (_bloomRam[slot]) {
+            memcpy(_bloomRam[slot], _maps[slot].data + h.bloomOffset, bloomBytes);
+            _images[slot].useBloomCopy(_bloomRam[slot]);
+        }
+        return true;
+    }
+
+    // Write into the slot being staged, erasing each sector on first touch
+    bool writeSlot(size_t offset, const void* data, size_t len) {
+        size_t base = slotOffset(_wrSlot);
+        for (size_t s = offset / FLASH_SECTOR_SIZE; s * FLASH_SECTOR_SIZE < offset + len; s++) {
+            if (!(_erased[s / 32] & (1u << (s % 32)))) {
+                if (!_part.erase(base + s * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE)) return false;
+                _erased[s / 32] |= 1u << (s % 32);
+            }
+        }
+        return len == 0 || _part.write(base + offset, data, len);
+    }
+
+    bool flushRecords() {
+        size_t n = _wrCount - _wrFlushed;
+        if (n == 0) return true;
+        if (!writeSlot(_wrHdr.recordsOffset + _wrFlushed * sizeof(WhitelistRecord),
+                       _wrRecords, n * sizeof(WhitelistRecord))) {
+            return false;
+        }
+        _wrRecordsCrc = crc32Update(_wrRecordsCrc, _wrRecords, n * sizeof(WhitelistRecord));
+        _wrFlushed = _wrCount;
+        return true;
+    }
+
+    bool flushUsers() {
+        size_t n = _wrUsers - _wrUsersFlushed;
+        if (n == 0) return true;
+        if (!writeSlot(_wrHdr.userIdsOffset + _wrUsersFlushed * WL_USER_ID_LEN, _wrUserIds, n * WL_USER_ID_LEN)) {
+            return false;
+        }
+        _wrUserIdsCrc = crc32Update(_wrUserIdsCrc, _wrUserIds, n * WL_USER_ID_LEN);
+        _wrUsersFlushed = _wrUsers;
+        return true;
+    }
+
+    // Slot in the record batch for the next key: 1 = use it, 0 = repeated
+    // card (skip), -1 = out of order or full (fails the stage)
+    int nextRecord(const uint8_t* uid, uint8_t uidLen, WhitelistRecord*& out) {
+        if (_wrSlot < 0 || _wrFailed) return -1;
+        if (!uid || uidLen == 0 || uidLen > WL_UID_MAX_LEN) return -1;
+
+        WhitelistRecord& rec = _wrRecords[_wrCount - _wrFlushed];
+        memset(&rec, 0, sizeof(rec));
+        memcpy(rec.uid, uid, uidLen);
+        rec.uidLen = uidLen;
+        if (_wrCount > 0) {
+            int c = WhitelistIndex::compareKey(rec.uid, rec.uidLen, _wrLast);
+            if (c == 0) return 0;
+            if (c < 0) {
+                _wrFailed = true;
+                return -1;
+            }
+        }
+        if (_wrCount >= _wrMax) {
+            _wrFailed = true;
+            return -1;
+        }
+        out = &rec;
+        return 1;
+    }
+
+    bool pushRecord(const WhitelistRecord& rec) {
+        _wrLast = rec;
+        _wrCount++;
+        if (_wrCount - _wrFlushed == WL_WRITE_BATCH && !flushRecords()) {
+            _wrFailed = true;
+            return false;
+        }
+        return true;
+    }
+
+    // CRC of a region as read back from flash
+    uint32_t flashCrc(size_t offset, size_t len) {
+        uint8_t buf[256];
+        uint32_t crc = 0;
+        while (len > 0) {
+            size_t n = len < sizeof(buf) ? len : sizeof(buf);
+            if (!_part.read(offset, buf, n)) return 0;
+            crc = crc32Update(crc, buf, n);
+            offset += n;
+            len -= n;
+        }
+        return crc;
+    }
+
+public:
+    // Lock-free read access to the live image. Keeps that slot mapped (the
+    // writer won't restage it) until destroyed; hold it only for a lookup.
+    class Reader {
+    private:
+        WhitelistStore& _store;
+        int _slot;
+
+    public:
+        explicit Reader(WhitelistStore& store) : _store(store), _slot(store.pin()) {}
+        ~Reader() { _store.unpin(_slot); }
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        const WhitelistImage& image() const {
+            static const WhitelistImage empty;
+            return _slot >= 0 ? _store._images[_slot] : empty;
+        }
+        int slot() const { return _slot; }
+    };
+
+    // Sequential read of the live image for delta merges (the sync task).
+    // Same interface as WhitelistBlockStore::Cursor.
+    class Cursor {
+    private:
+        const WhitelistImage& _image;
+        size_t _pos = 0;
+        bool _error = false;
+
+    public:
+        explicit Cursor(const WhitelistStore& store) : _image(store.active()) {}
+
+        // False at the end, or for a user ID that cannot be decrypted
+        bool next(WhitelistRecord& rec, char* userId) {
+            if (_error || _pos >= _image.count()) return false;
+            const WhitelistRecord* r = &_image.records()[_pos++];
+            rec = *r;
+            if (!_image.userId(r, userId, WL_USER_ID_LEN)) {
+                _error = true;
+                return false;
+            }
+            return true;
+        }
+
+        bool failed() const { return _error; }
+    };
+
+    explicit WhitelistStore(FlashPartition& part) : _part(part) {
+        _readers[0] = 0;
+        _readers[1] = 0;
+    }
+    ~WhitelistStore() {
+        unmapSlot(0);
+        unmapSlot(1);
+    }
+
+    // Encrypt the user IDs of images staged from now on (nullptr: plaintext)
+    // and decrypt those of encrypted ones. Set it before begin().
+    void setCipher(const StorageCipher* cipher) { _cipher = cipher; }
+
+    // Map both slots and select the newest valid one. Cost does not depend on roster size.
+    bool begin() {
+        _slotSize = (_part.size() / 2) & ~(size_t)(FLASH_SECTOR_SIZE - 1);
+        if (_slotSize > (size_t)WL_MAX_SLOT_SECTORS * FLASH_SECTOR_SIZE) {
+            _slotSize = (size_t)WL_MAX_SLOT_SECTORS * FLASH_SECTOR_SIZE;
+        }
+        if (_slotSize < FLASH_SECTOR_SIZE) return false;
+
+        _active = -1;
+        _staged = -1;
+        for (int slot = 0; slot < 2; slot++) {
+            if (mapSlot(slot) &&
+                (_active < 0 || _images[slot].generation() > _images[_active].generation())) {
+                _active = slot;
+            }
+        }
+        _live.store(_active);
+        return true;
+    }
+
+    // Start a new image in the inactive slot with room for `maxEntries`.
+    // Follow with append() in sorted order, then commitStage().
+    bool beginStage(size_t maxEntries) {
+        if (_slotSize == 0) return false;
+        if (maxEntries > slotCapacity()) return false;
+        if (maxEntries > (size_t)UINT16_MAX + 1) return false;  // userIdx is 16 bits
+
+        int slot = (_active == 0) ? 1 : 0;
+        _staged = -1;
+        waitForReaders(slot);  // Taps that started before the last flip
+        unmapSlot(slot);
+
+        WhitelistImageHeader& h = _wrHdr;
+        memset(&h, 0, sizeof(h));
+        h.magic = WL_IMAGE_MAGIC;
+        h.format = WL_IMAGE_FORMAT;
+        h.headerSize = sizeof(WhitelistImageHeader);
+        h.generation = (_active >= 0 ? _images[_active].generation() : 0) + 1;
+        h.recordsOffset = sizeof(WhitelistImageHeader);
+        h.userIdsOffset = h.recordsOffset + maxEntries * sizeof(WhitelistRecord);
+        h.bloomOffset = h.userIdsOffset + maxEntries * WL_USER_ID_LEN;
+        h.bloomHashes = BLOOM_HASHES;
+        if (_cipher) {
+            h.flags = WL_IMAGE_ENCRYPTED_IDS;
+            h.idNonce = (uint16_t)storageCipherNonce();  // A retried stage reuses the generation
+        }
+
+        _wrSlot = slot;
+        _wrMax = maxEntries;
+        _wrCount = 0;
+        _wrFlushed = 0;
+        _wrUsers = 0;
+        _wrUsersFlushed = 0;
+        _wrFailed = false;
+        _wrRecordsCrc = 0;
+        _wrUserIdsCrc = 0;
+        memset(_erased, 0, sizeof(_erased));
+
+        // Invalidate the slot first so a power cut leaves the other slot live
+        if (!_part.erase(slotOffset(slot), FLASH_SECTOR_SIZE)) {
+            _wrSlot = -1;
+            return false;
+        }
+        _erased[0] = 1;
+        return true;
+    }
+
+    // Add the next record with its own user ID. Keys must not decrease; a
+    // repeated card keeps its first entry. Out-of-order input or a full slot
+    // fails the whole stage.
+    bool append(const uint8_t* uid, uint8_t uidLen, const char* userId, uint16_t bioId, uint8_t role) {
+        if (!userId) return false;
+        WhitelistRecord* rec = nullptr;
+        int next = nextRecord(uid, uidLen, rec);
+        if (next <= 0) return next == 0;
+        if (_wrUsers > UINT16_MAX || !appendUser(userId)) return false;
+        rec->userIdx = (uint16_t)(_wrUsers - 1);
+        rec->bioId = bioId;
+        rec->role = role;
+        rec->flags = whitelistFlagsForRole(role);
+        return pushRecord(*rec);
+    }
+
+    // Next entry of an interned user-ID table (binary sync). Records then
+    // refer to it by position with appendRecord().
+    bool appendUser(const char* userId) {
+        if (_wrSlot < 0 || _wrFailed || !userId) return false;
+        if (_wrUsers >= _wrMax) {
+            _wrFailed = true;
+            return false;
+        }
+        char* id = _wrUserIds[_wrUsers - _wrUsersFlushed];
+        memset(id, 0, WL_USER_ID_LEN);
+        memcpy(id, userId, strnlen(userId, WL_USER_ID_LEN - 1));
+        if (_wrHdr.flags & WL_IMAGE_ENCRYPTED_IDS) {
+            _cipher->apply(CIPHER_DOMAIN_WL_IMAGE, _wrHdr.generation,
+                           WhitelistImage::idIv(_wrHdr.idNonce, (uint16_t)_wrUsers), id, WL_USER_ID_LEN);
+        }
+        _wrUsers++;
+        if (_wrUsers - _wrUsersFlushed == WL_WRITE_BATCH && !flushUsers()) {
+            _wrFailed = true;
+            return false;
+        }
+        return true;
+    }
+
+    // Add the next record, owned by a user already given to appendUser()
+    bool appendRecord(const uint8_t* uid, uint8_t uidLen, uint16_t userIdx, uint16_t bioId, uint8_t role) {
+        if (userIdx >= _wrUsers) {
+            _wrFailed = true;
+            return false;
+        }
+        WhitelistRecord* rec = nullptr;
+        int next = nextRecord(uid, uidLen, rec);
+        if (next <= 0) return next == 0;
+        rec->userIdx = userIdx;
+        rec->bioId = bioId;
+        rec->role = role;
+        rec->flags = whitelistFlagsForRole(role);
+        return pushRecord(*rec);
+    }
+
+    // Build the bloom filter from the written records, verify the body and
+    // write the header. Does not change the live image.
+    bool commitStage(uint32_t version) {
+        if (_wrSlot < 0) return false;
+        int slot = _wrSlot;
+        // The user table may hold more IDs than there are records: a binary
+        // roster interns the users of rows that are then skipped (repeated card)
+        if (_wrFailed || !flushRecords() || !flushUsers()) {
+            abortStage();
+            return false;
+        }
+
+        WhitelistImageHeader& h = _wrHdr;
+        h.version = version;
+        h.count = _wrCount;
+        h.bloomBits = BloomFilter::bitsFor(_wrCount);
+        size_t bloomBytes = BloomFilter::bytesFor(h.bloomBits);
+        h.imageSize = h.bloomOffset + bloomBytes;
+        if (h.imageSize > _slotSize) {
+            abortStage();
+            return false;
+        }
+
+        // Second pass over the records as read back: bloom bits + write check
+        uint8_t* bloom = (uint8_t*)calloc(1, bloomBytes);
+        if (!bloom) {
+            abortStage();
+            return false;
+        }
+        uint32_t recordsCrc = 0;
+        bool ok = true;
+        for (size_t i = 0; ok && i < _wrCount; i += WL_WRITE_BATCH) {
+            size_t n = _wrCount - i < WL_WRITE_BATCH ? _wrCount - i : WL_WRITE_BATCH;
+            ok = _part.read(slotOffset(slot) + h.recordsOffset + i * sizeof(WhitelistRecord),
+                            _wrRecords, n * sizeof(WhitelistRecord));
+            recordsCrc = crc32Update(recordsCrc, _wrRecords, n * sizeof(WhitelistRecord));
+            for (size_t j = 0; j < n; j++) {
+                BloomFilter::add(bloom, h.bloomBits, h.bloomHashes, _wrRecords[j].uid, _wrRecords[j].uidLen);
+            }
+        }
+        uint32_t bloomCrc = crc32Update(0, bloom, bloomBytes);
+        ok = ok && recordsCrc == _wrRecordsCrc &&
+             flashCrc(slotOffset(slot) + h.userIdsOffset, _wrUsers * WL_USER_ID_LEN) == _wrUserIdsCrc &&
+             writeSlot(h.bloomOffset, bloom, bloomBytes) &&
+             flashCrc(slotOffset(slot) + h.bloomOffset, bloomBytes) == bloomCrc;
+        free(bloom);
+        if (!ok) {
+            abortStage();
+            return false;
+        }
+
+        uint32_t regionCrcs[3] = { _wrRecordsCrc, _wrUserIdsCrc, bloomCrc };
+        h.bodyCrc = crc32Update(0, regionCrcs, sizeof(regionCrcs));
+        h.headerCrc = crc32Update(0, &h, offsetof(WhitelistImageHeader, headerCrc));
+
+        // Header last - this is the commit point across reboots
+        _wrSlot = -1;
+        if (!_part.write(slotOffset(slot), &h, sizeof(h))) return false;
+        if (!mapSlot(slot)) return false;
+
+        _staged = slot;
+        return true;
+    }
+
+    // Drop a partly written image. The slot stays invalid; the live one is untouched.
+    void abortStage() {
+        _wrSlot = -1;
+        _wrFailed = false;
+    }
+
+    size_t stagedCount() const { return _wrSlot >= 0 ? _wrCount : 0; }
+
+    // Write a sorted `index` to the inactive slot and verify it. Does not change the live image.
+    bool stage(const WhitelistIndex& index, uint32_t version) {
+        if (!beginStage(index.count())) return false;
+        const WhitelistRecord* records = index.records();
+        for (size_t i = 0; i < index.count(); i++) {
+            if (!append(records[i].uid, records[i].uidLen, index.userId(&records[i]),
+                        records[i].bioId, records[i].role)) {
+                abortStage();
+                return false;
+            }
+        }
+        return commitStage(version);
+    }
+
+    // Make the staged slot the live image for lookups: a single atomic store.
+    // Readers already inside the old slot finish on it.
+    void activate() {
+        if (_staged >= 0) {
+            _active = _staged;
+            _staged = -1;
+            _live.store(_active);
+        }
+    }
+
+    // Writer-side view of the live image (the sync task). Other tasks use Reader.
+    const WhitelistImage& active() const {
+        static const WhitelistImage empty;
+        return _active >= 0 ? _images[_active] : empty;
+    }
+
+    bool hasImage() const { return _active >= 0; }
+    size_t count() const { return active().count(); }
+    uint32_t version() const { return active().version(); }
+    uint32_t generation() const { return active().generation(); }
+    int activeSlot() const { return _active; }
+    size_t slotCapacity() const {
+        size_t overhead = sizeof(WhitelistImageHeader) + BLOOM_MIN_BITS / 8 + 4;  // + bloom rounding
+        if (_slotSize <= overhead) return 0;
+        // Records + user IDs + BLOOM_BITS_PER_ENTRY bits of filter per entry
+        return (_slotSize - overhead) * 8 /
+               ((sizeof(WhitelistRecord) + WL_USER_ID_LEN) * 8 + BLOOM_BITS_PER_ENTRY);
+    }
+};
+
+#endif // WHITELIST_IMAGE_H
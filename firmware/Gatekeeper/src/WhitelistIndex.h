@@ -0,0 +1,224 @@
+#ifndef WHITELIST_INDEX_H
+#define WHITELIST_INDEX_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+// =============================================================================
+// WHITELIST INDEX
+// Sorted array of card UIDs. Built in RAM during sync, then written out as a
+// flash image (see WhitelistImage.h) which the tap path searches in place.
+// Features:
+// - Raw UID bytes (no hex formatting or string keys)
+// - Fixed-size records, binary search lookup
+// - No NVS I/O and no heap allocation per lookup
+// - Plain C++ (no Arduino dependencies) so it can be benchmarked on the host
+// =============================================================================
+
+#define WL_UID_MAX_LEN 7     // PN532 ISO14443A reads are at most 7 bytes
+#define WL_USER_ID_LEN 32    // 31 chars + null terminator (matches AccessLog)
+
+// Server `role` values (mobile/convex/schema.ts), as sent on the binary wire
+// and stored per card
+enum WhitelistRole : uint8_t {
+    WL_ROLE_NONE = 0,
+    WL_ROLE_STUDENT = 1,
+    WL_ROLE_TEACHER = 2,
+    WL_ROLE_STAFF = 3,
+    WL_ROLE_ADMIN = 4,
+    WL_ROLE_LEGACY = 0x80   // Device only: migrated from the NVS whitelist, role unknown
+};
+
+inline WhitelistRole whitelistRoleFromName(const char* name) {
+    if (!name) return WL_ROLE_NONE;
+    if (strcmp(name, "student") == 0) return WL_ROLE_STUDENT;
+    if (strcmp(name, "teacher") == 0) return WL_ROLE_TEACHER;
+    if (strcmp(name, "staff") == 0) return WL_ROLE_STAFF;
+    if (strcmp(name, "admin") == 0) return WL_ROLE_ADMIN;
+    return WL_ROLE_NONE;
+}
+
+#define WL_FLAG_REQUIRE_BIO 0x01  // Card alone is not enough - match bioId first
+
+// Access policy per role. Unknown roles get the strict path; migrated
+// entries keep the old firmware's card-only access until the first sync.
+inline uint8_t whitelistFlagsForRole(uint8_t role) {
+    switch (role) {
+        case WL_ROLE_TEACHER:
+        case WL_ROLE_STAFF:
+        case WL_ROLE_ADMIN:
+        case WL_ROLE_LEGACY:
+            return 0;
+        default:
+            return WL_FLAG_REQUIRE_BIO;
+    }
+}
+
+// Everything a tap needs, in one fixed-size record per card
+struct WhitelistRecord {
+    uint8_t uid[WL_UID_MAX_LEN];  // Zero-padded raw UID bytes
+    uint8_t uidLen;
+    uint16_t userIdx;             // Index into the user ID table
+    uint16_t bioId;               // Expected biometric template (0 = none)
+    uint8_t role;                 // WhitelistRole
+    uint8_t flags;                // WL_FLAG_*
+    uint8_t reserved[2];
+};
+
+static_assert(sizeof(WhitelistRecord) == 16, "WhitelistRecord is part of the flash image format");
+
+class WhitelistIndex {
+private:
+    WhitelistRecord* _records = nullptr;
+    char (*_userIds)[WL_USER_ID_LEN] = nullptr;
+    size_t _count = 0;
+    size_t _capacity = 0;
+
+    static int hexNibble(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    }
+
+public:
+    // Orders by padded UID bytes, then by length
+    static int compareKey(const uint8_t* uid, uint8_t uidLen, const WhitelistRecord& rec) {
+        int c = memcmp(uid, rec.uid, WL_UID_MAX_LEN);
+        if (c != 0) return c;
+        return (int)uidLen - (int)rec.uidLen;
+    }
+
+    // Binary search over a sorted record array (RAM or memory-mapped flash)
+    static const WhitelistRecord* search(const WhitelistRecord* records, size_t count,
+                                         const uint8_t* uid, uint8_t uidLen) {
+        if (!records || !uid || uidLen == 0 || uidLen > WL_UID_MAX_LEN) return nullptr;
+
+        uint8_t key[WL_UID_MAX_LEN] = {0};
+        memcpy(key, uid, uidLen);
+
+        size_t lo = 0, hi = count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            int c = compareKey(key, uidLen, records[mid]);
+            if (c == 0) return &records[mid];
+            if (c < 0) hi = mid;
+            else lo = mid + 1;
+        }
+        return nullptr;
+    }
+
+    WhitelistIndex() {}
+    ~WhitelistIndex() { release(); }
+
+    WhitelistIndex(const WhitelistIndex&) = delete;
+    WhitelistIndex& operator=(const WhitelistIndex&) = delete;
+
+    // Allocate storage for up to `capacity` entries. Call once per build.
+    bool reserve(size_t capacity) {
+        release();
+        if (capacity == 0) return true;
+
+        _records = (WhitelistRecord*)malloc(capacity * sizeof(WhitelistRecord));
+        _userIds = (char (*)[WL_USER_ID_LEN])malloc(capacity * WL_USER_ID_LEN);
+        if (!_records || !_userIds) {
+            release();
+            return false;
+        }
+        _capacity = capacity;
+        return true;
+    }
+
+    void release() {
+        free(_records);
+        free(_userIds);
+        _records = nullptr;
+        _userIds = nullptr;
+        _count = 0;
+        _capacity = 0;
+    }
+
+    // Append an entry. Call finalize() once all entries are added.
+    bool add(const uint8_t* uid, uint8_t uidLen, const char* userId, uint16_t bioId,
+             uint8_t role = WL_ROLE_NONE) {
+        if (!uid || !userId || uidLen == 0 || uidLen > WL_UID_MAX_LEN) return false;
+        if (_count >= _capacity || _count > UINT16_MAX) return false;
+
+        WhitelistRecord& rec = _records[_count];
+        memset(&rec, 0, sizeof(rec));
+        memcpy(rec.uid, uid, uidLen);
+        rec.uidLen = uidLen;
+        rec.userIdx = (uint16_t)_count;
+        rec.bioId = bioId;
+        rec.role = role;
+        rec.flags = whitelistFlagsForRole(role);
+
+        size_t idLen = strnlen(userId, WL_USER_ID_LEN - 1);
+        memcpy(_userIds[_count], userId, idLen);
+        _userIds[_count][idLen] = '\0';
+
+        _count++;
+        return true;
+    }
+
+    // Append an entry keyed by a hex UID string ("04A1B2C3" or "04:A1:B2:C3")
+    bool addHex(const char* hexUid, const char* userId, uint16_t bioId, uint8_t role = WL_ROLE_NONE) {
+        uint8_t uid[WL_UID_MAX_LEN];
+        uint8_t len = parseHexUid(hexUid, uid, sizeof(uid));
+        return len > 0 && add(uid, len, userId, bioId, role);
+    }
+
+    // Sort records so find() can binary search
+    void finalize() {
+        std::sort(_records, _records + _count,
+            [](const WhitelistRecord& a, const WhitelistRecord& b) {
+                return compareKey(a.uid, a.uidLen, b) < 0;
+            });
+    }
+
+    // Binary search for a card. Returns nullptr if not whitelisted.
+    const WhitelistRecord* find(const uint8_t* uid, uint8_t uidLen) const {
+        return search(_records, _count, uid, uidLen);
+    }
+
+    const char* userId(const WhitelistRecord* rec) const {
+        if (!rec || rec->userIdx >= _count) return "";
+        return _userIds[rec->userIdx];
+    }
+
+    void swap(WhitelistIndex& other) {
+        std::swap(_records, other._records);
+        std::swap(_userIds, other._userIds);
+        std::swap(_count, other._count);
+        std::swap(_capacity, other._capacity);
+    }
+
+    size_t count() const { return _count; }
+    const WhitelistRecord* records() const { return _records; }
+    const char* userIdTable() const { return (const char*)_userIds; }
+    size_t memoryUsage() const { return _capacity * (sizeof(WhitelistRecord) + WL_USER_ID_LEN); }
+
+    // Parse a hex UID, ignoring ':' and ' ' separators. Returns byte count (0 on error).
+    static uint8_t parseHexUid(const char* hex, uint8_t* out, uint8_t maxLen) {
+        if (!hex || !out) return 0;
+        uint8_t len = 0;
+        int hi = -1;
+        for (const char* p = hex; *p; p++) {
+            if (*p == ':' || *p == ' ') continue;
+            int n = hexNibble(*p);
+            if (n < 0) return 0;
+            if (hi < 0) {
+                hi = n;
+            } else {
+                if (len >= maxLen) return 0;
+                out[len++] = (uint8_t)((hi << 4) | n);
+                hi = -1;
+            }
+        }
+        return hi < 0 ? len : 0;
+    }
+};
+
+#endif // WHITELIST_INDEX_H
@@ -0,0 +1,309 @@
+#ifndef WHITELIST_STREAM_H
+#define WHITELIST_STREAM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "WhitelistIndex.h"
+
+// =============================================================================
+// WHITELIST STREAM PARSER
+// Incremental parser for the /api/whitelist response. Bytes are fed as they
+// come off the socket and every entry is handed to a sink as soon as its
+// closing brace arrives - neither the body nor a JSON tree is held in RAM.
+// Features:
+// - Fixed memory: one token buffer and a shallow container stack
+// - Any chunking (down to single bytes) and any key order
+// - Unknown keys and nested values are skipped, as are entries without a
+//   valid UID or user ID
+// - Plain C++ (no Arduino dependencies) so it can be tested on the host
+// =============================================================================
+
+#define WL_STREAM_TOKEN_LEN 48   // Longest string/number kept (longer ones are dropped)
+#define WL_STREAM_KEY_LEN   16
+#define WL_STREAM_MAX_DEPTH 8
+#define WL_STREAM_UID_LEN   24   // "04:A1:B2:C3:D4:E5:F6" + null
+
+enum WhitelistSection : uint8_t {
+    WL_SECTION_NONE = 0,
+    WL_SECTION_ENTRIES,   // Full roster
+    WL_SECTION_ADDS,      // Delta: new or changed entries
+    WL_SECTION_REMOVES    // Delta: card UIDs to drop
+};
+
+// One roster/delta entry as decoded from either wire format
+struct WhitelistStreamEntry {
+    uint8_t uid[WL_UID_MAX_LEN];
+    uint8_t uidLen;
+    uint8_t role;        // WhitelistRole
+    uint16_t bioId;
+    uint16_t userIdx;    // Binary: position in the interned user table
+    const char* sid;     // JSON: inline user ID (nullptr for binary)
+};
+
+// Receives entries as they are decoded. Returning false aborts the decode.
+// Shared by the JSON parser below and the binary decoder (WhitelistBinary.h).
+class WhitelistStreamSink {
+public:
+    virtual ~WhitelistStreamSink() {}
+    // Binary only: the interned user table, in order, before any entry
+    virtual bool onUser(WhitelistSection, const char*) { return true; }
+    virtual bool onEntry(WhitelistSection section, const WhitelistStreamEntry& entry) = 0;
+    virtual bool onRemove(const uint8_t* uid, uint8_t uidLen) = 0;
+};
+
+class WhitelistStreamParser {
+private:
+    enum Lex : uint8_t { LEX_IDLE, LEX_STRING, LEX_ESCAPE, LEX_UNICODE, LEX_LITERAL };
+
+    struct Frame {
+        bool isObject;
+        bool expectKey;
+        WhitelistSection section;
+    };
+
+    WhitelistStreamSink* _sink;
+    Frame _stack[WL_STREAM_MAX_DEPTH];
+    uint8_t _depth = 0;
+
+    Lex _lex = LEX_IDLE;
+    uint8_t _unicodeLeft = 0;
+    bool _stringIsKey = false;
+    char _token[WL_STREAM_TOKEN_LEN];
+    uint8_t _tokenLen = 0;
+    bool _tokenOverflow = false;
+    char _key[WL_STREAM_KEY_LEN];
+
+    WhitelistStreamEntry _entry;
+    char _entryUid[WL_STREAM_UID_LEN];
+    char _entrySid[WL_USER_ID_LEN];
+    bool _inEntry = false;
+
+    uint32_t _version = 0;
+    bool _full = true;
+    bool _sawFull = false;
+    bool _sawEntries = false;
+    bool _error = false;
+    bool _done = false;
+
+    bool keyIs(const char* name) const { return strcmp(_key, name) == 0; }
+
+    void tokenPush(char c) {
+        if (_tokenLen < WL_STREAM_TOKEN_LEN - 1) _token[_tokenLen++] = c;
+        else _tokenOverflow = true;
+    }
+
+    void tokenReset() {
+        _tokenLen = 0;
+        _tokenOverflow = false;
+    }
+
+    // Truncated values are dropped rather than used (a cut UID is a different card)
+    const char* tokenValue() {
+        _token[_tokenOverflow ? 0 : _tokenLen] = '\0';
+        return _token;
+    }
+
+    static void copyField(char* dst, size_t size, const char* src) {
+        size_t n = strlen(src);
+        if (n >= size) n = 0;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+
+    bool fail() {
+        _error = true;
+        return false;
+    }
+
+    bool openContainer(bool isObject) {
+        if (_depth >= WL_STREAM_MAX_DEPTH) return fail();
+        if (_depth == 0 && !isObject) return fail();
+
+        WhitelistSection section = WL_SECTION_NONE;
+        if (_depth > 0) {
+            Frame& parent = _stack[_depth - 1];
+            if (parent.isObject && parent.expectKey) return fail();
+            section = parent.section;
+
+            if (_depth == 1 && !isObject) {
+                if (keyIs("entries")) section = WL_SECTION_ENTRIES;
+                else if (keyIs("adds")) section = WL_SECTION_ADDS;
+                else if (keyIs("removes")) section = WL_SECTION_REMOVES;
+                if (section == WL_SECTION_ENTRIES) _sawEntries = true;
+            } else if (_depth == 2 && isObject &&
+                       (section == WL_SECTION_ENTRIES || section == WL_SECTION_ADDS)) {
+                memset(&_entry, 0, sizeof(_entry));
+                _entryUid[0] = '\0';
+                _entrySid[0] = '\0';
+                _inEntry = true;
+            }
+        }
+
+        _stack[_depth++] = { isObject, isObject, section };
+        return true;
+    }
+
+    bool closeContainer(bool isObject) {
+        if (_depth == 0 || _stack[_depth - 1].isObject != isObject) return fail();
+        WhitelistSection section = _stack[_depth - 1].section;
+        _depth--;
+
+        if (_depth == 2 && _inEntry) {
+            _inEntry = false;
+            _entry.uidLen = WhitelistIndex::parseHexUid(_entryUid, _entry.uid, sizeof(_entry.uid));
+            _entry.sid = _entrySid;
+            if (_entry.uidLen > 0 && _entrySid[0] != '\0' && !_sink->onEntry(section, _entry)) return fail();
+        }
+        if (_depth == 0) _done = true;
+        return true;
+    }
+
+    // A complete string or literal at the current position
+    bool value(bool isString) {
+        if (_depth == 0) return fail();
+        Frame& top = _stack[_depth - 1];
+        if (top.isObject && top.expectKey) return fail();
+        const char* v = tokenValue();
+
+        if (_depth == 1) {
+            if (keyIs("version") && !isString) {
+                _version = (uint32_t)strtoul(v, nullptr, 10);
+            } else if (keyIs("full") && !isString) {
+                _full = strcmp(v, "true") == 0;
+                _sawFull = true;
+            }
+        } else if (_depth == 3 && _inEntry) {
+            if (keyIs("uid") && isString) {
+                copyField(_entryUid, sizeof(_entryUid), v);
+            } else if (keyIs("sid") && isString) {
+                copyField(_entrySid, sizeof(_entrySid), v);
+            } else if (keyIs("role") && isString) {
+                _entry.role = whitelistRoleFromName(v);
+            } else if (keyIs("bioId") && !isString) {
+                unsigned long bio = strtoul(v, nullptr, 10);
+                _entry.bioId = bio > UINT16_MAX ? 0 : (uint16_t)bio;
+            }
+        } else if (_depth == 2 && top.section == WL_SECTION_REMOVES && isString) {
+            uint8_t uid[WL_UID_MAX_LEN];
+            uint8_t len = WhitelistIndex::parseHexUid(v, uid, sizeof(uid));
+            if (len > 0 && !_sink->onRemove(uid, len)) return fail();
+        }
+        return true;
+    }
+
+    bool endString() {
+        if (_stringIsKey) {
+            copyField(_key, sizeof(_key), tokenValue());
+            _stack[_depth - 1].expectKey = false;
+            return true;
+        }
+        return value(true);
+    }
+
+    static bool isLiteralChar(char c) {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+               c == '-' || c == '+' || c == '.';
+    }
+
+    // One byte outside of a string
+    bool structural(char c) {
+        switch (c) {
+            case ' ': case '\t': case '\r': case '\n':
+                return true;
+            case '{': return openContainer(true);
+            case '[': return openContainer(false);
+            case '}': return closeContainer(true);
+            case ']': return closeContainer(false);
+            case ':':
+                return _depth > 0 && _stack[_depth - 1].isObject ? true : fail();
+            case ',':
+                if (_depth == 0) return fail();
+                if (_stack[_depth - 1].isObject) _stack[_depth - 1].expectKey = true;
+                return true;
+            case '"':
+                if (_depth == 0) return fail();
+                _stringIsKey = _stack[_depth - 1].isObject && _stack[_depth - 1].expectKey;
+                tokenReset();
+                _lex = LEX_STRING;
+                return true;
+            default:
+                if (!isLiteralChar(c)) return fail();
+                tokenReset();
+                tokenPush(c);
+                _lex = LEX_LITERAL;
+                return true;
+        }
+    }
+
+public:
+    explicit WhitelistStreamParser(WhitelistStreamSink& sink) : _sink(&sink) {
+        _key[0] = '\0';
+    }
+
+    // Parse the next chunk. Returns false once the input is malformed or the sink aborted.
+    bool feed(const char* data, size_t len) {
+        for (size_t i = 0; i < len && !_error; i++) {
+            char c = data[i];
+            if (_done) {
+                if (c != ' ' && c != '\t' && c != '\r' && c != '\n') fail();
+                continue;
+            }
+
+            switch (_lex) {
+                case LEX_STRING:
+                    if (c == '"') {
+                        _lex = LEX_IDLE;
+                        endString();
+                    } else if (c == '\\') {
+                        _lex = LEX_ESCAPE;
+                    } else {
+                        tokenPush(c);
+                    }
+                    break;
+
+                case LEX_ESCAPE:
+                    if (c == 'u') {
+                        // Non-ASCII never appears in IDs or UIDs; keep a placeholder
+                        tokenPush('?');
+                        _unicodeLeft = 4;
+                        _lex = LEX_UNICODE;
+                    } else {
+                        tokenPush(c == 'n' ? '\n' : c == 't' ? '\t' : c == 'r' ? '\r' :
+                                  c == 'b' ? '\b' : c == 'f' ? '\f' : c);
+                        _lex = LEX_STRING;
+                    }
+                    break;
+
+                case LEX_UNICODE:
+                    if (--_unicodeLeft == 0) _lex = LEX_STRING;
+                    break;
+
+                case LEX_LITERAL:
+                    if (isLiteralChar(c)) {
+                        tokenPush(c);
+                        break;
+                    }
+                    _lex = LEX_IDLE;
+                    if (!value(false)) break;
+                    structural(c);
+                    break;
+
+                case LEX_IDLE:
+                    structural(c);
+                    break;
+            }
+        }
+        return !_error;
+    }
+
+    // True once the top-level object closed without errors
+    bool complete() const { return _done && !_error; }
+    bool failed() const { return _error; }
+
+    uint32_t version() const { return _version; }
+    bool full() const { return _sawFull ? _full : true; }  // Older servers always sent the full roster
+    bool sawEntries() const { return _sawEntries; }
+};
+
+#endif // WHITELIST_STREAM_H
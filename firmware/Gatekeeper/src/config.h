@@ -46,23 +46,40 @@
 
 // =============================================================================
 // TIMING CONSTANTS
+// The HTTPS connection to Convex is kept open and reused while it has been
+// idle less than CLOUD_KEEPALIVE_MS: longer than LOG_SYNC_INTERVAL, so each
+// cycle reuses it, and shorter than the ~60 s after which servers drop idle
+// connections.
+// With CLOUD_SYNC each log upload is one POST /api/sync that also carries
+// the roster/config validators and the heartbeat. Roster and config are
+// still refreshed on their own intervals; with nothing to sync the device
+// only checks in every CLOUD_SYNC_IDLE_MS. A server without /api/sync (404)
+// gets the per-endpoint requests.
+// Online, a tap is uploaded LOG_UPLOAD_DELAY_MS after it is logged, so the
+// taps of a burst share one request; LOG_SYNC_INTERVAL still runs when idle.
 // =============================================================================
 #define UNLOCK_DURATION_MS      5000    // Door unlock duration
 #define BIOMETRIC_TIMEOUT_MS    10000   // Max time to wait for biometric
 #define WHITELIST_SYNC_INTERVAL 3600000 // 1 hour
 #define LOG_SYNC_INTERVAL       30000   // 30 seconds
+#define LOG_UPLOAD_DELAY_MS     500     // Upload delay after a tap
 #define HEARTBEAT_INTERVAL      60000   // 1 minute
 #define CONFIG_SYNC_INTERVAL    3600000 // 1 hour - system config refresh
 #define BEACON_INTERVAL_MS      2000    // ESP-NOW beacon interval
 #define HEARTBEAT_TIMEOUT_MS    15000   // Consider disconnected after this
 #define HTTP_TIMEOUT_MS         10000   // HTTP request timeout
+#define CLOUD_KEEPALIVE_MS      45000   // Keep-alive for the HTTPS connection
+#define CLOUD_REPLY_MAX         4096    // Largest JSON reply read into RAM (register, config)
+#define CLOUD_SYNC              true    // One /api/sync exchange instead of a request per endpoint
+#define CLOUD_SYNC_IDLE_MS      240000  // 4 minutes - check-in when there is nothing to sync
 #define WIFI_CONNECT_TIMEOUT_MS 30000   // WiFi connection timeout
+#define NTP_RETRY_MS            5000    // NTP update attempts until the first sync
+#define NTP_UPDATE_MS           60000   // NTP updates after that (NTPClient's own refresh interval)
 
 // =============================================================================
 // SECURITY CONSTANTS
 // =============================================================================
 #define MIN_VALID_EPOCH         1600000000  // Sept 2020 - sanity check for NTP
-#define MAX_LOG_FILE_SIZE       (100 * 1024) // 100KB max log file
 
 // ESP-NOW secrets are now fetched from Convex and stored in NVS
 // Fallback values used only until first config sync completes
@@ -70,6 +87,59 @@
 #define DEFAULT_ESP_NOW_PMK     "SmartCampusPMK01"   // 16 chars - default PMK
 #define DEFAULT_ESP_NOW_SECRET  "SmartCampus24!@#"  // Default HMAC secret
 
+// =============================================================================
+// ACCESS LOG
+// Taps are 8-byte records (user index into the live roster) buffered in RAM
+// and written to /taps.<n> in group commits: one write + sync per batch
+// instead of three opens and a close per tap. A power cut loses at most one
+// uncommitted batch. /logs.<n> holds 48-byte AccessLogs expanded before a
+// roster swap (and files left by older firmware); both are uploaded.
+// Each log is a run of numbered segment files (AccessLogSegments.h): uploads
+// drain the oldest first and delete a segment once all of it is
+// acknowledged. Nothing unsent is deleted - a full log refuses new taps.
+// On flash each record is a frame with its sequence number and a CRC32
+// (20 bytes per tap, 60 per AccessLog); boot checks the newest segment's
+// tail backwards and cuts what a brownout tore, in constant time.
+// With LOG_WRITER_TASK the tap only queues the record in RAM; a background
+// task does the flash write, and flushLogs() is the durability point.
+// =============================================================================
+#define LOG_COMMIT_INTERVAL_MS  15000   // Commit buffered taps at most this long after the first (taps are >= 6 s apart per door)
+#define LOG_COMMIT_RECORDS      8       // ...or as soon as this many are buffered (max 32)
+#define LOG_WRITER_TASK         true    // Queue taps in RAM for a background writer task (AccessLogQueue.h) instead of writing in openDoor()
+#define LOG_QUEUE_SLOTS         16      // Taps staged for the writer (44 bytes each, power of two); a full queue writes through
+#define LOG_WRITER_POLL_MS      1000    // Writer wakes at least this often to run the group-commit interval
+#define LOG_SEGMENT_SIZE        (16 * 1024) // Bytes per segment file (819 taps or 273 expanded logs)
+#define LOG_MAX_SEGMENTS        32      // Per log (32 x 819 taps), when LittleFS has room: the spiffs partition is 832 KB...
+#define LOG_FS_RESERVE          (128 * 1024) // ...and a new segment must leave this much of it free (whitelist files, temp files)
+#define LOG_UPLOAD_BATCH        50      // Taps per /api/logs request; the log is trimmed to the last acknowledged batch
+#define LOG_BINARY_WIRE         false   // Upload batches in the compact LGB1 format (LogUploadStream.h) instead of JSON; needs a backend that decodes it
+#define LOG_RAW_PARTITION       false   // Log to a sector ring on the `accesslog` partition instead of LittleFS (AccessLogRing.h)
+
+// =============================================================================
+// STORAGE ENCRYPTION
+// Log records and whitelist user IDs are encrypted on flash (StorageCipher.h):
+// AES-128-CTR keyed from an NVS secret and the chip's eFuse MAC. Files
+// written before it was on stay readable and age out.
+// =============================================================================
+#define STORAGE_ENCRYPTION      true    // Encrypt logs and whitelist user IDs at rest
+#define STORAGE_CIPHER_SOFTWARE false   // Portable AES instead of the AES peripheral (slower; for comparison)
+
+// =============================================================================
+// WHITELIST
+// A campus block file takes ~48 bytes per card, and twice that while a new
+// roster is staged next to the live one. On the 4MB layout (partitions.csv)
+// LittleFS is 832 KB shared with the logs: ~7k cards can still be swapped.
+// 50k cards (4.8 MB while staging) need the 16MB layout, partitions_campus.csv
+// (env:esp32dev_campus). The server has no campus roster scope yet: rooms get
+// staff plus their homeroom (lib/whitelist.ts buildFullWhitelist).
+// =============================================================================
+#define WHITELIST_BINARY_WIRE   true    // Ask /api/whitelist for the compact binary format (JSON if false)
+#define WHITELIST_DELTA_MAX_ENTRIES 128 // Per-sync adds (and removes) buffered; keep in sync with MAX_WHITELIST_DELTA on the server
+#ifndef WHITELIST_CAMPUS_STORE
+#define WHITELIST_CAMPUS_STORE  false   // Campus-wide doors: roster in a LittleFS block file (env:esp32dev_campus sets it)
+#endif
+#define WHITELIST_CAMPUS_FILE   "/campus" // Block file base name (.blk/.usr), ~48 bytes per card
+
 // =============================================================================
 // TLS CERTIFICATE
 // ISRG Root X1 - Let's Encrypt Root CA (valid until 2035)
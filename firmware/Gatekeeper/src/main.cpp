@@ -8,18 +8,18 @@
 // - HMAC-SHA256 for ESP-NOW message authentication
 // - Proper input validation and bounds checking
 // - NVS-based credential storage (not hardcoded)
+// - Logs and whitelist user IDs encrypted at rest (AES-128-CTR, AES peripheral)
 // =============================================================================
 
 #include <Arduino.h>
 #include <WiFi.h>
-#include <WiFiClientSecure.h>
 #include <Wire.h>
 #include <Adafruit_PN532.h>
 #include <Preferences.h>
-#include <HTTPClient.h>
 #include <ArduinoJson.h>
 #include <esp_now.h>
 #include <esp_task_wdt.h>
+#include <nvs.h>
 #include <freertos/semphr.h>
 
 #include "config.h"
@@ -28,6 +28,16 @@
 #include "FaceAuth.h"
 #include "FingerVeinAuth.h"
 #include "ESPNowProtocol.h"
+#include "WhitelistIndex.h"
+#include "WhitelistImage.h"
+#include "WhitelistStream.h"
+#include "WhitelistBinary.h"
+#include "WhitelistBlockFile.h"
+#include "LogUploadStream.h"
+#include "LatencyHistogram.h"
+#include "CloudLink.h"
+#include "CloudSync.h"
+#include "NetworkEvents.h"
 
 // =============================================================================
 // GLOBAL OBJECTS
@@ -40,9 +50,49 @@ HardwareSerial VeinSerial(2);
 // Task Handles
 TaskHandle_t NetworkTaskHandle = NULL;
 
+// Hand NetworkTask a work item (NET_EVENT_*) from any task; items posted
+// before it wakes are merged
+void postNetworkEvent(uint32_t events) {
+    if (NetworkTaskHandle) xTaskNotify(NetworkTaskHandle, events, eSetBits);
+}
+
 // Thread synchronization
 SemaphoreHandle_t stateMutex = NULL;
 
+// Time openDoor() spends logging a tap (queue push with the writer task,
+// the flash write without it) - the part of tap-to-tap latency it adds
+LatencyHistogram tapLogLatency;
+
+// Whitelist image in its own flash partition, read in place through the
+// flash cache. Taps read it lock-free; sync flips the live slot atomically.
+FlashPartition whitelistPartition;
+WhitelistStore whitelistStore(whitelistPartition);
+uint32_t bloomRejects = 0;  // Taps denied by the bloom filter alone
+
+#if WHITELIST_CAMPUS_STORE
+// Campus-wide doors: the roster is too big for the partition image and
+// lives in a LittleFS block file instead. Lookups read a block, so they
+// take a mutex that the file swap also takes.
+WhitelistBlockStore campusWhitelist;
+SemaphoreHandle_t campusMutex = NULL;
+typedef WhitelistBlockStore RosterStore;
+RosterStore& rosterStore = campusWhitelist;
+#else
+typedef WhitelistStore RosterStore;
+RosterStore& rosterStore = whitelistStore;
+#endif
+
+// Newest server version confirmed to match the live image. An empty delta
+// advances it without rewriting flash (RAM only - the image header holds
+// the durable version).
+uint32_t whitelistCheckedVersion = 0;
+uint32_t whitelistCheckedGen = 0;
+
+// ETag of the last whitelist response applied, valid only while the image
+// generation it was applied to is still live (NVS "wlsync")
+String whitelistEtag = "";
+uint32_t whitelistEtagGen = 0;
+
 // =============================================================================
 // SHARED STATE (Protected by mutex)
 // =============================================================================
@@ -60,16 +110,23 @@ String hardwareToken = "";
 String wifiSSID = "";
 String wifiPass = "";
 String convexUrl = "";
-unsigned long lastWhitelistSync = 0;
-unsigned long lastLogSync = 0;
-unsigned long lastHeartbeat = 0;
-unsigned long lastConfigSync = 0;
+NetworkTimers networkTimers;     // NetworkTask's recurring work (NetworkTask only)
+uint32_t networkWakeups = 0;     // Times NetworkTask woke up (events or deadlines)
 
 // Dynamic configuration from Convex (stored in NVS)
 String espNowPmk = "";           // 16 chars for ESP-NOW PMK
 String espNowSharedSecret = "";  // Shared secret for HMAC
 bool debugModeEnabled = true;    // Can be toggled remotely
 uint32_t configVersion = 0;      // For detecting config changes
+String configEtag = "";          // Validator of the stored config (If-None-Match)
+
+// Conditional GET results: 304 = hit, 200 = miss (full payload fetched)
+struct ConditionalFetchStats {
+    uint32_t hits;
+    uint32_t misses;
+};
+ConditionalFetchStats whitelistFetchStats = {0, 0};
+ConditionalFetchStats configFetchStats = {0, 0};
 
 // Sequence number manager for replay protection
 SeqNumManager seqNumManager;
@@ -132,6 +189,143 @@ uint32_t getNextSeqNum() {
     return result;
 }
 
+// =============================================================================
+// WHITELIST INDEX
+// =============================================================================
+
+// User ID behind a logged user index, while roster `generation` is live
+bool resolveLogUser(uint32_t generation, uint16_t userIdx, char* out, size_t size) {
+#if WHITELIST_CAMPUS_STORE
+    xSemaphoreTake(campusMutex, portMAX_DELAY);
+    bool ok = campusWhitelist.generation() == generation &&
+              campusWhitelist.userId(userIdx, out, size);
+    xSemaphoreGive(campusMutex);
+    return ok;
+#else
+    WhitelistStore::Reader reader(whitelistStore);
+    const WhitelistImage& image = reader.image();
+    return image.generation() == generation && image.userIdAt(userIdx, out, size);
+#endif
+}
+
+// Switch lookups to the staged slot. The previous image stays live (and
+// valid across reboots) until this flip; taps never wait for it. Taps
+// logged against the old roster are expanded first - their user indexes
+// mean nothing in the new one.
+void activateWhitelist() {
+    Storage::LogHold hold;
+    Storage::expandLogs(resolveLogUser);
+#if WHITELIST_CAMPUS_STORE
+    xSemaphoreTake(campusMutex, portMAX_DELAY);
+    campusWhitelist.activate();
+    xSemaphoreGive(campusMutex);
+#else
+    whitelistStore.activate();
+#endif
+    Storage::setLogRoster(rosterStore.generation());
+}
+
+// Write a freshly built index to the inactive slot, then make it live.
+bool commitWhitelist(const WhitelistIndex& fresh, uint32_t version) {
+    if (!whitelistStore.stage(fresh, version)) {
+        DEBUG_PRINTF("[SYNC] Whitelist image write failed (%u entries)\n", fresh.count());
+        return false;
+    }
+    activateWhitelist();  // Only called in partition-image builds
+    return true;
+}
+
+// A whitelisted card as copied out of the image: one lookup answers whether
+// it may enter, whether it needs a biometric and which template to expect.
+struct CardAccess {
+    WhitelistRecord rec;
+    char userId[WL_USER_ID_LEN];
+    uint32_t generation;       // Roster the entry came from (rec.userIdx is relative to it)
+
+    bool requiresBiometric() const { return (rec.flags & WL_FLAG_REQUIRE_BIO) != 0; }
+};
+
+// Copy out the whitelist entry for a card. Returns false if not whitelisted.
+// The bloom filter (RAM) rejects most unknown cards before the flash search.
+bool lookupCard(const uint8_t* uid, uint8_t uidLen, CardAccess& card) {
+#if WHITELIST_CAMPUS_STORE
+    // One block read; the user ID only on a hit
+    xSemaphoreTake(campusMutex, portMAX_DELAY);
+    bool found = campusWhitelist.find(uid, uidLen, card.rec) &&
+                 campusWhitelist.userId(card.rec.userIdx, card.userId, sizeof(card.userId));
+    card.generation = campusWhitelist.generation();
+    xSemaphoreGive(campusMutex);
+    return found;
+#else
+    WhitelistStore::Reader reader(whitelistStore);
+    const WhitelistImage& image = reader.image();
+    if (!image.mightContain(uid, uidLen)) {
+        bloomRejects++;
+        return false;
+    }
+    const WhitelistRecord* rec = image.find(uid, uidLen);
+    if (!rec) return false;
+    card.rec = *rec;
+    card.generation = image.generation();
+    return image.userId(rec, card.userId, sizeof(card.userId));
+#endif
+}
+
+// One-time import of the legacy NVS whitelist into the flash image
+void migrateWhitelistFromNVS() {
+    size_t count = 0;
+    nvs_iterator_t it = nvs_entry_find("nvs", "whitelist", NVS_TYPE_STR);
+    while (it) {
+        count++;
+        it = nvs_entry_next(it);
+    }
+    if (count == 0) return;
+
+    // Sized to every entry: a partial roster would drop cards without a
+    // trace. If it does not fit, NVS is kept and the first sync fills the image.
+    WhitelistIndex fresh;
+    if (!fresh.reserve(count)) {
+        Serial.printf("[BOOT] NVS whitelist not migrated: no RAM for %u entries\n", count);
+        return;
+    }
+
+    Preferences bioPrefs;
+    prefs.begin("whitelist", true);
+    bioPrefs.begin("biometrics", true);
+
+    it = nvs_entry_find("nvs", "whitelist", NVS_TYPE_STR);
+    while (it && fresh.count() < count) {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+        String sid = prefs.getString(info.key, "");
+        if (!sid.isEmpty()) {
+            // No role in the legacy entries: keep the old firmware's rule
+            // (biometric for "STU" IDs, card only for everyone else) so
+            // staff are not locked out offline until the first sync
+            // (version 0 forces a full roster) brings the real roles
+            uint8_t role = sid.startsWith("STU") ? WL_ROLE_STUDENT : WL_ROLE_LEGACY;
+            fresh.addHex(info.key, sid.c_str(), bioPrefs.getUShort(sid.c_str(), 0), role);
+        }
+        it = nvs_entry_next(it);
+    }
+    if (it) nvs_release_iterator(it);
+
+    bioPrefs.end();
+    prefs.end();
+
+    fresh.finalize();
+    if (!commitWhitelist(fresh, 0)) return;  // Version unknown - next sync is a full one
+
+    // Legacy namespaces are no longer read
+    prefs.begin("whitelist", false);
+    prefs.clear();
+    prefs.end();
+    prefs.begin("biometrics", false);
+    prefs.clear();
+    prefs.end();
+    Serial.printf("[BOOT] Migrated %u whitelist entries from NVS\n", fresh.count());
+}
+
 // =============================================================================
 // LED PATTERNS
 // =============================================================================
@@ -258,8 +452,8 @@ bool sendToWatchman(MessageType type) {
 // =============================================================================
 // ACCESS CONTROL
 // =============================================================================
-void openDoor(const String& userId, const String& method) {
-    DEBUG_PRINTF("[ACCESS] GRANTED: %s via %s\n", userId.c_str(), method.c_str());
+void openDoor(const CardAccess& card, AccessLogMethod method) {
+    DEBUG_PRINTF("[ACCESS] GRANTED: %s via %s\n", card.userId, accessLogMethodName(method));
     
     // Wake Watchman
     sendToWatchman(MSG_WAKE);
@@ -268,15 +462,20 @@ void openDoor(const String& userId, const String& method) {
     digitalWrite(RELAY_PIN, HIGH);
     ledSuccess();
     
-    // Log access
-    Storage::appendLog(userId.c_str(), method.c_str(), NTPSync::getEpochTime());
+    // Log access (queued for the log writer task)
+    uint32_t logStart = micros();
+    Storage::appendLog(card.rec.userIdx, card.userId, method,
+        NTPSync::isTimeValid() ? 0 : LOG_FLAG_LOCAL_TIME, NTPSync::getEpochTime(), card.generation);
+    tapLogLatency.record(micros() - logStart);
+    postNetworkEvent(NET_EVENT_LOG_READY);
     
     // Keep unlocked for configured duration
     delay(UNLOCK_DURATION_MS);
     digitalWrite(RELAY_PIN, LOW);
 }
 
-bool runBiometricCheck(uint16_t expectedBiometricId) {
+bool runBiometricCheck(const CardAccess& card) {
+    const uint16_t expectedBiometricId = card.rec.bioId;
     DEBUG_PRINTF("[BIOMETRIC] Starting check, expecting ID: %d\n", expectedBiometricId);
     unsigned long start = millis();
     
@@ -324,27 +523,48 @@ bool runBiometricCheck(uint16_t expectedBiometricId) {
 // =============================================================================
 // NETWORK FUNCTIONS WITH TLS
 // =============================================================================
-WiFiClientSecure* createSecureClient() {
-    WiFiClientSecure* client = new WiFiClientSecure();
-    client->setCACert(ROOT_CA_CERT);
-    client->setTimeout(HTTP_TIMEOUT_MS / 1000);
-    return client;
+// One HTTPS connection for every cloud call (NetworkTask only): kept alive
+// between requests, resumed across reconnects, CA chain parsed once
+CloudLink<MbedTlsTransport> cloud;
+
+// Host and port of convexUrl ("https://host[:port][/...]")
+bool convexHost(String& host, uint16_t& port) {
+    int start = convexUrl.indexOf("://");
+    start = start < 0 ? 0 : start + 3;
+    int end = convexUrl.indexOf('/', start);
+    host = convexUrl.substring(start, end < 0 ? convexUrl.length() : end);
+    port = 443;
+    int colon = host.indexOf(':');
+    if (colon >= 0) {
+        port = (uint16_t)host.substring(colon + 1).toInt();
+        host = host.substring(0, colon);
+    }
+    return !host.isEmpty() && port != 0;
 }
 
-void registerDevice() {
-    if (WiFi.status() != WL_CONNECTED || convexUrl.isEmpty()) return;
-    
-    WiFiClientSecure* client = createSecureClient();
-    HTTPClient http;
-    http.setTimeout(HTTP_TIMEOUT_MS);
-    
-    if (!http.begin(*client, convexUrl + "/api/register")) {
-        DEBUG_PRINTLN("[NET] Failed to begin HTTP");
-        delete client;
-        return;
+// Point the link at convexUrl; false without WiFi, a URL or the CA chain
+bool cloudReady() {
+    String host;
+    uint16_t port;
+    if (WiFi.status() != WL_CONNECTED || !convexHost(host, port)) return false;
+    if (!cloud.transport().begin(ROOT_CA_CERT)) {
+        DEBUG_PRINTLN("[NET] TLS setup failed");
+        return false;
     }
-    
-    http.addHeader("Content-Type", "application/json");
+    cloud.begin(host.c_str(), port, HTTP_TIMEOUT_MS, CLOUD_KEEPALIVE_MS);
+    return true;
+}
+
+// Response body as a String (small JSON replies)
+bool readCloudString(String& out) {
+    return cloud.readBody([&out](const char* data, size_t len) {
+        out.concat(data, len);
+        return out.length() <= CLOUD_REPLY_MAX;
+    }) >= 0;
+}
+
+void registerDevice() {
+    if (!cloudReady()) return;
     
     JsonDocument req;
     req["chipId"] = WiFi.macAddress();
@@ -353,10 +573,13 @@ void registerDevice() {
     String body;
     serializeJson(req, body);
     
-    int code = http.POST(body);
-    if (code == 200) {
+    CloudResponse head;
+    int code = cloud.request("POST", "/api/register", "Content-Type: application/json\r\n",
+                             body.c_str(), body.length()) ? cloud.readHead(head) : -1;
+    String reply;
+    if (code == 200 && readCloudString(reply)) {
         JsonDocument res;
-        DeserializationError err = deserializeJson(res, http.getString());
+        DeserializationError err = deserializeJson(res, reply);
         if (!err && res["token"].is<const char*>()) {
             hardwareToken = res["token"].as<String>();
             prefs.begin("auth", false);
@@ -368,120 +591,422 @@ void registerDevice() {
         DEBUG_PRINTF("[NET] Registration failed: %d\n", code);
     }
     
-    http.end();
-    delete client;
+    cloud.endRequest();
+}
+
+typedef LogUploadStream<CloudLink<MbedTlsTransport>> LogUpload;
+
+// Open a streamed POST /api/logs on the cloud link: headers and the start of
+// the body are sent, logs follow with LogUpload::add() as they are read from flash
+bool beginLogUpload(LogUpload& upload) {
+    if (cloud.beginRequest() &&
+        upload.begin(cloud.host(), "/api/logs", hardwareToken.c_str(), WiFi.macAddress().c_str())) {
+        return true;
+    }
+    DEBUG_PRINTLN("[SYNC] Log upload: connect failed");
+    cloud.endRequest(false);
+    return false;
 }
 
+// Finish the body and read the reply. True once the server has stored the
+// batch - for a batch with a sequence range, once it acknowledged the range.
+// The connection stays up for the next batch if the reply allows it.
+bool endLogUpload(LogUpload& upload, bool hasRange, uint32_t first, uint32_t last) {
+    char reply[128];
+    int httpCode = upload.finish(hasRange, first, last) ? upload.readResponse(reply, sizeof(reply)) : -1;
+    if (httpCode > 0) cloud.responseRead();
+    cloud.endRequest(upload.keepAlive());
+    if (httpCode != 200) {
+        DEBUG_PRINTF("[SYNC] Log upload failed: %d - %s\n", httpCode, httpCode > 0 ? reply : "");
+        return false;
+    }
+    DEBUG_PRINTF("[SYNC] Streamed %u logs: %u body bytes in %u chunks\n",
+        upload.logs(), upload.bodyBytes(), upload.chunks());
+
+    JsonDocument res;
+    bool stored = !hasRange || (deserializeJson(res, reply) == DeserializationError::Ok &&
+                                res["acked"].is<uint32_t>() && res["acked"].as<uint32_t>() == last);
+    if (!stored) DEBUG_PRINTLN("[SYNC] Log batch not acknowledged");
+    return stored;
+}
+
+// Upload cursor over the pending logs: expanded logs first (taps from
+// before a roster swap, or older firmware), then compact taps, whose
+// batches name the sequence range they cover. Each batch is read from flash
+// straight into the request body; trim() drops what was acknowledged.
+class LogBatchCursor {
+public:
+    LogBatchCursor() : _expander(resolveLogUser, Storage::getLogContext()) {
+        _expandedCount = Storage::getExpandedLogCount();
+        _compactCount = Storage::getCompactLogCount();
+        _ackedContext = _expander.generation();
+    }
+
+    bool pending() const { return _expandedDone < _expandedCount || _acked < _compactCount; }
+
+    // Streams the next batch (at most LOG_UPLOAD_BATCH logs) into `upload`;
+    // nothing if no log is pending
+    void fill(LogUpload& upload) {
+        _hasRange = false;
+        _batchExpanded = _expandedDone < _expandedCount;
+        if (_batchExpanded) {
+            for (_next = _expandedDone; _next < _expandedCount && _next - _expandedDone < LOG_UPLOAD_BATCH; _next++) {
+                AccessLog log;
+                if (!Storage::readExpandedLog(_next, log)) {
+                    continue;  // Frame failed its CRC
+                }
+                upload.add(log, !NTPSync::isTimeValid(), false, false, 0);
+            }
+            return;
+        }
+        _next = _acked;
+        if (_next >= _compactCount) return;
+        for (; _next < _compactCount && upload.logs() < LOG_UPLOAD_BATCH; _next++) {
+            AccessLogRecord rec;
+            AccessLog log;
+            if (!Storage::readLog(_next, rec)) {
+                continue;  // Frame failed its CRC
+            }
+            if (!_expander.expand(rec, log)) continue;  // Marker, or roster gone
+            upload.add(log, (rec.flags & LOG_FLAG_LOCAL_TIME) != 0, (rec.flags & LOG_FLAG_DENIED) != 0,
+                       true, Storage::getLogSeq(_next));
+        }
+        // A batch of markers only is still sent, so its range is acknowledged
+        _hasRange = true;
+        _first = Storage::getLogSeq(_acked);
+        _last = Storage::getLogSeq(_next - 1);
+    }
+
+    bool hasRange() const { return _hasRange; }
+    uint32_t first() const { return _first; }
+    uint32_t last() const { return _last; }
+
+    // The server stored the batch just sent
+    void ack() {
+        if (_batchExpanded) {
+            _expandedDone = _next;
+        } else {
+            _acked = _next;
+            _ackedContext = _expander.generation();
+        }
+    }
+
+    // Start over on the logs as they are now (after trim(), or a roster
+    // swap that moved the compact taps into the expanded log)
+    void reload() {
+        _expander = AccessLogExpander(resolveLogUser, Storage::getLogContext());
+        _expandedCount = Storage::getExpandedLogCount();
+        _expandedDone = 0;
+        _compactCount = Storage::getCompactLogCount();
+        _acked = 0;
+        _ackedContext = _expander.generation();
+        _hasRange = false;
+    }
+
+    void trim() {
+        Storage::trimExpandedLogs(_expandedDone);
+        if (_expander.unresolved() > 0) {
+            DEBUG_PRINTF("[SYNC] %u taps dropped: roster no longer live\n", _expander.unresolved());
+        }
+        if (_acked > 0 && Storage::trimLogs(_acked, _ackedContext)) {
+            DEBUG_PRINTF("[SYNC] %d log records acknowledged\n", _acked);
+        }
+    }
+
+private:
+    AccessLogExpander _expander;
+    int _expandedCount = 0;
+    int _expandedDone = 0;         // Expanded logs acknowledged
+    int _compactCount = 0;
+    int _acked = 0;                // Compact records before it are acknowledged
+    uint32_t _ackedContext = 0;
+    bool _batchExpanded = false;   // Batch in flight
+    int _next = 0;
+    bool _hasRange = false;
+    uint32_t _first = 0;
+    uint32_t _last = 0;
+};
+
+// Upload in batches of LOG_UPLOAD_BATCH, trimming only what the server
+// acknowledged: taps logged meanwhile stay, and a retried batch carries the
+// same sequence numbers, so the server drops what it already has. Each body
+// is streamed from flash as it is sent (LogUploadStream).
 void syncLogs() {
-    if (hardwareToken.isEmpty() || WiFi.status() != WL_CONNECTED) return;
+    if (hardwareToken.isEmpty() || !cloudReady()) return;
     
-    int count = Storage::getLogCount();
-    if (count == 0) return;
+    // Commit buffered taps so the upload and the trim cover the same records
+    Storage::flushLogs();
 
-    File file = LittleFS.open("/logs.bin", FILE_READ);
-    if (!file) return;
+    // In order: a failed batch is retried first next time
+    LogBatchCursor logs;
+    while (logs.pending()) {
+        LogUpload upload(cloud, LOG_BINARY_WIRE);
+        if (!beginLogUpload(upload)) break;
+        logs.fill(upload);
+        if (!endLogUpload(upload, logs.hasRange(), logs.first(), logs.last())) break;
+        logs.ack();
+    }
+    logs.trim();
+}
 
-    JsonDocument doc;
-    doc["chipId"] = WiFi.macAddress();
-    JsonArray logsArr = doc["logs"].to<JsonArray>();
-    
-    while (file.available()) {
-        AccessLog log;
-        if (file.read((uint8_t*)&log, sizeof(AccessLog)) != sizeof(AccessLog)) {
-            break;
+// Server version to request deltas from (0 = ask for the full roster)
+uint32_t whitelistSinceVersion() {
+    uint32_t since = rosterStore.version();
+    if (since > 0 && whitelistCheckedGen == rosterStore.generation() && whitelistCheckedVersion > since) {
+        since = whitelistCheckedVersion;
+    }
+    return since;
+}
+
+// Receives entries as the response is decoded (JSON or binary). A full
+// roster (sorted by the server in image order) goes straight into the
+// inactive slot; delta adds/removes are buffered and merged once the
+// response is complete.
+class WhitelistSyncSink : public WhitelistStreamSink {
+public:
+    WhitelistIndex adds;
+    WhitelistIndex removes;
+    bool staging = false;  // Full roster is being written to flash
+
+    ~WhitelistSyncSink() { free(deltaUsers); }
+
+    bool onUser(WhitelistSection section, const char* sid) override {
+        if (section == WL_SECTION_ENTRIES) {
+            return beginRoster() && rosterStore.appendUser(sid);
         }
-        JsonObject logObj = logsArr.add<JsonObject>();
-        logObj["userId"] = log.userId;
-        logObj["method"] = log.method;
-        logObj["action"] = "ATTENDANCE";
-        logObj["result"] = "success";
-        logObj["timestamp"] = log.timestamp;
-        logObj["timestampType"] = NTPSync::isTimeValid() ? "ntp" : "local";
+        if (!reserveDelta() || deltaUserCount >= WHITELIST_DELTA_MAX_ENTRIES) return false;
+        size_t n = strnlen(sid, WL_USER_ID_LEN - 1);
+        memcpy(deltaUsers[deltaUserCount], sid, n);
+        deltaUsers[deltaUserCount][n] = '\0';
+        deltaUserCount++;
+        return true;
     }
-    file.close();
 
-    WiFiClientSecure* client = createSecureClient();
-    HTTPClient http;
-    http.setTimeout(HTTP_TIMEOUT_MS);
-    
-    if (!http.begin(*client, convexUrl + "/api/logs")) {
-        delete client;
-        return;
+    bool onEntry(WhitelistSection section, const WhitelistStreamEntry& entry) override {
+        if (section == WL_SECTION_ENTRIES) {
+            if (!beginRoster()) return false;
+            return entry.sid
+                ? rosterStore.append(entry.uid, entry.uidLen, entry.sid, entry.bioId, entry.role)
+                : rosterStore.appendRecord(entry.uid, entry.uidLen, entry.userIdx, entry.bioId, entry.role);
+        }
+        if (!reserveDelta()) return false;
+        const char* sid = entry.sid;
+        if (!sid) {
+            if (entry.userIdx >= deltaUserCount) return false;
+            sid = deltaUsers[entry.userIdx];
+        }
+        return adds.add(entry.uid, entry.uidLen, sid, entry.bioId, entry.role);
     }
-    
-    http.addHeader("Content-Type", "application/json");
-    http.addHeader("Authorization", "Bearer " + hardwareToken);
-    
-    String body;
-    serializeJson(doc, body);
-    
-    int httpCode = http.POST(body);
-    if (httpCode == 200) {
-        Storage::clearLogs();
-        DEBUG_PRINTLN("[SYNC] Logs uploaded successfully");
+
+    bool onRemove(const uint8_t* uid, uint8_t uidLen) override {
+        return reserveDelta() && removes.add(uid, uidLen, "", 0);
+    }
+
+private:
+    bool deltaReserved = false;
+    char (*deltaUsers)[WL_USER_ID_LEN] = nullptr;
+    size_t deltaUserCount = 0;
+
+    bool beginRoster() {
+        if (!staging) {
+            if (!rosterStore.beginStage(rosterStore.slotCapacity())) return false;
+            staging = true;
+        }
+        return true;
+    }
+
+    // Allocated on the first delta entry - full rosters never need it
+    bool reserveDelta() {
+        if (!deltaReserved) {
+            deltaUsers = (char (*)[WL_USER_ID_LEN])malloc(WHITELIST_DELTA_MAX_ENTRIES * WL_USER_ID_LEN);
+            deltaReserved = deltaUsers &&
+                            adds.reserve(WHITELIST_DELTA_MAX_ENTRIES) &&
+                            removes.reserve(WHITELIST_DELTA_MAX_ENTRIES);
+        }
+        return deltaReserved;
+    }
+};
+
+// Merge sorted adds/removes with the live roster into the inactive slot.
+// An add replaces any live record for the same card (removes apply first).
+bool applyWhitelistDelta(WhitelistIndex& adds, WhitelistIndex& removes, uint32_t version) {
+    adds.finalize();
+    removes.finalize();
+
+    // Only this task changes the live roster, so it is stable here
+    size_t capacity = rosterStore.count() + adds.count();
+    if (capacity > rosterStore.slotCapacity()) capacity = rosterStore.slotCapacity();
+    RosterStore::Cursor live(rosterStore);
+    if (!rosterStore.beginStage(capacity)) return false;
+
+    WhitelistRecord cur;
+    char curId[WL_USER_ID_LEN];
+    bool haveLive = live.next(cur, curId);
+    const WhitelistRecord* added = adds.records();
+    size_t j = 0;
+    bool ok = true;
+    while (ok && (haveLive || j < adds.count())) {
+        int c = !haveLive ? 1 : (j == adds.count()) ? -1 :
+                WhitelistIndex::compareKey(cur.uid, cur.uidLen, added[j]);
+        if (c < 0) {
+            if (!removes.find(cur.uid, cur.uidLen)) {
+                ok = rosterStore.append(cur.uid, cur.uidLen, curId, cur.bioId, cur.role);
+            }
+            haveLive = live.next(cur, curId);
+        } else {
+            ok = rosterStore.append(added[j].uid, added[j].uidLen, adds.userId(&added[j]),
+                                    added[j].bioId, added[j].role);
+            j++;
+            if (c == 0) haveLive = live.next(cur, curId);
+        }
+    }
+    if (!ok || live.failed()) {
+        rosterStore.abortStage();
+        return false;
+    }
+    if (!rosterStore.commitStage(version)) return false;
+    activateWhitelist();
+    return true;
+}
+
+// Remember the validator of the response just applied, tied to the live generation
+void saveWhitelistEtag(const String& etag) {
+    if (etag.isEmpty()) return;
+    whitelistEtag = etag;
+    whitelistEtagGen = rosterStore.generation();
+    prefs.begin("wlsync", false);
+    prefs.putString("etag", whitelistEtag);
+    prefs.putULong("gen", whitelistEtagGen);
+    prefs.end();
+}
+
+// Stage/merge what `decoder` read (`received` bytes, -1 if cut short)
+template <typename Decoder>
+void applyWhitelist(Decoder& decoder, WhitelistSyncSink& sink, uint32_t since, const String& etag, long received) {
+    uint32_t version = decoder.version();
+
+    if (received < 0 || !decoder.complete()) {
+        rosterStore.abortStage();
+        DEBUG_PRINTF("[SYNC] Whitelist response rejected (%ld)\n", received);
+    } else if (decoder.full()) {
+        if (!decoder.sawEntries()) return;
+        // An empty roster still replaces the live one
+        if (sink.staging || rosterStore.beginStage(0)) {
+            size_t count = rosterStore.stagedCount();
+            if (rosterStore.commitStage(version)) {
+                activateWhitelist();
+                saveWhitelistEtag(etag);
+                DEBUG_PRINTF("[SYNC] Whitelist updated: %u entries, %ld bytes (v%u)\n", count, received, version);
+            } else {
+                DEBUG_PRINTF("[SYNC] Whitelist write failed (%u entries)\n", count);
+            }
+        }
+    } else if (sink.adds.count() == 0 && sink.removes.count() == 0) {
+        // Nothing for this room - no flash writes
+        whitelistCheckedVersion = version;
+        whitelistCheckedGen = rosterStore.generation();
+        saveWhitelistEtag(etag);
+        DEBUG_PRINTF("[SYNC] Whitelist unchanged (v%u)\n", version);
+    } else if (applyWhitelistDelta(sink.adds, sink.removes, version)) {
+        saveWhitelistEtag(etag);
+        DEBUG_PRINTF("[SYNC] Whitelist v%u -> v%u: +%u -%u\n",
+            since, version, sink.adds.count(), sink.removes.count());
     } else {
-        DEBUG_PRINTF("[SYNC] Log upload failed: %d - %s\n", httpCode, http.getString().c_str());
+        DEBUG_PRINTLN("[SYNC] Whitelist delta merge failed");
     }
-    
-    http.end();
-    delete client;
+}
+
+// Stream the response body through `decoder`, then stage/merge the result
+template <typename Decoder>
+void ingestWhitelist(Decoder& decoder, WhitelistSyncSink& sink, uint32_t since, const String& etag) {
+    long received = cloud.readBody([&decoder](const char* data, size_t len) {
+        return decoder.feed(data, len);   // false stops reading
+    });
+    applyWhitelist(decoder, sink, since, etag, received);
+}
+
+// Whether a whitelist response was last applied to the live image: its
+// ETag can then be sent as the validator
+bool whitelistEtagLive() {
+    return !whitelistEtag.isEmpty() && rosterStore.hasImage() && whitelistEtagGen == rosterStore.generation();
 }
 
 void syncWhitelist() {
-    if (hardwareToken.isEmpty() || WiFi.status() != WL_CONNECTED) return;
+    if (hardwareToken.isEmpty() || !cloudReady()) return;
     
-    WiFiClientSecure* client = createSecureClient();
-    HTTPClient http;
-    http.setTimeout(HTTP_TIMEOUT_MS);
-    
-    String url = convexUrl + "/api/whitelist?chipId=" + WiFi.macAddress();
-    if (!http.begin(*client, url)) {
-        delete client;
-        return;
+    uint32_t since = whitelistSinceVersion();
+    String path = "/api/whitelist?chipId=" + WiFi.macAddress();
+    if (since > 0) {
+        path += "&since=" + String(since);
+    }
+    String headers = "Authorization: Bearer " + hardwareToken + "\r\n";
+    
+#if WHITELIST_BINARY_WIRE
+    headers += "Accept: " WL_WIRE_CONTENT_TYPE "\r\n";
+#endif
+    // Unchanged since the image we hold: 304, no body, no flash writes
+    if (whitelistEtagLive()) {
+        headers += "If-None-Match: " + whitelistEtag + "\r\n";
     }
     
-    http.addHeader("Authorization", "Bearer " + hardwareToken);
-    
-    int httpCode = http.GET();
-    if (httpCode == 200) {
-        JsonDocument res;
-        DeserializationError error = deserializeJson(res, http.getString());
-        if (!error) {
-            JsonArray entries = res["entries"];
-            if (!entries.isNull()) {
-                // Store card UID -> studentId mapping
-                prefs.begin("whitelist", false);
-                prefs.clear();
-                for (JsonObject entry : entries) {
-                    const char* uid = entry["uid"];
-                    const char* sid = entry["sid"];
-                    if (uid && sid) {
-                        prefs.putString(uid, sid);
-                    }
-                }
-                prefs.end();
-                
-                // Store studentId -> biometricId mapping (separate namespace)
-                prefs.begin("biometrics", false);
-                prefs.clear();
-                for (JsonObject entry : entries) {
-                    const char* sid = entry["sid"];
-                    uint16_t bioId = entry["bioId"] | 0;
-                    if (sid && bioId > 0) {
-                        prefs.putUShort(sid, bioId);
-                    }
-                }
-                prefs.end();
-                
-                DEBUG_PRINTF("[SYNC] Whitelist updated: %d entries\n", entries.size());
-            }
+    CloudResponse head;
+    int httpCode = cloud.request("GET", path.c_str(), headers.c_str()) ? cloud.readHead(head) : -1;
+    if (httpCode == 304) {
+        whitelistFetchStats.hits++;
+        DEBUG_PRINTLN("[SYNC] Whitelist not modified");
+    } else if (httpCode == 200) {
+        whitelistFetchStats.misses++;
+        // Decode straight off the socket - the body is never buffered
+        WhitelistSyncSink sink;
+        String etag = head.etag;
+        if (strncmp(head.contentType, WL_WIRE_CONTENT_TYPE, strlen(WL_WIRE_CONTENT_TYPE)) == 0) {
+            WhitelistBinaryDecoder decoder(sink);
+            ingestWhitelist(decoder, sink, since, etag);
+        } else {
+            WhitelistStreamParser parser(sink);
+            ingestWhitelist(parser, sink, since, etag);
         }
     } else {
         DEBUG_PRINTF("[SYNC] Whitelist sync failed: %d\n", httpCode);
     }
     
-    http.end();
-    delete client;
+    cloud.endRequest();
+}
+
+// Store a config reply (JSON { pmk, secret, debug, version }) with its ETag
+void applySystemConfig(const String& etag, const char* json, size_t len) {
+    JsonDocument res;
+    DeserializationError error = deserializeJson(res, json, len);
+    if (error) return;
+
+    const char* pmk = res["pmk"];
+    const char* secret = res["secret"];
+    bool debug = res["debug"] | true;
+    uint32_t version = res["version"] | 0;
+    
+    // Update if the version or the payload digest changed (or first time)
+    if ((version != configVersion || etag != configEtag) && pmk && secret) {
+        espNowPmk = String(pmk);
+        espNowSharedSecret = String(secret);
+        debugModeEnabled = debug;
+        configVersion = version;
+        configEtag = etag;
+        
+        // Persist to NVS
+        prefs.begin("config", false);
+        prefs.putString("pmk", espNowPmk);
+        prefs.putString("secret", espNowSharedSecret);
+        prefs.putBool("debug", debugModeEnabled);
+        prefs.putULong("version", configVersion);
+        prefs.putString("etag", configEtag);
+        prefs.end();
+        
+        DEBUG_PRINTLN("[CONFIG] System configuration updated from Convex");
+        
+        // Re-initialize ESP-NOW with new PMK
+        // Note: This requires ESP-NOW to be restarted with new encryption keys
+        // For simplicity, we just store it - full re-init would require more work
+    }
 }
 
 /**
@@ -489,125 +1014,442 @@ void syncWhitelist() {
  * Called after registration and periodically (hourly).
  */
 void syncSystemConfig() {
-    if (hardwareToken.isEmpty() || WiFi.status() != WL_CONNECTED) return;
-    
-    WiFiClientSecure* client = createSecureClient();
-    HTTPClient http;
-    http.setTimeout(HTTP_TIMEOUT_MS);
+    if (hardwareToken.isEmpty() || !cloudReady()) return;
     
-    String url = convexUrl + "/api/config?chipId=" + WiFi.macAddress();
-    if (!http.begin(*client, url)) {
-        delete client;
-        return;
+    String path = "/api/config?chipId=" + WiFi.macAddress();
+    String headers = "Authorization: Bearer " + hardwareToken + "\r\n";
+    if (!configEtag.isEmpty()) {
+        headers += "If-None-Match: " + configEtag + "\r\n";
     }
     
-    http.addHeader("Authorization", "Bearer " + hardwareToken);
+    CloudResponse head;
+    int httpCode = cloud.request("GET", path.c_str(), headers.c_str()) ? cloud.readHead(head) : -1;
+    String reply;
+    if (httpCode == 304) {
+        configFetchStats.hits++;
+        DEBUG_PRINTLN("[CONFIG] Config not modified");
+    } else if (httpCode == 200 && readCloudString(reply)) {
+        configFetchStats.misses++;
+        applySystemConfig(head.etag, reply.c_str(), reply.length());
+    } else {
+        DEBUG_PRINTF("[CONFIG] Config sync failed: %d\n", httpCode);
+    }
     
-    int httpCode = http.GET();
-    if (httpCode == 200) {
+    cloud.endRequest();
+}
+
+// =============================================================================
+// CLOUD SYNC (one POST /api/sync per cycle)
+// =============================================================================
+// Set when the server has no /api/sync (404): the per-endpoint calls are
+// used until reboot
+bool cloudSyncMissing = false;
+
+// Roster/config refreshes that are due (WHITELIST_DUE / CONFIG_DUE): the
+// next exchange asks for them, per endpoint they are fetched directly
+bool whitelistDue = false;
+bool configDue = false;
+
+// millis() of the last complete exchange (0 = none yet)
+unsigned long cloudSyncedAt = 0;
+
+bool useCloudSync() {
+    return CLOUD_SYNC && !cloudSyncMissing;
+}
+
+// Applies the sections of a sync reply: the log acknowledgement, the
+// config, and the roster, decoded as it streams in
+class CloudSyncSink : public SyncSink {
+public:
+    bool logsStored = false;       // The server stored (and acknowledged) the batch
+    bool configSent = false;
+    bool rosterSent = false;
+
+    CloudSyncSink(const LogBatchCursor& logs, uint32_t since)
+        : _logs(logs), _since(since), _binaryDecoder(_roster), _jsonParser(_roster) {}
+
+    bool onLogReply(const char* json, size_t len) override {
         JsonDocument res;
-        DeserializationError error = deserializeJson(res, http.getString());
-        if (!error) {
-            const char* pmk = res["pmk"];
-            const char* secret = res["secret"];
-            bool debug = res["debug"] | true;
-            uint32_t version = res["version"] | 0;
-            
-            // Only update if version changed (or first time)
-            if (version != configVersion && pmk && secret) {
-                espNowPmk = String(pmk);
-                espNowSharedSecret = String(secret);
-                debugModeEnabled = debug;
-                configVersion = version;
-                
-                // Persist to NVS
-                prefs.begin("config", false);
-                prefs.putString("pmk", espNowPmk);
-                prefs.putString("secret", espNowSharedSecret);
-                prefs.putBool("debug", debugModeEnabled);
-                prefs.putULong("version", configVersion);
-                prefs.end();
-                
-                DEBUG_PRINTLN("[CONFIG] System configuration updated from Convex");
-                
-                // Re-initialize ESP-NOW with new PMK
-                // Note: This requires ESP-NOW to be restarted with new encryption keys
-                // For simplicity, we just store it - full re-init would require more work
-            }
+        if (deserializeJson(res, json, len) != DeserializationError::Ok) return true;
+        logsStored = res["success"] == true &&
+                     (!_logs.hasRange() || (res["acked"].is<uint32_t>() && res["acked"].as<uint32_t>() == _logs.last()));
+        return true;
+    }
+
+    bool onConfig(const char* etag, const char* json, size_t len) override {
+        configSent = true;
+        applySystemConfig(etag, json, len);
+        return true;
+    }
+
+    bool onWhitelistBegin(const char* etag, bool binary) override {
+        rosterSent = true;
+        _etag = etag;
+        _binary = binary;
+        return true;
+    }
+
+    bool onWhitelistData(const char* data, size_t len) override {
+        _rosterBytes += (long)len;
+        return _binary ? _binaryDecoder.feed(data, len) : _jsonParser.feed(data, len);   // false stops reading
+    }
+
+    bool onWhitelistEnd() override {
+        _rosterDone = true;
+        return true;
+    }
+
+    // After the body: stage/merge the roster if one came in full
+    void finish() {
+        if (!rosterSent) return;
+        long received = _rosterDone ? _rosterBytes : -1;
+        if (_binary) {
+            applyWhitelist(_binaryDecoder, _roster, _since, _etag, received);
+        } else {
+            applyWhitelist(_jsonParser, _roster, _since, _etag, received);
+        }
+    }
+
+private:
+    const LogBatchCursor& _logs;
+    uint32_t _since;
+    WhitelistSyncSink _roster;
+    WhitelistBinaryDecoder _binaryDecoder;
+    WhitelistStreamParser _jsonParser;
+    String _etag;
+    bool _binary = false;
+    bool _rosterDone = false;
+    long _rosterBytes = 0;
+};
+
+// Counters sent with each exchange (stored on the device record;
+// names: mobile/convex/lib/sync.ts deviceHealth)
+void addHealth(SyncHeaders& headers) {
+    uint32_t queued, queueHigh, queueFull;
+    Storage::getLogQueue(queued, queueHigh, queueFull);
+    LogRecoveryStats tapRecovery, logRecovery;
+    uint32_t logBootUs;
+    Storage::getLogRecovery(tapRecovery, logRecovery, logBootUs);
+
+    headers.health("uptime", (long)(millis() / 1000));
+    headers.health("heap", (long)ESP.getFreeHeap());
+    headers.health("heapMin", (long)ESP.getMinFreeHeap());
+    headers.health("backlog", (long)Storage::getLogCount());
+    headers.health("queueFull", (long)queueFull);
+    headers.health("badReads", (long)(tapRecovery.badReads + logRecovery.badReads));
+    headers.health("handshakes", (long)cloud.stats().handshakes);
+    headers.health("rssi", (long)WiFi.RSSI());
+}
+
+// One exchange: the next log batch (possibly empty) goes up with our
+// roster/config validators and health; the acknowledgement and, for the
+// sections that are due, whatever is newer come back. True if the batch
+// was stored.
+bool syncExchange(LogBatchCursor& logs) {
+    uint32_t since = whitelistSinceVersion();
+    bool wantWhitelist = whitelistDue;
+    bool wantConfig = configDue;
+    SyncHeaders headers;
+    headers.whitelist(since, whitelistEtagLive() ? whitelistEtag.c_str() : nullptr, WHITELIST_BINARY_WIRE);
+    headers.config(configEtag.c_str());
+    headers.want(wantWhitelist, wantConfig);
+    headers.firmware(FIRMWARE_VERSION);
+    addHealth(headers);
+
+    LogUpload upload(cloud, LOG_BINARY_WIRE);
+    if (!cloud.beginRequest() ||
+        !upload.begin(cloud.host(), "/api/sync", hardwareToken.c_str(), WiFi.macAddress().c_str(), headers.str())) {
+        DEBUG_PRINTLN("[SYNC] Sync: connect failed");
+        cloud.endRequest(false);
+        return false;
+    }
+    logs.fill(upload);
+    CloudResponse head;
+    int httpCode = upload.finish(logs.hasRange(), logs.first(), logs.last()) ? cloud.readHead(head) : -1;
+    if (httpCode != 200) {
+        char reply[64];
+        if (httpCode > 0) cloud.readBody(reply, sizeof(reply));
+        cloud.endRequest();
+        if (httpCode == 404) {
+            cloudSyncMissing = true;
+            DEBUG_PRINTLN("[SYNC] Server has no /api/sync: syncing per endpoint");
+        } else {
+            DEBUG_PRINTF("[SYNC] Sync failed: %d\n", httpCode);
         }
+        return false;
+    }
+
+    // Decode straight off the socket - the roster is never buffered
+    CloudSyncSink sink(logs, since);
+    SyncResponseReader reader(sink);
+    long received = cloud.readBody([&reader](const char* data, size_t len) {
+        return reader.feed(data, len);
+    });
+    cloud.endRequest();
+    bool sentBatch = upload.logs() > 0 || logs.hasRange();
+    bool stored = settleSyncReply(logs, sink);   // Ack and trim before the roster swap
+
+    if (received < 0 || !reader.complete()) {
+        DEBUG_PRINTF("[SYNC] Sync reply incomplete (%ld bytes)\n", received);
     } else {
-        DEBUG_PRINTF("[CONFIG] Config sync failed: %d\n", httpCode);
+        // Answered: the refreshes asked for are done until their next interval
+        if (wantWhitelist) {
+            whitelistDue = false;
+            if (sink.rosterSent) whitelistFetchStats.misses++;
+            else whitelistFetchStats.hits++;
+        }
+        if (wantConfig) {
+            configDue = false;
+            if (sink.configSent) configFetchStats.misses++;
+            else configFetchStats.hits++;
+        }
+        cloudSyncedAt = millis();
     }
-    
-    http.end();
-    delete client;
+    DEBUG_PRINTF("[SYNC] Synced: %u logs (%u bytes) up, %ld bytes down%s%s\n",
+        upload.logs(), upload.bodyBytes(), received,
+        sink.rosterSent ? ", roster" : "", sink.configSent ? ", config" : "");
+
+    if (!stored && sentBatch) DEBUG_PRINTLN("[SYNC] Log batch not acknowledged");
+    return stored;
+}
+
+// Everything the per-endpoint calls did, in one request per log batch:
+// a backlog longer than one batch takes further exchanges, whose validators
+// are current by then, so those replies carry only the acknowledgement.
+// With nothing to upload or refresh, a cycle only checks in every
+// CLOUD_SYNC_IDLE_MS so the device stays online.
+void syncCloud() {
+    if (hardwareToken.isEmpty()) return;
+
+    // Commit buffered taps so the upload and the trim cover the same records
+    Storage::flushLogs();
+
+    LogBatchCursor logs;
+    if (!logs.pending() && !whitelistDue && !configDue && cloudSyncedAt != 0 &&
+        millis() - cloudSyncedAt < CLOUD_SYNC_IDLE_MS) {
+        return;
+    }
+    if (!cloudReady()) return;
+    while (syncExchange(logs) && logs.pending()) {}
+    logs.trim();
 }
 
 // =============================================================================
 // NETWORK TASK (Core 0)
+// Sleeps until there is work (NetworkEvents.h): WiFi up/down from the WiFi
+// event handler, a logged tap from openDoor, or the nearest deadline in
+// networkTimers. Nothing wakes it while idle but those deadlines.
 // =============================================================================
+// Work that needs the link, armed only while connected
+#define NET_EVENTS_ONLINE (NET_EVENT_LOGS_DUE | NET_EVENT_WHITELIST_DUE | NET_EVENT_CONFIG_DUE | \
+                           NET_EVENT_HEARTBEAT_DUE | NET_EVENT_NTP_DUE)
+
+// WiFi event task
+void onWifiEvent(WiFiEvent_t event) {
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) postNetworkEvent(NET_EVENT_WIFI_UP);
+    else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) postNetworkEvent(NET_EVENT_WIFI_DOWN);
+}
+
+void onWifiConnected() {
+    DEBUG_PRINTF("[WIFI] Connected! IP: %s\n", WiFi.localIP().toString().c_str());
+    
+    NTPSync::begin();
+    
+    if (hardwareToken.isEmpty()) {
+        registerDevice();
+    }
+    
+    // Pending logs and the config right away, the roster too if there is no
+    // usable image (first boot or format change). With /api/sync these are
+    // one exchange.
+    uint32_t now = millis();
+    networkTimers.every(NET_EVENT_NTP_DUE, NTP_RETRY_MS, now, 0);
+    networkTimers.every(NET_EVENT_LOGS_DUE, LOG_SYNC_INTERVAL, now, 0);
+    networkTimers.every(NET_EVENT_CONFIG_DUE, CONFIG_SYNC_INTERVAL, now, 0);
+    networkTimers.every(NET_EVENT_WHITELIST_DUE, WHITELIST_SYNC_INTERVAL, now,
+                        rosterStore.hasImage() ? WHITELIST_SYNC_INTERVAL : 0);
+    networkTimers.every(NET_EVENT_HEARTBEAT_DUE, HEARTBEAT_INTERVAL, now);
+}
+
 void NetworkTask(void* pvParameters) {
+    WiFi.onEvent(onWifiEvent);
+    
     // Connect to WiFi
     if (!wifiSSID.isEmpty()) {
         WiFi.begin(wifiSSID.c_str(), wifiPass.c_str());
         DEBUG_PRINTF("[WIFI] Connecting to %s...\n", wifiSSID.c_str());
     }
+    if (WiFi.status() == WL_CONNECTED) postNetworkEvent(NET_EVENT_WIFI_UP);
     
     bool wasConnected = false;
     
     for (;;) {
+        // Until the nearest deadline, or forever if none is armed (offline)
+        uint32_t events = 0;
+        uint32_t wait = networkTimers.untilNext(millis());
+        xTaskNotifyWait(0, UINT32_MAX, &events,
+            wait == NET_TIMER_NONE ? portMAX_DELAY : pdMS_TO_TICKS(wait + portTICK_PERIOD_MS - 1));
         esp_task_wdt_reset();
+        networkWakeups++;
+        events |= networkTimers.expire(millis());
         
-        bool isConnected = (WiFi.status() == WL_CONNECTED);
-        
-        if (isConnected && !wasConnected) {
-            // Just connected
-            wasConnected = true;
-            DEBUG_PRINTF("[WIFI] Connected! IP: %s\n", WiFi.localIP().toString().c_str());
-            
-            NTPSync::begin();
-            
-            if (hardwareToken.isEmpty()) {
-                registerDevice();
+        if (events & (NET_EVENT_WIFI_UP | NET_EVENT_WIFI_DOWN)) {
+            bool isConnected = (WiFi.status() == WL_CONNECTED);
+            if (isConnected && !wasConnected) {
+                wasConnected = true;
+                onWifiConnected();
+                continue;   // Its first deadlines are due now
+            } else if (!isConnected && wasConnected) {
+                // Just disconnected - the TLS session is kept for resumption
+                wasConnected = false;
+                networkTimers.cancel(NET_EVENTS_ONLINE);
+                cloud.close();
+                DEBUG_PRINTLN("[WIFI] Disconnected");
             }
-            
-            // Fetch system config immediately after registration
-            syncSystemConfig();
-        } else if (!isConnected && wasConnected) {
-            // Just disconnected
-            wasConnected = false;
-            DEBUG_PRINTLN("[WIFI] Disconnected");
         }
+        if (!wasConnected) continue;   // Taps wait for the reconnect's upload
         
-        if (isConnected) {
+        if (events & NET_EVENT_NTP_DUE) {
             NTPSync::update();
-            
-            unsigned long now = millis();
-            if (now - lastWhitelistSync > WHITELIST_SYNC_INTERVAL) {
-                syncWhitelist();
-                lastWhitelistSync = now;
-            }
-            if (now - lastLogSync > LOG_SYNC_INTERVAL) {
-                syncLogs();
-                lastLogSync = now;
-            }
-            if (now - lastHeartbeat > HEARTBEAT_INTERVAL) {
-                sendToWatchman(MSG_HEARTBEAT);
-                lastHeartbeat = now;
-            }
-            if (now - lastConfigSync > CONFIG_SYNC_INTERVAL) {
-                syncSystemConfig();
-                lastConfigSync = now;
-            }
+            networkTimers.every(NET_EVENT_NTP_DUE, NTPSync::isTimeValid() ? NTP_UPDATE_MS : NTP_RETRY_MS, millis());
+        }
+        // Roster and config keep their own intervals: with /api/sync a due
+        // refresh rides on an exchange now, per endpoint it is a request
+        if (events & NET_EVENT_WHITELIST_DUE) whitelistDue = true;
+        if (events & NET_EVENT_CONFIG_DUE) configDue = true;
+        bool upload = (events & NET_EVENT_LOGS_DUE) ||
+                      ((events & (NET_EVENT_WHITELIST_DUE | NET_EVENT_CONFIG_DUE)) && useCloudSync());
+        // A fresh tap goes up shortly after, unless an upload is starting anyway
+        if ((events & NET_EVENT_LOG_READY) && !upload) {
+            networkTimers.within(NET_EVENT_LOGS_DUE, LOG_UPLOAD_DELAY_MS, millis());
+        }
+        if (upload) {
+            if (useCloudSync()) syncCloud();
+            else syncLogs();
+        }
+        // Per endpoint, or the server turned out to have no /api/sync
+        if (whitelistDue && !useCloudSync()) {
+            syncWhitelist();
+            whitelistDue = false;
+        }
+        if (configDue && !useCloudSync()) {
+            syncSystemConfig();
+            configDue = false;
+        }
+        if (events & NET_EVENT_HEARTBEAT_DUE) {
+            sendToWatchman(MSG_HEARTBEAT);
         }
-        
-        vTaskDelay(pdMS_TO_TICKS(5000));
     }
 }
 
 // =============================================================================
 // SERIAL COMMAND HANDLER
 // =============================================================================
+
+// One tap per line, straight to Serial (no String building):
+// [LOG] <seq> <epoch> <user> <method> [local] [denied]
+static void printLogLine(char kind, uint32_t seq, uint32_t timestamp, const char* user,
+                         const char* method, uint8_t flags) {
+    Serial.printf("[LOG] %c%u %u %s %s%s%s\n", kind, seq, timestamp, user, method,
+        (flags & LOG_FLAG_LOCAL_TIME) ? " local" : "", (flags & LOG_FLAG_DENIED) ? " denied" : "");
+}
+
+// Print one compact record if it is a tap; markers only update `expander`.
+// Taps whose roster is gone print their index and generation instead.
+static bool printCompactLog(const AccessLogRecord& rec, uint32_t seq, AccessLogExpander& expander) {
+    AccessLog log;
+    bool resolved = expander.expand(rec, log);
+    if (!accessLogIsTap(rec)) return false;
+    char user[40];
+    if (resolved) {
+        snprintf(user, sizeof(user), "%s", log.userId);
+    } else {
+        snprintf(user, sizeof(user), "#%u@gen%u", rec.userIdx, expander.generation());
+    }
+    printLogLine('T', seq, rec.timestamp, user, accessLogMethodName(rec.method), rec.flags);
+    return true;
+}
+
+// LOGS:SINCE - taps at or after `since`, oldest first: expanded logs, then
+// compact taps (upload order)
+static void printLogsSince(uint32_t since) {
+    uint32_t printed = 0, bad = 0, seq;
+    AccessLog log;
+    Storage::ExpandedIterator expanded = Storage::readExpandedLogs(false, since);
+    while (expanded.next(log, &seq)) {
+        printLogLine('E', seq, log.timestamp, log.userId, log.method, 0);
+        printed++;
+    }
+    bad += expanded.badFrames();
+
+    // Markers pass the time filter, so the expander follows every roster
+    AccessLogRecord rec;
+    AccessLogExpander expander(resolveLogUser, Storage::getLogContext());
+    Storage::TapIterator taps = Storage::readTaps(false, since);
+    while (taps.next(rec, &seq)) {
+        if (printCompactLog(rec, seq, expander)) printed++;
+    }
+    bad += taps.badFrames();
+    Serial.printf("[LOG] %u taps since %u (%u bad frames skipped)\n", printed, since, bad);
+}
+
+// LOGS:TAIL - the newest `n` taps, oldest first. A backward pass finds
+// where they start (and the roster in effect there), then a forward pass
+// prints them; expanded logs fill in when the compact taps are fewer.
+static void printLogTail(uint32_t n) {
+    AccessLogRecord rec;
+    uint32_t seq, start = 0, found = 0;
+    uint32_t generation = 0;
+    bool haveGeneration = false;
+    Storage::TapIterator back = Storage::readTaps(true);
+    while (back.next(rec, &seq)) {
+        if (found == n) {
+            if (rec.method != LOG_METHOD_ROSTER) continue;
+            generation = rec.timestamp;
+            haveGeneration = true;
+            break;
+        }
+        if (!accessLogIsTap(rec)) continue;
+        found++;
+        start = seq;
+    }
+    uint32_t bad = back.badFrames();
+
+    uint32_t printed = 0;
+    if (found < n) {
+        // Older taps, expanded before a roster swap
+        AccessLog log;
+        uint32_t from = 0, more = 0;
+        Storage::ExpandedIterator expandedBack = Storage::readExpandedLogs(true);
+        while (more < n - found && expandedBack.next(log, &seq)) {
+            from = seq;
+            more++;
+        }
+        Storage::ExpandedIterator expanded = Storage::readExpandedLogs();
+        expanded.seek(from);
+        while (more > 0 && expanded.next(log, &seq)) {
+            printLogLine('E', seq, log.timestamp, log.userId, log.method, 0);
+            printed++;
+            more--;
+        }
+        bad += expandedBack.badFrames() + expanded.badFrames();
+    }
+
+    if (found > 0) {
+        AccessLogExpander expander(resolveLogUser, haveGeneration ? generation : Storage::getLogContext());
+        Storage::TapIterator taps = Storage::readTaps();
+        taps.seek(start);
+        while (found > 0 && taps.next(rec, &seq)) {
+            if (printCompactLog(rec, seq, expander)) {
+                printed++;
+                found--;
+            }
+        }
+        bad += taps.badFrames();
+    }
+    Serial.printf("[LOG] %u taps (%u bad frames skipped)\n", printed, bad);
+}
+
 void handleSerial() {
     if (!Serial.available()) return;
     
@@ -629,6 +1471,7 @@ void handleSerial() {
             prefs.end();
             
             Serial.printf("[CONFIG] WiFi credentials saved. Restarting...\n");
+            Storage::flushLogs();
             delay(1000);
             ESP.restart();
         } else {
@@ -712,8 +1555,90 @@ void handleSerial() {
         Serial.printf("[INFO] NTP: %s\n", NTPSync::isTimeValid() ? "Synced" : "Not synced");
         Serial.printf("[INFO] Token: %s\n", hardwareToken.isEmpty() ? "None" : "Set");
         Serial.printf("[INFO] Logs pending: %d\n", Storage::getLogCount());
+        AccessLogStats logStats = Storage::getLogStats();
+#if LOG_RAW_PARTITION
+        uint32_t minErases, maxErases;
+        Storage::getLogWear(minErases, maxErases);
+        Serial.printf("[INFO] Log ring: %u taps in %u writes, %u sector erases (%u-%u per sector)\n",
+            logStats.appends, logStats.commits, logStats.opens, minErases, maxErases);
+#else
+        Serial.printf("[INFO] Log writes: %u taps in %u commits (max batch %u), %u opens\n",
+            logStats.appends, logStats.commits, logStats.maxBatch, logStats.opens);
+#endif
+        size_t tapSegments, logSegments, maxSegments;
+        uint32_t deletedSegments;
+        Storage::getLogSegments(tapSegments, logSegments, maxSegments, deletedSegments);
+        Serial.printf("[INFO] Log segments: taps %u, expanded %u (max %u each), %u deleted after upload\n",
+            (unsigned)tapSegments, (unsigned)logSegments, (unsigned)maxSegments, deletedSegments);
+        LogRecoveryStats tapRecovery, logRecovery;
+        uint32_t logBootUs;
+        Storage::getLogRecovery(tapRecovery, logRecovery, logBootUs);
+        Serial.printf("[INFO] Log recovery: opened in %u us, cut %u frames (%u bytes), %u bad reads\n",
+            logBootUs, tapRecovery.framesCut + logRecovery.framesCut,
+            tapRecovery.bytesCut + logRecovery.bytesCut, tapRecovery.badReads + logRecovery.badReads);
+        Serial.printf("[INFO] At-rest encryption: %s\n", Storage::cipherName());
+        uint32_t queued, queueHigh, queueFull;
+        Storage::getLogQueue(queued, queueHigh, queueFull);
+        Serial.printf("[INFO] Log queue: %u waiting (max %u of %u), %u written in place\n",
+            queued, queueHigh, (unsigned)LOG_QUEUE_SLOTS, queueFull);
+        Serial.printf("[INFO] Tap log latency: %u taps, p50 %u us, p99 %u us, max %u us\n",
+            tapLogLatency.count(), tapLogLatency.percentile(0.50f),
+            tapLogLatency.percentile(0.99f), tapLogLatency.max());
+        Serial.printf("[INFO] Not modified (304/200): whitelist %u/%u, config %u/%u\n",
+            whitelistFetchStats.hits, whitelistFetchStats.misses,
+            configFetchStats.hits, configFetchStats.misses);
+        const CloudLinkStats& cloudStats = cloud.stats();
+        Serial.printf("[INFO] Cloud link: %u requests, %u on a kept connection, %u handshakes "
+            "(%u resumed, %.0f%%), %u connect failures, %u dropped by server\n",
+            cloudStats.requests, cloudStats.reused, cloudStats.handshakes, cloudStats.resumed,
+            cloudStats.handshakes ? 100.0f * cloudStats.resumed / cloudStats.handshakes : 0.0f,
+            cloudStats.connectFailures, cloudStats.dropped);
+        Serial.printf("[INFO] Cloud latency: handshake p50 %u ms, max %u ms; request p50 %u ms, p99 %u ms\n",
+            cloud.handshakeLatency().percentile(0.50f) / 1000, cloud.handshakeLatency().max() / 1000,
+            cloud.requestLatency().percentile(0.50f) / 1000, cloud.requestLatency().percentile(0.99f) / 1000);
+        Serial.printf("[INFO] Cloud sync: %s\n", useCloudSync() ? "one /api/sync per cycle" : "per endpoint");
+        Serial.printf("[INFO] Network task: %u wakeups in %lu s\n", networkWakeups, millis() / 1000);
+#if WHITELIST_CAMPUS_STORE
+        xSemaphoreTake(campusMutex, portMAX_DELAY);
+        Serial.printf("[INFO] Whitelist: %u entries (v%u, gen %u, campus file %u bytes)\n",
+            campusWhitelist.count(), whitelistSinceVersion(), campusWhitelist.generation(),
+            campusWhitelist.fileBytes());
+        Serial.printf("[INFO] Blocks: %u, index %u bytes RAM, block reads: %u, cache hits: %u\n",
+            campusWhitelist.blockCount(), campusWhitelist.indexBytes(),
+            campusWhitelist.blockReads(), campusWhitelist.cacheHits());
+        xSemaphoreGive(campusMutex);
+#else
+        WhitelistStore::Reader reader(whitelistStore);
+        const WhitelistImage& image = reader.image();
+        Serial.printf("[INFO] Whitelist: %u entries (v%u, gen %u, slot %d, %u bytes flash)\n",
+            image.count(), whitelistSinceVersion(), image.generation(),
+            reader.slot(), image.imageSize());
+        Serial.printf("[INFO] Bloom: %u bits (%u bytes), k=%u, est. FP %.2f%%, rejects: %u\n",
+            image.bloomBits(), image.bloomBits() / 8, image.bloomHashes(),
+            100.0f * image.bloomFalsePositiveRate(), bloomRejects);
+#endif
         Storage::printInfo();
     }
+    // Log inspection: LOGS:TAIL n, LOGS:SINCE epoch (or LOGS:TAIL:n, LOGS:SINCE:epoch)
+    else if (cmd.startsWith("LOGS:TAIL ") || cmd.startsWith("LOGS:TAIL:")) {
+        long n = cmd.substring(10).toInt();
+        if (n > 0) {
+            printLogTail((uint32_t)n);
+        } else {
+            Serial.println("[ERROR] Format: LOGS:TAIL n");
+        }
+    }
+    else if (cmd.startsWith("LOGS:SINCE ") || cmd.startsWith("LOGS:SINCE:")) {
+        long since = cmd.substring(11).toInt();
+        if (since > 0) {
+            printLogsSince((uint32_t)since);
+        } else {
+            Serial.println("[ERROR] Format: LOGS:SINCE epoch");
+        }
+    }
+    else if (cmd.startsWith("LOGS")) {
+        Serial.println("[ERROR] Format: LOGS:TAIL n or LOGS:SINCE epoch");
+    }
     else if (cmd == "HELP") {
         Serial.println("Commands:");
         Serial.println("  WIFI:ssid:password - Set WiFi credentials");
@@ -725,6 +1650,8 @@ void handleSerial() {
         Serial.println("  ENROLL:VEIN:id     - Enroll vein (1-1000)");
         Serial.println("  MAC                - Show MAC address");
         Serial.println("  STATUS             - Show system status");
+        Serial.println("  LOGS:TAIL n        - Print the newest n taps");
+        Serial.println("  LOGS:SINCE epoch   - Print taps since a Unix time");
     }
     else {
         Serial.println("[ERROR] Unknown command. Type HELP for list.");
@@ -789,6 +1716,12 @@ void setup() {
     espNowSharedSecret = prefs.getString("secret", "");
     debugModeEnabled = prefs.getBool("debug", true);
     configVersion = prefs.getULong("version", 0);
+    configEtag = prefs.getString("etag", "");
+    prefs.end();
+    
+    prefs.begin("wlsync", true);
+    whitelistEtag = prefs.getString("etag", "");
+    whitelistEtagGen = prefs.getULong("gen", 0);
     prefs.end();
     
     // Use defaults if not configured yet
@@ -799,6 +1732,25 @@ void setup() {
         espNowSharedSecret = DEFAULT_ESP_NOW_SECRET;  // Fallback until config is fetched
     }
     
+#if WHITELIST_CAMPUS_STORE
+    // Load the sparse block index (header + ~8 bytes per 255 cards)
+    campusMutex = xSemaphoreCreateMutex();
+    campusWhitelist.setCipher(Storage::cipher());
+    if (!campusMutex || !campusWhitelist.begin(Storage::vfsPath(WHITELIST_CAMPUS_FILE).c_str())) {
+        Serial.println("[WARN] Campus whitelist init failed");
+    }
+#else
+    // Map the whitelist image (no copy into RAM, boot cost independent of roster size)
+    whitelistStore.setCipher(Storage::cipher());
+    if (!whitelistPartition.begin("whitelist") || !whitelistStore.begin()) {
+        Serial.println("[WARN] Whitelist partition not found");
+    } else if (!whitelistStore.hasImage()) {
+        migrateWhitelistFromNVS();
+    }
+#endif
+    Storage::setLogRoster(rosterStore.generation());  // Taps log user indexes into this roster
+    Storage::startLogWriter();                        // Taps are queued from here on
+    
     // Initialize biometrics
     if (FaceAuth::begin(FaceSerial, FACE_RX_PIN, FACE_TX_PIN)) {
         Serial.println("[BOOT] Face module OK");
@@ -875,6 +1827,7 @@ void setup() {
 void loop() {
     esp_task_wdt_reset();
     handleSerial();
+    Storage::pollLogs();
     
     // Continue any ongoing vein enrollment
     if (FingerVeinAuth::getEnrollStep() > 0) {
@@ -901,41 +1854,34 @@ void loop() {
     uint8_t uidLength = 0;
     
     if (nfc.readPassiveTargetID(PN532_MIFARE_ISO14443A, uid, &uidLength, 100)) {
-        // Convert UID to hex string
+#if DEBUG_MODE
+        // Convert UID to hex string (debug output only)
         char cardUID[15] = {0};  // 7 bytes * 2 + null
         for (uint8_t i = 0; i < uidLength && i < 7; i++) {
             sprintf(&cardUID[i * 2], "%02X", uid[i]);
         }
-        
         DEBUG_PRINTF("[NFC] Card: %s\n", cardUID);
+#endif
         
-        // Check whitelist
-        prefs.begin("whitelist", true);
-        bool isInWhitelist = prefs.isKey(cardUID);
-        String sid = isInWhitelist ? prefs.getString(cardUID) : "";
-        prefs.end();
+        // Check whitelist (one record per card - role, flags and template)
+        CardAccess card;
+        bool isInWhitelist = lookupCard(uid, uidLength, card);
         
         if (isInWhitelist) {
-            // Check if biometric verification required (students)
-            if (sid.startsWith("STU")) {
-                // Look up expected biometric ID for this student
-                prefs.begin("biometrics", true);
-                uint16_t expectedBioId = prefs.getUShort(sid.c_str(), 0);
-                prefs.end();
-                
-                if (expectedBioId == 0) {
-                    DEBUG_PRINTLN("[ACCESS] Student has no enrolled biometric");
+            if (card.requiresBiometric()) {
+                if (card.rec.bioId == 0) {
+                    DEBUG_PRINTLN("[ACCESS] Card requires biometric, none enrolled");
                     ledDenied();
                     Serial.println("[ACCESS] Denied - No biometric enrolled");
-                } else if (runBiometricCheck(expectedBioId)) {
-                    openDoor(sid, "NFC+BIO");
+                } else if (runBiometricCheck(card)) {
+                    openDoor(card, LOG_METHOD_NFC_BIO);
                 } else {
                     ledDenied();
                     Serial.println("[ACCESS] Denied - Biometric mismatch");
                 }
             } else {
                 // Staff/Admin - NFC only
-                openDoor(sid, "NFC");
+                openDoor(card, LOG_METHOD_NFC);
             }
         } else {
             Serial.println("[ACCESS] Denied - Not in whitelist");
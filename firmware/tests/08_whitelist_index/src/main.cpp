@@ -0,0 +1,149 @@
+/**
+ * Whitelist Index Benchmark
+ * ==========================
+ *
+ * PURPOSE: Measure tap lookup latency of the Gatekeeper RAM whitelist
+ *          index (WhitelistIndex.h) at 100, 1k and 10k entries.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware needed - runs on the development machine
+ *
+ * BASELINE:
+ * The old tap path formatted the UID with sprintf and looked it up by
+ * hex string key. The baseline below models that as sprintf + a linear
+ * strcmp scan, which is roughly what an NVS page scan does per tap.
+ *
+ * EXPECTED OUTPUT:
+ * - Every whitelisted card is found, every unknown card is rejected
+ * - Biometric requirement follows the record's role (unknown = required)
+ * - Index lookups stay well under a microsecond as the roster grows
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "WhitelistIndex.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const int LOOKUPS = 200000;
+
+struct Card {
+    uint8_t uid[WL_UID_MAX_LEN];
+    uint8_t len;
+};
+
+static std::vector<Card> makeCards(size_t n, std::mt19937& rng) {
+    std::vector<Card> cards(n);
+    for (auto& c : cards) {
+        c.len = (rng() & 1) ? 7 : 4;
+        for (uint8_t i = 0; i < c.len; i++) c.uid[i] = (uint8_t)rng();
+    }
+    return cards;
+}
+
+static void toHex(const Card& c, char* out) {
+    for (uint8_t i = 0; i < c.len; i++) sprintf(&out[i * 2], "%02X", c.uid[i]);
+}
+
+static bool runSize(size_t n) {
+    std::mt19937 rng(1234 + n);
+    std::vector<Card> members = makeCards(n, rng);
+    std::vector<Card> strangers = makeCards(1024, rng);
+
+    // Build the index the same way syncWhitelist() does
+    WhitelistIndex index;
+    if (!index.reserve(n)) {
+        printf("  [FAIL] reserve(%zu)\n", n);
+        return false;
+    }
+    char userId[WL_USER_ID_LEN];
+    auto t0 = Clock::now();
+    for (size_t i = 0; i < n; i++) {
+        snprintf(userId, sizeof(userId), "user%06zu", i);
+        index.add(members[i].uid, members[i].len, userId, (uint16_t)(i % 1000));
+    }
+    index.finalize();
+    double buildMs = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+
+    // Correctness
+    for (size_t i = 0; i < n; i++) {
+        const WhitelistRecord* rec = index.find(members[i].uid, members[i].len);
+        snprintf(userId, sizeof(userId), "user%06zu", i);
+        if (!rec || strcmp(index.userId(rec), userId) != 0) {
+            printf("  [FAIL] member %zu not found\n", i);
+            return false;
+        }
+    }
+
+    // Index lookup latency (half hits, half misses)
+    volatile size_t hits = 0;
+    t0 = Clock::now();
+    for (int i = 0; i < LOOKUPS; i++) {
+        const Card& c = (i & 1) ? strangers[i % strangers.size()] : members[i % n];
+        if (index.find(c.uid, c.len)) hits = hits + 1;
+    }
+    double indexNs = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / LOOKUPS;
+
+    // Baseline: sprintf + linear scan of hex string keys
+    std::vector<char> keys(n * 15);
+    for (size_t i = 0; i < n; i++) toHex(members[i], &keys[i * 15]);
+    int baselineLookups = LOOKUPS / 20;
+    volatile size_t baseHits = 0;
+    t0 = Clock::now();
+    for (int i = 0; i < baselineLookups; i++) {
+        const Card& c = (i & 1) ? strangers[i % strangers.size()] : members[i % n];
+        char hex[15] = {0};
+        toHex(c, hex);
+        for (size_t k = 0; k < n; k++) {
+            if (strcmp(&keys[k * 15], hex) == 0) { baseHits = baseHits + 1; break; }
+        }
+    }
+    double baseNs = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / baselineLookups;
+
+    printf("  %6zu entries | build %7.2f ms | index %7.1f ns | baseline %10.1f ns | RAM %7zu B\n",
+        n, buildMs, indexNs, baseNs, index.memoryUsage());
+    return true;
+}
+
+int main() {
+    printf("\n=== Whitelist Index Benchmark ===\n\n");
+
+    // UID parsing accepts both firmware and seed-data formats
+    uint8_t uid[WL_UID_MAX_LEN];
+    bool parseOk = WhitelistIndex::parseHexUid("04A1B2C3", uid, sizeof(uid)) == 4 &&
+                   WhitelistIndex::parseHexUid("04:1A:2B:AF", uid, sizeof(uid)) == 4 &&
+                   WhitelistIndex::parseHexUid("XYZ", uid, sizeof(uid)) == 0;
+    printf("[TEST] Hex UID parsing: %s\n", parseOk ? "PASS" : "FAIL");
+
+    // Access policy comes from the record's role, not the user ID text
+    WhitelistIndex roles;
+    roles.reserve(4);
+    roles.addHex("04000001", "STU-2024-001", 7, WL_ROLE_STUDENT);
+    roles.addHex("04000002", "STU-looking-teacher", 0, WL_ROLE_TEACHER);
+    roles.addHex("04000003", "legacy", 0, WL_ROLE_NONE);
+    roles.addHex("04000004", "T-1042", 0, WL_ROLE_LEGACY);   // migrateWhitelistFromNVS, non-student
+    roles.finalize();
+    const WhitelistRecord* student = roles.find((const uint8_t*)"\x04\x00\x00\x01", 4);
+    const WhitelistRecord* teacher = roles.find((const uint8_t*)"\x04\x00\x00\x02", 4);
+    const WhitelistRecord* legacy = roles.find((const uint8_t*)"\x04\x00\x00\x03", 4);
+    const WhitelistRecord* migrated = roles.find((const uint8_t*)"\x04\x00\x00\x04", 4);
+    bool roleOk = student && teacher && legacy && migrated &&
+                  student->role == WL_ROLE_STUDENT && (student->flags & WL_FLAG_REQUIRE_BIO) &&
+                  student->bioId == 7 &&
+                  teacher->role == WL_ROLE_TEACHER && !(teacher->flags & WL_FLAG_REQUIRE_BIO) &&
+                  (legacy->flags & WL_FLAG_REQUIRE_BIO) && !(migrated->flags & WL_FLAG_REQUIRE_BIO);
+    printf("[TEST] Role and access flags: %s\n\n", roleOk ? "PASS" : "FAIL");
+
+    bool ok = parseOk && roleOk;
+    const size_t sizes[] = {100, 1000, 10000};
+    for (size_t n : sizes) ok = runSize(n) && ok;
+
+    printf("\n%s\n", ok ? "All checks passed" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+/**
+ * Whitelist Bloom Filter Test
+ * ============================
+ *
+ * PURPOSE: Verify the bloom filter that the whitelist image carries
+ *          (BloomFilter.h / WhitelistImage.h) and measure how fast
+ *          unknown cards are rejected.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware needed
+ *
+ * WHAT IT CHECKS:
+ * - No false negatives: every whitelisted card passes the pre-check
+ * - Measured false-positive rate is close to the rate reported in STATUS
+ * - The filter survives a commit + remount (it lives in the image)
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "WhitelistImage.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const char* PARTITION_FILE = "bloom_partition.bin";
+static const size_t PARTITION_SIZE = 1024 * 1024;
+static const int STRANGERS = 200000;
+
+struct Card {
+    uint8_t uid[WL_UID_MAX_LEN];
+    uint8_t len;
+};
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("[TEST] %-52s %s\n", what, ok ? "PASS" : "FAIL");
+    if (!ok) failures++;
+}
+
+static std::vector<Card> makeCards(size_t n, std::mt19937& rng) {
+    std::vector<Card> cards(n);
+    for (auto& c : cards) {
+        c.len = (rng() & 1) ? 7 : 4;
+        for (uint8_t i = 0; i < c.len; i++) c.uid[i] = (uint8_t)rng();
+    }
+    return cards;
+}
+
+static void runSize(size_t n) {
+    std::mt19937 rng(99 + n);
+    std::vector<Card> members = makeCards(n, rng);
+    std::vector<Card> strangers = makeCards(STRANGERS, rng);
+
+    remove(PARTITION_FILE);
+    {
+        FlashPartition part;
+        part.begin(PARTITION_FILE, PARTITION_SIZE);
+        WhitelistStore store(part);
+        store.begin();
+
+        WhitelistIndex index;
+        index.reserve(n);
+        for (size_t i = 0; i < n; i++) index.add(members[i].uid, members[i].len, "user", 0);
+        index.finalize();
+        store.stage(index, 1);
+        store.activate();
+    }
+
+    // Remount: the filter must come back from flash
+    FlashPartition part;
+    part.begin(PARTITION_FILE, PARTITION_SIZE);
+    WhitelistStore store(part);
+    store.begin();
+    const WhitelistImage& image = store.active();
+
+    bool noFalseNegatives = true;
+    for (const Card& c : members) {
+        if (!image.mightContain(c.uid, c.len)) noFalseNegatives = false;
+    }
+    char label[64];
+    snprintf(label, sizeof(label), "%zu entries: no false negatives", n);
+    check(noFalseNegatives, label);
+
+    size_t falsePositives = 0;
+    auto t0 = Clock::now();
+    for (const Card& c : strangers) {
+        if (image.mightContain(c.uid, c.len)) falsePositives++;
+    }
+    double bloomNs = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / STRANGERS;
+
+    volatile size_t found = 0;
+    t0 = Clock::now();
+    for (const Card& c : strangers) {
+        if (image.find(c.uid, c.len)) found = found + 1;
+    }
+    double searchNs = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / STRANGERS;
+
+    float measured = (float)falsePositives / STRANGERS;
+    float expected = image.bloomFalsePositiveRate();
+    snprintf(label, sizeof(label), "%zu entries: FP rate within 2x of estimate", n);
+    check(measured <= expected * 2.0f + 0.001f, label);
+
+    printf("  %6zu entries | %6u bits (%5u B) k=%u | FP est %.3f%% measured %.3f%% | reject %5.1f ns vs search %5.1f ns\n",
+        n, image.bloomBits(), image.bloomBits() / 8, image.bloomHashes(),
+        100.0f * expected, 100.0f * measured, bloomNs, searchNs);
+}
+
+int main() {
+    printf("\n=== Whitelist Bloom Filter Test ===\n\n");
+
+    // Empty roster: everything is rejected
+    uint8_t bits[8] = {0};
+    uint8_t uid[4] = {0x04, 0xA1, 0xB2, 0xC3};
+    check(!BloomFilter::mightContain(bits, 64, BLOOM_HASHES, uid, 4), "Empty filter rejects");
+    BloomFilter::add(bits, 64, BLOOM_HASHES, uid, 4);
+    check(BloomFilter::mightContain(bits, 64, BLOOM_HASHES, uid, 4), "Added UID passes");
+
+    const size_t sizes[] = {100, 1000, 5000};
+    for (size_t n : sizes) runSize(n);
+
+    remove(PARTITION_FILE);
+    printf("\n%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
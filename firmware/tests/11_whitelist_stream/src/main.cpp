@@ -0,0 +1,351 @@
+/**
+ * Whitelist Stream Ingestion Test
+ * ================================
+ *
+ * PURPOSE: Verify that a /api/whitelist response can be parsed as it
+ *          arrives (WhitelistStream.h) and written straight into the flash
+ *          image, and compare peak heap against buffering the whole body.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware needed - the partition is a file mapped with mmap()
+ *
+ * WHAT IT CHECKS:
+ * - Same result for any chunking of the body (1 byte up to a TCP segment)
+ * - Key order does not matter; unknown keys and escapes are skipped
+ * - Delta responses deliver adds/removes, truncated bodies are rejected
+ * - An unsorted roster is refused and the live image stays untouched
+ * - Peak heap: whole body + sort buffer vs. streaming (glibc hosts only)
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include "WhitelistImage.h"
+#include "WhitelistStream.h"
+
+// -----------------------------------------------------------------------------
+// Heap accounting: wrap the C allocator so every malloc (and operator new,
+// which calls it) counts toward a high-water mark.
+// -----------------------------------------------------------------------------
+#if defined(__GLIBC__)
+#include <malloc.h>
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void __libc_free(void*);
+}
+
+static long long heapNow = 0;
+static long long heapPeak = 0;
+
+static void heapAdd(void* p) {
+    if (!p) return;
+    heapNow += malloc_usable_size(p);
+    if (heapNow > heapPeak) heapPeak = heapNow;
+}
+
+extern "C" void* malloc(size_t n) {
+    void* p = __libc_malloc(n);
+    heapAdd(p);
+    return p;
+}
+
+extern "C" void* calloc(size_t n, size_t size) {
+    void* p = __libc_calloc(n, size);
+    heapAdd(p);
+    return p;
+}
+
+extern "C" void* realloc(void* old, size_t n) {
+    if (old) heapNow -= malloc_usable_size(old);
+    void* p = __libc_realloc(old, n);
+    heapAdd(p);
+    return p;
+}
+
+extern "C" void free(void* p) {
+    if (p) heapNow -= malloc_usable_size(p);
+    __libc_free(p);
+}
+
+static const bool HEAP_TRACKED = true;
+#else
+static long long heapNow = 0;
+static long long heapPeak = 0;
+static const bool HEAP_TRACKED = false;
+#endif
+
+static void heapReset() { heapPeak = heapNow; }
+static long long heapUsedSinceReset(long long base) { return heapPeak - base; }
+
+// -----------------------------------------------------------------------------
+
+static const char* PARTITION_FILE = "stream_partition.bin";
+static const size_t PARTITION_SIZE = 512 * 1024;  // Same as the device partition
+static const size_t TCP_CHUNK = 1460;             // HTTPClient read buffer
+
+struct Card {
+    uint8_t uid[WL_UID_MAX_LEN];
+    uint8_t len;
+    char sid[WL_USER_ID_LEN];
+    uint16_t bioId;
+};
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("[TEST] %-52s %s\n", what, ok ? "PASS" : "FAIL");
+    if (!ok) failures++;
+}
+
+static std::vector<Card> makeRoster(size_t n, std::mt19937& rng) {
+    std::vector<Card> cards(n);
+    for (size_t i = 0; i < n; i++) {
+        Card& c = cards[i];
+        memset(c.uid, 0, sizeof(c.uid));
+        c.len = (rng() & 1) ? 7 : 4;
+        for (uint8_t b = 0; b < c.len; b++) c.uid[b] = (uint8_t)rng();
+        // Convex document IDs are 32 lowercase alphanumerics
+        for (int k = 0; k < 31; k++) c.sid[k] = "abcdefghijklmnopqrstuvwxyz0123456789"[rng() % 36];
+        c.sid[31] = '\0';
+        c.bioId = (uint16_t)(rng() % 1000);
+    }
+    // Server order (lib/whitelist.ts sortWhitelistEntries)
+    std::sort(cards.begin(), cards.end(), [](const Card& a, const Card& b) {
+        WhitelistRecord rb;
+        memset(&rb, 0, sizeof(rb));
+        memcpy(rb.uid, b.uid, sizeof(rb.uid));
+        rb.uidLen = b.len;
+        return WhitelistIndex::compareKey(a.uid, a.len, rb) < 0;
+    });
+    return cards;
+}
+
+static std::string hexUid(const Card& c, bool colons) {
+    std::string out;
+    char buf[4];
+    for (uint8_t i = 0; i < c.len; i++) {
+        if (colons && i > 0) out += ':';
+        snprintf(buf, sizeof(buf), "%02X", c.uid[i]);
+        out += buf;
+    }
+    return out;
+}
+
+static std::string entryJson(const Card& c, bool colons) {
+    char bio[16];
+    snprintf(bio, sizeof(bio), "%u", c.bioId);
+    return std::string("{\"uid\":\"") + hexUid(c, colons) + "\",\"sid\":\"" + c.sid +
+           "\",\"role\":\"student\",\"bioId\":" + bio + "}";
+}
+
+// Full roster in the shape hardware.getWhitelist returns
+static std::string fullResponse(const std::vector<Card>& roster, uint32_t version, bool entriesFirst) {
+    std::string entries = "[";
+    for (size_t i = 0; i < roster.size(); i++) {
+        if (i) entries += ",";
+        entries += entryJson(roster[i], i % 3 == 0);
+    }
+    entries += "]";
+
+    std::string meta = "\"version\": " + std::to_string(version) + ", \"full\": true, "
+        "\"roomId\": \"k17abc\", \"roomName\": \"Room \\\"7\\\" \\u00e9\\\\\", "
+        "\"extra\": {\"nested\": [1, 2.5e3, {\"uid\": \"FFFF\"}], \"flag\": null}";
+    if (entriesFirst) return "{\"entries\":" + entries + ",\n  " + meta + "}";
+    return "{" + meta + ",\n  \"entries\": " + entries + "}";
+}
+
+// Test double for the firmware's sync sink: full rosters go straight to flash
+class TestSink : public WhitelistStreamSink {
+public:
+    WhitelistStore& store;
+    std::vector<WhitelistStreamEntry> adds;
+    std::vector<std::vector<uint8_t>> removes;
+    bool staging = false;
+
+    explicit TestSink(WhitelistStore& s) : store(s) {}
+
+    bool onEntry(WhitelistSection section, const WhitelistStreamEntry& entry) override {
+        if (section == WL_SECTION_ENTRIES) {
+            if (!staging) {
+                if (!store.beginStage(store.slotCapacity())) return false;
+                staging = true;
+            }
+            return store.append(entry.uid, entry.uidLen, entry.sid, entry.bioId, entry.role);
+        }
+        adds.push_back(entry);
+        return true;
+    }
+
+    bool onRemove(const uint8_t* uid, uint8_t uidLen) override {
+        removes.push_back(std::vector<uint8_t>(uid, uid + uidLen));
+        return true;
+    }
+};
+
+// Feed `body` in `chunk`-byte pieces, then commit what was streamed
+static bool ingest(WhitelistStore& store, const std::string& body, size_t chunk, uint32_t* version = nullptr) {
+    TestSink sink(store);
+    WhitelistStreamParser parser(sink);
+    for (size_t off = 0; off < body.size(); off += chunk) {
+        size_t n = std::min(chunk, body.size() - off);
+        if (!parser.feed(body.data() + off, n)) break;
+    }
+    if (!parser.complete() || !parser.full() || !parser.sawEntries()) {
+        store.abortStage();
+        return false;
+    }
+    if (!sink.staging && !store.beginStage(0)) return false;
+    if (!store.commitStage(parser.version())) return false;
+    store.activate();
+    if (version) *version = parser.version();
+    return true;
+}
+
+static bool rosterMatches(const WhitelistImage& image, const std::vector<Card>& roster) {
+    if (image.count() != roster.size()) return false;
+    char stored[WL_USER_ID_LEN];
+    for (const Card& c : roster) {
+        const WhitelistRecord* rec = image.find(c.uid, c.len);
+        if (!image.userId(rec, stored, sizeof(stored)) || strcmp(stored, c.sid) != 0 || rec->bioId != c.bioId) return false;
+    }
+    return true;
+}
+
+static void testParsing() {
+    std::mt19937 rng(7);
+    std::vector<Card> roster = makeRoster(300, rng);
+    std::string body = fullResponse(roster, 42, false);
+
+    remove(PARTITION_FILE);
+    FlashPartition part;
+    part.begin(PARTITION_FILE, PARTITION_SIZE);
+    WhitelistStore store(part);
+    store.begin();
+
+    const size_t chunks[] = {1, 7, 256, TCP_CHUNK, body.size()};
+    bool allOk = true;
+    for (size_t chunk : chunks) {
+        uint32_t version = 0;
+        allOk &= ingest(store, body, chunk, &version) && version == 42 && rosterMatches(store.active(), roster);
+    }
+    check(allOk, "Any chunk size yields the same image");
+
+    uint32_t version = 0;
+    check(ingest(store, fullResponse(roster, 43, true), 64, &version) && version == 43 &&
+          rosterMatches(store.active(), roster), "Entries before version/full still parse");
+    check(store.active().version() == 43, "Server version stored in the image");
+
+    // Delta: adds and removes are delivered, nothing staged
+    {
+        TestSink sink(store);
+        WhitelistStreamParser parser(sink);
+        std::string delta = "{\"version\":44,\"full\":false,\"since\":43,"
+            "\"adds\":[" + entryJson(roster[0], true) + "],\"removes\":[\"04A1B2C3\",\"04:00:00:01\"]}";
+        parser.feed(delta.data(), delta.size());
+        check(parser.complete() && !parser.full() && parser.version() == 44 &&
+              sink.adds.size() == 1 && sink.adds[0].role == WL_ROLE_STUDENT &&
+              sink.removes.size() == 2 && sink.removes[1].size() == 4 && !sink.staging,
+              "Delta response yields adds and removes");
+    }
+
+    // Truncated body: never committed
+    uint32_t gen = store.active().generation();
+    std::string cut = body.substr(0, body.size() / 2);
+    check(!ingest(store, cut, TCP_CHUNK) && store.active().generation() == gen &&
+          rosterMatches(store.active(), roster), "Truncated body is rejected");
+
+    check(!ingest(store, "{\"version\":1,\"entries\":[}", 1), "Malformed JSON is rejected");
+
+    // Unsorted roster (older server): refused, live image unchanged
+    std::vector<Card> shuffled = roster;
+    std::swap(shuffled[10], shuffled[200]);
+    check(!ingest(store, fullResponse(shuffled, 45, false), TCP_CHUNK) &&
+          store.active().version() == 43 && rosterMatches(store.active(), roster),
+          "Unsorted roster is refused");
+
+    // Empty roster still replaces the image
+    check(ingest(store, "{\"version\":46,\"full\":true,\"entries\":[]}", 5) &&
+          store.active().count() == 0 && store.active().version() == 46, "Empty roster clears the image");
+}
+
+static void benchHeap(size_t n) {
+    std::mt19937 rng(1000 + n);
+    std::vector<Card> roster = makeRoster(n, rng);
+    std::string response = fullResponse(roster, 7, false);
+
+    remove(PARTITION_FILE);
+    FlashPartition part;
+    part.begin(PARTITION_FILE, PARTITION_SIZE);
+    WhitelistStore store(part);
+    store.begin();
+
+    // Before: http.getString() holds the body, then a sort buffer of every
+    // entry (the JsonDocument tree the firmware also built is not counted)
+    long long base = heapNow;
+    heapReset();
+    {
+        std::string body;
+        for (size_t off = 0; off < response.size(); off += TCP_CHUNK) {
+            body.append(response, off, TCP_CHUNK);
+        }
+        WhitelistIndex index;
+        index.reserve(roster.size());
+        for (const Card& c : roster) index.add(c.uid, c.len, c.sid, c.bioId);
+        index.finalize();
+        store.stage(index, 7);
+        store.activate();
+    }
+    long long before = heapUsedSinceReset(base);
+    bool beforeOk = rosterMatches(store.active(), roster);
+
+    // After: TCP-sized chunks fed straight into the parser and flash writer
+    base = heapNow;
+    heapReset();
+    bool afterOk;
+    {
+        char* chunk = (char*)malloc(TCP_CHUNK);
+        TestSink sink(store);
+        WhitelistStreamParser parser(sink);
+        for (size_t off = 0; off < response.size(); off += TCP_CHUNK) {
+            size_t len = std::min(TCP_CHUNK, response.size() - off);
+            memcpy(chunk, response.data() + off, len);
+            parser.feed(chunk, len);
+        }
+        free(chunk);
+        afterOk = parser.complete() && store.commitStage(parser.version());
+        store.activate();
+    }
+    long long after = heapUsedSinceReset(base);
+    afterOk = afterOk && rosterMatches(store.active(), roster);
+
+    char label[64];
+    snprintf(label, sizeof(label), "%zu entries: streamed image matches buffered", n);
+    check(beforeOk && afterOk, label);
+    if (HEAP_TRACKED) {
+        printf("  %5zu entries | body %7zu B | peak heap buffered %7lld B | streamed %6lld B\n",
+            n, response.size(), before, after);
+    } else {
+        printf("  %5zu entries | body %7zu B | heap tracking needs glibc\n", n, response.size());
+    }
+}
+
+int main() {
+    printf("\n=== Whitelist Stream Ingestion Test ===\n\n");
+    testParsing();
+
+    printf("\n");
+    const size_t sizes[] = {100, 1000, 5000};
+    for (size_t n : sizes) benchHeap(n);
+
+    remove(PARTITION_FILE);
+    printf("\n%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,337 @@
+/**
+ * Whitelist Wire Format Benchmark
+ * ================================
+ *
+ * PURPOSE: Compare the binary /api/whitelist format (WhitelistBinary.h)
+ *          with the JSON one (WhitelistStream.h): bytes on the wire and
+ *          decode time, both on their own and streamed into the flash image.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware needed - the partition is a file mapped with mmap()
+ *
+ * WHAT IT CHECKS:
+ * - Both formats produce the same image (user IDs, bio IDs, versions)
+ * - Binary deltas resolve adds through the interned user table
+ * - A full roster with a skipped row (repeated card) still commits
+ * - Truncated, trailing-garbage and wrong-magic payloads are rejected
+ * - Payload size and decode time at 100 / 1k / 5k entries
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include "WhitelistImage.h"
+#include "WhitelistStream.h"
+#include "WhitelistBinary.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const char* PARTITION_FILE = "wire_partition.bin";
+static const size_t PARTITION_SIZE = 512 * 1024;  // Same as the device partition
+static const size_t TCP_CHUNK = 1460;             // HTTPClient read buffer
+
+struct Card {
+    uint8_t uid[WL_UID_MAX_LEN];
+    uint8_t len;
+    char sid[WL_USER_ID_LEN];
+    uint8_t role;
+    uint16_t bioId;
+};
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("[TEST] %-52s %s\n", what, ok ? "PASS" : "FAIL");
+    if (!ok) failures++;
+}
+
+static const char* ROLE_NAMES[] = {"", "student", "teacher", "staff", "admin"};
+
+static std::vector<Card> makeRoster(size_t n, std::mt19937& rng) {
+    std::vector<Card> cards(n);
+    for (Card& c : cards) {
+        memset(c.uid, 0, sizeof(c.uid));
+        c.len = (rng() & 1) ? 7 : 4;
+        for (uint8_t b = 0; b < c.len; b++) c.uid[b] = (uint8_t)rng();
+        // Convex document IDs are 32 lowercase alphanumerics
+        for (int k = 0; k < 31; k++) c.sid[k] = "abcdefghijklmnopqrstuvwxyz0123456789"[rng() % 36];
+        c.sid[31] = '\0';
+        c.role = (rng() % 10 == 0) ? WL_ROLE_TEACHER : WL_ROLE_STUDENT;
+        c.bioId = (uint16_t)(rng() % 1000);
+    }
+    std::sort(cards.begin(), cards.end(), [](const Card& a, const Card& b) {
+        WhitelistRecord rb;
+        memset(&rb, 0, sizeof(rb));
+        memcpy(rb.uid, b.uid, sizeof(rb.uid));
+        rb.uidLen = b.len;
+        return WhitelistIndex::compareKey(a.uid, a.len, rb) < 0;
+    });
+    return cards;
+}
+
+// Same shape as JSON.stringify(hardware.getWhitelist(...))
+static std::string encodeJson(const std::vector<Card>& roster, uint32_t version) {
+    std::string out = "{\"version\":" + std::to_string(version) +
+        ",\"full\":true,\"roomId\":\"k17e2x9m3n4p5q6r7s8t9u0v1w2x3y4z\",\"roomName\":\"Room 101\",\"entries\":[";
+    char buf[160];
+    for (size_t i = 0; i < roster.size(); i++) {
+        const Card& c = roster[i];
+        std::string uid;
+        for (uint8_t b = 0; b < c.len; b++) {
+            snprintf(buf, sizeof(buf), "%02X", c.uid[b]);
+            uid += buf;
+        }
+        snprintf(buf, sizeof(buf), "%s{\"uid\":\"%s\",\"sid\":\"%s\",\"role\":\"%s\",\"bioId\":%u}",
+            i ? "," : "", uid.c_str(), c.sid, ROLE_NAMES[c.role], c.bioId);
+        out += buf;
+    }
+    return out + "]}";
+}
+
+// Mirror of lib/whitelist.ts encodeWhitelistBinary
+static std::string encodeBinary(const std::vector<Card>& rows, uint32_t version, bool full,
+                                const std::vector<Card>& removes = {}) {
+    std::vector<std::string> users;
+    std::vector<uint16_t> userIdx;
+    for (const Card& c : rows) {
+        auto it = std::find(users.begin(), users.end(), std::string(c.sid));
+        userIdx.push_back((uint16_t)(it - users.begin()));
+        if (it == users.end()) users.push_back(c.sid);
+    }
+
+    std::string out(WL_WIRE_HEADER_LEN, '\0');
+    auto put16 = [](std::string& s, size_t at, uint16_t v) {
+        s[at] = (char)(v & 0xFF);
+        s[at + 1] = (char)(v >> 8);
+    };
+    auto put32 = [&](std::string& s, size_t at, uint32_t v) {
+        put16(s, at, (uint16_t)v);
+        put16(s, at + 2, (uint16_t)(v >> 16));
+    };
+    put32(out, 0, WL_WIRE_MAGIC);
+    put16(out, 4, WL_WIRE_HEADER_LEN);
+    out[6] = WL_WIRE_FORMAT;
+    out[7] = full ? WL_WIRE_FLAG_FULL : 0;
+    put32(out, 8, version);
+    put32(out, 12, users.size());
+    put32(out, 16, rows.size());
+    put32(out, 20, removes.size());
+
+    for (const std::string& u : users) {
+        out += (char)u.size();
+        out += u;
+    }
+    for (size_t i = 0; i < rows.size(); i++) {
+        const Card& c = rows[i];
+        out += (char)c.len;
+        out.append((const char*)c.uid, c.len);
+        std::string tail(5, '\0');
+        tail[0] = (char)c.role;
+        put16(tail, 1, c.bioId);
+        put16(tail, 3, userIdx[i]);
+        out += tail;
+    }
+    for (const Card& c : removes) {
+        out += (char)c.len;
+        out.append((const char*)c.uid, c.len);
+    }
+    return out;
+}
+
+// Streams full rosters into the store; collects delta adds/removes
+class TestSink : public WhitelistStreamSink {
+public:
+    WhitelistStore* store;
+    std::vector<std::string> deltaUsers;
+    std::vector<std::pair<WhitelistStreamEntry, std::string>> adds;
+    size_t removes = 0;
+    size_t entries = 0;
+    bool staging = false;
+
+    explicit TestSink(WhitelistStore* s) : store(s) {}
+
+    bool beginRoster() {
+        if (!store || staging) return true;
+        staging = store->beginStage(store->slotCapacity());
+        return staging;
+    }
+
+    bool onUser(WhitelistSection section, const char* sid) override {
+        if (section != WL_SECTION_ENTRIES) {
+            deltaUsers.push_back(sid);
+            return true;
+        }
+        return beginRoster() && (!store || store->appendUser(sid));
+    }
+
+    bool onEntry(WhitelistSection section, const WhitelistStreamEntry& entry) override {
+        entries++;
+        if (section != WL_SECTION_ENTRIES) {
+            const char* sid = entry.sid;
+            if (!sid) {
+                if (entry.userIdx >= deltaUsers.size()) return false;
+                sid = deltaUsers[entry.userIdx].c_str();
+            }
+            adds.push_back({entry, sid});
+            return true;
+        }
+        if (!beginRoster()) return false;
+        if (!store) return true;
+        return entry.sid ? store->append(entry.uid, entry.uidLen, entry.sid, entry.bioId, entry.role)
+                         : store->appendRecord(entry.uid, entry.uidLen, entry.userIdx, entry.bioId, entry.role);
+    }
+
+    bool onRemove(const uint8_t*, uint8_t) override {
+        removes++;
+        return true;
+    }
+};
+
+template <typename Decoder>
+static bool decodeAll(Decoder& decoder, const std::string& body, size_t chunk) {
+    for (size_t off = 0; off < body.size(); off += chunk) {
+        if (!decoder.feed(body.data() + off, std::min(chunk, body.size() - off))) return false;
+    }
+    return decoder.complete();
+}
+
+// Decode into the store and make the result live
+template <typename Decoder>
+static bool ingest(WhitelistStore& store, const std::string& body, size_t chunk) {
+    TestSink sink(&store);
+    Decoder decoder(sink);
+    if (!decodeAll(decoder, body, chunk) || !decoder.full()) {
+        store.abortStage();
+        return false;
+    }
+    if (!sink.staging && !store.beginStage(0)) return false;
+    if (!store.commitStage(decoder.version())) return false;
+    store.activate();
+    return true;
+}
+
+static bool rosterMatches(const WhitelistImage& image, const std::vector<Card>& roster) {
+    if (image.count() != roster.size()) return false;
+    char stored[WL_USER_ID_LEN];
+    for (const Card& c : roster) {
+        const WhitelistRecord* rec = image.find(c.uid, c.len);
+        if (!image.userId(rec, stored, sizeof(stored)) || strcmp(stored, c.sid) != 0 || rec->bioId != c.bioId) return false;
+    }
+    return true;
+}
+
+static void testFormats() {
+    std::mt19937 rng(11);
+    std::vector<Card> roster = makeRoster(400, rng);
+
+    remove(PARTITION_FILE);
+    FlashPartition part;
+    part.begin(PARTITION_FILE, PARTITION_SIZE);
+    WhitelistStore store(part);
+    store.begin();
+
+    std::string json = encodeJson(roster, 9);
+    std::string bin = encodeBinary(roster, 10, true);
+
+    check(ingest<WhitelistStreamParser>(store, json, TCP_CHUNK) && rosterMatches(store.active(), roster) &&
+          store.active().version() == 9, "JSON roster lands in the image");
+    check(ingest<WhitelistBinaryDecoder>(store, bin, 1) && rosterMatches(store.active(), roster) &&
+          store.active().version() == 10, "Binary roster (1-byte chunks) lands in the image");
+    check(ingest<WhitelistBinaryDecoder>(store, bin, 97) && rosterMatches(store.active(), roster),
+          "Binary roster (odd chunks) lands in the image");
+
+    // Delta: two adds sharing one user, one remove
+    {
+        std::vector<Card> adds = {roster[3], roster[5]};
+        strcpy(adds[1].sid, adds[0].sid);
+        std::string delta = encodeBinary(adds, 11, false, {roster[7]});
+        TestSink sink(nullptr);
+        WhitelistBinaryDecoder decoder(sink);
+        check(decodeAll(decoder, delta, 3) && !decoder.full() && decoder.version() == 11 &&
+              sink.deltaUsers.size() == 1 && sink.adds.size() == 2 && sink.removes == 1 &&
+              sink.adds[1].second == adds[0].sid && sink.adds[0].first.role == roster[3].role,
+              "Binary delta resolves interned users");
+    }
+
+    // A repeated card owned by a user no other row has: the row is skipped,
+    // its user stays in the table, and the rows after it still resolve
+    {
+        std::vector<Card> rows = roster;
+        Card repeat = rows[5];
+        strcpy(repeat.sid, "repeatedcardowner00000000000000");
+        rows.insert(rows.begin() + 6, repeat);
+        check(ingest<WhitelistBinaryDecoder>(store, encodeBinary(rows, 12, true), TCP_CHUNK) &&
+              rosterMatches(store.active(), roster) && store.active().version() == 12,
+              "Skipped row keeps its user interned, roster commits");
+    }
+
+    uint32_t gen = store.active().generation();
+    check(!ingest<WhitelistBinaryDecoder>(store, bin.substr(0, bin.size() - 3), TCP_CHUNK) &&
+          store.active().generation() == gen, "Truncated binary payload is rejected");
+    check(!ingest<WhitelistBinaryDecoder>(store, bin + "x", TCP_CHUNK), "Trailing bytes are rejected");
+    std::string badMagic = bin;
+    badMagic[0] ^= 0xFF;
+    check(!ingest<WhitelistBinaryDecoder>(store, badMagic, TCP_CHUNK), "Wrong magic is rejected");
+    check(rosterMatches(store.active(), roster), "Live image untouched by rejected payloads");
+}
+
+template <typename Decoder>
+static double decodeUs(const std::string& body, WhitelistStore* store, int rounds) {
+    auto t0 = Clock::now();
+    for (int r = 0; r < rounds; r++) {
+        TestSink sink(store);
+        Decoder decoder(sink);
+        decodeAll(decoder, body, TCP_CHUNK);
+        if (store) {
+            store->commitStage(decoder.version());
+            store->activate();
+        }
+    }
+    return std::chrono::duration<double, std::micro>(Clock::now() - t0).count() / rounds;
+}
+
+static void benchSize(size_t n) {
+    std::mt19937 rng(500 + n);
+    std::vector<Card> roster = makeRoster(n, rng);
+    std::string json = encodeJson(roster, 1);
+    std::string bin = encodeBinary(roster, 1, true);
+
+    remove(PARTITION_FILE);
+    FlashPartition part;
+    part.begin(PARTITION_FILE, PARTITION_SIZE);
+    WhitelistStore store(part);
+    store.begin();
+
+    const int rounds = n >= 5000 ? 20 : 100;
+    double jsonDecode = decodeUs<WhitelistStreamParser>(json, nullptr, rounds);
+    double binDecode = decodeUs<WhitelistBinaryDecoder>(bin, nullptr, rounds);
+    double jsonIngest = decodeUs<WhitelistStreamParser>(json, &store, 5);
+    double binIngest = decodeUs<WhitelistBinaryDecoder>(bin, &store, 5);
+
+    char label[64];
+    snprintf(label, sizeof(label), "%zu entries: binary image matches roster", n);
+    check(rosterMatches(store.active(), roster), label);
+    printf("  %5zu entries | JSON %7zu B  decode %8.1f us  ingest %8.1f us\n", n, json.size(), jsonDecode, jsonIngest);
+    printf("  %5s         | bin  %7zu B  decode %8.1f us  ingest %8.1f us  (%.1fx smaller)\n",
+        "", bin.size(), binDecode, binIngest, (double)json.size() / bin.size());
+}
+
+int main() {
+    printf("\n=== Whitelist Wire Format Benchmark ===\n\n");
+    testFormats();
+
+    printf("\n");
+    const size_t sizes[] = {100, 1000, 5000};
+    for (size_t n : sizes) benchSize(n);
+
+    remove(PARTITION_FILE);
+    printf("\n%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
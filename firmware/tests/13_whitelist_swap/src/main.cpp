@@ -0,0 +1,196 @@
+/**
+ * Whitelist Swap Benchmark
+ * =========================
+ *
+ * PURPOSE: Verify that taps keep working, without locks, while sync writes
+ *          a new roster into the other slot and flips it live
+ *          (WhitelistStore::Reader / activate()), and measure tap latency.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware needed - one thread taps, another syncs 5k-entry rosters
+ *
+ * WHAT IT CHECKS:
+ * - A card present in both the old and new roster is never denied
+ * - Every hit returns the user ID of one of the two generations
+ * - The writer never restages a slot a reader still holds
+ * - Tap latency percentiles: idle, during sync (lock-free), and during
+ *   sync with a mutex around lookups and the flip (previous design)
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "WhitelistImage.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const char* PARTITION_FILE = "swap_partition.bin";
+static const size_t PARTITION_SIZE = 512 * 1024;  // Same as the device partition
+static const size_t ROSTER = 5000;
+static const size_t CHURN = 500;                  // Cards that differ between generations
+static const int SYNCS = 12;
+
+struct Card {
+    uint8_t uid[WL_UID_MAX_LEN];
+    uint8_t len;
+};
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("[TEST] %-52s %s\n", what, ok ? "PASS" : "FAIL");
+    if (!ok) failures++;
+}
+
+static std::vector<Card> makeCards(size_t n, std::mt19937& rng) {
+    std::vector<Card> cards(n);
+    for (Card& c : cards) {
+        memset(c.uid, 0, sizeof(c.uid));
+        c.len = (rng() & 1) ? 7 : 4;
+        for (uint8_t i = 0; i < c.len; i++) c.uid[i] = (uint8_t)rng();
+    }
+    return cards;
+}
+
+static void sortCards(std::vector<Card>& cards) {
+    std::sort(cards.begin(), cards.end(), [](const Card& a, const Card& b) {
+        WhitelistRecord rb;
+        memset(&rb, 0, sizeof(rb));
+        memcpy(rb.uid, b.uid, sizeof(rb.uid));
+        rb.uidLen = b.len;
+        return WhitelistIndex::compareKey(a.uid, a.len, rb) < 0;
+    });
+}
+
+// Stream a roster into the inactive slot; user IDs carry the generation tag
+static bool writeRoster(WhitelistStore& store, const std::vector<Card>& roster, char tag) {
+    if (!store.beginStage(roster.size())) return false;
+    char userId[WL_USER_ID_LEN];
+    for (size_t i = 0; i < roster.size(); i++) {
+        snprintf(userId, sizeof(userId), "%c-user", tag);
+        if (!store.append(roster[i].uid, roster[i].len, userId, (uint16_t)i, WL_ROLE_STAFF)) {
+            store.abortStage();
+            return false;
+        }
+    }
+    return store.commitStage(1);
+}
+
+struct Latency {
+    std::vector<uint32_t> ns;
+    void report(const char* label) {
+        std::sort(ns.begin(), ns.end());
+        auto pct = [&](double p) { return ns[(size_t)(p * (ns.size() - 1))]; };
+        printf("  %-24s %9zu taps | p50 %5u ns | p99 %6u ns | p99.9 %7u ns | max %8u ns\n",
+            label, ns.size(), pct(0.50), pct(0.99), pct(0.999), ns.back());
+    }
+};
+
+enum Mode { IDLE, LOCK_FREE, MUTEX };
+
+static void run(Mode mode, const char* label) {
+    std::mt19937 rng(2024);
+    std::vector<Card> common = makeCards(ROSTER - CHURN, rng);
+    std::vector<Card> onlyA = makeCards(CHURN, rng);
+    std::vector<Card> onlyB = makeCards(CHURN, rng);
+    std::vector<Card> strangers = makeCards(1000, rng);
+
+    std::vector<Card> rosterA = common, rosterB = common;
+    rosterA.insert(rosterA.end(), onlyA.begin(), onlyA.end());
+    rosterB.insert(rosterB.end(), onlyB.begin(), onlyB.end());
+    sortCards(rosterA);
+    sortCards(rosterB);
+
+    remove(PARTITION_FILE);
+    FlashPartition part;
+    part.begin(PARTITION_FILE, PARTITION_SIZE);
+    WhitelistStore store(part);
+    store.begin();
+    writeRoster(store, rosterA, 'A');
+    store.activate();
+
+    std::mutex lock;  // MUTEX mode only
+    std::atomic<bool> done{false};
+    std::atomic<int> flips{0};
+    std::atomic<int> writeErrors{0};
+
+    std::thread writer([&] {
+        if (mode == IDLE) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        } else {
+            for (int i = 0; i < SYNCS; i++) {
+                bool b = (i % 2 == 0);
+                if (!writeRoster(store, b ? rosterB : rosterA, b ? 'B' : 'A')) {
+                    writeErrors++;
+                    continue;
+                }
+                if (mode == MUTEX) {
+                    std::lock_guard<std::mutex> g(lock);
+                    store.activate();
+                } else {
+                    store.activate();
+                }
+                flips++;
+            }
+        }
+        done = true;
+    });
+
+    Latency lat;
+    lat.ns.reserve(4000000);
+    size_t denied = 0, badUser = 0, i = 0;
+    while (!done) {
+        // Mostly members present in every generation, some strangers
+        bool member = (i % 4) != 0;
+        const Card& c = member ? common[i % common.size()] : strangers[i % strangers.size()];
+        i++;
+
+        auto t0 = Clock::now();
+        bool found = false;
+        char userId[WL_USER_ID_LEN] = {0};
+        {
+            std::unique_lock<std::mutex> g(lock, std::defer_lock);
+            if (mode == MUTEX) g.lock();
+            WhitelistStore::Reader reader(store);
+            const WhitelistImage& image = reader.image();
+            if (image.mightContain(c.uid, c.len)) {
+                const WhitelistRecord* rec = image.find(c.uid, c.len);
+                found = rec && image.userId(rec, userId, sizeof(userId));
+            }
+        }
+        lat.ns.push_back((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count());
+
+        if (member && !found) denied++;
+        if (found && strcmp(userId, "A-user") != 0 && strcmp(userId, "B-user") != 0) badUser++;
+    }
+    writer.join();
+
+    lat.report(label);
+    if (mode != IDLE) {
+        char what[80];
+        snprintf(what, sizeof(what), "%s: %d flips, no member denied", label, flips.load());
+        check(writeErrors == 0 && flips == SYNCS && denied == 0, what);
+        snprintf(what, sizeof(what), "%s: hits return a valid user ID", label);
+        check(badUser == 0, what);
+    }
+}
+
+int main() {
+    printf("\n=== Whitelist Swap Benchmark (%zu entries, %d syncs) ===\n\n", ROSTER, SYNCS);
+    run(IDLE, "idle");
+    run(LOCK_FREE, "during sync, lock-free");
+    run(MUTEX, "during sync, mutex");
+
+    remove(PARTITION_FILE);
+    printf("\n%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,299 @@
+/**
+ * Campus Whitelist Benchmark
+ * ===========================
+ *
+ * PURPOSE: Check that a campus-wide roster (50k cards) in the LittleFS
+ *          block file (WhitelistBlockFile.h) keeps taps bounded and boot
+ *          cheap.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware needed - plain files stand in for LittleFS
+ *
+ * BASELINE:
+ * A flat sorted record file searched with one seek + read per probe,
+ * i.e. the same data without the sparse block index (~16 reads per tap).
+ * Host reads come from the page cache, so the reads/tap column is the
+ * figure that carries over to LittleFS on flash, not the nanoseconds.
+ *
+ * WHAT IT CHECKS:
+ * - Every member is found with its user ID and role, strangers are not
+ * - At most one block read per tap (plus the user ID read on a hit)
+ * - Tap latency percentiles and boot-time index load at 50k entries
+ * - The merge cursor returns every record in key order
+ * - Power cut while staging keeps the old roster; one between the file
+ *   renames is finished at the next boot
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "WhitelistBlockFile.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const char* BASE = "campus_test";
+static const char* FLAT_FILE = "campus_flat.bin";
+static const size_t ROSTER = 50000;
+static const int TAPS = 20000;
+static const int BOOTS = 20;
+
+struct Card {
+    uint8_t uid[WL_UID_MAX_LEN];
+    uint8_t len;
+};
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("[TEST] %-56s %s\n", what, ok ? "PASS" : "FAIL");
+    if (!ok) failures++;
+}
+
+static std::vector<Card> makeCards(size_t n, std::mt19937& rng) {
+    std::vector<Card> cards(n);
+    for (Card& c : cards) {
+        memset(c.uid, 0, sizeof(c.uid));
+        c.len = (rng() & 1) ? 7 : 4;
+        for (uint8_t i = 0; i < c.len; i++) c.uid[i] = (uint8_t)rng();
+    }
+    return cards;
+}
+
+static bool lessCard(const Card& a, const Card& b) {
+    WhitelistRecord rb;
+    memset(&rb, 0, sizeof(rb));
+    memcpy(rb.uid, b.uid, sizeof(rb.uid));
+    rb.uidLen = b.len;
+    return WhitelistIndex::compareKey(a.uid, a.len, rb) < 0;
+}
+
+static void userIdFor(size_t i, char* out) {
+    snprintf(out, WL_USER_ID_LEN, "j57%024zu", i);  // Convex-ID sized
+}
+
+static uint8_t roleFor(size_t i) {
+    return (i % 10 == 0) ? WL_ROLE_TEACHER : WL_ROLE_STUDENT;
+}
+
+static bool writeRoster(WhitelistBlockStore& store, const std::vector<Card>& roster, uint32_t version) {
+    if (!store.beginStage(roster.size())) return false;
+    char userId[WL_USER_ID_LEN];
+    for (size_t i = 0; i < roster.size(); i++) {
+        userIdFor(i, userId);
+        if (!store.append(roster[i].uid, roster[i].len, userId, (uint16_t)(i % 1000), roleFor(i))) {
+            store.abortStage();
+            return false;
+        }
+    }
+    return store.commitStage(version);
+}
+
+static void removeFiles() {
+    const char* suffixes[] = {".blk", ".usr", ".blk.new", ".usr.new"};
+    char path[WL_BLOCK_PATH_LEN];
+    for (const char* s : suffixes) {
+        snprintf(path, sizeof(path), "%s%s", BASE, s);
+        remove(path);
+    }
+    remove(FLAT_FILE);
+}
+
+struct Latency {
+    std::vector<uint32_t> ns;
+    void report(const char* label, double readsPerTap) {
+        std::sort(ns.begin(), ns.end());
+        auto pct = [&](double p) { return ns[(size_t)(p * (ns.size() - 1))]; };
+        printf("  %-22s p50 %6u ns | p99 %6u ns | max %7u ns | %5.2f reads/tap\n",
+            label, pct(0.50), pct(0.99), ns.back(), readsPerTap);
+    }
+};
+
+// Baseline: binary search with one seek + read per probe
+static bool flatFind(FILE* f, size_t count, const Card& c, WhitelistRecord& out, size_t& reads) {
+    uint8_t key[WL_UID_MAX_LEN] = {0};
+    memcpy(key, c.uid, c.len);
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        fseek(f, (long)(mid * sizeof(WhitelistRecord)), SEEK_SET);
+        if (fread(&out, 1, sizeof(out), f) != sizeof(out)) return false;
+        reads++;
+        int cmp = WhitelistIndex::compareKey(key, c.len, out);
+        if (cmp == 0) return true;
+        if (cmp < 0) hi = mid;
+        else lo = mid + 1;
+    }
+    return false;
+}
+
+int main() {
+    printf("\n=== Campus Whitelist Benchmark (%zu entries) ===\n\n", ROSTER);
+    removeFiles();
+
+    std::mt19937 rng(50000);
+    std::vector<Card> roster = makeCards(ROSTER, rng);
+    std::sort(roster.begin(), roster.end(), lessCard);
+    roster.erase(std::unique(roster.begin(), roster.end(), [](const Card& a, const Card& b) {
+        return !lessCard(a, b) && !lessCard(b, a);
+    }), roster.end());
+    std::vector<Card> strangers = makeCards(5000, rng);
+
+    // --- Build ---
+    WhitelistBlockStore store;
+    store.begin(BASE);
+    auto t0 = Clock::now();
+    bool built = writeRoster(store, roster, 7) && store.activate();
+    double buildMs = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+    check(built && store.count() == roster.size(), "50k roster staged and activated");
+    printf("  build %.1f ms | %u blocks | file %zu KB | RAM index %zu B\n\n",
+        buildMs, store.blockCount(), store.fileBytes() / 1024, store.indexBytes());
+
+    // --- Correctness ---
+    bool allFound = true;
+    char userId[WL_USER_ID_LEN], expected[WL_USER_ID_LEN];
+    for (size_t i = 0; i < roster.size() && allFound; i++) {
+        WhitelistRecord rec;
+        userIdFor(i, expected);
+        allFound = store.find(roster[i].uid, roster[i].len, rec) &&
+                   store.userId(rec.userIdx, userId, sizeof(userId)) &&
+                   strcmp(userId, expected) == 0 && rec.role == roleFor(i) &&
+                   rec.flags == whitelistFlagsForRole(roleFor(i));
+    }
+    check(allFound, "Every member found with user ID and role");
+
+    size_t strangerHits = 0;
+    for (const Card& c : strangers) {
+        WhitelistRecord rec;
+        if (std::binary_search(roster.begin(), roster.end(), c, lessCard)) continue;
+        if (store.find(c.uid, c.len, rec)) strangerHits++;
+    }
+    check(strangerHits == 0, "Strangers are rejected");
+
+    // --- Tap latency: random members and strangers ---
+    Latency blockLat;
+    blockLat.ns.reserve(TAPS);
+    uint32_t readsBefore = store.blockReads();
+    for (int i = 0; i < TAPS; i++) {
+        const Card& c = (i % 4 == 0) ? strangers[rng() % strangers.size()] : roster[rng() % roster.size()];
+        auto s = Clock::now();
+        WhitelistRecord rec;
+        if (store.find(c.uid, c.len, rec)) store.userId(rec.userIdx, userId, sizeof(userId));
+        blockLat.ns.push_back((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - s).count());
+    }
+    double blockReads = (double)(store.blockReads() - readsBefore) / TAPS;
+    check(blockReads <= 1.0, "At most one block read per tap");
+
+    // --- Baseline: flat sorted file, one read per probe ---
+    FILE* flat = fopen(FLAT_FILE, "wb+");
+    for (size_t i = 0; i < roster.size(); i++) {
+        WhitelistRecord rec;
+        memset(&rec, 0, sizeof(rec));
+        memcpy(rec.uid, roster[i].uid, WL_UID_MAX_LEN);
+        rec.uidLen = roster[i].len;
+        rec.userIdx = (uint16_t)i;
+        fwrite(&rec, 1, sizeof(rec), flat);
+    }
+    fflush(flat);
+    Latency flatLat;
+    flatLat.ns.reserve(TAPS);
+    size_t flatReads = 0;
+    for (int i = 0; i < TAPS; i++) {
+        const Card& c = (i % 4 == 0) ? strangers[rng() % strangers.size()] : roster[rng() % roster.size()];
+        auto s = Clock::now();
+        WhitelistRecord rec;
+        flatFind(flat, roster.size(), c, rec, flatReads);
+        flatLat.ns.push_back((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - s).count());
+    }
+    fclose(flat);
+
+    printf("\n  Tap latency (%d taps, 25%% strangers):\n", TAPS);
+    blockLat.report("block file", blockReads);
+    flatLat.report("flat sorted file", (double)flatReads / TAPS);
+
+    // --- Boot: header + sparse index only ---
+    t0 = Clock::now();
+    bool booted = true;
+    for (int i = 0; i < BOOTS; i++) {
+        WhitelistBlockStore fresh;
+        booted = fresh.begin(BASE) && fresh.hasImage() && fresh.count() == roster.size() && booted;
+    }
+    double bootUs = std::chrono::duration<double, std::micro>(Clock::now() - t0).count() / BOOTS;
+    printf("\n  Boot index load: %.1f us (%zu B read)\n\n", bootUs,
+        sizeof(WhitelistBlockFileHeader) + store.indexBytes() + sizeof(WhitelistUsersHeader));
+    check(booted, "Reboot loads the roster from the index");
+
+    // Delta merges walk the live roster with a cursor
+    {
+        WhitelistBlockStore::Cursor cursor(store);
+        WhitelistRecord rec;
+        size_t n = 0;
+        bool inOrder = true;
+        while (cursor.next(rec, userId)) {
+            userIdFor(n, expected);
+            inOrder = inOrder && n < roster.size() && rec.uidLen == roster[n].len &&
+                      memcmp(rec.uid, roster[n].uid, WL_UID_MAX_LEN) == 0 && strcmp(userId, expected) == 0;
+            n++;
+        }
+        check(inOrder && n == roster.size() && !cursor.failed(), "Cursor walks the roster in key order");
+    }
+
+    // --- Power cuts ---
+    std::vector<Card> smaller(roster.begin(), roster.begin() + 1000);
+    {
+        // Cut while staging: .new files without a valid header
+        WhitelistBlockStore writer;
+        writer.begin(BASE);
+        writer.beginStage(smaller.size());
+        for (size_t i = 0; i < 500; i++) {
+            writer.append(smaller[i].uid, smaller[i].len, "x", 0, WL_ROLE_STAFF);
+        }
+        char path[WL_BLOCK_PATH_LEN];
+        snprintf(path, sizeof(path), "%s.blk.new", BASE);
+        FILE* f = fopen(path, "rb");
+        WhitelistBlockFileHeader h;
+        bool headerless = f && fread(&h, 1, sizeof(h), f) == sizeof(h) && h.magic != WL_BLOCK_MAGIC;
+        if (f) fclose(f);
+        // Reboot without abortStage() or activate()
+        WhitelistBlockStore rebooted;
+        rebooted.begin(BASE);
+        check(headerless && rebooted.count() == roster.size() && rebooted.version() == 7,
+              "Cut while staging: old roster stays live");
+    }
+    {
+        // Cut after the users file was swapped, before the block file
+        WhitelistBlockStore writer;
+        writer.begin(BASE);
+        bool staged = writeRoster(writer, smaller, 8);
+        char from[WL_BLOCK_PATH_LEN], to[WL_BLOCK_PATH_LEN];
+        snprintf(from, sizeof(from), "%s.usr.new", BASE);
+        snprintf(to, sizeof(to), "%s.usr", BASE);
+        remove(to);
+        rename(from, to);
+        WhitelistBlockStore rebooted;
+        rebooted.begin(BASE);
+        WhitelistRecord rec;
+        check(staged && rebooted.count() == smaller.size() && rebooted.version() == 8 &&
+              rebooted.find(smaller[10].uid, smaller[10].len, rec),
+              "Cut between renames: new roster finished at boot");
+    }
+    {
+        // Out-of-order input fails the stage and leaves the live roster alone
+        WhitelistBlockStore writer;
+        writer.begin(BASE);
+        writer.beginStage(2);
+        writer.append(smaller[1].uid, smaller[1].len, "a", 0, WL_ROLE_STAFF);
+        bool rejected = !writer.append(smaller[0].uid, smaller[0].len, "b", 0, WL_ROLE_STAFF) &&
+                        !writer.commitStage(9);
+        check(rejected && writer.version() == 8, "Out-of-order key rejected");
+    }
+
+    removeFiles();
+    printf("\n%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,271 @@
+/**
+ * Access Log Writer Benchmark
+ * ============================
+ *
+ * PURPOSE: Compare the group-committed access log (AccessLogFile.h, used by
+ *          Storage::appendLog) with the previous writer, which opened the
+ *          file to read its size, reopened it to append a record and closed
+ *          it again on every tap.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware needed - a plain file stands in for /logs.bin on LittleFS
+ *
+ * WHAT IT MEASURES:
+ * - Append latency percentiles (the call made while the door opens)
+ * - Opens and write+sync commits per 1,000 taps. On LittleFS every sync
+ *   (or close after a write) is a metadata commit - the flash write that
+ *   dominates an 8-byte append.
+ * Taps follow a class-change pattern: bursts ~6 s apart (unlock + debounce)
+ * with idle gaps, on a virtual clock; the loop polls every 100 ms.
+ *
+ * WHAT IT CHECKS:
+ * - Every tap is read back in order, including uncommitted ones
+ * - Only committed taps survive a power cut; reopen continues the count
+ * - A torn trailing record is cut off and later appends stay aligned
+ * - The file rotates before passing its size limit
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "AccessLogFile.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const char* LOG_FILE = "logs_test.bin";
+static const char* OLD_FILE = "logs_test.old.bin";
+static const size_t MAX_SIZE = 100 * 1024;        // MAX_LOG_FILE_SIZE
+static const uint32_t COMMIT_MS = 15000;          // LOG_COMMIT_INTERVAL_MS
+static const size_t COMMIT_RECORDS = 8;           // LOG_COMMIT_RECORDS
+static const int TAPS = 1000;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("[TEST] %-56s %s\n", what, ok ? "PASS" : "FAIL");
+    if (!ok) failures++;
+}
+
+static AccessLogRecord makeLog(uint32_t i) {
+    AccessLogRecord rec;
+    rec.timestamp = 1760000000 + i;
+    rec.userIdx = (uint16_t)(i * 7);
+    rec.method = (i % 3) ? LOG_METHOD_NFC_BIO : LOG_METHOD_NFC;
+    rec.flags = 0;
+    return rec;
+}
+
+static void resetFiles() {
+    remove(LOG_FILE);
+    remove(OLD_FILE);
+}
+
+static size_t fileSize(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fclose(f);
+    return n > 0 ? (size_t)n : 0;
+}
+
+// Previous Storage::appendLog: size check (open/close), then open/append/close
+struct BaselineWriter {
+    AccessLogStats stats = {};
+
+    size_t size() {
+        stats.opens++;
+        return fileSize(LOG_FILE);
+    }
+
+    bool append(const AccessLogRecord& log) {
+        if (size() >= MAX_SIZE) {
+            remove(OLD_FILE);
+            rename(LOG_FILE, OLD_FILE);
+        }
+        FILE* f = fopen(LOG_FILE, "ab");
+        if (!f) return false;
+        stats.opens++;
+        bool ok = fwrite(&log, 1, sizeof(log), f) == sizeof(log) &&
+                  fflush(f) == 0 && fsync(fileno(f)) == 0;  // LittleFS syncs on close
+        fclose(f);
+        stats.appends++;
+        stats.commits++;
+        stats.bytesWritten += sizeof(log);
+        return ok;
+    }
+};
+
+struct Result {
+    std::vector<uint32_t> appendUs;
+    double totalMs = 0;   // All log I/O: appends plus timer commits
+    AccessLogStats stats = {};
+};
+
+// Virtual tap times: bursts at class change, idle in between
+static std::vector<uint32_t> tapSchedule() {
+    std::mt19937 rng(7);
+    std::vector<uint32_t> at;
+    uint32_t now = 0;
+    while ((int)at.size() < TAPS) {
+        int burst = 10 + rng() % 30;
+        for (int i = 0; i < burst && (int)at.size() < TAPS; i++) {
+            now += 6000 + rng() % 4000;
+            at.push_back(now);
+        }
+        now += 60000 + rng() % 600000;
+    }
+    return at;
+}
+
+static void report(const char* label, Result& r) {
+    std::sort(r.appendUs.begin(), r.appendUs.end());
+    auto pct = [&](double p) { return r.appendUs[(size_t)(p * (r.appendUs.size() - 1))]; };
+    printf("  %-22s append p50 %5u us | p99 %5u us | max %6u us | log I/O %7.1f ms\n",
+        label, pct(0.50), pct(0.99), r.appendUs.back(), r.totalMs);
+    printf("  %-22s per 1000 taps: %4u opens, %4u commits (max batch %u)\n",
+        "", r.stats.opens * 1000 / TAPS, r.stats.commits * 1000 / TAPS,
+        r.stats.maxBatch ? r.stats.maxBatch : 1);
+}
+
+static Result runBaseline() {
+    resetFiles();
+    BaselineWriter writer;
+    Result r;
+    for (int i = 0; i < TAPS; i++) {
+        auto t0 = Clock::now();
+        writer.append(makeLog(i));
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0).count();
+        r.appendUs.push_back((uint32_t)us);
+        r.totalMs += us / 1000.0;
+    }
+    r.stats = writer.stats;
+    return r;
+}
+
+static Result runGrouped(const std::vector<uint32_t>& schedule) {
+    resetFiles();
+    AccessLogFile log;
+    Result r;
+    auto t0 = Clock::now();
+    log.begin(LOG_FILE, OLD_FILE, MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+    r.totalMs += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0).count() / 1000.0;
+
+    uint32_t now = 0;
+    for (int i = 0; i < TAPS; i++) {
+        // Main loop polls every 100 ms until the next tap
+        for (; now + 100 < schedule[i]; now += 100) {
+            t0 = Clock::now();
+            log.poll(now);
+            r.totalMs += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0).count() / 1000.0;
+        }
+        now = schedule[i];
+        t0 = Clock::now();
+        log.append(makeLog(i), now);
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0).count();
+        r.appendUs.push_back((uint32_t)us);
+        r.totalMs += us / 1000.0;
+    }
+    log.flush();
+    r.stats = log.stats();
+
+    bool inOrder = log.count() == (size_t)TAPS;
+    for (int i = 0; inOrder && i < TAPS; i++) {
+        AccessLogRecord got;
+        AccessLogRecord want = makeLog(i);
+        inOrder = log.read(i, got) && memcmp(&got, &want, sizeof(got)) == 0;
+    }
+    check(inOrder, "Every tap read back in order");
+    return r;
+}
+
+static void testPendingAndPowerCut() {
+    resetFiles();
+    AccessLogFile log;
+    log.begin(LOG_FILE, OLD_FILE, MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+    for (int i = 0; i < 11; i++) log.append(makeLog(i), 1000);  // One batch of 8 + 3 pending
+
+    AccessLogRecord got;
+    AccessLogRecord want = makeLog(10);
+    check(log.count() == 11 && log.pending() == 3 && log.read(10, got) &&
+          memcmp(&got, &want, sizeof(got)) == 0, "Uncommitted taps are counted and readable");
+    check(fileSize(LOG_FILE) == 8 * AccessLogFile::FRAME_SIZE, "Only full batches reach the file before the timer");
+
+    log.poll(1000 + COMMIT_MS - 1);
+    check(log.pending() == 3, "Timer does not commit early");
+    log.poll(1000 + COMMIT_MS);
+    check(log.pending() == 0 && fileSize(LOG_FILE) == 11 * AccessLogFile::FRAME_SIZE, "Timer commits the partial batch");
+
+    // Power cut: a second writer opens the file while the first holds pending taps
+    log.append(makeLog(11), 2000);
+    AccessLogFile after;
+    after.begin(LOG_FILE, OLD_FILE, MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+    check(after.count() == 11, "Power cut keeps committed taps, loses the pending one");
+    after.append(makeLog(11), 0);
+    after.flush();
+    check(after.count() == 12 && after.read(11, got), "Reopened log continues the count");
+}
+
+static void testTornTail() {
+    resetFiles();
+    {
+        AccessLogFile log;
+        log.begin(LOG_FILE, OLD_FILE, MAX_SIZE, COMMIT_MS, 1);
+        for (int i = 0; i < 5; i++) log.append(makeLog(i), 0);
+    }
+    FILE* f = fopen(LOG_FILE, "ab");
+    AccessLogRecord partial = makeLog(99);
+    fwrite(&partial, 1, sizeof(partial) / 2, f);  // Power cut mid-frame
+    fclose(f);
+
+    AccessLogFile log;
+    bool ok = log.begin(LOG_FILE, OLD_FILE, MAX_SIZE, COMMIT_MS, 1);
+    check(ok && log.count() == 5 && fileSize(LOG_FILE) == 5 * AccessLogFile::FRAME_SIZE, "Torn trailing record is cut off");
+
+    log.append(makeLog(5), 0);
+    AccessLogRecord got;
+    AccessLogRecord want = makeLog(5);
+    check(log.read(5, got) && memcmp(&got, &want, sizeof(got)) == 0, "Appends after the repair stay aligned");
+}
+
+static void testRotation() {
+    resetFiles();
+    const size_t small = 20 * AccessLogFile::FRAME_SIZE;
+    AccessLogFile log;
+    log.begin(LOG_FILE, OLD_FILE, small, COMMIT_MS, COMMIT_RECORDS);
+    for (int i = 0; i < 50; i++) log.append(makeLog(i), 0);
+    log.flush();
+    check(fileSize(LOG_FILE) <= small && fileSize(OLD_FILE) > 0 && fileSize(OLD_FILE) <= small,
+          "Log rotates before passing its size limit");
+
+    AccessLogRecord got;
+    AccessLogRecord want = makeLog(49);
+    check(log.read(log.count() - 1, got) && memcmp(&got, &want, sizeof(got)) == 0, "Newest tap is in the live file");
+}
+
+int main() {
+    printf("\n=== Access Log Writer Benchmark (%d taps, %zu-byte frames) ===\n\n", TAPS, AccessLogFile::FRAME_SIZE);
+
+    std::vector<uint32_t> schedule = tapSchedule();
+    Result before = runBaseline();
+    Result after = runGrouped(schedule);
+    report("open/write/close", before);
+    report("group commit", after);
+    check(after.stats.commits * 2 <= before.stats.commits, "Group commit at least halves flash commits");
+    check(after.stats.opens <= 1, "One open for the whole run");
+    printf("\n");
+
+    testPendingAndPowerCut();
+    testTornTail();
+    testRotation();
+
+    resetFiles();
+    printf("\n%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
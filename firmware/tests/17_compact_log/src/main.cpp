@@ -0,0 +1,300 @@
+/**
+ * Compact Access Log Test
+ * ========================
+ *
+ * PURPOSE: Verify the 8-byte access log records (AccessLogRecord.h) that
+ *          replaced 48-byte AccessLogs on flash, and how they are turned
+ *          back into user IDs for upload across roster swaps.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware needed - plain files stand in for /taps.bin and /logs.bin,
+ *    and a table of rosters stands in for the whitelist image
+ *
+ * WHAT IT MEASURES:
+ * - Taps held by one 100 KB file, compact vs expanded (CRC-framed on flash)
+ *
+ * WHAT IT CHECKS:
+ * - Taps expand to the same user ID, method and timestamp they were logged with
+ * - Expanding before a roster swap (as Storage::expandLogs does) keeps
+ *   every tap attributed to the right user
+ * - Taps whose roster is gone are dropped and counted, never misattributed
+ * - A /logs.bin left by older firmware is adopted and reads back unchanged
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "AccessLogSegments.h"
+
+static const char* TAPS_FILE = "taps_test.bin";
+static const char* TAPS_OLD_FILE = "taps_test.old.bin";
+static const char* LOGS_FILE = "logs_test.bin";
+static const char* LOGS_OLD_FILE = "logs_test.old.bin";
+static const char* LOGS_BASE = "logs_test";       // Segments logs_test.<n>
+static const size_t MAX_SIZE = 100 * 1024;
+static const uint32_t COMMIT_MS = 15000;          // LOG_COMMIT_INTERVAL_MS
+static const size_t COMMIT_RECORDS = 8;           // LOG_COMMIT_RECORDS
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("[TEST] %-58s %s\n", what, ok ? "PASS" : "FAIL");
+    if (!ok) failures++;
+}
+
+static void resetFiles() {
+    remove(TAPS_FILE);
+    remove(TAPS_OLD_FILE);
+    remove(LOGS_FILE);
+    remove(LOGS_OLD_FILE);
+    remove("logs_test.1");
+    remove("logs_test.man");
+}
+
+// User tables by roster generation; a sync replaces the live one
+static std::map<uint32_t, std::vector<std::string>> rosters;
+static uint32_t liveGen = 0;
+
+static bool resolveUser(uint32_t generation, uint16_t userIdx, char* out, size_t size) {
+    if (generation != liveGen) return false;
+    const std::vector<std::string>& users = rosters[generation];
+    if (userIdx >= users.size()) return false;
+    snprintf(out, size, "%s", users[userIdx].c_str());
+    return true;
+}
+
+// Roster `gen`: the same 500 students, in an order that changes per generation
+static void makeRoster(uint32_t gen) {
+    std::vector<std::string>& users = rosters[gen];
+    users.clear();
+    for (uint32_t i = 0; i < 500; i++) {
+        char id[32];
+        snprintf(id, sizeof(id), "j57%024u", (i * 37 + gen * 101) % 500);
+        users.push_back(id);
+    }
+}
+
+static AccessLogRecord makeTap(uint32_t i) {
+    AccessLogRecord rec;
+    rec.timestamp = 1760000000 + i;
+    rec.userIdx = (uint16_t)((i * 13) % 500);
+    rec.method = (i % 3) ? LOG_METHOD_NFC_BIO : LOG_METHOD_NFC;
+    rec.flags = (i % 4) ? 0 : LOG_FLAG_LOCAL_TIME;
+    return rec;
+}
+
+// What the tap should upload as, resolved against the roster it was logged in
+static AccessLog expected(const AccessLogRecord& rec, uint32_t gen) {
+    AccessLog log;
+    memset(&log, 0, sizeof(log));
+    log.timestamp = rec.timestamp;
+    snprintf(log.userId, sizeof(log.userId), "%s", rosters[gen][rec.userIdx].c_str());
+    snprintf(log.method, sizeof(log.method), "%s", accessLogMethodName(rec.method));
+    return log;
+}
+
+// Storage::appendLog: a marker whenever the roster differs from the last one
+struct Writer {
+    AccessLogFile taps;
+    uint32_t markedGen = 0;
+
+    void append(const AccessLogRecord& rec, uint32_t gen) {
+        if (markedGen != gen) {
+            taps.append(accessLogRosterMarker(gen), 0);
+            markedGen = gen;
+        }
+        taps.append(rec, 0);
+    }
+};
+
+static void testCapacity() {
+    // Each record is stored in a frame: 12 bytes of magic, size, seq and CRC
+    size_t expandedTaps = MAX_SIZE / ExpandedLogFile::FRAME_SIZE;
+    // One marker per roster: allow a sync every 50 taps
+    size_t compactTaps = MAX_SIZE / AccessLogFile::FRAME_SIZE * 50 / 51;
+    printf("  %zu-byte AccessLog:       %6zu taps per %zu KB file\n", sizeof(AccessLog), expandedTaps, MAX_SIZE / 1024);
+    printf("  %zu-byte AccessLogRecord: %6zu taps per %zu KB file (a roster marker every 50 taps)\n",
+        sizeof(AccessLogRecord), compactTaps, MAX_SIZE / 1024);
+    check(sizeof(AccessLogRecord) == 8, "Compact record is 8 bytes");
+    check(compactTaps >= 2.9 * expandedTaps, "Same file holds nearly 3x the taps");
+
+    // Fill a file to its limit and count what it really holds
+    resetFiles();
+    AccessLogFile taps;
+    taps.begin(TAPS_FILE, TAPS_OLD_FILE, MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+    uint32_t i = 0;
+    while (taps.size() + AccessLogFile::FRAME_SIZE <= MAX_SIZE) taps.append(makeTap(i++), 0);
+    taps.flush();
+    check(taps.count() == MAX_SIZE / AccessLogFile::FRAME_SIZE, "A full taps file holds 5,120 records");
+}
+
+static void testRoundTrip() {
+    resetFiles();
+    rosters.clear();
+    makeRoster(7);
+    liveGen = 7;
+
+    Writer w;
+    w.taps.begin(TAPS_FILE, TAPS_OLD_FILE, MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+    for (uint32_t i = 0; i < 1000; i++) w.append(makeTap(i), 7);
+    w.taps.flush();
+
+    AccessLogFile reopened;
+    reopened.begin(TAPS_FILE, TAPS_OLD_FILE, MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+    AccessLogExpander expander(resolveUser);
+    uint32_t matched = 0, taps = 0, localTime = 0;
+    for (size_t i = 0; i < reopened.count(); i++) {
+        AccessLogRecord rec;
+        AccessLog log;
+        if (!reopened.read(i, rec) || !expander.expand(rec, log)) continue;
+        AccessLog want = expected(makeTap(taps), 7);
+        if (memcmp(&log, &want, sizeof(log)) == 0) matched++;
+        if (rec.flags & LOG_FLAG_LOCAL_TIME) localTime++;
+        taps++;
+    }
+    check(reopened.count() == 1001, "One roster marker, then 1000 taps");
+    check(matched == 1000 && expander.unresolved() == 0, "Every tap expands to its user, method and time");
+    check(localTime == 250, "Local-time flag survives the round trip");
+}
+
+static void testRosterSwap() {
+    resetFiles();
+    rosters.clear();
+    makeRoster(1);
+    makeRoster(2);
+    makeRoster(3);
+    liveGen = 1;
+
+    Writer w;
+    w.taps.begin(TAPS_FILE, TAPS_OLD_FILE, MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+    ExpandedLogFile expanded;
+    expanded.begin(LOGS_FILE, LOGS_OLD_FILE, MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+
+    std::vector<AccessLog> want;
+    uint32_t i = 0;
+    for (uint32_t gen = 1; gen <= 3; gen++) {
+        for (uint32_t n = 0; n < 300; n++, i++) {
+            w.append(makeTap(i), gen);
+            want.push_back(expected(makeTap(i), gen));
+        }
+        if (gen == 3) break;
+
+        // Storage::expandLogs, then the swap
+        w.taps.flush();
+        AccessLogExpander expander(resolveUser);
+        for (size_t k = 0; k < w.taps.count(); k++) {
+            AccessLogRecord rec;
+            AccessLog log;
+            if (w.taps.read(k, rec) && expander.expand(rec, log)) expanded.append(log, 0);
+        }
+        expanded.flush();
+        w.taps.clear();
+        w.markedGen = 0;
+        liveGen = gen + 1;
+    }
+
+    // Upload order: expanded first, then the taps of the live roster
+    std::vector<AccessLog> got;
+    for (size_t k = 0; k < expanded.count(); k++) {
+        AccessLog log;
+        if (expanded.read(k, log)) got.push_back(log);
+    }
+    AccessLogExpander expander(resolveUser);
+    for (size_t k = 0; k < w.taps.count(); k++) {
+        AccessLogRecord rec;
+        AccessLog log;
+        if (w.taps.read(k, rec) && expander.expand(rec, log)) got.push_back(log);
+    }
+    bool same = got.size() == want.size();
+    for (size_t k = 0; same && k < got.size(); k++) same = memcmp(&got[k], &want[k], sizeof(AccessLog)) == 0;
+    check(same, "Two roster swaps: 900 taps upload with the right users");
+
+    // Without the expansion, the indexes would name other students
+    size_t differ = 0;
+    for (uint32_t n = 0; n < 300; n++) {
+        AccessLogRecord rec = makeTap(n);
+        if (rosters[1][rec.userIdx] != rosters[3][rec.userIdx]) differ++;
+    }
+    printf("  %zu of 300 gen-1 taps would name a different user under gen 3\n", differ);
+    check(differ > 0, "Roster order really changes between generations");
+}
+
+static void testStaleRoster() {
+    resetFiles();
+    rosters.clear();
+    makeRoster(1);
+    makeRoster(2);
+    liveGen = 1;
+
+    Writer w;
+    w.taps.begin(TAPS_FILE, TAPS_OLD_FILE, MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+    for (uint32_t i = 0; i < 20; i++) w.append(makeTap(i), 1);
+    liveGen = 2;  // Swapped without expanding (what expandLogs prevents)
+    for (uint32_t i = 20; i < 30; i++) w.append(makeTap(i), 2);
+
+    AccessLogExpander expander(resolveUser);
+    uint32_t resolved = 0, right = 0;
+    for (size_t k = 0; k < w.taps.count(); k++) {
+        AccessLogRecord rec;
+        AccessLog log;
+        if (!w.taps.read(k, rec) || !expander.expand(rec, log)) continue;
+        resolved++;
+        AccessLog want = expected(rec, 2);
+        if (memcmp(&log, &want, sizeof(log)) == 0 && rec.timestamp >= 1760000020) right++;
+    }
+    check(expander.unresolved() == 20 && resolved == 10 && right == 10,
+          "Taps of a replaced roster are dropped, not misattributed");
+
+    // A log with no marker at all (e.g. cleared mid-roster) resolves nothing
+    AccessLogExpander bare(resolveUser);
+    AccessLog log;
+    check(!bare.expand(makeTap(0), log) && bare.unresolved() == 1, "Taps before any marker are not resolved");
+}
+
+static void testLegacyFile() {
+    resetFiles();
+    // /logs.bin as written by firmware before compact records
+    FILE* f = fopen(LOGS_FILE, "wb");
+    std::vector<AccessLog> legacy;
+    for (uint32_t i = 0; i < 25; i++) {
+        AccessLog log;
+        memset(&log, 0, sizeof(log));
+        log.timestamp = 1750000000 + i;
+        snprintf(log.userId, sizeof(log.userId), "k17%024u", i);
+        snprintf(log.method, sizeof(log.method), "%s", (i % 2) ? "NFC+BIO" : "NFC");
+        fwrite(&log, 1, sizeof(log), f);
+        legacy.push_back(log);
+    }
+    fclose(f);
+
+    // Storage::begin: converted into the first segment
+    ExpandedLogSegments expanded;
+    expanded.begin(LOGS_BASE, MAX_SIZE, 4, COMMIT_MS, COMMIT_RECORDS);
+    bool adopted = expanded.adopt(LOGS_FILE);
+    bool same = adopted && expanded.count() == legacy.size();
+    for (size_t k = 0; same && k < legacy.size(); k++) {
+        AccessLog log;
+        same = expanded.read(k, log) && memcmp(&log, &legacy[k], sizeof(log)) == 0;
+    }
+    check(sizeof(AccessLog) == 48 && same, "Older firmware's /logs.bin reads back unchanged");
+}
+
+int main() {
+    printf("\n=== Compact Access Log Test ===\n\n");
+
+    testCapacity();
+    printf("\n");
+    testRoundTrip();
+    testRosterSwap();
+    testStaleRoster();
+    testLegacyFile();
+
+    resetFiles();
+    printf("\n%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,301 @@
+/**
+ * Acknowledged Log Upload Test
+ * =============================
+ *
+ * PURPOSE: Verify the cursor-based access log upload (syncLogs with
+ *          Storage::trimLogs) against a stand-in for the server's
+ *          /api/logs dedupe, on both log backends (AccessLogFile and
+ *          AccessLogRing). Compares it with the previous upload, which
+ *          sent the whole log and cleared it on HTTP 200.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware needed - a plain file stands in for /taps.bin and the host
+ *    FlashPartition for the `accesslog` partition
+ *
+ * WHAT IT MEASURES:
+ * - Taps lost when the door is used during an upload, old vs new
+ * - Largest request body, in taps
+ *
+ * WHAT IT CHECKS:
+ * - Taps logged during an upload are kept and sent next time
+ * - A batch whose acknowledgement is lost is resent and stored once
+ * - A reboot between the acknowledgement and the trim sends nothing twice
+ * - Sequence numbers and the roster context survive trims and reboots
+ * - Numbering continues after everything is trimmed
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "AccessLogFile.h"
+#include "AccessLogRing.h"
+
+static const char* TAPS_FILE = "taps_upload.bin";
+static const char* RING_FILE = "ring_upload.bin";
+static const size_t RING_SIZE = 128 * 1024;
+static const size_t MAX_SIZE = 100 * 1024;        // MAX_LOG_FILE_SIZE
+static const int BATCH = 50;                      // LOG_UPLOAD_BATCH
+static const uint32_t GEN = 4;                    // Live roster generation
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("[TEST] %-58s %s\n", what, ok ? "PASS" : "FAIL");
+    if (!ok) failures++;
+}
+
+static bool resolveUser(uint32_t generation, uint16_t userIdx, char* out, size_t size) {
+    if (generation != GEN) return false;
+    snprintf(out, size, "j57%024u", userIdx);
+    return true;
+}
+
+static AccessLogRecord makeTap(uint32_t i) {
+    AccessLogRecord rec;
+    rec.timestamp = 1760000000 + i * 7;
+    rec.userIdx = (uint16_t)(i % 400);
+    rec.method = LOG_METHOD_NFC;
+    rec.flags = 0;
+    return rec;
+}
+
+// hardware.syncLogs: a seq already stored with the same tap is a retry
+struct Server {
+    std::map<uint32_t, std::string> bySeq;
+    std::vector<std::string> stored;      // Every insert, to spot duplicates
+    int requests = 0;
+    int largest = 0;
+    int dropAckOf = -1;                   // Store this request, then lose the reply
+
+    struct Log { uint32_t seq; std::string key; };
+
+    // Returns the acknowledged `last`, or -1 if the reply never arrives
+    long post(const std::vector<Log>& logs, uint32_t last) {
+        int n = requests++;
+        if ((int)logs.size() > largest) largest = (int)logs.size();
+        for (const Log& log : logs) {
+            auto it = bySeq.find(log.seq);
+            if (it != bySeq.end() && it->second == log.key) continue;
+            bySeq[log.seq] = log.key;
+            stored.push_back(log.key);
+        }
+        return n == dropAckOf ? -1 : (long)last;
+    }
+
+    size_t unique() const { return std::set<std::string>(stored.begin(), stored.end()).size(); }
+};
+
+template <typename Log>
+static size_t tapsIn(Log& log) {
+    size_t taps = 0;
+    for (size_t i = 0; i < log.count(); i++) {
+        AccessLogRecord rec;
+        if (log.read(i, rec) && accessLogIsTap(rec)) taps++;
+    }
+    return taps;
+}
+
+static std::string keyOf(const AccessLog& log) {
+    return std::string(log.userId) + "@" + std::to_string(log.timestamp);
+}
+
+// Storage::appendLog: roster marker first, then taps
+template <typename Log>
+struct Device {
+    Log& log;
+    uint32_t markedGen = 0;
+    uint32_t nextTap = 0;
+
+    explicit Device(Log& l) : log(l) {}
+
+    void tap() {
+        if (markedGen != GEN) {
+            log.append(accessLogRosterMarker(GEN), 0);
+            markedGen = GEN;
+        }
+        log.append(makeTap(nextTap++), 0);
+    }
+
+    // syncLogs(): batches of BATCH taps, trim to the last acknowledged one.
+    // `during` runs after each request (taps while the upload is in flight).
+    int upload(Server& server, void (*during)(Device&) = nullptr, bool trim = true) {
+        log.flush();
+        size_t count = log.count();
+        AccessLogExpander expander(resolveUser, log.context());
+        size_t acked = 0;
+        uint32_t ackedContext = expander.generation();
+        while (acked < count) {
+            std::vector<Server::Log> batch;
+            size_t next = acked;
+            for (; next < count && (int)batch.size() < BATCH; next++) {
+                AccessLogRecord rec;
+                AccessLog out;
+                if (!log.read(next, rec) || !expander.expand(rec, out)) continue;
+                batch.push_back({log.seqAt(next), keyOf(out)});
+            }
+            uint32_t last = log.seqAt(next - 1);
+            long reply = batch.empty() ? (long)last : server.post(batch, last);
+            if (during) during(*this);
+            if (reply != (long)last) break;
+            acked = next;
+            ackedContext = expander.generation();
+        }
+        if (trim && acked > 0) log.trim(acked, ackedContext);
+        return (int)acked;
+    }
+};
+
+static void tapTwice(Device<AccessLogFile>& d) { d.tap(); d.tap(); }
+static void tapTwiceRing(Device<AccessLogRing>& d) { d.tap(); d.tap(); }
+
+// Previous syncLogs: read everything, POST, clear on 200
+static void testBaseline() {
+    remove(TAPS_FILE);
+    AccessLogFile log;
+    log.begin(TAPS_FILE, nullptr, MAX_SIZE, 15000, 1);
+    Device<AccessLogFile> d(log);
+    for (int i = 0; i < 200; i++) d.tap();
+
+    Server server;
+    std::vector<Server::Log> all;
+    AccessLogExpander expander(resolveUser);
+    for (size_t i = 0; i < log.count(); i++) {
+        AccessLogRecord rec;
+        AccessLog out;
+        if (log.read(i, rec) && expander.expand(rec, out)) all.push_back({0, keyOf(out)});
+    }
+    server.post(all, 0);
+    for (int i = 0; i < 6; i++) d.tap();   // Door used while the request is in flight
+    log.clear();
+    d.markedGen = 0;
+
+    printf("  clear on 200:   %3d taps in one request, %u of %u on the server, %u lost\n",
+        server.largest, (unsigned)server.unique(), d.nextTap, d.nextTap - (unsigned)server.unique());
+}
+
+template <typename Log>
+static void runScenarios(const char* label, Log& log, bool (*reopen)(Log&), void (*during)(Device<Log>&)) {
+    char what[96];
+    Device<Log> d(log);
+    for (int i = 0; i < 200; i++) d.tap();
+
+    // Pass 1: two taps land after every request
+    Server server;
+    d.upload(server, during);
+    int sent1 = server.requests;
+    d.upload(server);
+    printf("  %-14s %3d taps max per request, %u of %u on the server, %u lost\n",
+        label, server.largest, (unsigned)server.unique(), d.nextTap, d.nextTap - (unsigned)server.unique());
+    snprintf(what, sizeof(what), "%s: taps during an upload are kept", label);
+    check(server.unique() == d.nextTap && server.stored.size() == d.nextTap, what);
+    snprintf(what, sizeof(what), "%s: requests bounded to %d taps", label, BATCH);
+    check(server.largest <= BATCH && sent1 >= 4, what);
+
+    // Lost acknowledgement: the batch is resent and deduplicated
+    for (int i = 0; i < 120; i++) d.tap();
+    server.dropAckOf = server.requests + 1;
+    d.upload(server);
+    d.upload(server);
+    snprintf(what, sizeof(what), "%s: lost ack is resent, stored once", label);
+    check(server.unique() == d.nextTap && server.stored.size() == d.nextTap && tapsIn(log) == 0, what);
+
+    // Sequence numbers are stable across a trim and a reboot
+    for (int i = 0; i < 30; i++) d.tap();
+    size_t mid = log.count() / 2;
+    uint32_t seqMid = log.seqAt(mid);
+    AccessLogRecord before;
+    log.read(mid, before);
+    log.flush();
+    reopen(log);
+    AccessLogRecord after;
+    snprintf(what, sizeof(what), "%s: sequence numbers survive a reboot", label);
+    check(log.seqAt(mid) == seqMid && log.read(mid, after) && memcmp(&before, &after, sizeof(after)) == 0, what);
+
+    // Reboot after the server stored a pass but before the trim
+    d.upload(server, nullptr, false);
+    reopen(log);
+    size_t storedBefore = server.stored.size();
+    d.upload(server);
+    snprintf(what, sizeof(what), "%s: reboot before the trim resends nothing new", label);
+    check(server.stored.size() == storedBefore && server.unique() == d.nextTap, what);
+
+    // Partial trim keeps the roster context for the taps after it
+    for (int i = 0; i < 40; i++) d.tap();
+    log.flush();
+    AccessLogExpander walk(resolveUser, log.context());
+    size_t cut = log.count() / 2;
+    for (size_t i = 0; i < cut; i++) {
+        AccessLogRecord rec;
+        AccessLog out;
+        if (log.read(i, rec)) walk.expand(rec, out);
+    }
+    uint32_t seqCut = log.seqAt(cut);
+    log.trim(cut, walk.generation());
+    reopen(log);
+    AccessLogExpander rest(resolveUser, log.context());
+    size_t resolved = 0;
+    for (size_t i = 0; i < log.count(); i++) {
+        AccessLogRecord rec;
+        AccessLog out;
+        if (log.read(i, rec) && rest.expand(rec, out)) resolved++;
+    }
+    bool seqKept = false;
+    for (size_t i = 0; i < log.count(); i++) {
+        AccessLogRecord rec;
+        if (log.seqAt(i) == seqCut && log.read(i, rec)) seqKept = true;
+    }
+    snprintf(what, sizeof(what), "%s: partial trim keeps seqs and roster context", label);
+    check(seqKept && rest.unresolved() == 0 && resolved >= 19, what);
+
+    // Everything trimmed: numbering continues
+    uint32_t nextSeq = log.seqAt(log.count());
+    d.upload(server);
+    reopen(log);
+    d.tap();
+    log.flush();
+    uint32_t firstTapSeq = 0;
+    for (size_t i = 0; i < log.count(); i++) {
+        AccessLogRecord rec;
+        if (log.read(i, rec) && accessLogIsTap(rec)) firstTapSeq = log.seqAt(i);
+    }
+    snprintf(what, sizeof(what), "%s: numbering continues after a full trim", label);
+    check(firstTapSeq >= nextSeq, what);
+}
+
+static bool reopenFile(AccessLogFile& log) {
+    log.end();
+    return log.begin(TAPS_FILE, nullptr, MAX_SIZE, 15000, 8);
+}
+
+static FlashPartition ringPart;
+
+static bool reopenRing(AccessLogRing& ring) {
+    return ringPart.begin(RING_FILE, RING_SIZE) && ring.begin(ringPart);
+}
+
+int main() {
+    printf("\n=== Acknowledged Log Upload Test (batches of %d taps) ===\n\n", BATCH);
+
+    testBaseline();
+
+    remove(TAPS_FILE);
+    AccessLogFile file;
+    file.begin(TAPS_FILE, nullptr, MAX_SIZE, 15000, 8);
+    runScenarios("AccessLogFile", file, reopenFile, tapTwice);
+
+    remove(RING_FILE);
+    AccessLogRing ring;
+    reopenRing(ring);
+    runScenarios("AccessLogRing", ring, reopenRing, tapTwiceRing);
+
+    remove(TAPS_FILE);
+    remove(RING_FILE);
+    printf("\n%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,305 @@
+/**
+ * Streaming Log Upload Test
+ * ==========================
+ *
+ * PURPOSE: Verify the chunked POST /api/logs (LogUploadStream.h, used by
+ *          syncLogs) against a loopback HTTP stand-in that records the
+ *          request, and compare its RAM with the previous upload, which
+ *          built a JsonDocument and serialized it into a String.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware needed - a plain TCP socket on 127.0.0.1 stands in for the
+ *    TLS client, and a thread stands in for the Convex HTTP action
+ *
+ * WHAT IT MEASURES:
+ * - Body bytes for a full 100 KB log file (what the String used to hold)
+ *   vs the streaming writer's fixed size
+ *
+ * WHAT IT CHECKS:
+ * - Request line and headers: chunked transfer, no Content-Length
+ * - The de-chunked body is exactly the JSON the server expects, for
+ *   batches with and without a sequence range, with escaping
+ * - No chunk is larger than LOG_UPLOAD_CHUNK
+ * - Response status and body are read with Content-Length, chunked, and
+ *   close-delimited framing
+ * - A server that hangs up mid-body fails the upload instead of hanging
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "AccessLogFile.h"
+#include "LogUploadStream.h"
+
+static const char* TAPS_FILE = "taps_stream.bin";
+static const size_t MAX_SIZE = 100 * 1024;        // MAX_LOG_FILE_SIZE
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("[TEST] %-58s %s\n", what, ok ? "PASS" : "FAIL");
+    if (!ok) failures++;
+}
+
+// Blocking TCP client with the two calls LogUploadStream makes on WiFiClientSecure
+struct SocketClient {
+    int fd = -1;
+
+    bool connect(uint16_t port) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        timeval tv = {2, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return ::connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+    }
+
+    size_t write(const uint8_t* data, size_t len) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        return n > 0 ? (size_t)n : 0;
+    }
+
+    size_t readBytes(char* out, size_t len) {
+        ssize_t n = recv(fd, out, len, 0);
+        return n > 0 ? (size_t)n : 0;
+    }
+
+    void stop() {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+};
+
+// One-request HTTP server: records the raw request, sends `reply`
+struct StandIn {
+    int listenFd = -1;
+    uint16_t port = 0;
+    std::string request;          // Head + raw chunked body
+    std::string reply;
+    size_t hangUpAfter = 0;       // Close after this many request bytes (0 = never)
+    std::thread worker;
+
+    void start() {
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(listenFd, (sockaddr*)&addr, sizeof(addr));
+        socklen_t len = sizeof(addr);
+        getsockname(listenFd, (sockaddr*)&addr, &len);
+        port = ntohs(addr.sin_port);
+        listen(listenFd, 1);
+        worker = std::thread([this] { serve(); });
+    }
+
+    void serve() {
+        int fd = accept(listenFd, nullptr, nullptr);
+        timeval tv = {2, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        char buf[4096];
+        while (request.find("\r\n0\r\n\r\n") == std::string::npos) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) break;
+            request.append(buf, (size_t)n);
+            if (hangUpAfter && request.size() >= hangUpAfter) break;
+        }
+        if (!hangUpAfter) send(fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+        close(fd);
+    }
+
+    void join() {
+        worker.join();
+        close(listenFd);
+    }
+
+    std::string head() const { return request.substr(0, request.find("\r\n\r\n") + 4); }
+
+    // De-chunked body; `maxChunk` gets the largest chunk, false if framing is bad
+    bool body(std::string& out, size_t& maxChunk) const {
+        out.clear();
+        maxChunk = 0;
+        size_t pos = request.find("\r\n\r\n");
+        if (pos == std::string::npos) return false;
+        pos += 4;
+        for (;;) {
+            size_t eol = request.find("\r\n", pos);
+            if (eol == std::string::npos) return false;
+            size_t len = strtoul(request.substr(pos, eol - pos).c_str(), nullptr, 16);
+            pos = eol + 2;
+            if (len == 0) return request.compare(pos, 2, "\r\n") == 0;
+            if (pos + len + 2 > request.size() || request.compare(pos + len, 2, "\r\n") != 0) return false;
+            out.append(request, pos, len);
+            if (len > maxChunk) maxChunk = len;
+            pos += len + 2;
+        }
+    }
+};
+
+static AccessLog makeLog(uint32_t i, const char* userId = nullptr) {
+    AccessLog log;
+    memset(&log, 0, sizeof(log));
+    log.timestamp = 1760000000 + i * 7;
+    if (userId) snprintf(log.userId, sizeof(log.userId), "%s", userId);
+    else snprintf(log.userId, sizeof(log.userId), "j57%024u", i % 400);
+    snprintf(log.method, sizeof(log.method), "%s", (i % 3) ? "NFC+BIO" : "NFC");
+    return log;
+}
+
+// The body as the previous syncLogs() produced it (ArduinoJson key order)
+static std::string expectedEntry(const AccessLog& log, bool local, bool denied, bool hasSeq, uint32_t seq) {
+    std::string s = "{\"userId\":\"";
+    for (const char* p = log.userId; *p; p++) {
+        if (*p == '"' || *p == '\\') s += '\\';
+        s += *p;
+    }
+    s += "\",\"method\":\"" + std::string(log.method) + "\",\"action\":\"ATTENDANCE\",\"result\":\"";
+    s += denied ? "denied" : "success";
+    s += "\",\"timestamp\":" + std::to_string(log.timestamp) + ",\"timestampType\":\"";
+    s += local ? "local" : "ntp";
+    s += "\"";
+    if (hasSeq) s += ",\"seq\":" + std::to_string(seq);
+    return s + "}";
+}
+
+static const char* OK_BODY = "{\"success\":true,\"count\":3,\"duplicates\":0,\"acked\":102}";
+
+static void testSmallBatch() {
+    StandIn server;
+    server.reply = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " +
+                   std::to_string(strlen(OK_BODY)) + "\r\n\r\n" + OK_BODY;
+    server.start();
+
+    SocketClient client;
+    client.connect(server.port);
+    LogUploadStream<SocketClient> upload(client);
+    upload.begin("example.convex.site", "/api/logs", "tok123", "24:6F:28:AA:BB:CC");
+    std::string want = "{\"chipId\":\"24:6F:28:AA:BB:CC\",\"logs\":[";
+    for (uint32_t i = 0; i < 3; i++) {
+        AccessLog log = i == 1 ? makeLog(i, "quote\"and\\slash") : makeLog(i);
+        upload.add(log, i == 2, i == 1, true, 100 + i);
+        want += (i ? "," : "") + expectedEntry(log, i == 2, i == 1, true, 100 + i);
+    }
+    want += "],\"batch\":{\"first\":99,\"last\":102}}";
+    upload.finish(true, 99, 102);
+
+    char reply[128];
+    int status = upload.readResponse(reply, sizeof(reply));
+    client.stop();
+    server.join();
+
+    std::string head = server.head();
+    check(head.rfind("POST /api/logs HTTP/1.1\r\nHost: example.convex.site\r\n", 0) == 0 &&
+          head.find("Authorization: Bearer tok123\r\n") != std::string::npos,
+          "Request line, Host and Authorization");
+    check(head.find("Transfer-Encoding: chunked\r\n") != std::string::npos &&
+          head.find("Content-Length") == std::string::npos, "Chunked transfer, no Content-Length");
+
+    std::string body;
+    size_t maxChunk;
+    check(server.body(body, maxChunk) && body == want, "Body is the expected JSON, with range, seqs and escaping");
+    check(status == 200 && strcmp(reply, OK_BODY) == 0,
+          "Status and Content-Length body read back");
+}
+
+static void testFullLog() {
+    // A full /logs.bin worth of expanded logs, read back from a file as syncLogs does
+    remove(TAPS_FILE);
+    ExpandedLogFile file;
+    file.begin(TAPS_FILE, nullptr, MAX_SIZE * 6, 15000, 32);
+    size_t taps = MAX_SIZE / sizeof(AccessLogRecord);  // A full compact file, expanded
+    for (uint32_t i = 0; i < taps; i++) file.append(makeLog(i), 0);
+    file.flush();
+
+    StandIn server;
+    server.reply = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                   "5\r\n{\"ack\r\n9\r\ned\":1234}\r\n0\r\n\r\n";
+    server.start();
+    SocketClient client;
+    client.connect(server.port);
+    LogUploadStream<SocketClient> upload(client);
+    upload.begin("example.convex.site", "/api/logs", "tok", "chip");
+    std::string want = "{\"chipId\":\"chip\",\"logs\":[";
+    for (size_t i = 0; i < file.count(); i++) {
+        AccessLog log;
+        file.read(i, log);
+        upload.add(log, false, false, false, 0);
+        want += (i ? "," : "") + expectedEntry(log, false, false, false, 0);
+    }
+    want += "]}";
+    upload.finish(false, 0, 0);
+    char reply[64];
+    int status = upload.readResponse(reply, sizeof(reply));
+    client.stop();
+    server.join();
+    file.end();
+    remove(TAPS_FILE);
+
+    std::string body;
+    size_t maxChunk;
+    bool framed = server.body(body, maxChunk);
+    printf("  %zu logs: %u body bytes in %u chunks\n", taps, upload.bodyBytes(), upload.chunks());
+    printf("  before: body String alone %u bytes (plus the JsonDocument); now: %zu-byte writer\n",
+        upload.bodyBytes(), sizeof(LogUploadStream<SocketClient>));
+    check(framed && body == want, "12,800-log body streamed intact");
+    check(maxChunk <= LOG_UPLOAD_CHUNK, "No chunk larger than LOG_UPLOAD_CHUNK");
+    check(sizeof(LogUploadStream<SocketClient>) < 1024, "Writer RAM is fixed and under 1 KB");
+    check(status == 200 && strcmp(reply, "{\"acked\":1234}") == 0, "Chunked response body read back");
+}
+
+static void testErrors() {
+    StandIn server;
+    server.reply = "HTTP/1.1 401 Unauthorized\r\nConnection: close\r\n\r\nUnauthorized";
+    server.start();
+    SocketClient client;
+    client.connect(server.port);
+    LogUploadStream<SocketClient> upload(client);
+    upload.begin("h", "/api/logs", "bad", "chip");
+    upload.add(makeLog(1), false, false, true, 1);
+    upload.finish(true, 1, 1);
+    char reply[64];
+    int status = upload.readResponse(reply, sizeof(reply));
+    client.stop();
+    server.join();
+    check(status == 401 && strcmp(reply, "Unauthorized") == 0, "Error status and close-delimited body");
+
+    // Server hangs up after the headers: writes fail, no response
+    StandIn hangup;
+    hangup.hangUpAfter = 1;
+    hangup.start();
+    SocketClient c2;
+    c2.connect(hangup.port);
+    LogUploadStream<SocketClient> up2(c2);
+    up2.begin("h", "/api/logs", "tok", "chip");
+    hangup.join();
+    usleep(50000);
+    for (uint32_t i = 0; i < 2000 && up2.ok(); i++) up2.add(makeLog(i), false, false, true, i);
+    bool finished = up2.finish(true, 0, 1999);
+    int s2 = up2.readResponse(reply, sizeof(reply));
+    c2.stop();
+    check(!finished && !up2.ok() && s2 == -1, "Hang-up mid-body fails the upload");
+}
+
+int main() {
+    printf("\n=== Streaming Log Upload Test (%d-byte chunks) ===\n\n", LOG_UPLOAD_CHUNK);
+
+    testSmallBatch();
+    testFullLog();
+    testErrors();
+
+    printf("\n%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
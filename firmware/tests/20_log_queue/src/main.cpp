@@ -0,0 +1,355 @@
+/**
+ * Access Log Queue Test
+ * ======================
+ *
+ * PURPOSE: Compare Storage::appendLog with LOG_WRITER_TASK - the tap is
+ *          pushed to a lock-free single-producer/single-consumer queue
+ *          (AccessLogQueue.h) and a background task writes it - with
+ *          writing the log inside openDoor(), on a log whose commits stall
+ *          the caller the way LittleFS commits and block erases do.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware needed - a plain file stands in for /taps.bin, a sleep
+ *    after each commit for the flash, and std::threads for the tap loop
+ *    and the writer task
+ *
+ * WHAT IT MEASURES:
+ * - Histogram of the time openDoor() spends logging a tap (the part of
+ *   tap-to-tap latency the log adds), inline vs queued. Taps arrive every
+ *   TAP_GAP_MS, far faster than a real door, to keep the run short.
+ *
+ * WHAT IT CHECKS:
+ * - The queue hands over every item, in order, between two threads
+ * - Every queued tap reaches the file, in order
+ * - A full queue writes through in order and drops nothing
+ * - Queued taps are lost in a power cut until flushLogs() (drain + commit)
+ * - LatencyHistogram buckets and percentiles
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "AccessLogFile.h"
+#include "AccessLogQueue.h"
+#include "LatencyHistogram.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const char* TAPS_FILE = "taps_queue.bin";
+static const size_t MAX_SIZE = 100 * 1024;        // MAX_LOG_FILE_SIZE
+static const uint32_t COMMIT_MS = 15000;          // LOG_COMMIT_INTERVAL_MS
+static const size_t COMMIT_RECORDS = 8;           // LOG_COMMIT_RECORDS
+static const size_t QUEUE_SLOTS = 16;             // LOG_QUEUE_SLOTS
+static const uint32_t WRITER_POLL_MS = 1000;      // LOG_WRITER_POLL_MS
+static const uint32_t COMMIT_US = 6000;           // LittleFS metadata commit
+static const uint32_t ERASE_US = 40000;           // ...plus a block erase every ERASE_EVERY commits
+static const uint32_t ERASE_EVERY = 16;
+static const int TAPS = 600;
+static const int TAP_GAP_MS = 4;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("[TEST] %-58s %s\n", what, ok ? "PASS" : "FAIL");
+    if (!ok) failures++;
+}
+
+static uint32_t nowMs() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        Clock::now().time_since_epoch()).count();
+}
+
+static uint32_t elapsedUs(Clock::time_point since) {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - since).count();
+}
+
+// /taps.bin where every commit blocks the caller for as long as the flash would
+struct SlowLog {
+    AccessLogFile log;
+    uint32_t charged = 0;
+
+    void charge() {
+        while (charged < log.stats().commits) {
+            charged++;
+            uint32_t us = COMMIT_US + (charged % ERASE_EVERY == 0 ? ERASE_US : 0);
+            std::this_thread::sleep_for(std::chrono::microseconds(us));
+        }
+    }
+
+    bool begin() {
+        remove(TAPS_FILE);
+        charged = 0;
+        return log.begin(TAPS_FILE, nullptr, MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+    }
+    bool append(const AccessLogRecord& rec) { bool ok = log.append(rec, nowMs()); charge(); return ok; }
+    bool poll() { bool ok = log.poll(nowMs()); charge(); return ok; }
+    bool flush() { bool ok = log.flush(); charge(); return ok; }
+};
+
+static AccessLogRecord recordOf(const PendingLog& tap) {
+    AccessLogRecord rec;
+    rec.timestamp = tap.timestamp;
+    rec.userIdx = tap.userIdx;
+    rec.method = tap.method;
+    rec.flags = tap.flags;
+    return rec;
+}
+
+static PendingLog makeTap(uint32_t i) {
+    PendingLog tap;
+    memset(&tap, 0, sizeof(tap));
+    tap.timestamp = 1760000000 + i;
+    tap.generation = 1;
+    tap.userIdx = (uint16_t)(i % 400);
+    tap.method = LOG_METHOD_NFC;
+    snprintf(tap.userId, sizeof(tap.userId), "j57%024u", tap.userIdx);
+    return tap;
+}
+
+// Storage with LOG_WRITER_TASK: appendLog pushes and notifies, the writer
+// drains under the log mutex, flushLogs drains and commits
+struct QueuedStorage {
+    SlowLog& flash;
+    SpscQueue<PendingLog, QUEUE_SLOTS> queue;
+    std::recursive_mutex lock;                 // Storage::_logMutex
+    std::mutex wakeLock;
+    std::condition_variable wake;              // ulTaskNotifyTake / xTaskNotifyGive
+    std::atomic<bool> notified{false};
+    std::atomic<bool> stop{false};
+    std::atomic<bool> paused{false};           // Writer starved (e.g. busy core)
+    std::thread writer;
+
+    explicit QueuedStorage(SlowLog& f) : flash(f) {}
+
+    bool drain() {
+        bool ok = true;
+        PendingLog tap;
+        while (queue.pop(tap)) ok = flash.append(recordOf(tap)) && ok;
+        return ok;
+    }
+
+    void start() {
+        writer = std::thread([this] {
+            while (!stop) {
+                {
+                    std::unique_lock<std::mutex> g(wakeLock);
+                    wake.wait_for(g, std::chrono::milliseconds(WRITER_POLL_MS),
+                                  [this] { return notified.load() || stop.load(); });
+                    notified = false;
+                }
+                if (paused) continue;
+                std::lock_guard<std::recursive_mutex> g(lock);
+                drain();
+                flash.poll();
+            }
+        });
+    }
+
+    void shutdown() {
+        stop = true;
+        wake.notify_one();
+        if (writer.joinable()) writer.join();
+    }
+
+    bool append(const PendingLog& tap) {
+        if (queue.push(tap)) {
+            notified = true;
+            wake.notify_one();
+            return true;
+        }
+        std::lock_guard<std::recursive_mutex> g(lock);  // Full: write through, after the queue
+        drain();
+        return flash.append(recordOf(tap));
+    }
+
+    bool flushLogs() {
+        std::lock_guard<std::recursive_mutex> g(lock);
+        bool ok = drain();
+        return flash.flush() && ok;
+    }
+};
+
+// Taps on file, checked for order against makeTap()
+static size_t tapsInOrder(const char* path, size_t& outOfOrder) {
+    AccessLogFile reader;
+    reader.begin(path, nullptr, MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+    size_t taps = 0;
+    outOfOrder = 0;
+    for (size_t i = 0; i < reader.count(); i++) {
+        AccessLogRecord rec;
+        if (!reader.read(i, rec) || !accessLogIsTap(rec)) continue;
+        if (rec.timestamp != makeTap((uint32_t)taps).timestamp) outOfOrder++;
+        taps++;
+    }
+    return taps;
+}
+
+static void printHistogram(const char* label, const LatencyHistogram& h) {
+    printf("  %-10s %u taps | p50 %6u us | p99 %6u us | max %6u us | mean %5u us\n",
+        label, h.count(), h.percentile(0.50f), h.percentile(0.99f), h.max(), h.mean());
+    uint32_t peak = 1;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        if (h.bucket(b) > peak) peak = h.bucket(b);
+    }
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        if (h.bucket(b) == 0) continue;
+        int bar = (int)(40 * h.bucket(b) / peak);
+        printf("    <= %8u us %5u %.*s\n", LatencyHistogram::bucketLimit(b), h.bucket(b),
+            bar > 0 ? bar : 1, "########################################");
+    }
+}
+
+static void testQueueThreads() {
+    static SpscQueue<uint32_t, 64> queue;
+    const uint32_t N = 2000000;
+    std::atomic<uint32_t> bad{0};
+    std::thread consumer([&] {
+        uint32_t expect = 0, v;
+        while (expect < N) {
+            if (queue.pop(v)) {
+                if (v != expect) bad++;
+                expect++;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+    for (uint32_t i = 0; i < N; ) {
+        if (queue.push(i)) i++;
+        else std::this_thread::yield();
+    }
+    consumer.join();
+    printf("  SPSC queue: %u items across threads, %u refused pushes while full\n", N, queue.fullCount());
+    check(bad == 0 && queue.empty() && queue.highWater() == 64, "Queue hands over every item in order");
+}
+
+static void testHistogram() {
+    LatencyHistogram h;
+    for (int i = 0; i < 98; i++) h.record(100);
+    h.record(5000);
+    h.record(70000);
+    check(LatencyHistogram::bucketOf(0) == 0 && LatencyHistogram::bucketOf(1) == 0 &&
+          LatencyHistogram::bucketOf(2) == 1 && LatencyHistogram::bucketOf(100) == 6 &&
+          LatencyHistogram::bucketOf(0xFFFFFFFF) == LATENCY_BUCKETS - 1,
+          "Histogram buckets are powers of two");
+    check(h.count() == 100 && h.percentile(0.50f) == 127 && h.percentile(0.99f) == 8191 &&
+          h.max() == 70000, "Histogram percentiles are bucket upper bounds");
+}
+
+// The tap loop: one tap every TAP_GAP_MS, timing only the log call
+static LatencyHistogram runInline() {
+    SlowLog flash;
+    flash.begin();
+    LatencyHistogram h;
+    for (int i = 0; i < TAPS; i++) {
+        auto t0 = Clock::now();
+        flash.append(recordOf(makeTap(i)));
+        h.record(elapsedUs(t0));
+        std::this_thread::sleep_for(std::chrono::milliseconds(TAP_GAP_MS));
+        flash.poll();  // Storage::pollLogs() in loop()
+    }
+    flash.flush();
+    return h;
+}
+
+static LatencyHistogram runQueued(uint32_t& highWater, uint32_t& full, bool& allInOrder) {
+    SlowLog flash;
+    flash.begin();
+    QueuedStorage storage(flash);
+    storage.start();
+    LatencyHistogram h;
+    for (int i = 0; i < TAPS; i++) {
+        auto t0 = Clock::now();
+        storage.append(makeTap(i));
+        h.record(elapsedUs(t0));
+        std::this_thread::sleep_for(std::chrono::milliseconds(TAP_GAP_MS));
+    }
+    storage.flushLogs();
+    storage.shutdown();
+    highWater = storage.queue.highWater();
+    full = storage.queue.fullCount();
+    flash.log.end();
+
+    size_t outOfOrder;
+    allInOrder = tapsInOrder(TAPS_FILE, outOfOrder) == (size_t)TAPS && outOfOrder == 0;
+    return h;
+}
+
+static void testLatency() {
+    LatencyHistogram inl = runInline();
+    uint32_t highWater, full;
+    bool inOrder;
+    LatencyHistogram queued = runQueued(highWater, full, inOrder);
+
+    printf("\n  Log time per tap (flash commit %u ms, +%u ms erase every %u commits):\n",
+        COMMIT_US / 1000, ERASE_US / 1000, ERASE_EVERY);
+    printHistogram("inline", inl);
+    printHistogram("queued", queued);
+    printf("  queue: max %u of %u slots used, %u written through\n\n",
+        highWater, (unsigned)QUEUE_SLOTS, full);
+
+    check(inOrder, "Every queued tap is on file, in order");
+    check(inl.max() >= COMMIT_US, "Inline taps wait for flash commits");
+    check(queued.max() < COMMIT_US && queued.percentile(0.99f) < 1000,
+          "Queued taps never wait for the flash");
+}
+
+static void testWriteThrough() {
+    SlowLog flash;
+    flash.begin();
+    QueuedStorage storage(flash);
+    storage.paused = true;       // Writer never gets the CPU
+    storage.start();
+    for (int i = 0; i < 40; i++) storage.append(makeTap(i));
+    uint32_t full = storage.queue.fullCount();
+    storage.flushLogs();
+    storage.shutdown();
+    flash.log.end();
+
+    size_t outOfOrder;
+    size_t taps = tapsInOrder(TAPS_FILE, outOfOrder);
+    printf("  stalled writer: 40 taps, %u written through, %u on file\n", full, (unsigned)taps);
+    // Each write-through drains the queue first, so it fills again from empty
+    check(full == 40 / (QUEUE_SLOTS + 1) && taps == 40 && outOfOrder == 0,
+          "Full queue writes through in order, nothing dropped");
+}
+
+static void testDurabilityPoint() {
+    SlowLog flash;
+    flash.begin();
+    QueuedStorage storage(flash);
+    storage.paused = true;
+    storage.start();
+    for (int i = 0; i < 5; i++) storage.append(makeTap(i));
+
+    // Power cut: what a reboot would find on flash
+    size_t outOfOrder;
+    size_t before = tapsInOrder(TAPS_FILE, outOfOrder);
+    storage.flushLogs();
+    size_t after = tapsInOrder(TAPS_FILE, outOfOrder);
+    storage.shutdown();
+    printf("  5 queued taps: %u on flash before flushLogs(), %u after\n", (unsigned)before, (unsigned)after);
+    check(before == 0 && after == 5 && outOfOrder == 0, "flushLogs() makes queued taps durable");
+}
+
+int main() {
+    printf("\n=== Access Log Queue Test (%u slots, %d taps %d ms apart) ===\n\n",
+        (unsigned)QUEUE_SLOTS, TAPS, TAP_GAP_MS);
+
+    testQueueThreads();
+    testHistogram();
+    testLatency();
+    testWriteThrough();
+    testDurabilityPoint();
+
+    remove(TAPS_FILE);
+    printf("\n%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,385 @@
+/**
+ * Segmented Access Log Test
+ * ==========================
+ *
+ * PURPOSE: Verify the segmented access log (AccessLogSegments.h) that
+ *          replaced the single /taps.bin and the /logs.bin that rotated
+ *          into /logs.old.bin - a file the uploader never read and the
+ *          next rotation deleted.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware needed - plain files in the working directory stand in
+ *    for LittleFS
+ *
+ * WHAT IT MEASURES:
+ * - Taps still on the device for upload after a long outage, old vs new
+ * - Bytes rewritten to trim the log after each uploaded batch
+ *
+ * WHAT IT CHECKS:
+ * - Uploads drain the oldest taps first, in sequence order
+ * - Acknowledged segments are deleted whole; a full log refuses new taps
+ *   instead of deleting unsent ones (segment cap and free-space check)
+ * - Sequence numbers and the roster context survive trims and reboots
+ * - Power cuts between the manifest write and the deletes, and after a
+ *   new segment was started, lose nothing and leave no strays
+ * - Files from older firmware (/taps.bin with its SEQ head, /logs.old.bin
+ *   and /logs.bin, raw records) are converted into the first segments,
+ *   numbering kept
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "AccessLogSegments.h"
+
+static const char* BASE = "seg_taps";
+static const char* EXP_BASE = "seg_logs";
+static const char* OLD_TAPS = "seg_old_taps.bin";
+static const char* OLD_LOGS = "seg_old_logs.bin";
+static const char* OLD_LOGS_OLD = "seg_old_logs.old.bin";
+static const size_t OLD_MAX_SIZE = 100 * 1024;    // Previous MAX_LOG_FILE_SIZE
+static const size_t SEGMENT_SIZE = 16 * 1024;     // LOG_SEGMENT_SIZE
+static const size_t MAX_SEGMENTS = 32;            // LOG_MAX_SEGMENTS
+static const uint32_t COMMIT_MS = 15000;          // LOG_COMMIT_INTERVAL_MS
+static const size_t COMMIT_RECORDS = 8;           // LOG_COMMIT_RECORDS
+static const int BATCH = 50;                      // LOG_UPLOAD_BATCH
+static const uint32_t OUTAGE_TAPS = 20000;        // ~5 days offline at a busy door
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("[TEST] %-58s %s\n", what, ok ? "PASS" : "FAIL");
+    if (!ok) failures++;
+}
+
+static bool exists(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (f) fclose(f);
+    return f != nullptr;
+}
+
+static std::string segPath(const char* base, uint32_t n) {
+    return std::string(base) + "." + std::to_string(n);
+}
+
+static void removeLog(const char* base) {
+    for (uint32_t n = 1; n < 200; n++) remove(segPath(base, n).c_str());
+    remove((std::string(base) + ".man").c_str());
+    remove((std::string(base) + ".man.tmp").c_str());
+}
+
+static void resetFiles() {
+    removeLog(BASE);
+    removeLog(EXP_BASE);
+    remove(OLD_TAPS);
+    remove((std::string(OLD_TAPS) + ".tmp").c_str());
+    remove(OLD_LOGS);
+    remove(OLD_LOGS_OLD);
+}
+
+static int segmentFiles(const char* base) {
+    int n = 0;
+    for (uint32_t s = 1; s < 200; s++) n += exists(segPath(base, s).c_str()) ? 1 : 0;
+    return n;
+}
+
+static AccessLogRecord makeTap(uint32_t i) {
+    AccessLogRecord rec;
+    rec.timestamp = 1760000000 + i * 7;
+    rec.userIdx = (uint16_t)(i % 400);
+    rec.method = LOG_METHOD_NFC;
+    rec.flags = 0;
+    return rec;
+}
+
+static AccessLog makeLog(uint32_t i) {
+    AccessLog log;
+    memset(&log, 0, sizeof(log));
+    log.timestamp = 1760000000 + i;
+    snprintf(log.userId, sizeof(log.userId), "j57%024u", i);
+    snprintf(log.method, sizeof(log.method), "NFC");
+    return log;
+}
+
+static bool openLog(AccessLogSegments& log, size_t maxSegments = MAX_SEGMENTS, LogSpaceCheck space = nullptr) {
+    return log.begin(BASE, SEGMENT_SIZE, maxSegments, COMMIT_MS, COMMIT_RECORDS, space);
+}
+
+// Tap index (from makeTap) of a record, or -1 for markers
+static long tapIndex(const AccessLogRecord& rec) {
+    if (!accessLogIsTap(rec)) return -1;
+    return (long)((rec.timestamp - 1760000000) / 7);
+}
+
+// Previous logs: one /taps.bin that refuses taps when full, and a /logs.bin
+// that rotates its older half to .old (never uploaded, deleted next time)
+static void testOutageBaseline(uint32_t& compactKept, uint32_t& expandedKept) {
+    remove(OLD_TAPS);
+    AccessLogFile taps;
+    taps.begin(OLD_TAPS, nullptr, OLD_MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+    for (uint32_t i = 0; i < OUTAGE_TAPS; i++) taps.append(makeTap(i), 0);
+    taps.flush();
+    compactKept = (uint32_t)(taps.count() - taps.pending());  // The rest is refused
+    taps.end();
+
+    remove(OLD_LOGS);
+    remove(OLD_LOGS_OLD);
+    ExpandedLogFile logs;
+    logs.begin(OLD_LOGS, OLD_LOGS_OLD, OLD_MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+    for (uint32_t i = 0; i < OUTAGE_TAPS / 6; i++) logs.append(makeLog(i), 0);
+    logs.flush();
+    expandedKept = (uint32_t)logs.count();  // What syncLogs() read
+    logs.end();
+}
+
+static void testOutage() {
+    uint32_t oldCompact, oldExpanded;
+    testOutageBaseline(oldCompact, oldExpanded);
+
+    resetFiles();
+    AccessLogSegments log;
+    openLog(log);
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < OUTAGE_TAPS; i++) kept += log.append(makeTap(i), 0) ? 1 : 0;
+    log.flush();
+
+    ExpandedLogSegments logs;
+    logs.begin(EXP_BASE, SEGMENT_SIZE, MAX_SEGMENTS, COMMIT_MS, COMMIT_RECORDS);
+    uint32_t keptExpanded = 0;
+    for (uint32_t i = 0; i < OUTAGE_TAPS / 6; i++) keptExpanded += logs.append(makeLog(i), 0) ? 1 : 0;
+    logs.flush();
+
+    printf("  %u taps offline:  old /taps.bin kept %u, segments kept %u (%u files)\n",
+        OUTAGE_TAPS, oldCompact, kept, (unsigned)log.segments());
+    printf("  %u expanded logs: old /logs.bin upload saw %u, segments kept %u (%u files)\n",
+        OUTAGE_TAPS / 6, oldExpanded, keptExpanded, (unsigned)logs.segments());
+    check(kept == OUTAGE_TAPS && log.count() == OUTAGE_TAPS && keptExpanded == OUTAGE_TAPS / 6,
+          "Outage backlog is kept whole");
+
+    // Upload: batches of BATCH, trimmed as each is acknowledged
+    uint32_t expect = 0;
+    bool inOrder = true;
+    size_t startSegments = log.segments();
+    while (log.count() > 0) {
+        size_t n = log.count() < (size_t)BATCH ? log.count() : (size_t)BATCH;
+        for (size_t i = 0; i < n; i++) {
+            AccessLogRecord rec;
+            if (!log.read(i, rec) || tapIndex(rec) != (long)expect || log.seqAt(i) != expect) inOrder = false;
+            expect++;
+        }
+        log.trim(n, 0);
+    }
+    printf("  upload: %u taps oldest first, %u segments deleted, %d left on disk\n",
+        expect, log.deletedSegments(), segmentFiles(BASE));
+    check(inOrder && expect == OUTAGE_TAPS, "Upload drains oldest first, in sequence order");
+    check(log.deletedSegments() == startSegments && segmentFiles(BASE) == 1,
+          "Acknowledged segments are deleted whole");
+
+    uint32_t next = log.seqAt(0);
+    log.append(makeTap(expect), 0);
+    log.end();
+    openLog(log);
+    AccessLogRecord rec;
+    check(next == OUTAGE_TAPS && log.count() == 1 && log.read(0, rec) && log.seqAt(0) == OUTAGE_TAPS,
+          "Numbering continues after the log drains");
+}
+
+// Bytes written per trim: AccessLogFile rewrites everything kept, segments
+// write a manifest (and delete files)
+static void testTrimCost() {
+    const uint32_t backlog = 12000;
+    remove(OLD_TAPS);
+    AccessLogFile old;
+    old.begin(OLD_TAPS, nullptr, OLD_MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+    for (uint32_t i = 0; i < backlog; i++) old.append(makeTap(i), 0);
+    old.flush();
+    uint64_t oldBytes = 0;
+    int trims = 0;
+    while (old.count() > 1) {   // The SEQ head stays
+        size_t n = old.count() - 1 < (size_t)BATCH ? old.count() : (size_t)BATCH;
+        old.trim(n, 0);
+        oldBytes += old.count() * sizeof(AccessLogRecord);
+        trims++;
+    }
+    old.end();
+
+    resetFiles();
+    AccessLogSegments log;
+    openLog(log);
+    for (uint32_t i = 0; i < backlog; i++) log.append(makeTap(i), 0);
+    log.flush();
+    int segTrims = 0;
+    while (log.count() > 0) {
+        log.trim(log.count() < (size_t)BATCH ? log.count() : (size_t)BATCH, 0);
+        segTrims++;
+    }
+    uint64_t segBytes = (uint64_t)segTrims * sizeof(LogManifest);
+    printf("  draining %u taps in %d batches: single file rewrote %.1f MB, segments wrote %.1f KB of manifest\n",
+        backlog, trims, oldBytes / 1e6, segBytes / 1e3);
+    check(segBytes * 100 < oldBytes, "Trims write a manifest, not the remaining log");
+}
+
+static bool noSpace(size_t) { return false; }
+
+static void testCapacity() {
+    resetFiles();
+    AccessLogSegments log;
+    openLog(log, 3);
+    size_t perSegment = SEGMENT_SIZE / AccessLogSegments::FRAME_SIZE;
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < perSegment * 4; i++) kept += log.append(makeTap(i), 0) ? 1 : 0;
+    log.flush();
+    AccessLogRecord first;
+    check(kept == perSegment * 3 && log.refused() == perSegment && log.read(0, first) &&
+          tapIndex(first) == 0, "Full log refuses new taps, keeps the oldest");
+
+    // Uploading frees a segment for new taps
+    log.trim(perSegment, 0);
+    check(log.append(makeTap(999999), 0) && log.segments() == 3, "Room again once a segment is acknowledged");
+    log.end();
+
+    resetFiles();
+    openLog(log, MAX_SEGMENTS, noSpace);
+    kept = 0;
+    for (uint32_t i = 0; i < perSegment * 2; i++) kept += log.append(makeTap(i), 0) ? 1 : 0;
+    check(kept == perSegment && log.segments() == 1, "No new segment without filesystem space");
+    log.end();
+}
+
+static void testReboots() {
+    resetFiles();
+    AccessLogSegments log;
+    openLog(log);
+    size_t perSegment = SEGMENT_SIZE / AccessLogSegments::FRAME_SIZE;
+    for (uint32_t i = 0; i < perSegment * 3 + 100; i++) log.append(makeTap(i), 0);
+    log.flush();
+
+    // Partial trim with a roster context; survives a reboot
+    size_t cut = perSegment + 17;
+    uint32_t seqCut = log.seqAt(cut);
+    AccessLogRecord atCut;
+    log.read(cut, atCut);
+    log.trim(cut, 42);
+    log.end();
+    openLog(log);
+    AccessLogRecord rec;
+    check(log.seqAt(0) == seqCut && log.context() == 42 && log.read(0, rec) &&
+          memcmp(&rec, &atCut, sizeof(rec)) == 0 && log.count() == perSegment * 3 + 100 - cut,
+          "Trim offset, seqs and roster context survive a reboot");
+
+    // Power cut after the manifest write, before the deletes: put a dropped
+    // segment back; begin() removes it and nothing shifts
+    uint32_t oldest = 0;
+    for (uint32_t s = 1; s < 200 && !oldest; s++) if (exists(segPath(BASE, s).c_str())) oldest = s;
+    log.end();
+    FILE* stray = fopen(segPath(BASE, oldest - 1).c_str(), "wb");
+    fwrite(&rec, sizeof(rec), 1, stray);
+    fclose(stray);
+    openLog(log);
+    check(!exists(segPath(BASE, oldest - 1).c_str()) && log.seqAt(0) == seqCut && log.read(0, rec) &&
+          memcmp(&rec, &atCut, sizeof(rec)) == 0, "Stray acknowledged segment removed at boot");
+
+    // Power cut right after a new segment started: found by probing, no manifest needed
+    size_t before = log.count();
+    size_t segs = log.segments();
+    while (log.segments() == segs) log.append(makeTap(500000 + (uint32_t)log.count()), 0);
+    log.flush();
+    size_t after = log.count();
+    log.end();
+    openLog(log);
+    check(log.count() == after && after > before && log.segments() == segs + 1,
+          "New segment found after a power cut");
+
+    // Torn frame at the end of the head
+    log.end();
+    std::string head = segPath(BASE, oldest + (uint32_t)segs);
+    FILE* f = fopen(head.c_str(), "ab");
+    fwrite("\x01\x02\x03", 1, 3, f);
+    fclose(f);
+    openLog(log);
+    log.append(makeTap(777777), 0);
+    log.flush();
+    check(log.count() == after + 1 && log.read(after, rec) && tapIndex(rec) == 777777,
+          "Torn head record cut off, appends stay aligned");
+    log.end();
+}
+
+static void testLegacy() {
+    resetFiles();
+
+    // /taps.bin from the previous firmware (raw 8-byte records), already
+    // trimmed once: a SEQ head numbered 119, then taps 120..499
+    std::vector<AccessLogRecord> recs;
+    AccessLogRecord seqHead;
+    memset(&seqHead, 0, sizeof(seqHead));
+    seqHead.method = LOG_METHOD_SEQ;
+    seqHead.timestamp = 119;
+    recs.push_back(seqHead);
+    for (uint32_t i = 120; i < 500; i++) recs.push_back(makeTap(i));
+    FILE* f = fopen(OLD_TAPS, "wb");
+    fwrite(recs.data(), sizeof(AccessLogRecord), recs.size(), f);
+    fclose(f);
+    size_t oldCount = recs.size();
+    std::vector<uint32_t> seqs;
+    for (size_t i = 0; i < oldCount; i++) seqs.push_back(119 + (uint32_t)i);
+
+    AccessLogSegments log;
+    openLog(log);
+    bool adopted = log.adopt(OLD_TAPS);
+    bool same = log.count() == oldCount;
+    for (size_t i = 0; same && i < oldCount; i++) {
+        AccessLogRecord r;
+        same = log.read(i, r) && memcmp(&r, &recs[i], sizeof(r)) == 0 && log.seqAt(i) == seqs[i];
+    }
+    log.append(makeTap(500), 0);
+    log.end();
+    openLog(log);
+    AccessLogRecord last;
+    check(adopted && same && !exists(OLD_TAPS) && log.read(oldCount, last) && tapIndex(last) == 500 &&
+          log.seqAt(oldCount) == seqs.back() + 1, "Old /taps.bin adopted, sequence numbers kept");
+    log.end();
+
+    // /logs.old.bin (older half, never uploaded before) then /logs.bin
+    f = fopen(OLD_LOGS_OLD, "wb");
+    for (uint32_t i = 0; i < 100; i++) {
+        AccessLog l = makeLog(i);
+        fwrite(&l, sizeof(l), 1, f);
+    }
+    fclose(f);
+    f = fopen(OLD_LOGS, "wb");
+    for (uint32_t i = 100; i < 150; i++) {
+        AccessLog l = makeLog(i);
+        fwrite(&l, sizeof(l), 1, f);
+    }
+    fclose(f);
+    ExpandedLogSegments logs;
+    logs.begin(EXP_BASE, SEGMENT_SIZE, MAX_SEGMENTS, COMMIT_MS, COMMIT_RECORDS);
+    bool ok = logs.adopt(OLD_LOGS_OLD) && logs.adopt(OLD_LOGS);
+    bool ordered = logs.count() == 150;
+    for (size_t i = 0; ordered && i < logs.count(); i++) {
+        AccessLog l;
+        ordered = logs.read(i, l) && l.timestamp == 1760000000 + i;
+    }
+    check(ok && ordered && !exists(OLD_LOGS) && !exists(OLD_LOGS_OLD),
+          "Old /logs.old.bin and /logs.bin adopted, oldest first");
+    logs.end();
+}
+
+int main() {
+    printf("\n=== Segmented Access Log Test (%u KB segments, max %u) ===\n\n",
+        (unsigned)(SEGMENT_SIZE / 1024), (unsigned)MAX_SEGMENTS);
+
+    testOutage();
+    testTrimCost();
+    testCapacity();
+    testReboots();
+    testLegacy();
+
+    resetFiles();
+    printf("\n%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,284 @@
+/**
+ * Log Recovery Test
+ * ==================
+ *
+ * PURPOSE: Verify the CRC-framed log records (LogFrame in AccessLogFile.h)
+ *          and the boot-time recovery scan that replaced raw fwrite()s of
+ *          structs, where a brownout mid-append left a torn tail and every
+ *          later read was misaligned.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware needed - plain files in the working directory stand in
+ *    for LittleFS, and damage is written into them directly
+ *
+ * WHAT IT MEASURES:
+ * - Boot recovery time at 1k / 10k / 50k frames: bounded backward scan vs
+ *   checking every frame from the start
+ * - CRC cost per frame (software CRC here; the ESP32 uses its ROM one)
+ *
+ * WHAT IT CHECKS:
+ * - A partial frame and whole garbage frames at the tail are cut at boot
+ * - A corrupted frame further in fails its read; the ones after it stay
+ *   aligned and nothing is cut
+ * - Sequence numbers continue after recovery, and the frames carry the
+ *   numbers seqAt() reports (even with the manifest lost)
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "AccessLogSegments.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const char* LOG_FILE = "recovery_test.bin";
+static const char* BASE = "recovery_seg";
+static const size_t MAX_SIZE = 2 * 1024 * 1024;
+static const size_t SEGMENT_SIZE = 16 * 1024;     // LOG_SEGMENT_SIZE
+static const size_t MAX_SEGMENTS = 32;            // LOG_MAX_SEGMENTS
+static const uint32_t COMMIT_MS = 15000;          // LOG_COMMIT_INTERVAL_MS
+static const size_t COMMIT_RECORDS = 8;           // LOG_COMMIT_RECORDS
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("[TEST] %-58s %s\n", what, ok ? "PASS" : "FAIL");
+    if (!ok) failures++;
+}
+
+static std::string segPath(uint32_t n) {
+    return std::string(BASE) + "." + std::to_string(n);
+}
+
+static void resetFiles() {
+    remove(LOG_FILE);
+    remove((std::string(LOG_FILE) + ".tmp").c_str());
+    for (uint32_t n = 1; n < 100; n++) remove(segPath(n).c_str());
+    remove((std::string(BASE) + ".man").c_str());
+    remove((std::string(BASE) + ".man.tmp").c_str());
+}
+
+static size_t fileSize(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    long end = ftell(f);
+    fclose(f);
+    return end > 0 ? (size_t)end : 0;
+}
+
+static AccessLogRecord makeTap(uint32_t i) {
+    AccessLogRecord rec;
+    rec.timestamp = 1770000000 + i * 5;
+    rec.userIdx = (uint16_t)(i % 700);
+    rec.method = LOG_METHOD_NFC;
+    rec.flags = 0;
+    return rec;
+}
+
+static bool isTap(const AccessLogRecord& rec, uint32_t i) {
+    AccessLogRecord want = makeTap(i);
+    return memcmp(&rec, &want, sizeof(rec)) == 0;
+}
+
+static void writeLog(size_t frames) {
+    resetFiles();
+    AccessLogFile log;
+    log.begin(LOG_FILE, nullptr, MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+    for (uint32_t i = 0; i < frames; i++) log.append(makeTap(i), 0);
+    log.end();
+}
+
+static void appendBytes(const char* path, const void* data, size_t n) {
+    FILE* f = fopen(path, "ab");
+    fwrite(data, 1, n, f);
+    fclose(f);
+}
+
+// Overwrite one byte of frame `index` in place
+static void corruptFrame(const char* path, size_t index, size_t offset) {
+    FILE* f = fopen(path, "r+b");
+    fseek(f, (long)(index * AccessLogFile::FRAME_SIZE + offset), SEEK_SET);
+    int c = fgetc(f);
+    fseek(f, (long)(index * AccessLogFile::FRAME_SIZE + offset), SEEK_SET);
+    fputc(c ^ 0x5A, f);
+    fclose(f);
+}
+
+// What boot would cost without the bound: check every frame from the start
+static size_t forwardScan(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    LogFrame<AccessLogRecord> frame;
+    size_t valid = 0;
+    while (fread(&frame, 1, sizeof(frame), f) == sizeof(frame)) {
+        if (!frame.valid()) break;
+        valid++;
+    }
+    fclose(f);
+    return valid;
+}
+
+static void testTornTail() {
+    writeLog(100);
+    LogFrame<AccessLogRecord> half;
+    half.encode(makeTap(100), 100);
+    appendBytes(LOG_FILE, &half, sizeof(half) / 2);  // Brownout mid-frame
+
+    AccessLogFile log;
+    bool ok = log.begin(LOG_FILE, nullptr, MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+    LogRecoveryStats r = log.recovery();
+    check(ok && log.count() == 100 && fileSize(LOG_FILE) == 100 * AccessLogFile::FRAME_SIZE &&
+          r.framesCut == 0 && r.bytesCut == sizeof(half) / 2, "Partial frame at the tail is cut");
+    log.end();
+
+    // A whole commit of garbage: the sizes line up, only the CRC can tell
+    std::vector<uint8_t> junk(3 * AccessLogFile::FRAME_SIZE, 0xA5);
+    appendBytes(LOG_FILE, junk.data(), junk.size());
+    AccessLogFile after;
+    ok = after.begin(LOG_FILE, nullptr, MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+    r = after.recovery();
+    AccessLogRecord rec;
+    check(ok && after.count() == 100 && r.framesCut == 3 && r.framesScanned == 4 &&
+          after.read(99, rec) && isTap(rec, 99), "Invalid frames cut back to the last valid one");
+
+    after.append(makeTap(100), 0);
+    after.flush();
+    uint32_t seq = 0;
+    check(after.read(100, rec, &seq) && isTap(rec, 100) && seq == 100,
+          "Appends after recovery continue the numbering");
+    after.end();
+}
+
+static void testCorruptMiddle() {
+    writeLog(100);
+    corruptFrame(LOG_FILE, 40, 8);  // Inside the record
+
+    AccessLogFile log;
+    log.begin(LOG_FILE, nullptr, MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+    AccessLogRecord rec;
+    uint32_t seq = 0;
+    bool bad = !log.read(40, rec);
+    bool aligned = log.read(41, rec, &seq) && isTap(rec, 41) && seq == 41;
+    uint32_t good = 0;
+    for (size_t i = 0; i < log.count(); i++) good += log.read(i, rec) ? 1 : 0;
+    check(log.count() == 100 && log.recovery().framesCut == 0, "Corrupt frame further in is not cut at boot");
+    check(bad && aligned && good == 99 && log.recovery().badReads >= 1,
+          "Corrupt frame fails its read, the rest stay aligned");
+    log.end();
+}
+
+static void testBootTime() {
+    printf("\n  %-8s %14s %14s %10s\n", "frames", "recovery (us)", "full scan (us)", "scanned");
+    const size_t sizes[] = {1000, 10000, 50000};
+    uint32_t scanned[3] = {0, 0, 0};
+    double recoveryUs[3] = {0, 0, 0};
+    bool allKept = true;
+    for (int s = 0; s < 3; s++) {
+        writeLog(sizes[s]);
+        std::vector<uint8_t> junk(5 * AccessLogFile::FRAME_SIZE + 7, 0x00);
+        const int RUNS = 20;
+        double total = 0;
+        for (int k = 0; k < RUNS; k++) {
+            appendBytes(LOG_FILE, junk.data(), junk.size());  // Torn tail every boot
+            AccessLogFile log;
+            auto t0 = Clock::now();
+            log.begin(LOG_FILE, nullptr, MAX_SIZE, COMMIT_MS, COMMIT_RECORDS);
+            total += std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+            scanned[s] = log.recovery().framesScanned;
+            allKept = allKept && log.count() == sizes[s];
+            log.end();
+        }
+        recoveryUs[s] = total / RUNS;
+
+        auto t0 = Clock::now();
+        size_t valid = 0;
+        for (int k = 0; k < RUNS; k++) valid = forwardScan(LOG_FILE);
+        double fullUs = std::chrono::duration<double, std::micro>(Clock::now() - t0).count() / RUNS;
+        allKept = allKept && valid == sizes[s];
+        printf("  %-8zu %14.1f %14.1f %10u\n", sizes[s], recoveryUs[s], fullUs, scanned[s]);
+    }
+    check(allKept, "Every boot cuts the torn tail, keeps every record");
+    check(scanned[0] == scanned[2] && scanned[0] <= LOG_RECOVERY_FRAMES,
+          "Frames checked at boot do not grow with the file");
+    // Generous: host file I/O is noisy; a forward scan grows 50x here
+    check(recoveryUs[2] < recoveryUs[0] * 5 + 200, "Boot recovery time stays flat from 1k to 50k frames");
+}
+
+static void testSegmentSeqs() {
+    resetFiles();
+    AccessLogSegments log;
+    log.begin(BASE, SEGMENT_SIZE, MAX_SEGMENTS, COMMIT_MS, COMMIT_RECORDS);
+    size_t perSegment = SEGMENT_SIZE / AccessLogSegments::FRAME_SIZE;
+    for (uint32_t i = 0; i < perSegment * 2 + 50; i++) log.append(makeTap(i), 0);
+    log.flush();
+    log.trim(perSegment + 10, 0);
+
+    bool match = true;
+    for (size_t i = 0; match && i < log.count(); i++) {
+        AccessLogRecord rec;
+        uint32_t seq;
+        match = log.read(i, rec, &seq) && seq == log.seqAt(i);
+    }
+    check(match && log.seqAt(0) == perSegment + 10, "Frames carry the numbers seqAt() reports across trims");
+
+    // Torn head after a reboot: numbering picks up after the last valid frame
+    log.end();
+    uint32_t headSeg = 0;
+    for (uint32_t n = 1; n < 100; n++) if (fileSize(segPath(n).c_str()) > 0) headSeg = n;
+    appendBytes(segPath(headSeg).c_str(), "\x0C\xA1\x08", 3);
+    log.begin(BASE, SEGMENT_SIZE, MAX_SEGMENTS, COMMIT_MS, COMMIT_RECORDS);
+    size_t n = log.count();
+    log.append(makeTap(999), 0);
+    log.flush();
+    AccessLogRecord rec;
+    uint32_t seq = 0;
+    check(log.recovery().bytesCut == 3 && log.read(n, rec, &seq) && isTap(rec, 999) && seq == log.seqAt(n),
+          "Torn segment tail cut, numbering continues");
+
+    // Manifest lost: the oldest frame still states where numbering starts
+    // (the acknowledged ones left in the oldest segment are resent)
+    log.end();
+    remove((std::string(BASE) + ".man").c_str());
+    log.begin(BASE, SEGMENT_SIZE, MAX_SEGMENTS, COMMIT_MS, COMMIT_RECORDS);
+    uint32_t first = 0;
+    bool read = log.read(0, rec, &first);
+    check(read && log.seqAt(0) == first && first == perSegment && log.seqAt(log.count() - 1) == perSegment * 2 + 50,
+          "Without a manifest, numbering comes from the frames");
+    log.end();
+}
+
+static void testCrcCost() {
+    const int N = 200000;
+    LogFrame<AccessLogRecord> frame;
+    uint32_t valid = 0;
+    auto t0 = Clock::now();
+    for (int i = 0; i < N; i++) {
+        frame.encode(makeTap((uint32_t)i), (uint32_t)i);
+        valid += frame.valid() ? 1 : 0;
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / N;
+    printf("\n  encode + check one %zu-byte frame: %.0f ns (software CRC; ROM CRC on the ESP32)\n",
+        sizeof(frame), ns);
+    check(valid == (uint32_t)N, "Every encoded frame checks out");
+}
+
+int main() {
+    printf("\n=== Log Recovery Test (%zu-byte tap frames, %zu-byte expanded frames) ===\n\n",
+        AccessLogFile::FRAME_SIZE, ExpandedLogFile::FRAME_SIZE);
+
+    testTornTail();
+    testCorruptMiddle();
+    testSegmentSeqs();
+    testBootTime();
+    testCrcCost();
+
+    resetFiles();
+    printf("\n%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,307 @@
+/**
+ * Log Iterator Benchmark
+ * =======================
+ *
+ * PURPOSE: Compare bulk reads through LogIterator (AccessLogIterator.h,
+ *          behind the LOGS:TAIL / LOGS:SINCE serial commands) with
+ *          Storage::readLog() per record, which seeks the segment file and
+ *          takes the log mutex for every record.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware needed - plain files in the working directory stand in
+ *    for the LittleFS log segments
+ *
+ * WHAT IT MEASURES:
+ * - Time to read a 20,000-tap log forward and backward, per record vs in
+ *   blocks of LOG_READ_BLOCK
+ * - Lock acquisitions per dump (the writer task waits on each)
+ *
+ * WHAT IT CHECKS:
+ * - Forward and reverse order across segments and pending records
+ * - Time filter keeps taps in range and every roster marker
+ * - Frames that fail their CRC are skipped and counted
+ * - Trims and appends between blocks: no record twice, appends still seen
+ * - The LOGS:TAIL start search attributes every tap to the right roster
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "AccessLogSegments.h"
+#include "AccessLogIterator.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const char* BASE = "iter_taps";
+static const size_t SEGMENT_SIZE = 16 * 1024;     // LOG_SEGMENT_SIZE
+static const size_t MAX_SEGMENTS = 32;            // LOG_MAX_SEGMENTS
+static const uint32_t COMMIT_MS = 15000;          // LOG_COMMIT_INTERVAL_MS
+static const size_t COMMIT_RECORDS = 8;           // LOG_COMMIT_RECORDS
+static const uint32_t TAPS = 20000;
+static const uint32_t T0 = 1780000000;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("[TEST] %-58s %s\n", what, ok ? "PASS" : "FAIL");
+    if (!ok) failures++;
+}
+
+static std::string segPath(uint32_t n) {
+    return std::string(BASE) + "." + std::to_string(n);
+}
+
+static void resetFiles() {
+    for (uint32_t n = 1; n < 200; n++) remove(segPath(n).c_str());
+    remove((std::string(BASE) + ".man").c_str());
+    remove((std::string(BASE) + ".man.tmp").c_str());
+}
+
+// Stands in for Storage::LogLock
+struct CountingLock {
+    static uint32_t taken;
+    CountingLock() { taken++; }
+};
+uint32_t CountingLock::taken = 0;
+
+typedef LogIterator<AccessLogSegments, AccessLogRecord, CountingLock> TapIterator;
+
+static AccessLogRecord makeTap(uint32_t i) {
+    AccessLogRecord rec;
+    rec.timestamp = T0 + i * 10;
+    rec.userIdx = (uint16_t)(i % 500);
+    rec.method = LOG_METHOD_NFC;
+    rec.flags = 0;
+    return rec;
+}
+
+static long tapIndex(const AccessLogRecord& rec) {
+    if (!accessLogIsTap(rec)) return -1;
+    return (long)((rec.timestamp - T0) / 10);
+}
+
+static void openLog(AccessLogSegments& log) {
+    log.begin(BASE, SEGMENT_SIZE, MAX_SEGMENTS, COMMIT_MS, COMMIT_RECORDS);
+}
+
+// Taps 0..n-1, nothing pending
+static void fillLog(AccessLogSegments& log, uint32_t n) {
+    resetFiles();
+    openLog(log);
+    for (uint32_t i = 0; i < n; i++) log.append(makeTap(i), 0);
+    log.flush();
+}
+
+static void testThroughput() {
+    AccessLogSegments log;
+    fillLog(log, TAPS);
+    const int RUNS = 5;
+
+    // Storage::readLog(): a lock and a seek per record
+    CountingLock::taken = 0;
+    uint32_t good = 0;
+    auto t0 = Clock::now();
+    for (int r = 0; r < RUNS; r++) {
+        for (size_t i = 0; i < log.count(); i++) {
+            CountingLock lock;
+            AccessLogRecord rec;
+            good += log.read(i, rec) ? 1 : 0;
+        }
+    }
+    double perRecordMs = std::chrono::duration<double, std::milli>(Clock::now() - t0).count() / RUNS;
+    uint32_t perRecordLocks = CountingLock::taken / RUNS;
+
+    CountingLock::taken = 0;
+    uint32_t forward = 0, reverse = 0;
+    bool forwardOrder = true, reverseOrder = true;
+    t0 = Clock::now();
+    for (int r = 0; r < RUNS; r++) {
+        TapIterator it(log);
+        AccessLogRecord rec;
+        uint32_t seq;
+        forward = 0;
+        while (it.next(rec, &seq)) {
+            if (tapIndex(rec) != (long)forward || seq != forward) forwardOrder = false;
+            forward++;
+        }
+    }
+    double forwardMs = std::chrono::duration<double, std::milli>(Clock::now() - t0).count() / RUNS;
+    uint32_t iterLocks = CountingLock::taken / RUNS;
+
+    t0 = Clock::now();
+    for (int r = 0; r < RUNS; r++) {
+        TapIterator it(log, true);
+        AccessLogRecord rec;
+        reverse = 0;
+        while (it.next(rec)) {
+            if (tapIndex(rec) != (long)(TAPS - 1 - reverse)) reverseOrder = false;
+            reverse++;
+        }
+    }
+    double reverseMs = std::chrono::duration<double, std::milli>(Clock::now() - t0).count() / RUNS;
+
+    printf("  %u taps in %u segments:\n", TAPS, (unsigned)log.segments());
+    printf("    readLog() per record:   %7.2f ms, %6u locks\n", perRecordMs, perRecordLocks);
+    printf("    iterator forward:       %7.2f ms, %6u locks (%u-record blocks)\n",
+        forwardMs, iterLocks, (unsigned)LOG_READ_BLOCK);
+    printf("    iterator reverse:       %7.2f ms\n\n", reverseMs);
+    check(good == TAPS * RUNS && forward == TAPS && forwardOrder, "Forward iteration returns every tap in order");
+    check(reverse == TAPS && reverseOrder, "Reverse iteration returns every tap newest first");
+    check(iterLocks * (LOG_READ_BLOCK / 2) <= perRecordLocks, "Lock taken per block, not per record");
+    check(forwardMs < perRecordMs, "Block reads beat a seek per record");
+    log.end();
+}
+
+static void testPendingAndFilter() {
+    AccessLogSegments log;
+    fillLog(log, 100);
+    log.append(accessLogRosterMarker(7), 0);
+    for (uint32_t i = 100; i < 105; i++) log.append(makeTap(i), 0);  // Still pending
+
+    TapIterator all(log, true);
+    AccessLogRecord rec;
+    check(all.next(rec) && tapIndex(rec) == 104 && log.pending() > 0, "Pending records are read (newest first)");
+
+    // Taps 40..59 by time, plus the marker
+    TapIterator range(log, false, T0 + 400, T0 + 590);
+    uint32_t taps = 0, markers = 0;
+    bool inRange = true;
+    while (range.next(rec)) {
+        if (rec.method == LOG_METHOD_ROSTER) {
+            markers++;
+            continue;
+        }
+        long i = tapIndex(rec);
+        if (i < 40 || i > 59) inRange = false;
+        taps++;
+    }
+    check(inRange && taps == 20 && markers == 1, "Time filter keeps taps in range and every marker");
+    log.end();
+}
+
+static void testBadFrame() {
+    AccessLogSegments log;
+    fillLog(log, 3000);
+    log.end();
+    // Flip a byte inside frame 10 of the oldest segment
+    FILE* f = fopen(segPath(1).c_str(), "r+b");
+    fseek(f, (long)(10 * AccessLogSegments::FRAME_SIZE + 9), SEEK_SET);
+    fputc(0xEE, f);
+    fclose(f);
+    openLog(log);
+
+    TapIterator it(log);
+    AccessLogRecord rec;
+    uint32_t n = 0;
+    bool skipped = true;
+    while (it.next(rec)) {
+        if (tapIndex(rec) == 10) skipped = false;
+        n++;
+    }
+    check(n == 2999 && skipped && it.badFrames() == 1, "Frame failing its CRC is skipped and counted");
+    log.end();
+}
+
+static void testConcurrentChanges() {
+    AccessLogSegments log;
+    fillLog(log, 2000);
+
+    // Uploads trim ahead of a slow dump: the dump skips to what is left
+    TapIterator it(log);
+    AccessLogRecord rec;
+    uint32_t seq, last = 0, n = 0;
+    bool ascending = true;
+    while (it.next(rec, &seq)) {
+        if (n > 0 && seq <= last) ascending = false;
+        last = seq;
+        n++;
+        if (n == 100) log.trim(900, 0);            // Trimmed past the dump
+        if (n == 1200) log.append(makeTap(2000), 0);  // Appended meanwhile
+    }
+    check(ascending && last == 2000 && tapIndex(rec) == 2000,
+          "Trims and appends between blocks: no repeats, appends seen");
+
+    // Reverse dump while the front is trimmed away: stops at the trim
+    TapIterator back(log, true);
+    uint32_t m = 0;
+    while (back.next(rec, &seq)) {
+        if (++m == 50) log.trim(log.count() - 500, 0);
+    }
+    check(m <= 500 + LOG_READ_BLOCK && seq >= log.seqAt(0) - LOG_READ_BLOCK,
+          "Reverse dump ends where the log was trimmed");
+
+    TapIterator sought(log);
+    sought.seek(log.seqAt(0) + 10);
+    check(sought.next(rec, &seq) && seq == log.seqAt(10), "seek() continues from a sequence number");
+    log.end();
+}
+
+// main.cpp printLogTail(): backward pass for the start and the roster in
+// effect there, then forward with the expander
+static void testTailRosters() {
+    AccessLogSegments log;
+    resetFiles();
+    openLog(log);
+    uint32_t i = 0;
+    for (uint32_t gen = 1; gen <= 3; gen++) {
+        log.append(accessLogRosterMarker(gen), 0);
+        for (uint32_t k = 0; k < 400; k++, i++) {
+            AccessLogRecord rec = makeTap(i);
+            rec.userIdx = (uint16_t)(gen * 1000 + k);
+            log.append(rec, 0);
+        }
+    }
+    log.flush();
+
+    const uint32_t n = 450;   // Spans the gen 2 -> 3 marker
+    TapIterator back(log, true);
+    AccessLogRecord rec;
+    uint32_t seq, start = 0, found = 0, generation = 0;
+    while (back.next(rec, &seq)) {
+        if (found == n) {
+            if (rec.method != LOG_METHOD_ROSTER) continue;
+            generation = rec.timestamp;
+            break;
+        }
+        if (!accessLogIsTap(rec)) continue;
+        found++;
+        start = seq;
+    }
+
+    uint32_t gen = generation, printed = 0;
+    bool right = true;
+    TapIterator fwd(log);
+    fwd.seek(start);
+    while (printed < found && fwd.next(rec, &seq)) {
+        if (rec.method == LOG_METHOD_ROSTER) {
+            gen = rec.timestamp;
+            continue;
+        }
+        if (rec.userIdx / 1000 != gen) right = false;
+        if (printed == 0 && tapIndex(rec) != (long)(i - n)) right = false;
+        printed++;
+    }
+    check(found == n && generation == 2 && printed == n && right && tapIndex(rec) == (long)(i - 1),
+          "TAIL across a roster swap names each tap's roster");
+    log.end();
+}
+
+int main() {
+    printf("\n=== Log Iterator Benchmark (%u-record blocks, %zu-byte frames) ===\n\n",
+        (unsigned)LOG_READ_BLOCK, AccessLogSegments::FRAME_SIZE);
+
+    testThroughput();
+    testPendingAndFilter();
+    testBadFrame();
+    testConcurrentChanges();
+    testTailRosters();
+
+    resetFiles();
+    printf("\n%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
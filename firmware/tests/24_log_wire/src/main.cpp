@@ -0,0 +1,316 @@
+/**
+ * Log Upload Wire Format Benchmark
+ * =================================
+ *
+ * PURPOSE: Compare the compact binary log batch (LGB1, LogUploadStream.h
+ *          with LOG_BINARY_WIRE) with the JSON body, which repeats
+ *          "action":"ATTENDANCE", "result" and "timestampType" on every row.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware needed - an in-memory client captures what would go to
+ *    the socket, and a reference decoder stands in for
+ *    mobile/convex/lib/logs.ts decodeLogBatchBinary
+ *
+ * WHAT IT MEASURES:
+ * - Bytes on the wire for a 2,000-record backlog (LOG_UPLOAD_BATCH per
+ *   request), JSON vs binary, including HTTP framing
+ * - Upload time on a weak Wi-Fi link (8 KB/s, 250 ms RTT, a TLS handshake
+ *   per request as syncLogs does today), from those byte counts
+ * - Encode time per log
+ *
+ * WHAT IT CHECKS:
+ * - Every binary batch decodes to exactly what the JSON batch says: users,
+ *   methods, timestamps, flags, sequence numbers and the batch range
+ * - Users past the LOG_WIRE_USERS dictionary are still sent correctly
+ * - Unknown method names, out-of-order timestamps and seq gaps survive
+ * - A truncated body (no trailer) is rejected
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "AccessLogRecord.h"
+#include "LogUploadStream.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const int BACKLOG = 2000;
+static const int BATCH = 50;                      // LOG_UPLOAD_BATCH
+static const double LINK_BYTES_PER_S = 8 * 1024;  // Weak Wi-Fi, effective
+static const double RTT_S = 0.25;
+static const int TLS_HANDSHAKE_RTTS = 2;
+static const int TLS_HANDSHAKE_BYTES = 5000;      // Certificate chain + key exchange
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("[TEST] %-58s %s\n", what, ok ? "PASS" : "FAIL");
+    if (!ok) failures++;
+}
+
+// The two calls LogUploadStream makes on WiFiClientSecure, in memory
+struct CaptureClient {
+    std::string sent;
+    std::string reply = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\n{}";
+    size_t replyPos = 0;
+
+    size_t write(const uint8_t* data, size_t len) {
+        sent.append((const char*)data, len);
+        return len;
+    }
+    size_t readBytes(char* out, size_t len) {
+        size_t n = 0;
+        while (n < len && replyPos < reply.size()) out[n++] = reply[replyPos++];
+        return n;
+    }
+};
+
+struct Tap {
+    AccessLog log;
+    bool localTime;
+    bool denied;
+    uint32_t seq;
+};
+
+// ~400 students over a few days, a busy door: bursts seconds apart
+static std::vector<Tap> makeBacklog(int n) {
+    std::vector<Tap> taps;
+    uint32_t t = 1781000000;
+    uint32_t rng = 12345;
+    for (int i = 0; i < n; i++) {
+        rng = rng * 1103515245 + 12345;
+        Tap tap;
+        memset(&tap.log, 0, sizeof(tap.log));
+        t += (i % 40 == 0) ? 3600 + (rng >> 20) % 1800 : 3 + (rng >> 16) % 20;
+        tap.log.timestamp = t;
+        snprintf(tap.log.userId, sizeof(tap.log.userId), "j57%012u%016u", (rng >> 8) % 400, 7u);
+        static const char* methods[] = {"NFC", "NFC", "NFC", "NFC+BIO", "FACE", "VEIN"};
+        snprintf(tap.log.method, sizeof(tap.log.method), "%s", methods[(rng >> 4) % 6]);
+        tap.localTime = (i % 97) == 0;
+        tap.denied = (i % 53) == 0;
+        tap.seq = 10000 + (uint32_t)i;
+        taps.push_back(tap);
+    }
+    return taps;
+}
+
+// Strip headers and chunk framing: the body as the server sees it
+static std::string dechunk(const std::string& request) {
+    size_t pos = request.find("\r\n\r\n");
+    if (pos == std::string::npos) return "";
+    pos += 4;
+    std::string body;
+    while (pos < request.size()) {
+        size_t eol = request.find("\r\n", pos);
+        size_t len = strtoul(request.substr(pos, eol - pos).c_str(), nullptr, 16);
+        if (len == 0) break;
+        body += request.substr(eol + 2, len);
+        pos = eol + 2 + len + 2;
+    }
+    return body;
+}
+
+// One request per batch; returns the bytes sent (headers + chunk framing)
+static std::string sendBatch(const std::vector<Tap>& taps, size_t from, size_t n, bool binary, bool hasSeq) {
+    CaptureClient client;
+    LogUploadStream<CaptureClient> upload(client, binary);
+    upload.begin("example.convex.site", "/api/logs", "0123456789abcdef0123456789abcdef", "24:6F:28:AA:BB:CC");
+    for (size_t i = from; i < from + n; i++) {
+        upload.add(taps[i].log, taps[i].localTime, taps[i].denied, hasSeq, taps[i].seq);
+    }
+    upload.finish(hasSeq, taps[from].seq, taps[from + n - 1].seq);
+    return client.sent;
+}
+
+// Reference for lib/logs.ts decodeLogBatchBinary
+struct Decoded {
+    std::string chipId;
+    bool hasRange = false;
+    uint32_t first = 0, last = 0;
+    std::vector<Tap> taps;
+    std::vector<bool> hasSeq;
+};
+
+static bool decodeBinary(const std::string& body, Decoded& out) {
+    size_t pos = 0;
+    bool ok = true;
+    auto byte = [&]() -> uint8_t {
+        if (pos >= body.size()) {
+            ok = false;
+            return 0;
+        }
+        return (uint8_t)body[pos++];
+    };
+    auto varint = [&]() -> uint32_t {
+        uint32_t v = 0;
+        for (int shift = 0; shift < 35 && ok; shift += 7) {
+            uint8_t b = byte();
+            v |= (uint32_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        ok = false;
+        return 0;
+    };
+    auto delta = [&](uint32_t base) -> uint32_t {
+        uint32_t z = varint();
+        int32_t d = (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+        return base + (uint32_t)d;
+    };
+    auto shortString = [&]() -> std::string {
+        uint8_t len = byte();
+        if (pos + len > body.size()) {
+            ok = false;
+            return "";
+        }
+        std::string s = body.substr(pos, len);
+        pos += len;
+        return s;
+    };
+
+    if (body.size() < 6) return false;
+    uint32_t magic = (uint8_t)body[0] | ((uint8_t)body[1] << 8) | ((uint8_t)body[2] << 16) |
+                     ((uint32_t)(uint8_t)body[3] << 24);
+    pos = 4;
+    if (magic != LOG_WIRE_MAGIC || byte() != LOG_WIRE_FORMAT) return false;
+    out.chipId = shortString();
+
+    std::vector<std::string> users;
+    uint32_t prevTime = 0, nextSeq = 0;
+    while (ok) {
+        uint8_t flags = byte();
+        if (!ok) return false;
+        if (flags == 0) break;
+        Tap tap;
+        memset(&tap.log, 0, sizeof(tap.log));
+        uint8_t code = flags & LOG_WIRE_METHOD_NAMED;
+        std::string method = code == LOG_WIRE_METHOD_NAMED ? shortString() : accessLogMethodName(code);
+        std::string user;
+        if (flags & LOG_WIRE_NEW_USER) {
+            user = shortString();
+            users.push_back(user);
+        } else {
+            uint32_t index = varint();
+            if (index >= users.size()) return false;
+            user = users[index];
+        }
+        prevTime = delta(prevTime);
+        tap.log.timestamp = prevTime;
+        snprintf(tap.log.userId, sizeof(tap.log.userId), "%s", user.c_str());
+        snprintf(tap.log.method, sizeof(tap.log.method), "%s", method.c_str());
+        tap.localTime = (flags & LOG_WIRE_LOCAL_TIME) != 0;
+        tap.denied = (flags & LOG_WIRE_DENIED) != 0;
+        tap.seq = 0;
+        if (flags & LOG_WIRE_HAS_SEQ) {
+            tap.seq = delta(nextSeq);
+            nextSeq = tap.seq + 1;
+        }
+        out.hasSeq.push_back((flags & LOG_WIRE_HAS_SEQ) != 0);
+        out.taps.push_back(tap);
+    }
+    uint8_t trailer = byte();
+    if (trailer & LOG_WIRE_TRAILER_RANGE) {
+        out.hasRange = true;
+        out.first = varint();
+        out.last = varint();
+    }
+    return ok && pos == body.size();
+}
+
+static bool sameTaps(const std::vector<Tap>& want, size_t from, const Decoded& got, bool hasSeq) {
+    for (size_t i = 0; i < got.taps.size(); i++) {
+        const Tap& a = want[from + i];
+        const Tap& b = got.taps[i];
+        if (a.log.timestamp != b.log.timestamp || strcmp(a.log.userId, b.log.userId) != 0 ||
+            strcmp(a.log.method, b.log.method) != 0 || a.localTime != b.localTime || a.denied != b.denied ||
+            got.hasSeq[i] != hasSeq || (hasSeq && a.seq != b.seq)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void testBacklog() {
+    std::vector<Tap> taps = makeBacklog(BACKLOG);
+    size_t jsonBytes = 0, binBytes = 0, jsonBody = 0, binBody = 0;
+    int batches = 0;
+    bool roundTrip = true;
+    double encodeJson = 0, encodeBin = 0;
+    for (size_t from = 0; from < taps.size(); from += BATCH, batches++) {
+        size_t n = taps.size() - from < (size_t)BATCH ? taps.size() - from : BATCH;
+        auto t0 = Clock::now();
+        std::string json = sendBatch(taps, from, n, false, true);
+        auto t1 = Clock::now();
+        std::string bin = sendBatch(taps, from, n, true, true);
+        auto t2 = Clock::now();
+        encodeJson += std::chrono::duration<double, std::micro>(t1 - t0).count();
+        encodeBin += std::chrono::duration<double, std::micro>(t2 - t1).count();
+        jsonBytes += json.size();
+        binBytes += bin.size();
+        jsonBody += dechunk(json).size();
+        std::string body = dechunk(bin);
+        binBody += body.size();
+
+        Decoded d;
+        roundTrip = roundTrip && bin.find("Content-Type: " LOG_WIRE_CONTENT_TYPE) != std::string::npos &&
+                    decodeBinary(body, d) && d.chipId == "24:6F:28:AA:BB:CC" && d.taps.size() == n &&
+                    d.hasRange && d.first == taps[from].seq && d.last == taps[from + n - 1].seq &&
+                    sameTaps(taps, from, d, true);
+    }
+
+    auto uploadSeconds = [&](size_t bytes) {
+        return batches * (TLS_HANDSHAKE_RTTS + 1) * RTT_S +
+               (bytes + (double)batches * TLS_HANDSHAKE_BYTES) / LINK_BYTES_PER_S;
+    };
+    double jsonS = uploadSeconds(jsonBytes), binS = uploadSeconds(binBytes);
+    printf("  %d logs in %d batches of %d:\n", BACKLOG, batches, BATCH);
+    printf("    %-8s %8s %10s %12s %10s\n", "format", "body", "on wire", "bytes/log", "upload");
+    printf("    %-8s %8zu %10zu %12.1f %9.1fs\n", "JSON", jsonBody, jsonBytes, (double)jsonBody / BACKLOG, jsonS);
+    printf("    %-8s %8zu %10zu %12.1f %9.1fs\n", "binary", binBody, binBytes, (double)binBody / BACKLOG, binS);
+    printf("    link: %.0f KB/s, %.0f ms RTT, TLS handshake per request (%d RTTs, %d bytes)\n",
+        LINK_BYTES_PER_S / 1024, RTT_S * 1000, TLS_HANDSHAKE_RTTS, TLS_HANDSHAKE_BYTES);
+    printf("    encode: JSON %.2f us/log, binary %.2f us/log\n\n", encodeJson / BACKLOG, encodeBin / BACKLOG);
+
+    check(roundTrip, "Every binary batch decodes to the JSON batch's logs");
+    check(binBody * 3 <= jsonBody, "Binary body is at most a third of the JSON");
+    check(binS < jsonS, "Binary batches upload faster on a weak link");
+}
+
+static void testEdgeCases() {
+    std::vector<Tap> taps = makeBacklog(120);
+    // More distinct users than the dictionary keeps
+    for (int i = 0; i < 120; i++) {
+        snprintf(taps[i].log.userId, sizeof(taps[i].log.userId), "user%03d", i < 80 ? i : i - 80);
+    }
+    snprintf(taps[5].log.method, sizeof(taps[5].log.method), "card");   // Not a LOG_METHOD name
+    taps[6].log.timestamp = taps[5].log.timestamp - 3600;                 // Clock stepped back
+    taps[7].seq = taps[6].seq + 40;                                       // Gap (records skipped)
+
+    std::string body = dechunk(sendBatch(taps, 0, taps.size(), true, true));
+    Decoded d;
+    check(decodeBinary(body, d) && d.taps.size() == taps.size() && sameTaps(taps, 0, d, true),
+          "Dictionary overflow, named method, clock step, seq gap");
+
+    // Expanded logs are sent without seq or range
+    body = dechunk(sendBatch(taps, 0, 10, true, false));
+    Decoded e;
+    check(decodeBinary(body, e) && !e.hasRange && e.taps.size() == 10 && sameTaps(taps, 0, e, false),
+          "Batch without sequence numbers or range");
+
+    Decoded t;
+    check(!decodeBinary(body.substr(0, body.size() - 2), t), "Truncated body (no trailer) is rejected");
+}
+
+int main() {
+    printf("\n=== Log Upload Wire Format Benchmark ===\n\n");
+
+    testBacklog();
+    testEdgeCases();
+
+    printf("\n%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
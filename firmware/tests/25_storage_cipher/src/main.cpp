@@ -0,0 +1,535 @@
+/**
+ * Storage Cipher Benchmark
+ * =========================
+ *
+ * PURPOSE: Measure what encrypting the logs and whitelist user IDs at rest
+ *          (StorageCipher.h, STORAGE_ENCRYPTION) costs on the paths that
+ *          touch them, and check the encrypted formats.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware needed - plain files stand in for LittleFS and a
+ *    file-backed mmap for the whitelist partition. Plaintext vs the
+ *    portable software AES; the device uses the AES peripheral through
+ *    mbedTLS (CtrCipher<MbedAes128>), which is faster than this column.
+ *
+ * WHAT IT MEASURES:
+ * - Keystream cost per call at frame sizes (12 B tap, 52 B expanded log,
+ *   32 B user ID) and bulk throughput
+ * - Tap append (frame + encrypt + group commit) and read-back per record
+ * - Whitelist lookup with the user ID copied out
+ *
+ * WHAT IT CHECKS:
+ * - FIPS-197 and SP 800-38A vectors (the counter layout matches
+ *   mbedtls_aes_crypt_ctr, so files move between host and device)
+ * - No user ID appears in the log segments or whitelist files
+ * - Plaintext frames and images written before encryption still read
+ * - A wrong key makes frames fail their check, never return wrong records
+ * - Torn-tail recovery works on encrypted frames
+ * - Head frames a trim rewrites get their own keystream, not that of the
+ *   records whose numbers they take
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "StorageCipher.h"
+#include "AccessLogSegments.h"
+#include "AccessLogIterator.h"
+#include "WhitelistBlockFile.h"
+#include "WhitelistImage.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const uint32_t TAPS = 20000;
+static const uint32_t EXPANDED = 2000;
+static const size_t SEGMENT_SIZE = 16 * 1024;     // LOG_SEGMENT_SIZE
+static const size_t MAX_SEGMENTS = 64;
+static const size_t COMMIT_RECORDS = 8;           // LOG_COMMIT_RECORDS
+static const uint32_t T0 = 1780000000;
+
+static const uint8_t KEY[STORAGE_KEY_LEN] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+static const uint8_t OTHER_KEY[STORAGE_KEY_LEN] = {16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1};
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("[TEST] %-58s %s\n", what, ok ? "PASS" : "FAIL");
+    if (!ok) failures++;
+}
+
+static std::string path(const char* name) {
+    return std::string(name);
+}
+
+static void removeLog(const char* base) {
+    std::string b = path(base);
+    for (uint32_t n = 1; n < 200; n++) remove((b + "." + std::to_string(n)).c_str());
+    remove((b + ".man").c_str());
+    remove((b + ".man.tmp").c_str());
+}
+
+// Every byte of a log's segment files
+static std::string logBytes(const char* base) {
+    std::string all, b = path(base);
+    char buf[512];
+    for (uint32_t n = 1; n < 200; n++) {
+        FILE* f = fopen((b + "." + std::to_string(n)).c_str(), "rb");
+        if (!f) continue;
+        size_t got;
+        while ((got = fread(buf, 1, sizeof(buf), f)) > 0) all.append(buf, got);
+        fclose(f);
+    }
+    return all;
+}
+
+static void studentId(uint32_t i, char* out, size_t size) {
+    snprintf(out, size, "j57stud%08u", (unsigned)i);
+}
+
+static AccessLogRecord makeTap(uint32_t i) {
+    AccessLogRecord rec;
+    rec.timestamp = T0 + i * 10;
+    rec.userIdx = (uint16_t)(i % 500);
+    rec.method = LOG_METHOD_NFC;
+    rec.flags = 0;
+    return rec;
+}
+
+static AccessLog makeLog(uint32_t i) {
+    AccessLog log;
+    memset(&log, 0, sizeof(log));
+    log.timestamp = T0 + i * 10;
+    studentId(i, log.userId, sizeof(log.userId));
+    snprintf(log.method, sizeof(log.method), "%s", accessLogMethodName(LOG_METHOD_FACE));
+    return log;
+}
+
+static double usSince(Clock::time_point t0) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+}
+
+struct Engine {
+    const char* name;
+    const StorageCipher* cipher;    // nullptr: plaintext
+};
+
+static void testVectors(const StorageCipher* cipher, const char* name) {
+    // FIPS-197 C.1: one block is the keystream of counter = plaintext, XORed into zeros
+    static const uint8_t fipsKey[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+    static const uint8_t fipsCt[16] = {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+                                       0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a};
+    // SP 800-38A F.5.1 CTR-AES128.Encrypt, first two blocks
+    static const uint8_t ctrKey[16] = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+                                       0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+    static const uint8_t ctrPt[32] = {0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+                                      0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51};
+    static const uint8_t ctrCt[32] = {0x87, 0x4d, 0x61, 0x91, 0xb6, 0x20, 0xe3, 0x26, 0x1b, 0xef, 0x68, 0x64, 0x99, 0x0d, 0xb6, 0xce,
+                                      0x98, 0x06, 0xf6, 0x6b, 0x79, 0x70, 0xfd, 0xff, 0x86, 0x17, 0x18, 0x7b, 0xb9, 0xff, 0xfd, 0xff};
+    (void)cipher;
+
+    SoftAes128 soft;
+    soft.setKey(fipsKey);
+    uint8_t pt[16], out[16];
+    for (int i = 0; i < 16; i++) pt[i] = (uint8_t)(i * 0x11);
+    soft.encryptBlock(pt, out);
+    bool fips = memcmp(out, fipsCt, 16) == 0;
+
+    // The SP 800-38A counter is f0f1..ff: domain f0f1f2f3, a f4f5f6f7, b f8f9fafb, block fcfdfeff
+    uint8_t data[32];
+    memcpy(data, ctrPt, sizeof(data));
+    uint8_t counter[16];
+    for (int i = 0; i < 16; i++) counter[i] = (uint8_t)(0xf0 + i);
+    soft.setKey(ctrKey);
+    soft.ctr(counter, data, sizeof(data));
+    bool ctr = memcmp(data, ctrCt, sizeof(data)) == 0;
+
+    char what[80];
+    snprintf(what, sizeof(what), "AES-128 FIPS-197 and CTR SP 800-38A vectors (%s)", name);
+    check(fips && ctr, what);
+}
+
+static void benchKeystream(const std::vector<Engine>& engines) {
+    printf("  keystream per call (us):\n");
+    printf("    %-16s %8s %8s %8s %10s\n", "cipher", "12 B", "32 B", "52 B", "4 KB MB/s");
+    static uint8_t buf[4096];
+    for (const Engine& e : engines) {
+        if (!e.cipher) continue;
+        const size_t sizes[] = {12, 32, 52};
+        double us[3];
+        for (int s = 0; s < 3; s++) {
+            const int N = 20000;
+            auto t0 = Clock::now();
+            for (int i = 0; i < N; i++) e.cipher->apply(CIPHER_DOMAIN_TAPS, (uint32_t)i, 0, buf, sizes[s]);
+            us[s] = usSince(t0) / N;
+        }
+        const int BULK = 200;
+        auto t0 = Clock::now();
+        for (int i = 0; i < BULK; i++) e.cipher->apply(CIPHER_DOMAIN_LOGS, (uint32_t)i, 0, buf, sizeof(buf));
+        double mbs = (double)BULK * sizeof(buf) / usSince(t0);
+        printf("    %-16s %8.2f %8.2f %8.2f %10.1f\n", e.name, us[0], us[1], us[2], mbs);
+    }
+    printf("\n");
+}
+
+// Tap append (frame, encrypt, group commit) and block read-back per record
+static void benchLogs(const std::vector<Engine>& engines) {
+    printf("  %u taps / %u expanded logs, %zu-record commits:\n", (unsigned)TAPS, (unsigned)EXPANDED, COMMIT_RECORDS);
+    printf("    %-16s %12s %12s %14s %12s\n", "cipher", "append us", "read us", "exp. append", "exp. read");
+    double plainAppend = 0, softAppend = 0;
+    bool allRead = true, noIds = true;
+    for (const Engine& e : engines) {
+        removeLog("cipher_taps");
+        AccessLogSegments taps;
+        taps.setCipher(e.cipher);
+        taps.begin(path("cipher_taps").c_str(), SEGMENT_SIZE, MAX_SEGMENTS, 0xFFFFFFFF, COMMIT_RECORDS);
+        auto t0 = Clock::now();
+        for (uint32_t i = 0; i < TAPS; i++) taps.append(makeTap(i), 0);
+        taps.flush();
+        double appendUs = usSince(t0) / TAPS;
+
+        t0 = Clock::now();
+        LogIterator<AccessLogSegments, AccessLogRecord> it(taps);
+        AccessLogRecord rec;
+        uint32_t n = 0;
+        while (it.next(rec)) {
+            if (rec.timestamp != T0 + n * 10) allRead = false;
+            n++;
+        }
+        double readUs = usSince(t0) / TAPS;
+        allRead = allRead && n == TAPS;
+        taps.end();
+
+        removeLog("cipher_logs");
+        ExpandedLogSegments logs;
+        logs.setCipher(e.cipher);
+        logs.begin(path("cipher_logs").c_str(), SEGMENT_SIZE, MAX_SEGMENTS, 0xFFFFFFFF, COMMIT_RECORDS);
+        t0 = Clock::now();
+        for (uint32_t i = 0; i < EXPANDED; i++) logs.append(makeLog(i), 0);
+        logs.flush();
+        double expAppendUs = usSince(t0) / EXPANDED;
+        t0 = Clock::now();
+        LogIterator<ExpandedLogSegments, AccessLog> lit(logs);
+        AccessLog log;
+        n = 0;
+        while (lit.next(log)) {
+            if (strcmp(log.userId, makeLog(n).userId) != 0) allRead = false;
+            n++;
+        }
+        double expReadUs = usSince(t0) / EXPANDED;
+        allRead = allRead && n == EXPANDED;
+        logs.end();
+        if (e.cipher) {
+            std::string bytes = logBytes("cipher_logs");
+            char id[32];
+            for (uint32_t i = 0; i < EXPANDED && noIds; i += 97) {
+                studentId(i, id, sizeof(id));
+                if (bytes.find(id) != std::string::npos) noIds = false;
+            }
+            if (bytes.find("j57stud") != std::string::npos) noIds = false;
+        }
+
+        printf("    %-16s %12.2f %12.2f %14.2f %12.2f\n", e.name, appendUs, readUs, expAppendUs, expReadUs);
+        if (!e.cipher) plainAppend = appendUs;
+        if (e.cipher && strcmp(e.name, "software AES") == 0) softAppend = appendUs;
+    }
+    printf("\n");
+    check(allRead, "Every record reads back, plaintext and encrypted");
+    check(noIds, "No student ID bytes in encrypted log segments");
+    check(softAppend > 0 && plainAppend > 0, "Append cost measured with and without encryption");
+    removeLog("cipher_taps");
+    removeLog("cipher_logs");
+}
+
+static void testUpgradeAndWrongKey(const StorageCipher* cipher, const StorageCipher* wrong) {
+    // Plaintext frames from before encryption, then encrypted ones
+    removeLog("cipher_mixed");
+    ExpandedLogSegments log;
+    log.begin(path("cipher_mixed").c_str(), SEGMENT_SIZE, MAX_SEGMENTS, 0xFFFFFFFF, COMMIT_RECORDS);
+    for (uint32_t i = 0; i < 100; i++) log.append(makeLog(i), 0);
+    log.end();
+    log.setCipher(cipher);
+    log.begin(path("cipher_mixed").c_str(), SEGMENT_SIZE, MAX_SEGMENTS, 0xFFFFFFFF, COMMIT_RECORDS);
+    for (uint32_t i = 100; i < 600; i++) log.append(makeLog(i), 0);
+    log.end();
+
+    log.begin(path("cipher_mixed").c_str(), SEGMENT_SIZE, MAX_SEGMENTS, 0xFFFFFFFF, COMMIT_RECORDS);
+    bool ok = log.count() == 600;
+    uint32_t seqs = 0;
+    for (uint32_t i = 0; i < log.count() && ok; i++) {
+        AccessLog rec;
+        uint32_t seq;
+        ok = log.read(i, rec, &seq) && strcmp(rec.userId, makeLog(i).userId) == 0 && seq == i;
+        seqs++;
+    }
+    check(ok && seqs == 600, "Plaintext frames from before encryption still read");
+    log.end();
+
+    // Wrong key (NVS secret lost): every encrypted frame is rejected
+    ExpandedLogSegments other;
+    other.setCipher(wrong);
+    other.begin(path("cipher_mixed").c_str(), SEGMENT_SIZE, MAX_SEGMENTS, 0xFFFFFFFF, COMMIT_RECORDS);
+    LogIterator<ExpandedLogSegments, AccessLog> it(other);
+    AccessLog rec;
+    uint32_t good = 0;
+    bool plainOnly = true;
+    while (it.next(rec)) {
+        if (strncmp(rec.userId, "j57stud", 7) != 0) plainOnly = false;
+        good++;
+    }
+    check(plainOnly && good == 100 && it.badFrames() == 500, "Wrong key: encrypted frames fail their check");
+    check(other.count() == 600 && other.recovery().framesCut == 0, "Wrong key: boot recovery cuts no encrypted frames");
+    other.end();
+    removeLog("cipher_mixed");
+}
+
+static void testTornTail(const StorageCipher* cipher) {
+    removeLog("cipher_torn");
+    AccessLogSegments log;
+    log.setCipher(cipher);
+    log.begin(path("cipher_torn").c_str(), SEGMENT_SIZE, MAX_SEGMENTS, 0xFFFFFFFF, COMMIT_RECORDS);
+    for (uint32_t i = 0; i < 300; i++) log.append(makeTap(i), 0);
+    log.end();
+    // A commit torn after one frame's header: that frame, then half a frame
+    FILE* f = fopen((path("cipher_torn") + ".1").c_str(), "ab");
+    uint8_t junk[AccessLogSegments::FRAME_SIZE * 3 / 2];
+    memset(junk, 0xA5, sizeof(junk));
+    LogFrame<AccessLogRecord> torn;
+    torn.encode(makeTap(300), 300, cipher);
+    memcpy(junk, &torn, offsetof(LogFrame<AccessLogRecord>, rec));
+    fwrite(junk, 1, sizeof(junk), f);
+    fclose(f);
+
+    log.begin(path("cipher_torn").c_str(), SEGMENT_SIZE, MAX_SEGMENTS, 0xFFFFFFFF, COMMIT_RECORDS);
+    log.append(makeTap(300), 0);
+    log.flush();
+    AccessLogRecord rec;
+    uint32_t seq;
+    check(log.count() == 301 && log.recovery().bytesCut == sizeof(junk) &&
+          log.read(300, rec, &seq) && seq == 300 && rec.timestamp == makeTap(300).timestamp,
+          "Torn tail cut from an encrypted segment, numbering continues");
+    log.end();
+    removeLog("cipher_torn");
+}
+
+// Raw frame `index` of a single-file log
+static bool rawFrame(const char* name, size_t index, LogFrame<AccessLogRecord>& f) {
+    FILE* file = fopen(path(name).c_str(), "rb");
+    if (!file) return false;
+    bool ok = fseek(file, (long)(index * sizeof(f)), SEEK_SET) == 0 && fread(&f, 1, sizeof(f), file) == sizeof(f);
+    fclose(file);
+    return ok;
+}
+
+// Keystream a sealed frame was encrypted with
+static std::string keystream(const LogFrame<AccessLogRecord>& sealed, const StorageCipher* cipher) {
+    LogFrame<AccessLogRecord> plain = sealed;
+    plain.crypt(cipher);
+    std::string ks(LogFrame<AccessLogRecord>::SEALED, '\0');
+    const uint8_t* a = (const uint8_t*)&sealed + offsetof(LogFrame<AccessLogRecord>, rec);
+    const uint8_t* b = (const uint8_t*)&plain + offsetof(LogFrame<AccessLogRecord>, rec);
+    for (size_t i = 0; i < ks.size(); i++) ks[i] = (char)(a[i] ^ b[i]);
+    return ks;
+}
+
+// trim() rewrites the head of a /taps.bin under numbers records were
+// already sealed with: the head frames must not reuse their keystream
+static void testTrimHead(const StorageCipher* cipher) {
+    const char* name = "cipher_trim.bin";
+    remove(path(name).c_str());
+    AccessLogFile log;
+    log.setCipher(cipher);
+    log.begin(path(name).c_str(), nullptr, 64 * 1024, 0xFFFFFFFF, COMMIT_RECORDS);
+    for (uint32_t i = 0; i < 40; i++) log.append(makeTap(i), 0);
+    log.flush();
+    LogFrame<AccessLogRecord> before[2], after[2];
+    bool raw = rawFrame(name, 8, before[0]) && rawFrame(name, 9, before[1]);
+    bool trimmed = log.trim(10, 7);
+    log.end();
+    raw = raw && rawFrame(name, 0, after[0]) && rawFrame(name, 1, after[1]);
+
+    bool ownNonce = raw;
+    for (int i = 0; raw && i < 2; i++) {
+        ownNonce = ownNonce && after[i].seq == before[i].seq &&
+                   after[i].magic == LOG_FRAME_MAGIC_HEAD + i &&
+                   keystream(after[i], cipher) != keystream(before[i], cipher);
+    }
+    check(trimmed && ownNonce, "Trimmed head frames do not reuse a record's keystream");
+
+    log.begin(path(name).c_str(), nullptr, 64 * 1024, 0xFFFFFFFF, COMMIT_RECORDS);
+    AccessLogRecord seqRec, roster, rec;
+    uint32_t seq;
+    check(log.count() == 32 && log.read(0, seqRec) && seqRec.method == LOG_METHOD_SEQ &&
+          log.read(1, roster) && roster.method == LOG_METHOD_ROSTER && roster.timestamp == 7 &&
+          log.read(2, rec, &seq) && seq == 10 && rec.timestamp == makeTap(10).timestamp,
+          "Head frames read back after reopen, numbering kept");
+    log.end();
+    remove(path(name).c_str());
+}
+
+static void testCampusFile(const StorageCipher* cipher) {
+    std::string base = path("cipher_campus");
+    WhitelistBlockStore store;
+    store.setCipher(cipher);
+    store.begin(base.c_str());
+    const uint32_t N = 2000;
+    bool ok = store.beginStage(N);
+    char id[WL_USER_ID_LEN];
+    for (uint32_t i = 0; i < N && ok; i++) {
+        uint8_t uid[4] = {(uint8_t)(i >> 24), (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+        studentId(i, id, sizeof(id));
+        ok = store.append(uid, 4, id, 0, 0);
+    }
+    ok = ok && store.commitStage(1) && store.activate();
+
+    std::string bytes;
+    FILE* f = fopen((base + ".usr").c_str(), "rb");
+    char buf[512];
+    size_t got;
+    while (f && (got = fread(buf, 1, sizeof(buf), f)) > 0) bytes.append(buf, got);
+    if (f) fclose(f);
+    bool hidden = bytes.size() > N * WL_USER_ID_LEN && bytes.find("j57stud") == std::string::npos;
+
+    bool lookups = true;
+    for (uint32_t i = 0; i < N && lookups; i += 7) {
+        uint8_t uid[4] = {(uint8_t)(i >> 24), (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+        WhitelistRecord rec;
+        char want[WL_USER_ID_LEN];
+        studentId(i, want, sizeof(want));
+        lookups = store.find(uid, 4, rec) && store.userId(rec.userIdx, id, sizeof(id)) && strcmp(id, want) == 0;
+    }
+    WhitelistBlockStore::Cursor cursor(store);
+    WhitelistRecord rec;
+    uint32_t n = 0;
+    while (cursor.next(rec, id)) {
+        char want[WL_USER_ID_LEN];
+        studentId(n, want, sizeof(want));
+        if (strcmp(id, want) != 0) break;
+        n++;
+    }
+    check(ok && hidden && lookups && n == N && !cursor.failed(), "Campus .usr file: IDs encrypted, lookups and cursor read them");
+
+    WhitelistBlockStore keyless;
+    keyless.begin(base.c_str());
+    WhitelistRecord r0;
+    uint8_t uid0[4] = {0, 0, 0, 0};
+    check(keyless.find(uid0, 4, r0) && !keyless.userId(r0.userIdx, id, sizeof(id)),
+          "Campus file without the key: no user ID, not ciphertext");
+    remove((base + ".blk").c_str());
+    remove((base + ".usr").c_str());
+}
+
+static void benchWhitelistImage(const std::vector<Engine>& engines) {
+    const char* PARTITION_FILE = "cipher_partition.bin";
+    const size_t N = 2000;
+    WhitelistIndex index;
+    index.reserve(N);
+    char id[WL_USER_ID_LEN];
+    for (size_t i = 0; i < N; i++) {
+        uint8_t uid[4] = {(uint8_t)(i >> 24), (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+        studentId((uint32_t)i, id, sizeof(id));
+        index.add(uid, 4, id, 0);
+    }
+    index.finalize();
+
+    printf("  whitelist lookup + user ID copy, %zu entries:\n", N);
+    bool correct = true, hidden = true, oldImage = true, fresh = true;
+    for (const Engine& e : engines) {
+        remove(PARTITION_FILE);
+        FlashPartition part;
+        part.begin(PARTITION_FILE, 256 * 1024);
+        WhitelistStore store(part);
+        store.setCipher(e.cipher);
+        store.begin();
+        store.stage(index, 1);
+        store.activate();
+
+        const int LOOKUPS = 200000;
+        auto t0 = Clock::now();
+        for (int k = 0; k < LOOKUPS; k++) {
+            size_t i = (size_t)(k * 7919) % N;
+            uint8_t uid[4] = {(uint8_t)(i >> 24), (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+            WhitelistStore::Reader reader(store);
+            const WhitelistRecord* rec = reader.image().find(uid, 4);
+            if (!reader.image().userId(rec, id, sizeof(id))) correct = false;
+        }
+        double ns = usSince(t0) * 1000.0 / LOOKUPS;
+        printf("    %-16s %8.0f ns\n", e.name, ns);
+        for (size_t i = 0; i < N; i += 13) {
+            uint8_t uid[4] = {(uint8_t)(i >> 24), (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+            char want[WL_USER_ID_LEN];
+            studentId((uint32_t)i, want, sizeof(want));
+            WhitelistStore::Reader reader(store);
+            if (!reader.image().userId(reader.image().find(uid, 4), id, sizeof(id)) || strcmp(id, want) != 0) correct = false;
+        }
+
+        if (e.cipher) {
+            std::string bytes;
+            FILE* f = fopen(PARTITION_FILE, "rb");
+            char buf[4096];
+            size_t got;
+            while ((got = fread(buf, 1, sizeof(buf), f)) > 0) bytes.append(buf, got);
+            fclose(f);
+            if (bytes.find("j57stud") != std::string::npos || !store.active().encryptedIds()) hidden = false;
+
+            // The same roster staged again encrypts differently (fresh nonce)
+            uint32_t first = 0;
+            memcpy(&first, bytes.data() + sizeof(WhitelistImageHeader) + N * sizeof(WhitelistRecord), 4);
+            store.stage(index, 2);
+            store.activate();
+            uint32_t second = 0;
+            part.read(store.activeSlot() * (part.size() / 2) + sizeof(WhitelistImageHeader) + N * sizeof(WhitelistRecord),
+                      &second, 4);
+            fresh = fresh && first != second;
+        } else {
+            // Image written before encryption: readable once the key is set
+            WhitelistStore upgraded(part);
+            upgraded.setCipher(engines.back().cipher);
+            upgraded.begin();
+            WhitelistStore::Reader reader(upgraded);
+            uint8_t uid[4] = {0, 0, 0, 5};
+            oldImage = !reader.image().encryptedIds() &&
+                       reader.image().userId(reader.image().find(uid, 4), id, sizeof(id)) && strcmp(id, "j57stud00000005") == 0;
+        }
+        part.end();
+    }
+    remove(PARTITION_FILE);
+    printf("\n");
+    check(correct, "Lookups return each card's user ID");
+    check(hidden, "No student ID bytes in the encrypted whitelist image");
+    check(fresh, "Restaging the same roster changes the ciphertext");
+    check(oldImage, "Plaintext image from before encryption still reads");
+}
+
+static void runAll() {
+    printf("\n=== Storage Cipher Benchmark (AES-128-CTR) ===\n\n");
+
+    CtrCipher<SoftAes128> soft(KEY);
+    CtrCipher<SoftAes128> wrong(OTHER_KEY);
+    std::vector<Engine> engines;
+    engines.push_back({"plaintext", nullptr});
+    engines.push_back({"software AES", &soft});
+
+    testVectors(&soft, "software");
+    printf("\n");
+    benchKeystream(engines);
+    benchLogs(engines);
+    testUpgradeAndWrongKey(&soft, &wrong);
+    testTornTail(&soft);
+    testTrimHead(&soft);
+    testCampusFile(&soft);
+    printf("\n");
+    benchWhitelistImage(engines);
+
+    printf("\n%s\n", failures == 0 ? "All checks passed" : "FAILED");
+}
+
+int main() {
+    runAll();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,533 @@
+/**
+ * Cloud Link Test
+ * ================
+ *
+ * PURPOSE: Verify the persistent cloud connection (CloudLink.h) that
+ *          registerDevice, syncLogs, syncWhitelist and syncSystemConfig now
+ *          share, and compare its handshakes with the previous new
+ *          WiFiClientSecure (full TLS handshake, CA re-parse) per call.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware needed - a plain TCP socket on 127.0.0.1 stands in for
+ *    the TLS transport (it models the server's session cache), and a
+ *    thread stands in for the Convex HTTP actions with keep-alive and an
+ *    idle timeout. Time is scaled: 100 ms here is LOG_SYNC_INTERVAL.
+ *
+ * WHAT IT MEASURES:
+ * - Connections, full and resumed handshakes over half an hour of syncs,
+ *   old vs new, with the server keeping idle connections longer and
+ *   shorter than the sync interval
+ * - Modelled TLS cost of those handshakes on the ESP32 (CPU, round trips,
+ *   bytes); the real figures come from STATUS on a board
+ *
+ * WHAT IT CHECKS:
+ * - Back-to-back requests share one connection; 304s and chunked bodies
+ *   are read to their end so the connection stays usable
+ * - LogUploadStream batches go through the link and keep it
+ * - Connection: close, a server idle drop and the client idle limit all
+ *   lead to a new (resumed) connection, never a failed request
+ * - A sink that stops early or a body cut short closes the connection
+ * - Stats: requests, reuse, handshakes, resumption, latency samples
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "AccessLogRecord.h"
+#include "CloudLink.h"
+#include "LogUploadStream.h"
+
+static const uint32_t TIMEOUT_MS = 2000;            // HTTP_TIMEOUT_MS, shortened
+static const int SCALE = 300;                        // Real ms per scaled ms
+static const int SYNC_TICK_MS = 30000 / SCALE;       // LOG_SYNC_INTERVAL
+static const int KEEPALIVE_MS = 45000 / SCALE;       // CLOUD_KEEPALIVE_MS
+static const int SIM_TICKS = 60;                     // Half an hour of log syncs
+
+// TLS cost model (ESP32 at 240 MHz, weak Wi-Fi as in 24_log_wire)
+static const double RTT_S = 0.25;
+static const double LINK_BYTES_PER_S = 8 * 1024;
+static const double FULL_CPU_S = 1.0;     // ECDHE + certificate chain verify (1-3 s observed)
+static const int FULL_RTTS = 2;
+static const int FULL_BYTES = 5000;       // Certificate chain + key exchange
+static const double RESUMED_CPU_S = 0.02; // Symmetric crypto only
+static const int RESUMED_RTTS = 1;
+static const int RESUMED_BYTES = 400;     // Hellos with the session ID/ticket
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("[TEST] %-58s %s\n", what, ok ? "PASS" : "FAIL");
+    if (!ok) failures++;
+}
+
+static void sleepMs(int ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// Keep-alive HTTP server: one connection at a time, requests in sequence
+struct StandIn {
+    int listenFd = -1;
+    uint16_t port = 0;
+    std::thread worker;
+    std::atomic<bool> stop{false};
+    std::atomic<int> idleDropMs{1000};        // Close a connection idle this long
+    std::atomic<bool> closeNext{false};       // Answer the next request with Connection: close
+    std::atomic<bool> hangUpMidBody{false};   // Cut the next whitelist body short
+    std::atomic<int> connections{0};
+    std::atomic<int> served{0};
+    size_t whitelistBytes = 20000;
+
+    std::mutex m;
+    std::set<int> sessions;                   // TLS session cache
+    int nextSession = 1;
+    std::vector<std::string> heads;
+    std::string lastBody;
+
+    void start() {
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(listenFd, (sockaddr*)&addr, sizeof(addr));
+        socklen_t len = sizeof(addr);
+        getsockname(listenFd, (sockaddr*)&addr, &len);
+        port = ntohs(addr.sin_port);
+        listen(listenFd, 4);
+        worker = std::thread([this] { serve(); });
+    }
+
+    void shutdown() {
+        stop = true;
+        worker.join();
+        close(listenFd);
+    }
+
+    bool resume(int session) {
+        std::lock_guard<std::mutex> lock(m);
+        return session != 0 && sessions.count(session) > 0;
+    }
+
+    int newSession() {
+        std::lock_guard<std::mutex> lock(m);
+        sessions.insert(nextSession);
+        return nextSession++;
+    }
+
+    void flushSessions() {
+        std::lock_guard<std::mutex> lock(m);
+        sessions.clear();
+    }
+
+    void serve() {
+        while (!stop) {
+            pollfd p = {listenFd, POLLIN, 0};
+            if (poll(&p, 1, 20) <= 0) continue;
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0) continue;
+            connections++;
+            handle(fd);
+            close(fd);
+        }
+    }
+
+    // Waits for more request bytes; false on idle timeout or hang-up
+    bool more(int fd, std::string& buf) {
+        pollfd p = {fd, POLLIN, 0};
+        if (poll(&p, 1, idleDropMs) <= 0 || stop) return false;
+        char tmp[4096];
+        ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+        if (n <= 0) return false;
+        buf.append(tmp, (size_t)n);
+        return true;
+    }
+
+    void handle(int fd) {
+        std::string buf;
+        for (;;) {
+            size_t end;
+            while ((end = buf.find("\r\n\r\n")) == std::string::npos) {
+                if (!more(fd, buf)) return;
+            }
+            std::string head = buf.substr(0, end + 4);
+            buf.erase(0, end + 4);
+            std::string body;
+            if (head.find("Transfer-Encoding: chunked") != std::string::npos) {
+                size_t term;
+                while ((term = buf.find("0\r\n\r\n")) == std::string::npos ||
+                       (term > 0 && buf[term - 1] != '\n')) {
+                    if (!more(fd, buf)) return;
+                }
+                body = buf.substr(0, term);
+                buf.erase(0, term + 5);
+            } else {
+                size_t cl = head.find("Content-Length: ");
+                size_t len = cl == std::string::npos ? 0 : strtoul(head.c_str() + cl + 16, nullptr, 10);
+                while (buf.size() < len) {
+                    if (!more(fd, buf)) return;
+                }
+                body = buf.substr(0, len);
+                buf.erase(0, len);
+            }
+            {
+                std::lock_guard<std::mutex> lock(m);
+                heads.push_back(head);
+                lastBody = body;
+            }
+            served++;
+            if (!respond(fd, head)) return;
+        }
+    }
+
+    static bool sendAll(int fd, const std::string& s) {
+        return send(fd, s.data(), s.size(), MSG_NOSIGNAL) == (ssize_t)s.size();
+    }
+
+    static std::string withLength(const char* status, const char* extra, const std::string& body) {
+        return std::string("HTTP/1.1 ") + status + "\r\n" + extra +
+               "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    }
+
+    // False: connection ends here
+    bool respond(int fd, const std::string& head) {
+        bool closing = closeNext.exchange(false);
+        std::string conn = closing ? "Connection: close\r\n" : "";
+        std::string path = head.substr(head.find(' ') + 1);
+        path = path.substr(0, path.find(' '));
+        std::string reply;
+        if (path.rfind("/api/config", 0) == 0) {
+            if (head.find("If-None-Match: \"c1\"") != std::string::npos) {
+                reply = "HTTP/1.1 304 Not Modified\r\nETag: \"c1\"\r\n" + conn + "\r\n";
+            } else {
+                reply = withLength("200 OK", ("Content-Type: application/json\r\nETag: \"c1\"\r\n" + conn).c_str(),
+                                   "{\"pmk\":\"0123456789abcdef\",\"secret\":\"s3cret\",\"version\":3}");
+            }
+        } else if (path.rfind("/api/whitelist", 0) == 0) {
+            reply = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nETag: \"w7\"\r\n"
+                    "Transfer-Encoding: chunked\r\n" + conn + "\r\n";
+            bool cut = hangUpMidBody.exchange(false);
+            for (size_t sent = 0; sent < whitelistBytes; sent += 1000) {
+                size_t n = whitelistBytes - sent < 1000 ? whitelistBytes - sent : 1000;
+                char size[16];
+                snprintf(size, sizeof(size), "%zx\r\n", n);
+                reply += size;
+                for (size_t i = 0; i < n; i++) reply += (char)('a' + (sent + i) % 26);
+                reply += "\r\n";
+                if (cut && sent >= whitelistBytes / 2) {
+                    sendAll(fd, reply);
+                    return false;
+                }
+            }
+            reply += "0\r\n\r\n";
+        } else if (path.rfind("/api/logs", 0) == 0) {
+            reply = withLength("200 OK", ("Content-Type: application/json\r\n" + conn).c_str(), "{\"ok\":true}");
+        } else if (path.rfind("/api/register", 0) == 0) {
+            reply = withLength("200 OK", ("Content-Type: application/json\r\n" + conn).c_str(), "{\"token\":\"tok-1\"}");
+        } else {
+            reply = withLength("404 Not Found", conn.c_str(), "no such route");
+        }
+        return sendAll(fd, reply) && !closing;
+    }
+};
+
+// TCP in place of TLS; the session cache lives in the stand-in
+struct SocketTransport {
+    StandIn* server = nullptr;
+    int fd = -1;
+    int session = 0;
+
+    bool connect(const char*, uint16_t port, uint32_t timeoutMs, bool& resumed) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        timeval tv = {(time_t)(timeoutMs / 1000), (suseconds_t)((timeoutMs % 1000) * 1000)};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        resumed = server->resume(session);
+        if (!resumed) session = server->newSession();
+        return true;
+    }
+
+    bool alive() {
+        char c;
+        ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+
+    int write(const uint8_t* data, size_t len) {
+        return (int)send(fd, data, len, MSG_NOSIGNAL);
+    }
+
+    int read(uint8_t* out, size_t len) {
+        return (int)recv(fd, out, len, 0);
+    }
+
+    void close() {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+};
+
+typedef CloudLink<SocketTransport> Link;
+typedef LogUploadStream<Link> Upload;
+
+static AccessLog makeLog(uint32_t i) {
+    AccessLog log;
+    memset(&log, 0, sizeof(log));
+    log.timestamp = 1780000000 + i * 10;
+    snprintf(log.userId, sizeof(log.userId), "j57stud%08u", (unsigned)i);
+    snprintf(log.method, sizeof(log.method), "NFC");
+    return log;
+}
+
+// What syncSystemConfig does; the status (-1: no response)
+static int getConfig(Link& link, const char* etag, std::string* body = nullptr) {
+    std::string headers = "Authorization: Bearer tok-1\r\n";
+    if (etag) headers += std::string("If-None-Match: ") + etag + "\r\n";
+    CloudResponse head;
+    int code = link.request("GET", "/api/config?chipId=AA", headers.c_str()) ? link.readHead(head) : -1;
+    if (code == 200) {
+        char reply[256];
+        if (link.readBody(reply, sizeof(reply)) < 0) code = -1;
+        else if (body) *body = reply;
+    }
+    link.endRequest();
+    return code;
+}
+
+// What syncWhitelist does with the body: streamed to a decoder
+static long getWhitelist(Link& link, size_t stopAfter = 0, std::string* etag = nullptr) {
+    CloudResponse head;
+    int code = link.request("GET", "/api/whitelist?chipId=AA", "Authorization: Bearer tok-1\r\n")
+                   ? link.readHead(head) : -1;
+    long got = -1;
+    if (code == 200) {
+        size_t seen = 0;
+        bool pattern = true;
+        got = link.readBody([&](const char* data, size_t len) {
+            for (size_t i = 0; i < len; i++) {
+                if (data[i] != (char)('a' + (seen + i) % 26)) pattern = false;
+            }
+            seen += len;
+            return stopAfter == 0 || seen < stopAfter;
+        });
+        if (!pattern) got = -2;
+        if (etag) *etag = head.etag;
+    }
+    link.endRequest();
+    return got;
+}
+
+// What syncLogs does per batch
+static bool postLogs(Link& link, uint32_t first, uint32_t count) {
+    Upload upload(link);
+    if (!link.beginRequest() || !upload.begin(link.host(), "/api/logs", "tok-1", "AA")) {
+        link.endRequest(false);
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) upload.add(makeLog(first + i), false, false, true, first + i);
+    char reply[128];
+    int code = upload.finish(true, first, first + count - 1) ? upload.readResponse(reply, sizeof(reply)) : -1;
+    if (code > 0) link.responseRead();
+    link.endRequest(upload.keepAlive());
+    return code == 200;
+}
+
+static void testKeepAlive(StandIn& server) {
+    Link link;
+    link.transport().server = &server;
+    link.begin("convex.example", server.port, TIMEOUT_MS, 60000);
+    int before = server.connections;
+
+    std::string config;
+    bool ok = getConfig(link, nullptr, &config) == 200 && config.find("\"version\":3") != std::string::npos;
+    ok = ok && getConfig(link, "\"c1\"") == 304;
+    std::string etag;
+    ok = ok && getWhitelist(link, 0, &etag) == (long)server.whitelistBytes && etag == "\"w7\"";
+    for (uint32_t b = 0; b < 3; b++) ok = ok && postLogs(link, b * 50, 50);
+    const CloudLinkStats& st = link.stats();
+    check(ok, "Config, 304, chunked whitelist and log batches all succeed");
+    check(server.connections - before == 1 && st.handshakes == 1 && st.requests == 6 && st.reused == 5,
+          "Six back-to-back requests share one connection");
+    {
+        std::lock_guard<std::mutex> lock(server.m);
+        const std::string& h = server.heads.back();
+        check(h.find("Connection: close") == std::string::npos && h.find("Host: convex.example") != std::string::npos &&
+              server.lastBody.find("j57stud00000149") != std::string::npos,
+              "Log batch request: keep-alive, Host, streamed body intact");
+    }
+    check(link.requestLatency().count() == 6 && link.handshakeLatency().count() == 1,
+          "One latency sample per request, one per handshake");
+
+    // Connection: close from the server: next request reconnects, resumed
+    server.closeNext = true;
+    ok = getConfig(link, "\"c1\"") == 304 && !link.isOpen();
+    server.idleDropMs = 50;                   // Applies from the wait after this request
+    ok = ok && getConfig(link, "\"c1\"") == 304;
+    check(ok && st.handshakes == 2 && st.resumed == 1, "Connection: close -> reconnect with a resumed session");
+
+    // Server drops the idle connection: noticed before the request is sent
+    sleepMs(120);
+    server.idleDropMs = 1000;
+    ok = getConfig(link, "\"c1\"") == 304;
+    check(ok && st.dropped == 1 && st.handshakes == 3 && st.resumed == 2,
+          "Server idle drop detected, request goes out on a new connection");
+
+    // Client idle limit: not reused even if the server would still take it
+    link.begin("convex.example", server.port, TIMEOUT_MS, 30);
+    sleepMs(60);
+    uint32_t dropped = st.dropped;
+    ok = getConfig(link, "\"c1\"") == 304;
+    check(ok && st.handshakes == 4 && st.dropped == dropped, "Connection idle past the keep-alive limit is replaced");
+    link.begin("convex.example", server.port, TIMEOUT_MS, 60000);
+
+    // A sink that stops early leaves body bytes unread: never reused
+    long got = getWhitelist(link, 3000);
+    check(got < 0 && !link.isOpen(), "Sink stopping early closes the connection");
+    ok = getWhitelist(link) == (long)server.whitelistBytes;
+    check(ok && st.handshakes == 5, "Next request gets a fresh connection and the whole body");
+
+    // Body cut short by the server: an error, promptly
+    server.hangUpMidBody = true;
+    auto t0 = std::chrono::steady_clock::now();
+    got = getWhitelist(link);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    check(got == -1 && !link.isOpen() && ms < TIMEOUT_MS, "Body cut short fails the read without waiting out the timeout");
+
+    // Session cache gone on the server: a full handshake, counted as such
+    server.flushSessions();
+    link.close();
+    uint32_t resumed = st.resumed;
+    ok = getConfig(link, "\"c1\"") == 304;
+    check(ok && st.resumed == resumed, "Server lost the session: full handshake, not counted resumed");
+
+    // Unknown route: the 404 body is read, the connection kept
+    CloudResponse head;
+    int code = link.request("GET", "/nope", nullptr) ? link.readHead(head) : -1;
+    char reply[64];
+    link.readBody(reply, sizeof(reply));
+    link.endRequest();
+    check(code == 404 && strcmp(reply, "no such route") == 0 && link.isOpen(), "Error status read to its end, connection kept");
+
+    // Nobody listening: a connect failure, not a hang
+    Link dead;
+    dead.transport().server = &server;
+    dead.begin("convex.example", 1, TIMEOUT_MS, 60000);
+    check(getConfig(dead, nullptr) == -1 && dead.stats().connectFailures == 1 && dead.stats().requests == 0,
+          "Connect failure counted, request not sent");
+}
+
+struct SimResult {
+    uint32_t requests;
+    uint32_t connections;
+    uint32_t full;
+    uint32_t resumed;
+};
+
+// Half an hour of NetworkTask syncs at 1/SCALE speed: config and whitelist
+// once, one log batch per LOG_SYNC_INTERVAL. `perCall`: a new connection
+// and a full handshake per request, as before.
+static SimResult simulate(StandIn& server, int serverIdleMs, bool perCall) {
+    server.idleDropMs = serverIdleMs;
+    server.flushSessions();
+    int connectionsBefore = server.connections;
+    Link link;
+    link.transport().server = &server;
+    link.begin("convex.example", server.port, TIMEOUT_MS, KEEPALIVE_MS);
+    auto reset = [&]() {
+        if (perCall) {
+            link.close();
+            link.transport().session = 0;
+        }
+    };
+    bool ok = true;
+    reset();
+    ok = getConfig(link, nullptr) == 200 && ok;
+    reset();
+    ok = getWhitelist(link) == (long)server.whitelistBytes && ok;
+    for (int t = 0; t < SIM_TICKS; t++) {
+        reset();
+        ok = postLogs(link, (uint32_t)t * 5, 5) && ok;
+        sleepMs(SYNC_TICK_MS);
+    }
+    link.close();
+    sleepMs(20);
+    const CloudLinkStats& st = link.stats();
+    SimResult r = {st.requests, (uint32_t)(server.connections - connectionsBefore),
+                   st.handshakes - st.resumed, st.resumed};
+    if (!ok) r.requests = 0;
+    server.idleDropMs = 1000;
+    return r;
+}
+
+static double tlsSeconds(const SimResult& r) {
+    return r.full * (FULL_CPU_S + FULL_RTTS * RTT_S + FULL_BYTES / LINK_BYTES_PER_S) +
+           r.resumed * (RESUMED_CPU_S + RESUMED_RTTS * RTT_S + RESUMED_BYTES / LINK_BYTES_PER_S);
+}
+
+static void benchSyncs(StandIn& server) {
+    printf("\n  30 min of syncs: config + whitelist once, a log batch every %d s\n", 30);
+    printf("  model: full handshake %.1f s CPU + %d RTTs + %d B, resumed %.2f s + %d RTT + %d B, RTT %.0f ms\n\n",
+           FULL_CPU_S, FULL_RTTS, FULL_BYTES, RESUMED_CPU_S, RESUMED_RTTS, RESUMED_BYTES, RTT_S * 1000);
+    printf("    %-34s %9s %12s %6s %8s %12s\n", "", "requests", "connections", "full", "resumed", "TLS time");
+
+    struct Case {
+        const char* name;
+        int serverIdleMs;
+        bool perCall;
+    } cases[] = {
+        {"new client per call (before)", 60000 / SCALE, true},
+        {"link, server keeps idle 60 s", 60000 / SCALE, false},
+        {"link, server keeps idle 20 s", 20000 / SCALE, false},
+    };
+    SimResult results[3];
+    for (int i = 0; i < 3; i++) {
+        results[i] = simulate(server, cases[i].serverIdleMs, cases[i].perCall);
+        printf("    %-34s %9u %12u %6u %8u %10.1f s\n", cases[i].name, results[i].requests,
+               results[i].connections, results[i].full, results[i].resumed, tlsSeconds(results[i]));
+    }
+    printf("\n");
+    uint32_t n = SIM_TICKS + 2;
+    check(results[0].requests == n && results[0].full == n, "Before: one full handshake per request");
+    check(results[1].requests == n && results[1].connections <= 2 && results[1].full == 1,
+          "Server keeps idle 60 s: one connection for the half hour");
+    check(results[2].requests == n && results[2].full == 1 && results[2].resumed + 1 == results[2].connections,
+          "Server keeps idle 20 s: reconnects every sync, all resumed");
+    check(tlsSeconds(results[2]) * 4 < tlsSeconds(results[0]), "Modelled TLS time at least 4x lower even without keep-alive");
+}
+
+int main() {
+    printf("\n=== Cloud Link Test ===\n\n");
+    StandIn server;
+    server.start();
+
+    testKeepAlive(server);
+    benchSyncs(server);
+
+    server.shutdown();
+    printf("\n%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,1038 @@
+/**
+ * Cloud Sync Test
+ * ================
+ *
+ * PURPOSE: Verify the single POST /api/sync exchange (CloudSync.h) that
+ *          NetworkTask now makes each cycle in place of separate /api/logs,
+ *          /api/whitelist and /api/config calls (and the /api/heartbeat the
+ *          firmware never sent), and compare round trips and server writes
+ *          with the per-endpoint calls.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware or network needed - an in-memory transport carries the
+ *    requests through CloudLink to a stand-in for the Convex HTTP actions
+ *    (hardware.ts sync / syncCheck / syncSeen, syncLogs, getWhitelist,
+ *    getSystemConfig, heartbeat), which counts requests, mutations (writes)
+ *    and queries (reads)
+ *
+ * WHAT IT MEASURES:
+ * - Requests, writes, reads, bytes and modelled time on a weak link over
+ *   two hours of 30 s cycles with taps, roster edits and config edits:
+ *   per endpoint as shipped (roster/config hourly, no heartbeat), per
+ *   endpoint checked every cycle, and /api/sync (roster/config hourly,
+ *   idle check-ins). Tap-triggered uploads (28_network_events) are not
+ *   modelled; each of those is a log write in every mode.
+ * - How long a roster or config edit takes to reach the device, and the
+ *   longest time the server goes without recording the device as seen
+ *
+ * WHAT IT CHECKS:
+ * - Reply envelope decoded identically at every split; unknown sections
+ *   skipped; bad magic, missing END, trailing bytes and oversized
+ *   sections rejected
+ * - Request headers: validators, wanted sections, firmware, one health
+ *   line; a field that does not fit is dropped whole
+ * - One exchange: log batch acknowledged, roster and config only when due
+ *   and newer, health and firmware recorded, binary and JSON rosters
+ * - Without logs an exchange is a read; the device is recorded as seen
+ *   only when the SEEN interval is up; idle cycles only check in every
+ *   CLOUD_SYNC_IDLE_MS
+ * - A backlog over one batch: later exchanges carry only the acknowledgement
+ * - Roster cut short: the acknowledgement before it still counts, the
+ *   roster is rejected
+ * - Roster change in a reply (settleSyncReply): the stored batch is
+ *   trimmed before the swap moves the taps into the expanded log, so no
+ *   tap is uploaded twice or trimmed unsent
+ * - Server without /api/sync: 404 read to its end, connection kept
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "AccessLogRecord.h"
+#include "CloudLink.h"
+#include "CloudSync.h"
+#include "LogUploadStream.h"
+#include "WhitelistBinary.h"
+#include "WhitelistStream.h"
+
+static const int BATCH = 50;                 // LOG_UPLOAD_BATCH
+static const int CYCLE_S = 30;               // LOG_SYNC_INTERVAL
+static const int HOURLY = 3600 / CYCLE_S;    // WHITELIST_SYNC_INTERVAL / CONFIG_SYNC_INTERVAL in cycles
+static const int SIM_CYCLES = 2 * HOURLY;
+static const uint32_t SEEN_S = 300;          // hardware.ts SEEN_INTERVAL_MS
+static const uint32_t IDLE_S = 240;          // CLOUD_SYNC_IDLE_MS
+static const uint32_t OFFLINE_S = 900;       // monitorDeviceHealth offline threshold
+
+// Weak Wi-Fi as in 24_log_wire; the connection is kept alive (26_cloud_link)
+static const double RTT_S = 0.25;
+static const double LINK_BYTES_PER_S = 8 * 1024;
+static const double SERVER_S = 0.03;         // HTTP action + device lookup per request
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("[TEST] %-58s %s\n", what, ok ? "PASS" : "FAIL");
+    if (!ok) failures++;
+}
+
+static void put32(std::string& s, uint32_t v) {
+    for (int i = 0; i < 4; i++) s += (char)((v >> (8 * i)) & 0xFF);
+}
+
+// Mirror of lib/sync.ts encodeSyncResponse, one section at a time
+static std::string section(uint8_t kind, const std::string& payload) {
+    std::string s(1, (char)kind);
+    put32(s, (uint32_t)payload.size());
+    return s + payload;
+}
+
+static std::string withEtag(const std::string& etag, const std::string& rest) {
+    return std::string(1, (char)etag.size()) + etag + rest;
+}
+
+static std::string envelope(const std::string& sections) {
+    std::string s;
+    put32(s, SYNC_MAGIC);
+    return s + sections + section(SYNC_SECTION_END, "");
+}
+
+struct Card {
+    uint8_t uid[7];
+    uint8_t len;
+    char sid[32];
+    uint32_t version;     // Roster version that added it
+};
+
+// Stand-in for the Convex HTTP actions
+struct StandIn {
+    bool hasSync = true;
+    size_t cutAfter = 0;           // Hang up after this many body bytes of the next reply (0 = whole)
+    std::vector<Card> cards;       // Roster; sorted by UID
+    uint32_t rosterVersion = 0;
+    uint32_t configVersion = 1;
+    std::set<uint32_t> stored;     // Log seqs stored
+    uint32_t nowS = 0;
+    bool seen = false;             // lastSeen set
+    uint32_t seenAt = 0;
+    uint32_t maxSeenGapS = 0;
+
+    uint32_t requests = 0;
+    uint32_t writes = 0;           // Mutations
+    uint32_t reads = 0;            // Queries
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    uint32_t logs = 0;
+    uint32_t heartbeats = 0;       // markSeen calls
+    std::string health;
+    std::string firmware;
+    std::string lastHead;
+
+    void addCard(uint32_t n) {
+        Card c;
+        memset(&c, 0, sizeof(c));
+        c.len = 4;
+        c.uid[0] = 0x04;
+        c.uid[1] = (uint8_t)(n >> 8);
+        c.uid[2] = (uint8_t)n;
+        c.uid[3] = 0xA5;
+        snprintf(c.sid, sizeof(c.sid), "j57stud%08u", n);
+        c.version = rosterVersion;
+        cards.push_back(c);
+    }
+
+    void editRoster() {
+        rosterVersion++;
+        addCard((uint32_t)cards.size());
+    }
+
+    std::string rosterEtag() const { return "\"wl-" + std::to_string(rosterVersion) + "\""; }
+    std::string configEtag() const { return "\"cfg-" + std::to_string(configVersion) + "\""; }
+
+    std::string configJson() const {
+        return "{\"pmk\":\"0123456789abcdef\",\"secret\":\"s3cret\",\"debug\":true,\"version\":" +
+               std::to_string(configVersion) + "}";
+    }
+
+    // Full roster, or a delta of the cards after `since` (WLB1 or JSON)
+    std::string rosterBody(uint32_t since, bool binary) const {
+        bool full = since == 0;
+        std::vector<const Card*> rows;
+        for (const Card& c : cards) {
+            if (full || c.version > since) rows.push_back(&c);
+        }
+        if (!binary) {
+            std::string out = "{\"version\":" + std::to_string(rosterVersion) + ",\"full\":" +
+                              (full ? "true" : "false") + (full ? ",\"entries\":[" : ",\"since\":" + std::to_string(since) + ",\"adds\":[");
+            char buf[128];
+            for (size_t i = 0; i < rows.size(); i++) {
+                snprintf(buf, sizeof(buf), "%s{\"uid\":\"%02X%02X%02X%02X\",\"sid\":\"%s\",\"role\":\"student\",\"bioId\":0}",
+                    i ? "," : "", rows[i]->uid[0], rows[i]->uid[1], rows[i]->uid[2], rows[i]->uid[3], rows[i]->sid);
+                out += buf;
+            }
+            return out + (full ? "]}" : "],\"removes\":[]}");
+        }
+        std::string out;
+        put32(out, WL_WIRE_MAGIC);
+        out += (char)(WL_WIRE_HEADER_LEN & 0xFF);
+        out += (char)(WL_WIRE_HEADER_LEN >> 8);
+        out += (char)WL_WIRE_FORMAT;
+        out += (char)(full ? WL_WIRE_FLAG_FULL : 0);
+        put32(out, rosterVersion);
+        put32(out, (uint32_t)rows.size());
+        put32(out, (uint32_t)rows.size());
+        put32(out, 0);
+        for (const Card* c : rows) {
+            out += (char)strlen(c->sid);
+            out += c->sid;
+        }
+        for (size_t i = 0; i < rows.size(); i++) {
+            out += (char)rows[i]->len;
+            out.append((const char*)rows[i]->uid, rows[i]->len);
+            out += (char)WL_ROLE_STUDENT;
+            out += '\0';
+            out += '\0';
+            out += (char)(i & 0xFF);
+            out += (char)(i >> 8);
+        }
+        return out;
+    }
+
+    static std::string header(const std::string& head, const char* name) {
+        std::string key = std::string("\r\n") + name + ": ";
+        size_t at = head.find(key);
+        if (at == std::string::npos) return "";
+        at += key.size();
+        return head.substr(at, head.find("\r\n", at) - at);
+    }
+
+    // Stores the JSON log batch; the /api/logs reply
+    std::string storeLogs(const std::string& body) {
+        uint32_t count = 0, duplicates = 0;
+        for (size_t at = 0; (at = body.find("\"seq\":", at)) != std::string::npos; at += 6) {
+            count++;
+            if (!stored.insert((uint32_t)strtoul(body.c_str() + at + 6, nullptr, 10)).second) duplicates++;
+        }
+        logs += count - duplicates;
+        std::string reply = "{\"success\":true,\"count\":" + std::to_string(count) +
+                            ",\"duplicates\":" + std::to_string(duplicates);
+        unsigned first, last;
+        size_t batch = body.find("\"batch\":");
+        if (batch != std::string::npos && sscanf(body.c_str() + batch, "\"batch\":{\"first\":%u,\"last\":%u", &first, &last) == 2) {
+            reply += ",\"acked\":" + std::to_string(last);
+        }
+        return reply + "}";
+    }
+
+    // hardware.ts seenDue
+    bool seenDue(const std::string& fw) const {
+        return !seen || (!fw.empty() && fw != firmware) || nowS - seenAt >= SEEN_S;
+    }
+
+    void markSeen(const std::string& head) {
+        if (seen && nowS - seenAt > maxSeenGapS) maxSeenGapS = nowS - seenAt;
+        seen = true;
+        seenAt = nowS;
+        heartbeats++;
+        health = header(head, "X-Device-Health");
+        firmware = header(head, "X-Firmware");
+    }
+
+    static std::string reply(const char* status, const std::string& headers, const std::string& body) {
+        return std::string("HTTP/1.1 ") + status + "\r\n" + headers +
+               "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    }
+
+    std::string handle(const std::string& head, const std::string& body) {
+        requests++;
+        lastHead = head;
+        std::string path = head.substr(head.find(' ') + 1);
+        path = path.substr(0, path.find(' '));
+        bool binary = header(head, "Accept") == "application/octet-stream";
+
+        if (path == "/api/sync" && hasSync) {
+            // Logs: the sync mutation (seen when due). Otherwise syncCheck,
+            // a query, and syncSeen only when the device is due to be seen.
+            std::string want = header(head, "X-Sync-Want");
+            bool due = seenDue(header(head, "X-Firmware"));
+            std::string sections;
+            if (body.find("\"seq\":") != std::string::npos || body.find("\"batch\":") != std::string::npos) {
+                writes++;
+                sections += section(SYNC_SECTION_LOGS, storeLogs(body));
+            } else {
+                reads++;
+                if (due) writes++;
+            }
+            if (due) markSeen(head);
+            if (want.find("config") != std::string::npos && header(head, "X-Config-Match") != configEtag()) {
+                sections += section(SYNC_SECTION_CONFIG, withEtag(configEtag(), configJson()));
+            }
+            if (want.find("whitelist") != std::string::npos && header(head, "X-Whitelist-Match") != rosterEtag()) {
+                std::string since = header(head, "X-Whitelist-Since");
+                std::string wire(1, binary ? 1 : 0);
+                sections += section(SYNC_SECTION_WHITELIST,
+                    withEtag(rosterEtag(), wire + rosterBody((uint32_t)strtoul(since.c_str(), nullptr, 10), binary)));
+            }
+            return reply("200 OK", "Content-Type: application/octet-stream\r\n", envelope(sections));
+        }
+        if (path.rfind("/api/logs", 0) == 0) {
+            writes++;
+            return reply("200 OK", "Content-Type: application/json\r\n", storeLogs(body));
+        }
+        if (path.rfind("/api/whitelist", 0) == 0) {
+            reads++;
+            std::string etag = "ETag: " + rosterEtag() + "\r\n";
+            if (header(head, "If-None-Match") == rosterEtag()) return "HTTP/1.1 304 Not Modified\r\n" + etag + "\r\n";
+            size_t at = path.find("since=");
+            uint32_t since = at == std::string::npos ? 0 : (uint32_t)strtoul(path.c_str() + at + 6, nullptr, 10);
+            return reply("200 OK", std::string("Content-Type: ") + (binary ? "application/octet-stream" : "application/json") +
+                         "\r\n" + etag, rosterBody(since, binary));
+        }
+        if (path.rfind("/api/config", 0) == 0) {
+            reads++;
+            std::string etag = "ETag: " + configEtag() + "\r\n";
+            if (header(head, "If-None-Match") == configEtag()) return "HTTP/1.1 304 Not Modified\r\n" + etag + "\r\n";
+            return reply("200 OK", "Content-Type: application/json\r\n" + etag, configJson());
+        }
+        if (path == "/api/heartbeat") {
+            writes++;
+            markSeen(head);
+            return reply("200 OK", "Content-Type: application/json\r\n", "{\"success\":true}");
+        }
+        return reply("404 Not Found", "", "no such route");
+    }
+};
+
+// In memory in place of TLS: each complete request is answered at once
+struct LoopTransport {
+    StandIn* server = nullptr;
+    std::string in;
+    std::string out;
+    bool open = false;
+    bool hungUp = false;
+    bool session = false;
+
+    bool connect(const char*, uint16_t, uint32_t, bool& resumed) {
+        in.clear();
+        out.clear();
+        open = true;
+        hungUp = false;
+        resumed = session;
+        session = true;
+        return true;
+    }
+
+    bool alive() { return open && !hungUp; }
+
+    // Parses whole requests (Content-Length or chunked) off `in`
+    void pump() {
+        for (;;) {
+            size_t end = in.find("\r\n\r\n");
+            if (end == std::string::npos) return;
+            std::string head = in.substr(0, end + 2);
+            std::string rest = in.substr(end + 4);
+            std::string body;
+            size_t used = 0;
+            if (head.find("Transfer-Encoding: chunked") != std::string::npos) {
+                for (;;) {
+                    size_t eol = rest.find("\r\n", used);
+                    if (eol == std::string::npos) return;
+                    size_t n = strtoul(rest.c_str() + used, nullptr, 16);
+                    if (n == 0) {
+                        if (rest.size() < eol + 4) return;
+                        used = eol + 4;
+                        break;
+                    }
+                    if (rest.size() < eol + 2 + n + 2) return;
+                    body.append(rest, eol + 2, n);
+                    used = eol + 2 + n + 2;
+                }
+            } else {
+                std::string cl = StandIn::header(head, "Content-Length");
+                used = cl.empty() ? 0 : strtoul(cl.c_str(), nullptr, 10);
+                if (rest.size() < used) return;
+                body = rest.substr(0, used);
+            }
+            in = rest.substr(used);
+            std::string reply = server->handle(head, body);
+            if (server->cutAfter > 0) {
+                size_t bodyAt = reply.find("\r\n\r\n") + 4;
+                reply.resize(bodyAt + server->cutAfter);
+                server->cutAfter = 0;
+                hungUp = true;
+            }
+            out += reply;
+        }
+    }
+
+    int write(const uint8_t* data, size_t len) {
+        if (!open || hungUp) return -1;
+        server->bytesIn += len;
+        in.append((const char*)data, len);
+        pump();
+        return (int)len;
+    }
+
+    int read(uint8_t* buf, size_t len) {
+        if (out.empty()) return hungUp ? 0 : -1;
+        size_t n = std::min(len, out.size());
+        memcpy(buf, out.data(), n);
+        out.erase(0, n);
+        server->bytesOut += n;
+        return (int)n;
+    }
+
+    void close() { open = false; }
+};
+
+typedef CloudLink<LoopTransport> Link;
+typedef LogUploadStream<Link> Upload;
+
+static AccessLog makeLog(uint32_t seq) {
+    AccessLog log;
+    memset(&log, 0, sizeof(log));
+    log.timestamp = 1780000000 + seq * 7;
+    snprintf(log.userId, sizeof(log.userId), "j57stud%08u", (unsigned)(seq % 40));
+    snprintf(log.method, sizeof(log.method), "NFC");
+    return log;
+}
+
+// The gatekeeper's side: what it holds and what it has queued
+struct Device {
+    Link link;
+    bool binary = true;                // WHITELIST_BINARY_WIRE
+    uint32_t since = 0;                // Roster version held
+    std::string rosterEtag;
+    size_t rosterCards = 0;
+    uint32_t configVersion = 0;
+    std::string configEtag;
+    std::vector<uint32_t> pending;     // Log seqs not yet acknowledged
+    uint32_t nextSeq = 1;
+    bool syncMissing = false;          // cloudSyncMissing
+    bool whitelistDue = true;          // Both due at connect (no roster image yet)
+    bool configDue = true;
+    uint32_t nowS = 0;
+    bool synced = false;               // cloudSyncedAt set
+    uint32_t syncedAt = 0;
+
+    explicit Device(StandIn& server) {
+        link.transport().server = &server;
+        link.begin("convex.example", 443, 2000, 45000);
+    }
+
+    void tap(int n) {
+        for (int i = 0; i < n; i++) pending.push_back(nextSeq++);
+    }
+};
+
+// Collects a roster reply through either decoder
+struct RosterCollector : public WhitelistStreamSink {
+    size_t entries = 0;
+    bool onEntry(WhitelistSection, const WhitelistStreamEntry&) override {
+        entries++;
+        return true;
+    }
+    bool onRemove(const uint8_t*, uint8_t) override { return true; }
+};
+
+// What main.cpp CloudSyncSink does, into Device
+struct TestSyncSink : public SyncSink {
+    bool hasRange;
+    uint32_t last;
+    bool logsStored = false;
+    bool configSent = false;
+    bool rosterSent = false;
+    bool rosterDone = false;
+    bool binary = false;
+    std::string rosterEtag;
+    std::string configEtag;
+    uint32_t configVersion = 0;
+    RosterCollector roster;
+    WhitelistBinaryDecoder binaryDecoder;
+    WhitelistStreamParser jsonParser;
+
+    TestSyncSink(bool hasRange, uint32_t last)
+        : hasRange(hasRange), last(last), binaryDecoder(roster), jsonParser(roster) {}
+
+    bool onLogReply(const char* json, size_t) override {
+        const char* acked = strstr(json, "\"acked\":");
+        logsStored = strstr(json, "\"success\":true") != nullptr &&
+                     (!hasRange || (acked && strtoul(acked + 8, nullptr, 10) == last));
+        return true;
+    }
+    bool onConfig(const char* etag, const char* json, size_t) override {
+        configSent = true;
+        configEtag = etag;
+        const char* v = strstr(json, "\"version\":");
+        configVersion = v ? (uint32_t)strtoul(v + 10, nullptr, 10) : 0;
+        return true;
+    }
+    bool onWhitelistBegin(const char* etag, bool bin) override {
+        rosterSent = true;
+        rosterEtag = etag;
+        binary = bin;
+        return true;
+    }
+    bool onWhitelistData(const char* data, size_t len) override {
+        return binary ? binaryDecoder.feed(data, len) : jsonParser.feed(data, len);
+    }
+    bool onWhitelistEnd() override {
+        rosterDone = true;
+        return true;
+    }
+    bool rosterComplete() const {
+        return rosterDone && (binary ? binaryDecoder.complete() : jsonParser.complete());
+    }
+    bool rosterFull() const { return binary ? binaryDecoder.full() : jsonParser.full(); }
+    uint32_t rosterVersion() const { return binary ? binaryDecoder.version() : jsonParser.version(); }
+};
+
+static void applyRoster(Device& d, const std::string& etag, bool full, uint32_t version, size_t entries) {
+    d.rosterCards = full ? entries : d.rosterCards + entries;
+    d.since = version;
+    d.rosterEtag = etag;
+}
+
+// What main.cpp syncExchange does; true if the log batch was stored
+static bool syncExchange(Device& d, bool* complete = nullptr) {
+    SyncHeaders headers;
+    headers.whitelist(d.since, d.rosterEtag.c_str(), d.binary);
+    headers.config(d.configEtag.c_str());
+    bool wantWhitelist = d.whitelistDue, wantConfig = d.configDue;
+    headers.want(wantWhitelist, wantConfig);
+    headers.firmware("1.4.0");
+    headers.health("uptime", 3600);
+    headers.health("heap", 81234);
+    headers.health("backlog", (long)d.pending.size());
+    headers.health("rssi", -71);
+
+    Upload upload(d.link);
+    if (!d.link.beginRequest() || !upload.begin(d.link.host(), "/api/sync", "tok-1", "AA:BB", headers.str())) {
+        d.link.endRequest(false);
+        return false;
+    }
+    size_t n = std::min(d.pending.size(), (size_t)BATCH);
+    for (size_t i = 0; i < n; i++) upload.add(makeLog(d.pending[i]), false, false, true, d.pending[i]);
+    bool hasRange = n > 0;
+    uint32_t first = hasRange ? d.pending[0] : 0, last = hasRange ? d.pending[n - 1] : 0;
+    CloudResponse head;
+    int code = upload.finish(hasRange, first, last) ? d.link.readHead(head) : -1;
+    if (code != 200) {
+        char reply[64];
+        if (code > 0) d.link.readBody(reply, sizeof(reply));
+        d.link.endRequest();
+        if (code == 404) d.syncMissing = true;
+        return false;
+    }
+
+    TestSyncSink sink(hasRange, last);
+    SyncResponseReader reader(sink);
+    long received = d.link.readBody([&reader](const char* data, size_t len) { return reader.feed(data, len); });
+    d.link.endRequest();
+    bool answered = received >= 0 && reader.complete();
+    if (complete) *complete = answered;
+    if (answered) {
+        if (wantWhitelist) d.whitelistDue = false;
+        if (wantConfig) d.configDue = false;
+        d.synced = true;
+        d.syncedAt = d.nowS;
+    }
+    if (sink.configSent) {
+        d.configEtag = sink.configEtag;
+        d.configVersion = sink.configVersion;
+    }
+    if (sink.rosterSent && sink.rosterComplete()) {
+        applyRoster(d, sink.rosterEtag, sink.rosterFull(), sink.rosterVersion(), sink.roster.entries);
+    }
+    if (sink.logsStored) d.pending.erase(d.pending.begin(), d.pending.begin() + (long)n);
+    return sink.logsStored;
+}
+
+// What main.cpp syncCloud does; the number of exchanges
+static int syncCloud(Device& d) {
+    if (d.pending.empty() && !d.whitelistDue && !d.configDue && d.synced && d.nowS - d.syncedAt < IDLE_S) return 0;
+    int exchanges = 0;
+    bool stored;
+    do {
+        stored = syncExchange(d);
+        exchanges++;
+    } while (stored && !d.pending.empty());
+    return exchanges;
+}
+
+// The per-endpoint calls (syncLogs, syncWhitelist, syncSystemConfig, heartbeat)
+static void postLogs(Device& d) {
+    while (!d.pending.empty()) {
+        Upload upload(d.link);
+        if (!d.link.beginRequest() || !upload.begin(d.link.host(), "/api/logs", "tok-1", "AA:BB")) {
+            d.link.endRequest(false);
+            return;
+        }
+        size_t n = std::min(d.pending.size(), (size_t)BATCH);
+        for (size_t i = 0; i < n; i++) upload.add(makeLog(d.pending[i]), false, false, true, d.pending[i]);
+        char reply[128];
+        int code = upload.finish(true, d.pending[0], d.pending[n - 1]) ? upload.readResponse(reply, sizeof(reply)) : -1;
+        if (code > 0) d.link.responseRead();
+        d.link.endRequest(upload.keepAlive());
+        if (code != 200) return;
+        d.pending.erase(d.pending.begin(), d.pending.begin() + (long)n);
+    }
+}
+
+static void getWhitelist(Device& d) {
+    std::string path = "/api/whitelist?chipId=AA:BB";
+    if (d.since > 0) path += "&since=" + std::to_string(d.since);
+    std::string headers = "Authorization: Bearer tok-1\r\n";
+    if (d.binary) headers += "Accept: application/octet-stream\r\n";
+    if (!d.rosterEtag.empty()) headers += "If-None-Match: " + d.rosterEtag + "\r\n";
+    CloudResponse head;
+    int code = d.link.request("GET", path.c_str(), headers.c_str()) ? d.link.readHead(head) : -1;
+    if (code == 200) {
+        RosterCollector roster;
+        WhitelistBinaryDecoder decoder(roster);
+        if (d.link.readBody([&decoder](const char* data, size_t len) { return decoder.feed(data, len); }) >= 0 &&
+            decoder.complete()) {
+            applyRoster(d, head.etag, decoder.full(), decoder.version(), roster.entries);
+        }
+    }
+    d.link.endRequest();
+}
+
+static void getConfig(Device& d) {
+    std::string headers = "Authorization: Bearer tok-1\r\n";
+    if (!d.configEtag.empty()) headers += "If-None-Match: " + d.configEtag + "\r\n";
+    CloudResponse head;
+    int code = d.link.request("GET", "/api/config?chipId=AA:BB", headers.c_str()) ? d.link.readHead(head) : -1;
+    if (code == 200) {
+        char reply[256];
+        d.link.readBody(reply, sizeof(reply));
+        const char* v = strstr(reply, "\"version\":");
+        d.configVersion = v ? (uint32_t)strtoul(v + 10, nullptr, 10) : 0;
+        d.configEtag = head.etag;
+    }
+    d.link.endRequest();
+}
+
+static void heartbeat(Device& d) {
+    const char body[] = "{\"chipId\":\"AA:BB\",\"firmware\":\"1.4.0\"}";
+    CloudResponse head;
+    int code = d.link.request("POST", "/api/heartbeat", "Content-Type: application/json\r\n", body, sizeof(body) - 1)
+                   ? d.link.readHead(head) : -1;
+    char reply[64];
+    if (code > 0) d.link.readBody(reply, sizeof(reply));
+    d.link.endRequest();
+}
+
+// -----------------------------------------------------------------------------
+
+// Records what the reader hands over, for comparing splits
+struct RecordingSink : public SyncSink {
+    std::string trace;
+    bool onLogReply(const char* json, size_t len) override {
+        trace += "L[" + std::string(json, len) + "]";
+        return true;
+    }
+    bool onConfig(const char* etag, const char* json, size_t len) override {
+        trace += "C" + std::string(etag) + "[" + std::string(json, len) + "]";
+        return true;
+    }
+    bool onWhitelistBegin(const char* etag, bool binary) override {
+        trace += "W" + std::string(etag) + (binary ? "b[" : "j[");
+        return true;
+    }
+    bool onWhitelistData(const char* data, size_t len) override {
+        trace.append(data, len);
+        return true;
+    }
+    bool onWhitelistEnd() override {
+        trace += "]";
+        return true;
+    }
+};
+
+static bool decodes(const std::string& body, size_t split, std::string* trace = nullptr) {
+    RecordingSink sink;
+    SyncResponseReader reader(sink);
+    for (size_t at = 0; at < body.size(); at += split) {
+        reader.feed(body.data() + at, std::min(split, body.size() - at));
+    }
+    if (trace) *trace = sink.trace;
+    return reader.complete();
+}
+
+static void testEnvelope() {
+    std::string body = envelope(
+        section(SYNC_SECTION_LOGS, "{\"success\":true,\"acked\":9}") +
+        section(9, "from a newer server") +
+        section(SYNC_SECTION_CONFIG, withEtag("\"cfg-2\"", "{\"version\":2}")) +
+        section(SYNC_SECTION_WHITELIST, withEtag("\"wl-5\"", std::string(1, 1) + std::string(3000, 'r'))));
+    std::string whole;
+    bool ok = decodes(body, body.size(), &whole);
+    check(ok && whole == "L[{\"success\":true,\"acked\":9}]C\"cfg-2\"[{\"version\":2}]W\"wl-5\"b[" +
+                         std::string(3000, 'r') + "]", "Envelope decoded: logs, config, roster; unknown section skipped");
+    bool same = true;
+    for (size_t split = 1; split <= 64; split++) {
+        std::string trace;
+        same = same && decodes(body, split, &trace) && trace == whole;
+    }
+    check(same, "Same sections at every split from 1 to 64 bytes");
+
+    std::string only = envelope("");
+    check(decodes(only, 1), "Nothing newer: magic and END only (9 bytes)");
+    check(!decodes(body.substr(0, body.size() - 5), 7), "Missing END section: incomplete");
+    check(!decodes(body + "x", 7), "Bytes after END: rejected");
+    std::string bad = body;
+    bad[0] = 'X';
+    check(!decodes(bad, 7), "Bad magic: rejected");
+    check(!decodes(envelope(section(SYNC_SECTION_LOGS, std::string(SYNC_JSON_MAX, ' '))), 64),
+          "Log reply larger than SYNC_JSON_MAX: rejected");
+    check(!decodes(envelope(section(SYNC_SECTION_CONFIG, withEtag(std::string(SYNC_ETAG_LEN, 'e'), "{}"))), 64),
+          "ETag longer than SYNC_ETAG_LEN: rejected");
+    check(!decodes(envelope(section(SYNC_SECTION_WHITELIST, withEtag("\"w\"", ""))), 64),
+          "Roster section without its wire byte: rejected");
+
+    SyncHeaders h;
+    h.whitelist(42, "\"wl-42\"", true);
+    h.config("");
+    h.want(true, true);
+    h.firmware("1.4.0");
+    h.health("uptime", 3600);
+    h.health("rssi", -70);
+    std::string s = h.str();
+    check(h.ok() && s == "X-Whitelist-Since: 42\r\nX-Whitelist-Match: \"wl-42\"\r\nAccept: application/octet-stream\r\n"
+                         "X-Sync-Want: whitelist,config\r\nX-Firmware: 1.4.0\r\nX-Device-Health: uptime=3600;rssi=-70\r\n",
+          "Headers: validators, wanted sections, firmware, one health line");
+    SyncHeaders one, none;
+    one.want(false, true);
+    none.want(false, false);
+    check(strcmp(one.str(), "X-Sync-Want: config\r\n") == 0 && strcmp(none.str(), "") == 0,
+          "X-Sync-Want lists only due sections, none if nothing is due");
+    SyncHeaders full;
+    full.firmware(std::string(SYNC_HEADERS_LEN, 'v').c_str());
+    full.config("\"cfg-1\"");
+    check(!full.ok() && strcmp(full.str(), "X-Config-Match: \"cfg-1\"\r\n") == 0, "Field that does not fit is dropped whole");
+}
+
+static void testExchange() {
+    StandIn server;
+    for (int i = 0; i < 20; i++) server.editRoster();
+    Device d(server);
+    d.tap(7);
+
+    // First contact: everything is due and comes back
+    bool complete = false;
+    check(syncExchange(d, &complete) && complete && d.pending.empty() && server.logs == 7,
+          "Log batch stored and acknowledged in the same exchange");
+    check(d.rosterCards == 20 && d.since == 20 && d.rosterEtag == server.rosterEtag() &&
+          d.configVersion == 1 && d.configEtag == server.configEtag() && !d.whitelistDue && !d.configDue,
+          "First exchange: full roster and config, neither due after");
+    check(server.requests == 1 && server.writes == 1 && server.reads == 0 && server.heartbeats == 1,
+          "One request, one write: logs stored and device seen");
+    check(server.firmware == "1.4.0" && server.health == "uptime=3600;heap=81234;backlog=7;rssi=-71",
+          "Firmware and health counters reach the server");
+
+    // Nothing new, nothing due: a read, no logs section
+    uint64_t out = server.bytesOut;
+    check(!syncExchange(d, &complete) && complete && d.rosterCards == 20 && server.writes == 1 && server.reads == 1,
+          "Quiet cycle: answered by a query, no write");
+    size_t quiet = (size_t)(server.bytesOut - out);
+    check(server.lastHead.find("X-Whitelist-Match: \"wl-20\"") != std::string::npos &&
+          server.lastHead.find("X-Sync-Want") == std::string::npos && quiet < 200,
+          "Validators sent, nothing wanted; reply without any section");
+
+    // Edits wait for their interval; the logs go up meanwhile
+    server.editRoster();
+    server.configVersion = 2;
+    d.tap(3);
+    check(syncExchange(d) && d.since == 20 && d.configVersion == 1 && server.writes == 2,
+          "Edits before the refresh is due: ack only");
+    d.whitelistDue = d.configDue = true;
+    check(!syncExchange(d, &complete) && complete && d.rosterCards == 21 && d.since == 21 && d.configVersion == 2 &&
+          !d.whitelistDue && !d.configDue && server.writes == 2,
+          "Refresh due: roster delta and config in a read-only exchange");
+
+    // The device is recorded as seen again once the interval is up
+    d.nowS = server.nowS = SEEN_S;
+    uint32_t writes = server.writes, reads = server.reads;
+    syncExchange(d);
+    check(server.writes == writes + 1 && server.reads == reads + 1 && server.heartbeats == 2,
+          "Quiet cycle past SEEN_INTERVAL: query plus one small write");
+
+    // Idle: nothing to send or fetch, check in every CLOUD_SYNC_IDLE_MS only
+    uint32_t before = server.requests;
+    d.nowS = server.nowS = SEEN_S + IDLE_S - 1;
+    int idle = syncCloud(d);
+    d.nowS = server.nowS = SEEN_S + IDLE_S;
+    int checkIn = syncCloud(d);
+    check(idle == 0 && checkIn == 1 && server.requests == before + 1, "Idle cycles skipped until the check-in is due");
+
+    // Backlog over one batch: 3 exchanges, the roster only in the first
+    server.editRoster();
+    d.tap(120);
+    d.whitelistDue = true;
+    before = server.requests;
+    int exchanges = syncCloud(d);
+    check(exchanges == 3 && server.requests - before == 3 && d.pending.empty() && d.rosterCards == 22 &&
+          server.logs == 130, "120 taps: 3 exchanges of <= 50, roster once");
+
+    // JSON roster when the device doesn't ask for WLB1
+    Device j(server);
+    j.binary = false;
+    check(!syncExchange(j) && j.rosterCards == 22 && j.since == server.rosterVersion, "JSON roster section decoded");
+
+    // Cut inside the roster: the ack before it counts, the roster does not
+    server.editRoster();
+    d.tap(5);
+    d.whitelistDue = true;
+    server.cutAfter = 120;
+    complete = true;
+    bool stored = syncExchange(d, &complete);
+    check(stored && !complete && d.pending.empty() && d.since == 22 && d.whitelistDue && !d.link.isOpen(),
+          "Reply cut in the roster: logs acked, roster rejected and still due");
+    syncExchange(d);
+    check(d.since == 23 && d.rosterCards == 23 && !d.whitelistDue, "Next exchange fetches the roster again");
+
+    // Backend without /api/sync
+    server.hasSync = false;
+    d.tap(2);
+    check(!syncExchange(d) && d.syncMissing && d.link.isOpen() && d.pending.size() == 2,
+          "No /api/sync: 404 read, link kept, logs kept for /api/logs");
+    postLogs(d);
+    check(d.pending.empty(), "Per-endpoint upload takes over");
+}
+
+// Storage's two logs as main.cpp's LogBatchCursor sees them. A roster swap
+// (activateWhitelist -> Storage::expandLogs) moves every compact tap into the
+// expanded log, where it loses its sequence number, and empties the compact log.
+struct TwoLogs {
+    std::vector<uint32_t> compact;     // Tap seqs
+    std::vector<uint32_t> expanded;    // Same taps, uploaded without seq
+    uint32_t nextSeq = 1;
+
+    void tap(int n) {
+        for (int i = 0; i < n; i++) compact.push_back(nextSeq++);
+    }
+    void swapRoster() {
+        expanded.insert(expanded.end(), compact.begin(), compact.end());
+        compact.clear();
+    }
+};
+
+// main.cpp LogBatchCursor over TwoLogs: indexes, ack, trim, reload
+struct SwapCursor {
+    TwoLogs& logs;
+    size_t expandedCount = 0, expandedDone = 0, compactCount = 0, acked = 0, next = 0;
+    bool batchExpanded = false;
+
+    explicit SwapCursor(TwoLogs& l) : logs(l) { reload(); }
+
+    bool pending() const { return expandedDone < expandedCount || acked < compactCount; }
+    // Next batch: seqs, 0 for expanded logs
+    std::vector<uint32_t> fill() {
+        std::vector<uint32_t> batch;
+        batchExpanded = expandedDone < expandedCount;
+        size_t from = batchExpanded ? expandedDone : acked, to = batchExpanded ? expandedCount : compactCount;
+        for (next = from; next < to && batch.size() < (size_t)BATCH; next++) {
+            batch.push_back(batchExpanded ? 0 : logs.compact[next]);
+        }
+        return batch;
+    }
+    void ack() {
+        if (batchExpanded) expandedDone = next;
+        else acked = next;
+    }
+    void trim() {   // Storage::trimExpandedLogs / trimLogs: by index
+        logs.expanded.erase(logs.expanded.begin(), logs.expanded.begin() + (long)std::min(expandedDone, logs.expanded.size()));
+        logs.compact.erase(logs.compact.begin(), logs.compact.begin() + (long)std::min(acked, logs.compact.size()));
+    }
+    void reload() {
+        expandedCount = logs.expanded.size();
+        compactCount = logs.compact.size();
+        expandedDone = acked = 0;
+    }
+};
+
+// The parts of main.cpp CloudSyncSink that settleSyncReply uses
+struct SwapSink {
+    TwoLogs& logs;
+    bool logsStored = true;
+    bool rosterSent = false;
+    void finish() {
+        if (rosterSent) logs.swapRoster();
+    }
+};
+
+// Server rows: taps with a seq are deduplicated (storeDeviceLogs), without are not
+struct SwapServer {
+    std::set<uint32_t> seqs;
+    uint32_t rows = 0;
+    void store(const std::vector<uint32_t>& batch) {
+        for (uint32_t seq : batch) {
+            if (seq == 0 || seqs.insert(seq).second) rows++;
+        }
+    }
+};
+
+// One sync exchange whose reply carries a roster change, `during` taps
+// logged while it was in flight; then exchanges until nothing is pending.
+// settle: settleSyncReply, else the old order (roster, then ack and trim).
+static uint32_t syncAcrossSwap(bool settle, int before, int during, int after) {
+    TwoLogs logs;
+    SwapServer server;
+    logs.tap(before);
+    SwapCursor cursor(logs);
+    server.store(cursor.fill());
+    logs.tap(during);
+    SwapSink sink{logs};
+    sink.rosterSent = true;
+    if (settle) {
+        settleSyncReply(cursor, sink);
+    } else {
+        sink.finish();
+        cursor.ack();
+    }
+    cursor.trim();
+    logs.tap(after);
+    // Later cycles, each with a fresh cursor as syncCloud makes
+    for (int cycle = 0; cycle < 10 && (!logs.compact.empty() || !logs.expanded.empty()); cycle++) {
+        SwapCursor next(logs);
+        while (next.pending()) {
+            server.store(next.fill());
+            next.ack();
+        }
+        next.trim();
+    }
+    return server.rows;
+}
+
+static void testRosterSwap() {
+    // 30 taps uploaded and stored, 4 logged meanwhile, 6 after the swap
+    uint32_t settled = syncAcrossSwap(true, 30, 4, 6);
+    uint32_t oldOrder = syncAcrossSwap(false, 30, 4, 6);
+    check(settled == 40, "Roster in the reply: every tap stored once (settleSyncReply)");
+    check(oldOrder != 40, "Roster applied before the ack: taps duplicated or lost");
+    check(syncAcrossSwap(true, 120, 0, 0) == 120, "Roster swap under a backlog: whole backlog stored once");
+}
+
+struct SimResult {
+    uint32_t requests;
+    uint32_t writes;
+    uint32_t reads;
+    uint64_t bytes;
+    uint32_t heartbeats;
+    uint32_t maxSeenGapS;   // Longest stretch without lastSeen moving
+    double rosterDelayS;    // Mean time from edit to device
+    double configDelayS;
+};
+
+// Two hours of NetworkTask cycles. mode 0: per endpoint as shipped (roster
+// and config hourly); 1: per endpoint every cycle, with the heartbeat;
+// 2: /api/sync (roster and config due hourly)
+static SimResult simulate(int mode) {
+    StandIn server;
+    for (int i = 0; i < 30; i++) server.editRoster();
+    Device d(server);
+    // Start in sync
+    syncExchange(d);
+    server.requests = server.writes = server.reads = server.heartbeats = 0;
+    server.bytesIn = server.bytesOut = 0;
+
+    const int rosterEdits[] = {10, 47, 95, 170, 201};
+    const int configEdits[] = {70, 150};
+    std::vector<std::pair<int, uint32_t>> rosterAt, configAt;   // Cycle of each edit, version it made
+    double rosterDelay = 0, configDelay = 0;
+    size_t rosterDone = 0, configDone = 0;
+    for (int t = 1; t <= SIM_CYCLES; t++) {
+        d.nowS = server.nowS = (uint32_t)(t * CYCLE_S);
+        for (int e : rosterEdits) {
+            if (e == t) {
+                server.editRoster();
+                rosterAt.push_back({t, server.rosterVersion});
+            }
+        }
+        for (int e : configEdits) {
+            if (e == t) configAt.push_back({t, ++server.configVersion});
+        }
+        d.tap(t % HOURLY == 16 ? 120 : (t % 3 == 0 ? 2 : 0));   // Class change burst, a trickle otherwise
+
+        if (mode == 2) {
+            if (t % HOURLY == 0) d.whitelistDue = d.configDue = true;
+            syncCloud(d);
+        } else {
+            if (mode == 1 || t % HOURLY == 0) {
+                getWhitelist(d);
+                getConfig(d);
+            }
+            postLogs(d);
+            if (mode == 1) heartbeat(d);
+        }
+        for (; rosterDone < rosterAt.size() && d.since >= rosterAt[rosterDone].second; rosterDone++) {
+            rosterDelay += (t - rosterAt[rosterDone].first) * CYCLE_S;
+        }
+        for (; configDone < configAt.size() && d.configVersion >= configAt[configDone].second; configDone++) {
+            configDelay += (t - configAt[configDone].first) * CYCLE_S;
+        }
+    }
+    // Edits still not on the device count until the end of the run
+    for (; rosterDone < rosterAt.size(); rosterDone++) rosterDelay += (SIM_CYCLES - rosterAt[rosterDone].first) * CYCLE_S;
+    for (; configDone < configAt.size(); configDone++) configDelay += (SIM_CYCLES - configAt[configDone].first) * CYCLE_S;
+
+    SimResult r;
+    r.requests = server.requests;
+    r.writes = server.writes;
+    r.reads = server.reads;
+    r.bytes = server.bytesIn + server.bytesOut;
+    r.heartbeats = server.heartbeats;
+    r.maxSeenGapS = server.heartbeats > 0 ? std::max(server.maxSeenGapS, server.nowS - server.seenAt) : server.nowS;
+    r.rosterDelayS = rosterDelay / rosterAt.size();
+    r.configDelayS = configDelay / configAt.size();
+    if (!d.pending.empty()) r.requests = 0;
+    return r;
+}
+
+static double linkSeconds(const SimResult& r) {
+    return r.requests * (RTT_S + SERVER_S) + r.bytes / LINK_BYTES_PER_S;
+}
+
+static void benchCycles() {
+    printf("\n  2 h of %d s cycles: 80 taps/h trickle + a 120-tap burst hourly, 5 roster and 2 config edits\n", CYCLE_S);
+    printf("  model: kept-alive link, RTT %.0f ms + %.0f ms server per request, %.0f KB/s\n\n",
+           RTT_S * 1000, SERVER_S * 1000, LINK_BYTES_PER_S / 1024);
+    printf("    %-30s %9s %7s %6s %8s %5s %9s %11s %11s %10s\n", "", "requests", "writes", "reads", "KB", "seen",
+           "seen gap", "roster lag", "config lag", "link time");
+    const char* names[] = {"per endpoint, hourly (before)", "per endpoint, every cycle", "/api/sync"};
+    SimResult r[3];
+    for (int m = 0; m < 3; m++) {
+        r[m] = simulate(m);
+        printf("    %-30s %9u %7u %6u %8.1f %5u %7u s %9.0f s %9.0f s %8.1f s\n", names[m], r[m].requests, r[m].writes,
+               r[m].reads, r[m].bytes / 1024.0, r[m].heartbeats, r[m].maxSeenGapS, r[m].rosterDelayS,
+               r[m].configDelayS, linkSeconds(r[m]));
+    }
+    printf("\n");
+    check(r[0].requests > 0 && r[1].requests > 0 && r[2].requests > 0, "Every mode uploads the whole backlog");
+    check(r[2].requests <= r[0].requests && r[2].writes <= r[0].writes,
+          "Sync: no more requests or writes than per endpoint hourly");
+    check(r[2].requests * 3 <= r[1].requests, "Sync: at most a third of the per-endpoint-every-cycle requests");
+    check(r[2].rosterDelayS <= r[0].rosterDelayS && r[2].configDelayS <= r[0].configDelayS,
+          "Sync: roster and config keep the hourly cadence");
+    check(r[0].heartbeats == 0 && r[2].maxSeenGapS < OFFLINE_S,
+          "Before: never seen; sync: seen well inside the offline threshold");
+    // The health line on every exchange costs a little over the hourly calls
+    check(linkSeconds(r[2]) < linkSeconds(r[0]) * 1.1, "Sync: link time within 10% of per endpoint hourly");
+}
+
+int main() {
+    printf("\n=== Cloud Sync Test ===\n\n");
+    testEnvelope();
+    testExchange();
+    testRosterSwap();
+    benchCycles();
+    printf("\n%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
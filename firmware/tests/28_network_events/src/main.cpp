@@ -0,0 +1,361 @@
+/**
+ * Network Events Test
+ * ====================
+ *
+ * PURPOSE: Verify the event-driven NetworkTask (NetworkEvents.h): it sleeps
+ *          on its task notification until openDoor, the WiFi event handler
+ *          or the nearest NetworkTimers deadline posts work, instead of
+ *          waking every 5 s to compare millis() against last* timestamps.
+ *          Compare tap-to-cloud latency and wakeups with the polling loop.
+ *
+ * HOW TO USE:
+ * 1. pio run -e native -t exec
+ * 2. No hardware needed - both loops run against a simulated clock, the
+ *    event-driven one through the real NetworkTimers with the same event
+ *    handling as NetworkTask in main.cpp
+ *
+ * WHAT IT MEASURES:
+ * - Tap-to-cloud latency (tap to the end of the upload that carries it),
+ *   p50 / p99 / max, online and after a WiFi outage
+ * - Task wakeups over three hours and in an idle hour, and uploads made
+ *
+ * WHAT IT CHECKS:
+ * - NetworkTimers: nearest deadline, whole-period reschedules (no drift,
+ *   no burst after a long stall), within() only pulls earlier, one-shots,
+ *   cancel, millis() wrap-around, full table
+ * - Taps in quick succession share one upload; a tap during an upload gets
+ *   the next one
+ * - Online taps reach the cloud in under a second; taps logged offline go
+ *   up right after the reconnect
+ * - No deadline wakeups while offline; every tap uploaded once
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "NetworkEvents.h"
+
+// config.h
+static const uint32_t LOG_SYNC_INTERVAL = 30000;
+static const uint32_t LOG_UPLOAD_DELAY_MS = 500;
+static const uint32_t HEARTBEAT_INTERVAL = 60000;
+static const uint32_t WHITELIST_SYNC_INTERVAL = 3600000;
+static const uint32_t CONFIG_SYNC_INTERVAL = 3600000;
+static const uint32_t NTP_RETRY_MS = 5000;
+static const uint32_t NTP_UPDATE_MS = 60000;
+static const uint32_t POLL_MS = 5000;           // The old vTaskDelay
+
+// One /api/sync on a weak link, kept-alive connection (27_cloud_sync:
+// 90.6 s of link time over 244 exchanges)
+static const uint32_t EXCHANGE_MS = 370;
+
+static const uint32_t SIM_MS = 3 * 3600000;
+static const uint32_t OUTAGE_FROM = 3600000;
+static const uint32_t OUTAGE_TO = 4800000;
+static const uint32_t IDLE_FROM = 2 * 3600000;  // Last hour: no taps
+
+static const uint32_t NET_EVENTS_ONLINE = NET_EVENT_LOGS_DUE | NET_EVENT_WHITELIST_DUE |
+    NET_EVENT_CONFIG_DUE | NET_EVENT_HEARTBEAT_DUE | NET_EVENT_NTP_DUE;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("[TEST] %-58s %s\n", what, ok ? "PASS" : "FAIL");
+    if (!ok) failures++;
+}
+
+// =============================================================================
+// NetworkTimers
+// =============================================================================
+static void testTimers() {
+    printf("--- NetworkTimers ---\n");
+    NetworkTimers t;
+    check(t.untilNext(0) == NET_TIMER_NONE && t.expire(0) == 0, "Nothing armed: sleep forever, nothing due");
+
+    t.every(NET_EVENT_LOGS_DUE, 30000, 1000);
+    t.every(NET_EVENT_HEARTBEAT_DUE, 60000, 1000, 0);
+    check(t.untilNext(1000) == 0 && t.expire(1000) == NET_EVENT_HEARTBEAT_DUE,
+          "First deadline 0: due at once, only that one");
+    check(t.untilNext(1000) == 30000, "Sleep until the nearest deadline");
+    check(t.expire(30999) == 0 && t.expire(31000) == NET_EVENT_LOGS_DUE, "Due exactly at its deadline");
+
+    // Woken 700 ms late: the next deadline stays on the grid
+    t.expire(61700);
+    check(t.untilNext(61700) == 29300, "Late wakeup: next deadline on the period grid, no drift");
+
+    // Stalled for five periods (a long sync): due once, not five times
+    uint32_t due = t.expire(61000 + 5 * 30000 + 100);
+    uint32_t again = t.expire(61000 + 5 * 30000 + 200);
+    check((due & NET_EVENT_LOGS_DUE) && !(again & NET_EVENT_LOGS_DUE), "Stall over many periods: due once, no burst");
+
+    NetworkTimers w;
+    w.every(NET_EVENT_LOGS_DUE, 30000, 0);
+    w.within(NET_EVENT_LOGS_DUE, 500, 10000);
+    check(w.untilNext(10000) == 500, "within() pulls a recurring deadline earlier");
+    w.within(NET_EVENT_LOGS_DUE, 500, 10200);
+    check(w.untilNext(10000) == 500, "within() never pushes it later");
+    w.expire(10500);
+    check(w.untilNext(10500) == 30000, "Recurring event keeps its period from the pulled deadline");
+    w.within(NET_EVENT_CONFIG_DUE, 100, 10500);
+    check(w.expire(10600) == NET_EVENT_CONFIG_DUE && !w.armed(NET_EVENT_CONFIG_DUE), "One-shot fires once and is dropped");
+    w.cancel(NET_EVENT_LOGS_DUE | NET_EVENT_CONFIG_DUE);
+    check(w.untilNext(10600) == NET_TIMER_NONE, "cancel() clears the given events");
+
+    // millis() wraps after ~49.7 days
+    NetworkTimers z;
+    uint32_t nearWrap = 0xFFFFFFFFu - 1000;
+    z.every(NET_EVENT_NTP_DUE, 5000, nearWrap);
+    check(z.expire(nearWrap + 10) == 0 && z.untilNext(nearWrap + 10) == 4990, "Deadline past the wrap: not due early");
+    check(z.expire(nearWrap + 5000) == NET_EVENT_NTP_DUE && z.untilNext(nearWrap + 5000) == 5000,
+          "Deadline past the wrap: due on time, then on the grid");
+
+    NetworkTimers full;
+    bool all = true;
+    for (int i = 0; i < NET_TIMER_SLOTS; i++) all = full.every(1u << (8 + i), 1000, 0) && all;
+    check(all && !full.every(1u << 20, 1000, 0) && !full.within(1u << 21, 10, 0) &&
+          full.every(1u << 8, 2000, 0), "Full table: new events refused, armed ones re-armed");
+}
+
+// =============================================================================
+// Simulation
+// =============================================================================
+struct External {
+    uint32_t t;
+    enum Kind { TAP, WIFI_UP, WIFI_DOWN } kind;
+};
+
+struct Result {
+    std::vector<uint32_t> onlineLatency;   // ms, taps logged while online
+    std::vector<uint32_t> outageLatency;   // ms after the reconnect, taps logged offline
+    uint32_t wakeups = 0;
+    uint32_t idleWakeups = 0;
+    uint32_t outageWakeups = 0;            // Offline, other than taps and the WiFi event
+    uint32_t uploads = 0;
+    uint32_t uploaded = 0;
+    uint32_t left = 0;
+};
+
+// Common to both loops: the link, the taps waiting, the uploads
+struct Device {
+    const std::vector<External>& ext;
+    size_t next = 0;
+    bool link = false;
+    uint32_t reconnectAt = 0;
+    std::vector<uint32_t> unsent;
+    Result r;
+
+    explicit Device(const std::vector<External>& e) : ext(e) {}
+
+    static bool offline(uint32_t t) { return t >= OUTAGE_FROM && t < OUTAGE_TO; }
+
+    // Apply everything up to `now`; returns the events it would post
+    uint32_t deliver(uint32_t now) {
+        uint32_t bits = 0;
+        for (; next < ext.size() && ext[next].t <= now; next++) {
+            const External& e = ext[next];
+            if (e.kind == External::TAP) {
+                unsent.push_back(e.t);
+                bits |= NET_EVENT_LOG_READY;
+            } else if (e.kind == External::WIFI_UP) {
+                link = true;
+                reconnectAt = e.t;
+                bits |= NET_EVENT_WIFI_UP;
+            } else {
+                link = false;
+                bits |= NET_EVENT_WIFI_DOWN;
+            }
+        }
+        return bits;
+    }
+
+    uint32_t nextExternal() const { return next < ext.size() ? ext[next].t : UINT32_MAX; }
+
+    void wake(uint32_t now) {
+        r.wakeups++;
+        if (now >= IDLE_FROM) r.idleWakeups++;
+    }
+
+    // syncCloud(): flushLogs() then one exchange carrying every tap so far
+    void upload(uint32_t& now) {
+        std::vector<uint32_t> batch;
+        batch.swap(unsent);
+        now += EXCHANGE_MS;
+        r.uploads++;
+        for (uint32_t tap : batch) {
+            if (offline(tap)) r.outageLatency.push_back(now - reconnectAt);
+            else r.onlineLatency.push_back(now - tap);
+            r.uploaded++;
+        }
+    }
+};
+
+// The old loop: vTaskDelay(5000), then compare millis() with lastLogSync
+static Result runPolling(const std::vector<External>& ext) {
+    Device d(ext);
+    bool wasConnected = false;
+    uint32_t lastLogSync = 0;
+    for (uint32_t now = 0; now < SIM_MS;) {
+        d.deliver(now);
+        d.wake(now);
+        if (d.link && !wasConnected) {
+            wasConnected = true;
+            d.upload(now);
+            lastLogSync = now;
+        } else if (!d.link && wasConnected) {
+            wasConnected = false;
+        }
+        if (wasConnected && now - lastLogSync > LOG_SYNC_INTERVAL) {
+            uint32_t start = now;
+            d.upload(now);
+            lastLogSync = start;
+        }
+        now += POLL_MS;
+    }
+    d.r.left = (uint32_t)d.unsent.size();
+    return d.r;
+}
+
+// NetworkTask in main.cpp, with xTaskNotifyWait() as "advance to the
+// nearest deadline or posted event"
+static Result runEvents(const std::vector<External>& ext, uint32_t end = SIM_MS) {
+    Device d(ext);
+    NetworkTimers timers;
+    bool wasConnected = false;
+    uint32_t pending = 0;
+    uint32_t now = 0;
+
+    for (;;) {
+        pending |= d.deliver(now);
+        if (pending == 0) {
+            uint32_t wait = timers.untilNext(now);
+            uint32_t deadline = wait == NET_TIMER_NONE ? UINT32_MAX : now + wait;
+            uint32_t target = std::min(deadline, d.nextExternal());
+            if (target >= end) break;
+            now = std::max(now, target);
+            pending |= d.deliver(now);
+        }
+        uint32_t events = pending;
+        pending = 0;
+        d.wake(now);
+        events |= timers.expire(now);
+        if (!wasConnected && Device::offline(now) && !(events & (NET_EVENT_LOG_READY | NET_EVENT_WIFI_DOWN))) {
+            d.r.outageWakeups++;
+        }
+
+        if (events & (NET_EVENT_WIFI_UP | NET_EVENT_WIFI_DOWN)) {
+            if (d.link && !wasConnected) {
+                wasConnected = true;
+                timers.every(NET_EVENT_NTP_DUE, NTP_RETRY_MS, now, 0);
+                timers.every(NET_EVENT_LOGS_DUE, LOG_SYNC_INTERVAL, now, 0);
+                timers.every(NET_EVENT_CONFIG_DUE, CONFIG_SYNC_INTERVAL, now, 0);
+                timers.every(NET_EVENT_WHITELIST_DUE, WHITELIST_SYNC_INTERVAL, now, WHITELIST_SYNC_INTERVAL);
+                timers.every(NET_EVENT_HEARTBEAT_DUE, HEARTBEAT_INTERVAL, now);
+                continue;
+            } else if (!d.link && wasConnected) {
+                wasConnected = false;
+                timers.cancel(NET_EVENTS_ONLINE);
+            }
+        }
+        if (!wasConnected) continue;
+
+        if (events & NET_EVENT_NTP_DUE) {
+            timers.every(NET_EVENT_NTP_DUE, now > 20000 ? NTP_UPDATE_MS : NTP_RETRY_MS, now);   // Synced after a few tries
+        }
+        if ((events & NET_EVENT_LOG_READY) && !(events & NET_EVENT_LOGS_DUE)) {
+            timers.within(NET_EVENT_LOGS_DUE, LOG_UPLOAD_DELAY_MS, now);
+        }
+        if (events & NET_EVENT_LOGS_DUE) d.upload(now);
+    }
+    d.r.left = (uint32_t)d.unsent.size();
+    return d.r;
+}
+
+static uint32_t pct(std::vector<uint32_t> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[(size_t)(p * (v.size() - 1))];
+}
+
+static void printResult(const char* label, const Result& r) {
+    printf("  %-24s wakeups %5u (idle hour %4u)  uploads %4u  online p50 %6.2f s  p99 %6.2f s  max %6.2f s"
+           "  after outage max %5.2f s\n",
+           label, r.wakeups, r.idleWakeups, r.uploads,
+           pct(r.onlineLatency, 0.50) / 1000.0, pct(r.onlineLatency, 0.99) / 1000.0,
+           pct(r.onlineLatency, 1.0) / 1000.0, pct(r.outageLatency, 1.0) / 1000.0);
+}
+
+static void testCoalescing() {
+    printf("\n--- Taps close together ---\n");
+    // Two taps 200 ms apart share one upload; a third lands mid-upload.
+    // Between the 30 s log deadlines at 30 s and 60 s.
+    const uint32_t at = 40000;
+    std::vector<External> ext = {
+        {0, External::WIFI_UP},
+        {at, External::TAP},
+        {at + 200, External::TAP},
+        {at + LOG_UPLOAD_DELAY_MS + 100, External::TAP},
+    };
+    Result r = runEvents(ext, 50000);
+    check(r.onlineLatency.size() == 3 && r.onlineLatency[0] == LOG_UPLOAD_DELAY_MS + EXCHANGE_MS &&
+          r.onlineLatency[1] == LOG_UPLOAD_DELAY_MS + EXCHANGE_MS - 200,
+          "Taps 200 ms apart: one upload, LOG_UPLOAD_DELAY_MS after the first");
+    check(r.onlineLatency[2] <= EXCHANGE_MS - 100 + LOG_UPLOAD_DELAY_MS + EXCHANGE_MS,
+          "Tap during an upload: carried by the next one");
+    // At boot, at 30 s, then the two for the taps
+    check(r.uploads == 4, "Three taps, two uploads");
+}
+
+static void benchDay() {
+    printf("\n--- Three hours: class change, scattered taps, 20 min outage, idle hour ---\n");
+    std::vector<External> ext;
+    ext.push_back({0, External::WIFI_UP});
+    uint32_t seed = 12345;
+    auto rnd = [&seed](uint32_t n) {
+        seed = seed * 1103515245u + 12345u;
+        return (seed >> 8) % n;
+    };
+    // Class change: 30 students, one door, 6-9 s apart
+    for (uint32_t i = 0, t = 300000; i < 30; i++, t += 6000 + rnd(3000)) ext.push_back({t, External::TAP});
+    // Latecomers and staff over the rest of the first hour
+    for (int i = 0; i < 10; i++) ext.push_back({600000 + rnd(2900000), External::TAP});
+    // Outage with taps logged offline
+    ext.push_back({OUTAGE_FROM, External::WIFI_DOWN});
+    for (int i = 0; i < 10; i++) ext.push_back({OUTAGE_FROM + 1000 + rnd(OUTAGE_TO - OUTAGE_FROM - 2000), External::TAP});
+    ext.push_back({OUTAGE_TO, External::WIFI_UP});
+    // Second class change after the outage
+    for (uint32_t i = 0, t = 5400000; i < 30; i++, t += 6000 + rnd(3000)) ext.push_back({t, External::TAP});
+    std::stable_sort(ext.begin(), ext.end(), [](const External& a, const External& b) { return a.t < b.t; });
+    uint32_t taps = 0;
+    uint32_t offlineTaps = 0;
+    for (const External& e : ext) {
+        if (e.kind != External::TAP) continue;
+        taps++;
+        if (Device::offline(e.t)) offlineTaps++;
+    }
+
+    Result poll = runPolling(ext);
+    Result evt = runEvents(ext);
+    printf("  %u taps (%u offline)\n", taps, offlineTaps);
+    printResult("Poll every 5 s", poll);
+    printResult("Notifications + timers", evt);
+
+    check(poll.uploaded == taps && poll.left == 0, "Polling: every tap uploaded");
+    check(evt.uploaded == taps && evt.left == 0, "Events: every tap uploaded exactly once");
+    check(pct(evt.onlineLatency, 1.0) < 1000, "Events: every online tap in the cloud within 1 s");
+    check(pct(evt.outageLatency, 1.0) < 1000, "Events: offline taps up within 1 s of the reconnect");
+    check(pct(poll.onlineLatency, 0.50) > 10 * pct(evt.onlineLatency, 0.50), "Events: median tap-to-cloud over 10x lower than polling");
+    check(evt.outageWakeups == 0, "Events: no deadline wakeups while offline");
+    check(evt.idleWakeups * 2 < poll.idleWakeups, "Events: idle hour wakes less than half as often");
+}
+
+int main() {
+    printf("\n=== Network Events Test ===\n\n");
+    testTimers();
+    testCoalescing();
+    benchDay();
+    printf("\n%s\n", failures == 0 ? "All checks passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
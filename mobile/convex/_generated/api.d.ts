@@ -18,9 +18,12 @@ import type * as devices from "../devices.js";
 import type * as hardware from "../hardware.js";
 import type * as homerooms from "../homerooms.js";
 import type * as http from "../http.js";
+import type * as lib_logs from "../lib/logs.js";
 import type * as lib_permissions from "../lib/permissions.js";
+import type * as lib_sync from "../lib/sync.js";
 import type * as lib_timezone from "../lib/timezone.js";
 import type * as lib_utils from "../lib/utils.js";
+import type * as lib_whitelist from "../lib/whitelist.js";
 import type * as rooms from "../rooms.js";
 import type * as schedule from "../schedule.js";
 import type * as seed from "../seed.js";
@@ -45,9 +48,12 @@ declare const fullApi: ApiFromModules<{
   hardware: typeof hardware;
   homerooms: typeof homerooms;
   http: typeof http;
+  "lib/logs": typeof lib_logs;
   "lib/permissions": typeof lib_permissions;
+  "lib/sync": typeof lib_sync;
   "lib/timezone": typeof lib_timezone;
   "lib/utils": typeof lib_utils;
+  "lib/whitelist": typeof lib_whitelist;
   rooms: typeof rooms;
   schedule: typeof schedule;
   seed: typeof seed;
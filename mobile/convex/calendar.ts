@@ -1,6 +1,7 @@
 import { v } from "convex/values";
 import { mutation, query } from "./_generated/server";
 import { getCurrentUser, mustBeAdmin } from "./lib/permissions";
+import { recordWhitelistChange } from "./lib/whitelist";
 
 /**
  * Returns the currently active semester.
@@ -35,6 +36,11 @@ export const createSemester = mutation({
       status: args.status,
     });
 
+    // A new active semester swaps every homeroom roster
+    if (args.status === "active") {
+      await recordWhitelistChange(ctx, { fullResync: true });
+    }
+
     return semesterId;
   },
 });
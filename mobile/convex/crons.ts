@@ -1,10 +1,16 @@
 import { cronJobs } from "convex/server";
 import { internal } from "./_generated/api";
 import { internalMutation } from "./_generated/server";
+import { v } from "convex/values";
 import { MutationCtx } from "./_generated/server";
 import { Id, Doc } from "./_generated/dataModel";
 import { getCambodiaDateString, getCambodiaDayOfWeek, parseTimeForDate } from "./lib/timezone";
 import { calculateAttendanceWindow } from "./lib/utils";
+import {
+  WHITELIST_CHANGE_RETENTION_MS,
+  refreshRoomWhitelistSnapshot as refreshRoomSnapshot,
+  refreshWhitelistSnapshots as refreshSnapshots,
+} from "./lib/whitelist";
 
 // ===== INTERNAL MUTATIONS =====
 
@@ -271,6 +277,56 @@ export const analyzeSuspiciousActivity = internalMutation({
   },
 });
 
+/**
+ * Prunes old whitelist change rows. The newest row is always kept so the
+ * whitelist version never goes backwards; devices behind the pruned range
+ * get a full roster on their next sync.
+ */
+export const pruneWhitelistChanges = internalMutation({
+  handler: async (ctx: MutationCtx) => {
+    const cutoff = Date.now() - WHITELIST_CHANGE_RETENTION_MS;
+
+    const newest = await ctx.db
+      .query("whitelistChanges")
+      .withIndex("by_seq")
+      .order("desc")
+      .first();
+
+    const stale = await ctx.db
+      .query("whitelistChanges")
+      .withIndex("by_createdAt", q => q.lt("createdAt", cutoff))
+      .take(1000);
+
+    for (const change of stale) {
+      if (change._id !== newest?._id) {
+        await ctx.db.delete(change._id);
+      }
+    }
+  },
+});
+
+/**
+ * Dispatches a per-room refresh of the whitelist snapshots. Scheduled after
+ * each batch of whitelist changes; the cron is a backstop for new devices
+ * and lost runs.
+ */
+export const refreshWhitelistSnapshots = internalMutation({
+  handler: async (ctx: MutationCtx) => {
+    await refreshSnapshots(ctx);
+  },
+});
+
+/**
+ * Brings one room's whitelist snapshot up to date (scheduled by
+ * refreshWhitelistSnapshots).
+ */
+export const refreshRoomWhitelistSnapshot = internalMutation({
+  args: { roomId: v.id("rooms") },
+  handler: async (ctx: MutationCtx, args) => {
+    await refreshRoomSnapshot(ctx, args.roomId);
+  },
+});
+
 // ===== CRON DEFINITIONS =====
 
 const crons = cronJobs();
@@ -299,4 +355,16 @@ crons.interval(
   internal.crons.analyzeSuspiciousActivity
 );
 
+crons.daily(
+  "prune whitelist changes",
+  { hourUTC: 18, minuteUTC: 0 }, // 01:00 Cambodia time (UTC+7)
+  internal.crons.pruneWhitelistChanges
+);
+
+crons.interval(
+  "refresh whitelist snapshots",
+  { minutes: 10 },
+  internal.crons.refreshWhitelistSnapshots
+);
+
 export default crons;
@@ -2,6 +2,7 @@ import { mutation, query } from "./_generated/server";
 import { v } from "convex/values";
 import { getCurrentUser, mustBeAdmin, logActivity, touchRoom } from "./lib/permissions";
 import { hashToken, generateSecureToken } from "./lib/utils";
+import { recordWhitelistChange } from "./lib/whitelist";
 
 /**
  * Lists all devices for the admin dashboard.
@@ -41,6 +42,7 @@ export const assignToRoom = mutation({
 
     // Mark the room as updated so the device pulls the whitelist immediately
     await touchRoom(ctx, args.roomId);
+    await recordWhitelistChange(ctx, { roomId: args.roomId, fullResync: true });
 
     await logActivity(ctx, admin!, "DEVICE_ASSIGN", `Assigned device ${device.chipId} to room ${room.name}`);
   },
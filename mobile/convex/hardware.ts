@@ -1,9 +1,18 @@
 import { mutation, query } from "./_generated/server";
-import { v } from "convex/values";
+import { v, Infer } from "convex/values";
 import { QueryCtx, MutationCtx } from "./_generated/server";
 import { Doc } from "./_generated/dataModel";
 import { logActivity } from "./lib/permissions";
-import { hashToken, generateSecureToken, haversineDistance, secureCompare } from "./lib/utils";
+import {
+  buildFullWhitelist,
+  buildWhitelistDelta,
+  getWhitelistSnapshot,
+  getWhitelistVersion,
+  sortWhitelistEntries,
+  whitelistEtag,
+} from "./lib/whitelist";
+import { deviceHealth } from "./lib/sync";
+import { etagMatches, hashToken, generateSecureToken, haversineDistance, secureCompare } from "./lib/utils";
 
 /**
  * Validates that a request is coming from a legitimate hardware device.
@@ -40,222 +49,362 @@ async function validateDevice(
 }
 
 /**
- * Returns the whitelist for a specific device based on homeroom enrollment.
+ * Whitelist response for `device`. With `since`, only adds/removes after
+ * that version when possible. With `ifNoneMatch` still current, { notModified }
+ * before any roster query runs. Full rosters come from the room's snapshot,
+ * brought forward by any changes its refresh has not reached yet; they are
+ * built live only when that is not possible.
  */
-export const getWhitelist = query({
-  args: { chipId: v.string(), token: v.string() },
-  handler: async (ctx, args) => {
-    const device = await validateDevice(ctx, args.chipId, args.token);
-    if (!device.roomId) return { entries: [] };
-
-    const room = await ctx.db.get(device.roomId);
-
-    // 1. Get Active Semester
-    const semester = await ctx.db
-      .query("semesters")
-      .withIndex("by_status", (q) => q.eq("status", "active"))
-      .unique();
-    
-    if (!semester) return { entries: [] };
-
-    // 2. Find Homeroom associated with this room for the active semester
-    const homeroom = await ctx.db
-      .query("homerooms")
-      .withIndex("by_room", (q) => q.eq("roomId", device.roomId!))
-      .filter((q) => q.eq(q.field("semesterId"), semester._id))
-      .first();
-
-    if (!homeroom) {
-      // If no homeroom, only allow staff/admin access
-      const staff = await ctx.db
-        .query("users")
-        .filter((q) => q.or(
-          q.eq(q.field("role"), "admin"),
-          q.eq(q.field("role"), "teacher"),
-          q.eq(q.field("role"), "staff")
-        ))
-        .collect();
-        
-      return {
-        roomId: device.roomId,
-        roomName: room?.name,
-        entries: staff
-          .filter(u => !!u.cardUID)
-          .map(u => ({ uid: u.cardUID, sid: u._id, role: u.role, bioId: u.biometricId || 0 }))
-      };
+async function whitelistFor(
+  ctx: QueryCtx | MutationCtx,
+  device: Doc<"devices">,
+  since?: number,
+  ifNoneMatch?: string
+) {
+  const version = await getWhitelistVersion(ctx);
+  const etag = whitelistEtag(version, device.roomId);
+  if (etagMatches(ifNoneMatch, etag)) return { notModified: true as const, etag };
+  if (!device.roomId) return { etag, version, full: true, entries: [] };
+
+  if (since !== undefined) {
+    const delta = await buildWhitelistDelta(ctx, device.roomId, since, version);
+    if (delta) {
+      return { etag, version, full: false, since, ...delta };
     }
-
-    // 3. Get Enrolled Students
-    const enrollments = await ctx.db
-      .query("homeroomStudents")
-      .withIndex("by_homeroom", (q) => q.eq("homeroomId", homeroom._id))
-      .filter((q) => q.eq(q.field("status"), "active"))
-      .collect();
-
-    const students = [];
-    for (const enroll of enrollments) {
-      const student = await ctx.db.get(enroll.studentId);
-      if (student?.cardUID) students.push(student);
-    }
-
-    // 4. Get All Staff
-    const staff = await ctx.db
-      .query("users")
-      .filter((q) => q.or(
-        q.eq(q.field("role"), "admin"),
-        q.eq(q.field("role"), "teacher"),
-        q.eq(q.field("role"), "staff")
-      ))
-      .collect();
-
-    const allAuthorized = [...staff, ...students];
-
-    return {
-      roomId: device.roomId,
-      roomName: room?.name,
-      entries: allAuthorized
-        .filter(u => !!u.cardUID)
-        .map(u => ({
-          uid: u.cardUID,
-          sid: u._id,
-          role: u.role,
-          bioId: u.biometricId || 0
-        }))
-    };
   }
-});
+
+  const room = await ctx.db.get(device.roomId);
+  const snapshot = await getWhitelistSnapshot(ctx, device.roomId, version);
+  return {
+    etag,
+    version,
+    full: true,
+    roomId: device.roomId,
+    roomName: room?.name,
+    // Sorted so the device can stream entries into flash as they arrive
+    entries: snapshot ?? sortWhitelistEntries(await buildFullWhitelist(ctx, device.roomId)),
+  };
+}
 
 /**
- * Accepts a batch of access logs from the ESP32.
+ * Returns the whitelist for a specific device based on homeroom enrollment
+ * (see whitelistFor).
  */
-export const syncLogs = mutation({
+export const getWhitelist = query({
   args: {
     chipId: v.string(),
     token: v.string(),
-    logs: v.array(v.object({
-      userId: v.id("users"),
-      method: v.union(v.literal("card"), v.literal("phone")),
-      action: v.union(v.literal("OPEN_GATE"), v.literal("ATTENDANCE")),
-      result: v.string(),
-      timestamp: v.number(),
-      timestampType: v.union(v.literal("server"), v.literal("local")),
-      scanOrder: v.optional(v.number()),
-      deviceTime: v.optional(v.number()),
-      timeSource: v.optional(v.string()),
-      hasInternet: v.optional(v.boolean()),
-      deviceId: v.optional(v.string()),
-      gps: v.optional(v.object({ lat: v.number(), lng: v.number() })),
-    }))
+    since: v.optional(v.number()),
+    ifNoneMatch: v.optional(v.string()),
   },
   handler: async (ctx, args) => {
     const device = await validateDevice(ctx, args.chipId, args.token);
-    if (!device.roomId) throw new Error("Device not assigned to a room");
+    return whitelistFor(ctx, device, args.since, args.ifNoneMatch);
+  }
+});
 
-    const room = await ctx.db.get(device.roomId);
+/**
+ * Gatekeeper logs name the tap method ("NFC", "NFC+BIO", ...) and clock
+ * ("ntp"/"local") and stamp epoch seconds; store them like app logs.
+ */
+function normalizeDeviceLog<T extends { method: string; timestampType: string; timestamp: number }>(log: T) {
+  return {
+    ...log,
+    method: log.method === "phone" ? ("phone" as const) : ("card" as const),
+    timestampType: log.timestampType === "local" ? ("local" as const) : ("server" as const),
+    timestamp: log.timestamp < 1e11 ? log.timestamp * 1000 : log.timestamp,
+  };
+}
 
-    for (const log of args.logs) {
-      const user = await ctx.db.get(log.userId);
-      if (!user) continue;
-      
-      // Basic Anti-Cheat: Verify Device Binding
-      if (log.deviceId && user.deviceId && log.deviceId !== user.deviceId) {
-        // Only log activity, don't throw to avoid blocking other logs in batch
-        await logActivity(ctx, user, "SUSPECT_DEVICE", `Account used on unauthorized device: ${log.deviceId}`);
+/**
+ * One log uploaded by a gatekeeper (/api/logs, /api/sync)
+ */
+const deviceLog = v.object({
+  userId: v.id("users"),
+  method: v.union(
+    v.literal("card"), v.literal("phone"),
+    v.literal("NFC"), v.literal("NFC+BIO"), v.literal("FACE"), v.literal("VEIN")
+  ),
+  action: v.union(v.literal("OPEN_GATE"), v.literal("ATTENDANCE")),
+  result: v.string(),
+  timestamp: v.number(),
+  timestampType: v.union(v.literal("server"), v.literal("local"), v.literal("ntp")),
+  seq: v.optional(v.number()),
+  scanOrder: v.optional(v.number()),
+  deviceTime: v.optional(v.number()),
+  timeSource: v.optional(v.string()),
+  hasInternet: v.optional(v.boolean()),
+  deviceId: v.optional(v.string()),
+  gps: v.optional(v.object({ lat: v.number(), lng: v.number() })),
+});
+
+const logBatch = v.optional(v.object({ first: v.number(), last: v.number() }));
+
+/**
+ * Stores a batch of access logs from the ESP32.
+ * Batches with a sequence range (`batch`) are acknowledged by echoing its
+ * `last`; the device then trims up to it. A log whose `seq` was already
+ * stored for this device (same user and time) is a retry and is skipped,
+ * so resending a batch whose acknowledgement was lost is harmless.
+ */
+async function storeDeviceLogs(
+  ctx: MutationCtx,
+  device: Doc<"devices">,
+  logs: Infer<typeof deviceLog>[],
+  batch?: { first: number; last: number }
+) {
+  if (!device.roomId) throw new Error("Device not assigned to a room");
+
+  const room = await ctx.db.get(device.roomId);
+  let duplicates = 0;
+
+  for (const { seq, ...raw } of logs) {
+    const log = normalizeDeviceLog(raw);
+    const user = await ctx.db.get(log.userId);
+    if (!user) continue;
+
+    if (seq !== undefined) {
+      // Sequence numbers restart if the device's log is erased: only the
+      // same tap under the same number is a retry
+      const existing = await ctx.db
+        .query("accessLogs")
+        .withIndex("by_device_seq", (q) => q.eq("sourceDevice", device._id).eq("deviceSeq", seq))
+        .first();
+      if (existing && existing.userId === log.userId && existing.timestamp === log.timestamp) {
+        duplicates++;
+        continue;
       }
+    }
+    
+    // Basic Anti-Cheat: Verify Device Binding
+    if (log.deviceId && user.deviceId && log.deviceId !== user.deviceId) {
+      // Only log activity, don't throw to avoid blocking other logs in batch
+      await logActivity(ctx, user, "SUSPECT_DEVICE", `Account used on unauthorized device: ${log.deviceId}`);
+    }
 
-      // Basic Anti-Cheat: GPS Geofencing
-      if (log.gps && room?.gps) {
-        const distanceMeters = haversineDistance(
-          log.gps.lat, log.gps.lng,
-          room.gps.lat, room.gps.lng
-        );
-        
-        // Flag if student is > 100 meters from room
-        if (distanceMeters > 100) {
-          await logActivity(ctx, user, "SUSPECT_GPS", 
-            `Student scanned ${Math.round(distanceMeters)}m from room ${room.name}`);
-        }
+    // Basic Anti-Cheat: GPS Geofencing
+    if (log.gps && room?.gps) {
+      const distanceMeters = haversineDistance(
+        log.gps.lat, log.gps.lng,
+        room.gps.lat, room.gps.lng
+      );
+      
+      // Flag if student is > 100 meters from room
+      if (distanceMeters > 100) {
+        await logActivity(ctx, user, "SUSPECT_GPS", 
+          `Student scanned ${Math.round(distanceMeters)}m from room ${room.name}`);
       }
+    }
 
-      await ctx.db.insert("accessLogs", {
-        ...log,
-        roomId: device.roomId,
-      });
-
-      // If it's an attendance action, match it to a dailySession
-      if (log.action === "ATTENDANCE") {
-        // 1. Find the schedule slot for this room at this time
-        const date = new Date(log.timestamp).toISOString().split("T")[0];
-        const dayOfWeek = new Date(log.timestamp).getDay();
-        const timeStr = new Date(log.timestamp).toTimeString().split(" ")[0].substring(0, 5); // "HH:MM"
-
-        const homeroom = await ctx.db
-          .query("homerooms")
-          .withIndex("by_room", (q) => q.eq("roomId", device.roomId!))
+    await ctx.db.insert("accessLogs", {
+      ...log,
+      roomId: device.roomId,
+      ...(seq !== undefined ? { sourceDevice: device._id, deviceSeq: seq } : {}),
+    });
+
+    // If it's an attendance action, match it to a dailySession
+    if (log.action === "ATTENDANCE") {
+      // 1. Find the schedule slot for this room at this time
+      const date = new Date(log.timestamp).toISOString().split("T")[0];
+      const dayOfWeek = new Date(log.timestamp).getDay();
+      const timeStr = new Date(log.timestamp).toTimeString().split(" ")[0].substring(0, 5); // "HH:MM"
+
+      const homeroom = await ctx.db
+        .query("homerooms")
+        .withIndex("by_room", (q) => q.eq("roomId", device.roomId!))
+        .first();
+
+      if (homeroom) {
+        const slot = await ctx.db
+          .query("scheduleSlots")
+          .withIndex("by_homeroom", (q) => q.eq("homeroomId", homeroom._id))
+          .filter((q) => q.and(
+            q.eq(q.field("dayOfWeek"), dayOfWeek),
+            q.lte(q.field("startTime"), timeStr),
+            q.gte(q.field("endTime"), timeStr)
+          ))
           .first();
 
-        if (homeroom) {
-          const slot = await ctx.db
-            .query("scheduleSlots")
-            .withIndex("by_homeroom", (q) => q.eq("homeroomId", homeroom._id))
-            .filter((q) => q.and(
-              q.eq(q.field("dayOfWeek"), dayOfWeek),
-              q.lte(q.field("startTime"), timeStr),
-              q.gte(q.field("endTime"), timeStr)
-            ))
-            .first();
-
-          if (slot) {
-            const session = await ctx.db
-              .query("dailySessions")
-              .withIndex("by_slot", (q) => q.eq("scheduleSlotId", slot._id))
-              .filter((q) => q.eq(q.field("date"), date))
+        if (slot) {
+          const session = await ctx.db
+            .query("dailySessions")
+            .withIndex("by_slot", (q) => q.eq("scheduleSlotId", slot._id))
+            .filter((q) => q.eq(q.field("date"), date))
+            .unique();
+
+          if (session) {
+            // Found a matching session, record the attendance
+            const existingAttendance = await ctx.db
+              .query("attendance")
+              .withIndex("by_session", (q) => q.eq("dailySessionId", session._id))
+              .filter((q) => q.eq(q.field("studentId"), log.userId))
               .unique();
 
-            if (session) {
-              // Found a matching session, record the attendance
-              const existingAttendance = await ctx.db
-                .query("attendance")
-                .withIndex("by_session", (q) => q.eq("dailySessionId", session._id))
-                .filter((q) => q.eq(q.field("studentId"), log.userId))
-                .unique();
-
-              if (existingAttendance) {
-                await ctx.db.patch(existingAttendance._id, {
-                  status: log.timestamp > session.windowEnd ? "late" : "present", // Simple logic
-                  scanTime: log.timestamp,
-                  method: log.method,
-                  markedManually: false,
-                  deviceTime: log.deviceTime,
-                  timeSource: log.timeSource,
-                  hasInternet: log.hasInternet,
-                  deviceId: log.deviceId,
-                  gps: log.gps,
-                  scanOrder: log.scanOrder,
-                });
-              }
+            if (existingAttendance) {
+              await ctx.db.patch(existingAttendance._id, {
+                status: log.timestamp > session.windowEnd ? "late" : "present", // Simple logic
+                scanTime: log.timestamp,
+                method: log.method,
+                markedManually: false,
+                deviceTime: log.deviceTime,
+                timeSource: log.timeSource,
+                hasInternet: log.hasInternet,
+                deviceId: log.deviceId,
+                gps: log.gps,
+                scanOrder: log.scanOrder,
+              });
             }
           }
         }
       }
     }
-    
-    return { success: true, count: args.logs.length };
+  }
+  
+  return {
+    success: true,
+    count: logs.length,
+    duplicates,
+    ...(batch ? { acked: batch.last } : {}),
+  };
+}
+
+/**
+ * Accepts a batch of access logs from the ESP32 (see storeDeviceLogs).
+ */
+export const syncLogs = mutation({
+  args: {
+    chipId: v.string(),
+    token: v.string(),
+    batch: logBatch,
+    logs: v.array(deviceLog),
+  },
+  handler: async (ctx, args) => {
+    const device = await validateDevice(ctx, args.chipId, args.token);
+    return storeDeviceLogs(ctx, device, args.logs, args.batch);
   }
 });
 
+/**
+ * Records that the device checked in: an active device shows as online
+ */
+async function markSeen(
+  ctx: MutationCtx,
+  device: Doc<"devices">,
+  firmware?: string,
+  health?: Infer<typeof deviceHealth>
+) {
+  await ctx.db.patch(device._id, {
+    lastSeen: Date.now(),
+    status: device.status === "active" ? "online" : device.status,
+    ...(firmware ? { firmwareVersion: firmware } : {}),
+    ...(health ? { health } : {}),
+  });
+}
+
+/**
+ * How often a device that keeps syncing is recorded as seen (lastSeen,
+ * health): well inside monitorDeviceHealth's offline threshold, so a quiet
+ * sync cycle need not write the device record.
+ */
+const SEEN_INTERVAL_MS = 5 * 60 * 1000;
+
+/** Whether markSeen would record more than fresher health counters. */
+function seenDue(device: Doc<"devices">, now: number, firmware?: string) {
+  return (
+    device.status === "active" ||
+    (!!firmware && firmware !== device.firmwareVersion) ||
+    now - (device.lastSeen ?? 0) >= SEEN_INTERVAL_MS
+  );
+}
+
 export const heartbeat = mutation({
   args: { chipId: v.string(), token: v.string(), firmware: v.string() },
   handler: async (ctx, args) => {
     const device = await validateDevice(ctx, args.chipId, args.token, false);
-    const newStatus = device.status === "active" ? "online" : device.status;
+    await markSeen(ctx, device, args.firmware);
+    return { success: true };
+  }
+});
 
-    await ctx.db.patch(device._id, {
-      lastSeen: Date.now(),
-      firmwareVersion: args.firmware,
-      status: newStatus
-    });
+const syncArgs = {
+  chipId: v.string(),
+  token: v.string(),
+  firmware: v.optional(v.string()),
+  health: v.optional(deviceHealth),
+  whitelistSince: v.optional(v.number()),
+  whitelistMatch: v.optional(v.string()),
+  configMatch: v.optional(v.string()),
+  wantWhitelist: v.optional(v.boolean()),
+  wantConfig: v.optional(v.boolean()),
+};
+
+/**
+ * The roster and config sections of a sync reply. The device asks for each
+ * only when its refresh interval is due (X-Sync-Want); otherwise neither is
+ * looked up.
+ */
+async function syncSections(
+  ctx: QueryCtx | MutationCtx,
+  device: Doc<"devices">,
+  args: { whitelistSince?: number; whitelistMatch?: string; configMatch?: string;
+          wantWhitelist?: boolean; wantConfig?: boolean }
+) {
+  return {
+    whitelist: args.wantWhitelist
+      ? await whitelistFor(ctx, device, args.whitelistSince, args.whitelistMatch)
+      : undefined,
+    config: args.wantConfig ? await systemConfigFor(ctx, args.configMatch) : undefined,
+  };
+}
+
+/**
+ * One network cycle of a gatekeeper with logs to upload (POST /api/sync):
+ * stores its log batch, records it as seen when due, and returns the roster
+ * and config it asked for only when newer than the validators it holds -
+ * one device lookup instead of one per endpoint. A device without a room
+ * gets no `logs` reply, so it keeps its batch, but still gets its roster
+ * and config.
+ */
+export const sync = mutation({
+  args: { ...syncArgs, batch: logBatch, logs: v.array(deviceLog) },
+  handler: async (ctx, args) => {
+    const device = await validateDevice(ctx, args.chipId, args.token);
+    if (seenDue(device, Date.now(), args.firmware)) {
+      await markSeen(ctx, device, args.firmware, args.health);
+    }
+
+    const logs = device.roomId ? await storeDeviceLogs(ctx, device, args.logs, args.batch) : undefined;
+    return { logs, ...(await syncSections(ctx, device, args)) };
+  }
+});
+
+/**
+ * A sync cycle without logs: read-only, so a quiet check-in or a roster /
+ * config refresh costs no write. `seenDue` tells the caller to record the
+ * device as seen (syncSeen); `now` is passed in so a cached result does not
+ * hide that.
+ */
+export const syncCheck = query({
+  args: { ...syncArgs, now: v.number() },
+  handler: async (ctx, args) => {
+    const device = await validateDevice(ctx, args.chipId, args.token);
+    return {
+      seenDue: seenDue(device, args.now, args.firmware),
+      ...(await syncSections(ctx, device, args)),
+    };
+  }
+});
 
+export const syncSeen = mutation({
+  args: {
+    chipId: v.string(),
+    token: v.string(),
+    firmware: v.optional(v.string()),
+    health: v.optional(deviceHealth),
+  },
+  handler: async (ctx, args) => {
+    const device = await validateDevice(ctx, args.chipId, args.token);
+    await markSeen(ctx, device, args.firmware, args.health);
     return { success: true };
   }
 });
@@ -285,25 +434,38 @@ async function checkRateLimit(ctx: MutationCtx, key: string, limit: number, wind
 }
 
 /**
- * Returns system configuration for authenticated devices.
- * Devices cache this in NVS and refresh periodically.
+ * System configuration for devices, or null before it is set up. Devices
+ * cache this in NVS and refresh periodically. The ETag is a digest of the
+ * payload, so edits that don't bump updatedAt still change it.
+ */
+async function systemConfigFor(ctx: QueryCtx | MutationCtx, ifNoneMatch?: string) {
+  const config = await ctx.db.query("systemConfig").first();
+  if (!config) return null;
+
+  const data = {
+    pmk: config.espNowPmk,
+    secret: config.espNowSharedSecret,
+    debug: config.debugMode,
+    version: config.updatedAt,
+  };
+  const etag = `"cfg-${(await hashToken(JSON.stringify(data))).slice(0, 16)}"`;
+  if (etagMatches(ifNoneMatch, etag)) return { notModified: true as const, etag };
+  return { etag, ...data };
+}
+
+/**
+ * Returns system configuration for authenticated devices (see systemConfigFor).
  */
 export const getSystemConfig = query({
-  args: { chipId: v.string(), token: v.string() },
+  args: { chipId: v.string(), token: v.string(), ifNoneMatch: v.optional(v.string()) },
   handler: async (ctx, args) => {
     await validateDevice(ctx, args.chipId, args.token);
     
-    const config = await ctx.db.query("systemConfig").first();
+    const config = await systemConfigFor(ctx, args.ifNoneMatch);
     if (!config) {
       throw new Error("System not configured");
     }
-    
-    return {
-      pmk: config.espNowPmk,
-      secret: config.espNowSharedSecret,
-      debug: config.debugMode,
-      version: config.updatedAt,
-    };
+    return config;
   }
 });
 
@@ -1,6 +1,7 @@
 import { v } from "convex/values";
 import { mutation, query } from "./_generated/server";
 import { getCurrentUser, mustBeAdmin, touchRoom } from "./lib/permissions";
+import { recordWhitelistChange } from "./lib/whitelist";
 
 /**
  * Creates a new homeroom and links it to a physical room and semester.
@@ -27,6 +28,7 @@ export const create = mutation({
 
     // Notify hardware to re-sync whitelist for this room
     await touchRoom(ctx, args.roomId);
+    await recordWhitelistChange(ctx, { roomId: args.roomId, fullResync: true });
 
     return homeroomId;
   },
@@ -78,6 +80,7 @@ export const enrollStudent = mutation({
 
     // 4. Notify hardware
     await touchRoom(ctx, homeroom.roomId);
+    await recordWhitelistChange(ctx, { userId: args.studentId });
 
     return enrollmentId;
   },
@@ -195,6 +198,7 @@ export const bulkEnrollStudents = mutation({
       });
       
       await ctx.db.patch(studentId, { currentHomeroomId: args.homeroomId });
+      await recordWhitelistChange(ctx, { userId: studentId });
       results.enrolled++;
     }
     
@@ -245,6 +249,7 @@ export const transferStudent = mutation({
     // Touch both rooms for hardware sync
     if (oldRoomId) await touchRoom(ctx, oldRoomId);
     await touchRoom(ctx, newHomeroom.roomId);
+    await recordWhitelistChange(ctx, { userId: args.studentId });
     
     return { success: true };
   },
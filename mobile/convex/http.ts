@@ -2,18 +2,25 @@ import { httpRouter } from "convex/server";
 import { httpAction } from "./_generated/server";
 import { auth } from "./auth";
 import { api } from "./_generated/api";
+import { WHITELIST_BINARY_CONTENT_TYPE, encodeWhitelistBinary } from "./lib/whitelist";
+import { LOG_BINARY_CONTENT_TYPE, decodeLogBatchBinary } from "./lib/logs";
+import { SYNC_CONTENT_TYPE, encodeSyncResponse, parseHealthHeader } from "./lib/sync";
 
 const http = httpRouter();
 
 auth.addHttpRoutes(http);
 
+function bearerToken(request: Request) {
+  const authHeader = request.headers.get("Authorization");
+  return authHeader?.startsWith("Bearer ") ? authHeader.substring(7) : null;
+}
+
 /**
  * Utility to extract hardware credentials.
  * Token is now expected in the Authorization header: Bearer <token>
  */
 async function getHardwareCreds(request: Request) {
-  const authHeader = request.headers.get("Authorization");
-  const token = authHeader?.startsWith("Bearer ") ? authHeader.substring(7) : null;
+  const token = bearerToken(request);
 
   if (request.method === "GET") {
     const url = new URL(request.url);
@@ -32,7 +39,30 @@ async function getHardwareCreds(request: Request) {
 }
 
 /**
- * GET /api/whitelist?chipId=XXX&token=YYY
+ * getHardwareCreds for POST /api/logs, whose body may also be the compact
+ * binary batch (lib/logs.ts decodeLogBatchBinary)
+ */
+async function getLogUploadCreds(request: Request) {
+  if (!request.headers.get("Content-Type")?.startsWith(LOG_BINARY_CONTENT_TYPE)) {
+    return getHardwareCreds(request);
+  }
+  const payload = decodeLogBatchBinary(new Uint8Array(await request.arrayBuffer()));
+  return { chipId: payload.chipId, token: bearerToken(request), payload };
+}
+
+/**
+ * 304 with the validator, for devices whose If-None-Match is still current
+ */
+function notModified(etag: string) {
+  return new Response(null, { status: 304, headers: { ETag: etag } });
+}
+
+/**
+ * GET /api/whitelist?chipId=XXX[&since=VERSION]
+ * With `since`, the response may be a delta ({ full: false, adds, removes }).
+ * With "Accept: application/octet-stream", the same data in the compact
+ * binary format (lib/whitelist.ts encodeWhitelistBinary).
+ * Every response carries an ETag; If-None-Match with it gets a 304.
  */
 http.route({
   path: "/api/whitelist",
@@ -42,10 +72,22 @@ http.route({
     if (!chipId || !token) return new Response("Unauthorized", { status: 401 });
 
     try {
-      const data = await ctx.runQuery(api.hardware.getWhitelist, { chipId, token });
+      const sinceParam = new URL(request.url).searchParams.get("since");
+      const since = sinceParam !== null && /^\d+$/.test(sinceParam) ? Number(sinceParam) : undefined;
+      const ifNoneMatch = request.headers.get("If-None-Match") ?? undefined;
+      const result = await ctx.runQuery(api.hardware.getWhitelist, { chipId, token, since, ifNoneMatch });
+      if ("notModified" in result) return notModified(result.etag);
+
+      const { etag, ...data } = result;
+      if (request.headers.get("Accept")?.includes(WHITELIST_BINARY_CONTENT_TYPE)) {
+        return new Response(encodeWhitelistBinary(data), {
+          status: 200,
+          headers: { "Content-Type": WHITELIST_BINARY_CONTENT_TYPE, ETag: etag },
+        });
+      }
       return new Response(JSON.stringify(data), {
         status: 200,
-        headers: { "Content-Type": "application/json" },
+        headers: { "Content-Type": "application/json", ETag: etag },
       });
     } catch (e: any) {
       // Log internally but don't expose error details to client
@@ -56,19 +98,22 @@ http.route({
 
 /**
  * POST /api/logs
- * Body: { chipId, logs: [...] }
+ * Body: { chipId, batch?: { first, last }, logs: [...] }, or the same batch
+ * in the binary format (Content-Type: application/octet-stream, lib/logs.ts)
+ * Response: { success, count, duplicates, acked? } - `acked` echoes batch.last
  */
 http.route({
   path: "/api/logs",
   method: "POST",
   handler: httpAction(async (ctx, request) => {
     try {
-      const { chipId, token, payload } = await getHardwareCreds(request);
+      const { chipId, token, payload } = await getLogUploadCreds(request);
       if (!chipId || !token) return new Response("Unauthorized", { status: 401 });
       
       const result = await ctx.runMutation(api.hardware.syncLogs, { 
         chipId, 
         token, 
+        batch: payload.batch,
         logs: payload.logs 
       });
       return new Response(JSON.stringify(result), {
@@ -82,6 +127,78 @@ http.route({
   }),
 });
 
+/**
+ * POST /api/sync
+ * One round-trip per device cycle: the body is a log batch as for /api/logs
+ * (possibly empty), the roster/config validators, the sections due for a
+ * refresh (X-Sync-Want: whitelist,config) and health counters are headers.
+ * Response: the lib/sync.ts envelope with the log acknowledgement and only
+ * the wanted roster and config the device doesn't already hold. A cycle
+ * without logs is a query, plus a small write when the device is due to be
+ * recorded as seen.
+ */
+http.route({
+  path: "/api/sync",
+  method: "POST",
+  handler: httpAction(async (ctx, request) => {
+    try {
+      const { chipId, token, payload } = await getLogUploadCreds(request);
+      if (!chipId || !token) return new Response("Unauthorized", { status: 401 });
+
+      const header = (name: string) => request.headers.get(name) ?? undefined;
+      const sinceHeader = header("X-Whitelist-Since");
+      const want = (header("X-Sync-Want") ?? "").split(",").map((s) => s.trim());
+      const args = {
+        chipId,
+        token,
+        firmware: header("X-Firmware"),
+        health: parseHealthHeader(request.headers.get("X-Device-Health")),
+        whitelistSince: sinceHeader !== undefined && /^\d+$/.test(sinceHeader) ? Number(sinceHeader) : undefined,
+        whitelistMatch: header("X-Whitelist-Match"),
+        configMatch: header("X-Config-Match"),
+        wantWhitelist: want.includes("whitelist"),
+        wantConfig: want.includes("config"),
+      };
+
+      const logs = payload.logs ?? [];
+      let result;
+      if (logs.length > 0 || payload.batch) {
+        result = await ctx.runMutation(api.hardware.sync, { ...args, batch: payload.batch, logs });
+      } else {
+        const { seenDue, ...sections } = await ctx.runQuery(api.hardware.syncCheck, { ...args, now: Date.now() });
+        if (seenDue) {
+          await ctx.runMutation(api.hardware.syncSeen, {
+            chipId,
+            token,
+            firmware: args.firmware,
+            health: args.health,
+          });
+        }
+        result = { logs: undefined, ...sections };
+      }
+
+      const binary = !!request.headers.get("Accept")?.includes(WHITELIST_BINARY_CONTENT_TYPE);
+      let whitelist;
+      if (result.whitelist && !("notModified" in result.whitelist)) {
+        const { etag, ...data } = result.whitelist;
+        whitelist = { etag, binary, body: binary ? encodeWhitelistBinary(data) : JSON.stringify(data) };
+      }
+      let config;
+      if (result.config && !("notModified" in result.config)) {
+        const { etag, ...data } = result.config;
+        config = { etag, data };
+      }
+      return new Response(encodeSyncResponse({ logs: result.logs, config, whitelist }), {
+        status: 200,
+        headers: { "Content-Type": SYNC_CONTENT_TYPE },
+      });
+    } catch (e: any) {
+      // Log internally but don't expose error details to client
+      return new Response("Unauthorized", { status: 401 });
+    }
+  }),
+});
+
 /**
  * POST /api/heartbeat
  * Body: { chipId, firmware }
@@ -134,7 +251,8 @@ http.route({
 
 /**
  * GET /api/config
- * Returns system configuration (ESP-NOW secrets, debug mode) to authenticated devices
+ * Returns system configuration (ESP-NOW secrets, debug mode) to authenticated devices.
+ * Honors If-None-Match like /api/whitelist.
  */
 http.route({
   path: "/api/config",
@@ -144,10 +262,14 @@ http.route({
     if (!chipId || !token) return new Response("Unauthorized", { status: 401 });
 
     try {
-      const data = await ctx.runQuery(api.hardware.getSystemConfig, { chipId, token });
+      const ifNoneMatch = request.headers.get("If-None-Match") ?? undefined;
+      const result = await ctx.runQuery(api.hardware.getSystemConfig, { chipId, token, ifNoneMatch });
+      if ("notModified" in result) return notModified(result.etag);
+
+      const { etag, ...data } = result;
       return new Response(JSON.stringify(data), {
         status: 200,
-        headers: { "Content-Type": "application/json" },
+        headers: { "Content-Type": "application/json", ETag: etag },
       });
     } catch (e: any) {
       return new Response("Unauthorized", { status: 401 });
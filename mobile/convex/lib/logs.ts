@@ -0,0 +1,119 @@
+/**
+ * Compact binary body for POST /api/logs, sent by gatekeepers built with
+ * LOG_BINARY_WIRE (Content-Type: application/octet-stream). Layout and
+ * encoder: firmware/Gatekeeper/src/LogUploadStream.h. One header per batch
+ * replaces the JSON keys repeated on every row; timestamps and sequence
+ * numbers are zigzag varint deltas and user IDs are interned.
+ */
+export const LOG_BINARY_CONTENT_TYPE = "application/octet-stream";
+
+const WIRE_MAGIC = 0x3142474c; // "LGB1"
+const WIRE_FORMAT = 1;
+const WIRE_METHOD_NAMED = 0x07;
+const WIRE_LOCAL_TIME = 0x08;
+const WIRE_DENIED = 0x10;
+const WIRE_NEW_USER = 0x20;
+const WIRE_HAS_SEQ = 0x40;
+const WIRE_TRAILER_RANGE = 0x01;
+const WIRE_METHODS = ["", "NFC", "NFC+BIO", "FACE", "VEIN"];
+
+export type DeviceLog = {
+  userId: string;
+  method: string;
+  action: "ATTENDANCE";
+  result: "success" | "denied";
+  timestamp: number;
+  timestampType: "local" | "ntp";
+  seq?: number;
+};
+
+export type LogBatch = {
+  chipId: string;
+  batch?: { first: number; last: number };
+  logs: DeviceLog[];
+};
+
+/**
+ * Decodes a binary log batch into the same shape as the JSON body
+ * ({ chipId, batch?, logs }). Throws on a malformed or truncated body.
+ */
+export function decodeLogBatchBinary(body: Uint8Array): LogBatch {
+  const decoder = new TextDecoder();
+  let offset = 0;
+
+  const byte = () => {
+    if (offset >= body.length) throw new Error("Truncated log batch");
+    return body[offset++];
+  };
+  const varint = () => {
+    let value = 0;
+    for (let shift = 0; shift < 35; shift += 7) {
+      const b = byte();
+      value += (b & 0x7f) * 2 ** shift;
+      if (!(b & 0x80)) return value >>> 0;
+    }
+    throw new Error("Bad varint");
+  };
+  // Zigzag delta added to `base` with uint32 wrap-around, as the device computes it
+  const delta = (base: number) => {
+    const z = varint();
+    const d = (z >>> 1) ^ -(z & 1);
+    return (base + d) >>> 0;
+  };
+  const shortString = () => {
+    const len = byte();
+    if (offset + len > body.length) throw new Error("Truncated log batch");
+    const s = decoder.decode(body.subarray(offset, offset + len));
+    offset += len;
+    return s;
+  };
+
+  if (body.length < 6) throw new Error("Truncated log batch");
+  const view = new DataView(body.buffer, body.byteOffset, body.byteLength);
+  if (view.getUint32(0, true) !== WIRE_MAGIC) throw new Error("Not a log batch");
+  offset = 4;
+  if (byte() !== WIRE_FORMAT) throw new Error("Unsupported log batch format");
+  const chipId = shortString();
+
+  const users: string[] = [];
+  const logs: DeviceLog[] = [];
+  let prevTime = 0;
+  let nextSeq = 0;
+  for (;;) {
+    const flags = byte();
+    if (flags === 0) break; // Trailer
+    const code = flags & WIRE_METHOD_NAMED;
+    const method = code === WIRE_METHOD_NAMED ? shortString() : WIRE_METHODS[code];
+    if (!method) throw new Error("Bad log method");
+
+    let userId: string;
+    if (flags & WIRE_NEW_USER) {
+      userId = shortString();
+      users.push(userId);
+    } else {
+      const index = varint();
+      if (index >= users.length) throw new Error("Bad user reference");
+      userId = users[index];
+    }
+    prevTime = delta(prevTime);
+
+    const log: DeviceLog = {
+      userId,
+      method,
+      action: "ATTENDANCE",
+      result: flags & WIRE_DENIED ? "denied" : "success",
+      timestamp: prevTime,
+      timestampType: flags & WIRE_LOCAL_TIME ? "local" : "ntp",
+    };
+    if (flags & WIRE_HAS_SEQ) {
+      log.seq = delta(nextSeq);
+      nextSeq = (log.seq + 1) >>> 0;
+    }
+    logs.push(log);
+  }
+
+  const trailer = byte();
+  const batch = trailer & WIRE_TRAILER_RANGE ? { first: varint(), last: varint() } : undefined;
+  if (offset !== body.length) throw new Error("Trailing bytes after log batch");
+  return { chipId, batch, logs };
+}
@@ -0,0 +1,122 @@
+import { v, Infer } from "convex/values";
+
+/**
+ * POST /api/sync: one exchange per gatekeeper network cycle in place of
+ * /api/logs, /api/whitelist, /api/config and /api/heartbeat. The request
+ * body is a log batch exactly as for /api/logs (JSON or LGB1); the device's
+ * validators and health counters travel in headers:
+ *
+ *   X-Whitelist-Since   roster version held (deltas, as ?since= on /api/whitelist)
+ *   X-Whitelist-Match   roster ETag held (If-None-Match of /api/whitelist)
+ *   X-Config-Match      config ETag held (If-None-Match of /api/config)
+ *   X-Sync-Want         "whitelist,config": sections whose refresh is due
+ *   X-Firmware          firmware version (as the heartbeat body)
+ *   X-Device-Health     "key=value;..." counters (deviceHealth)
+ *   Accept              application/octet-stream: roster section in WLB1
+ *
+ * The response is the envelope below; a section is left out when it was
+ * not wanted or there is nothing newer than what the device holds. Layout
+ * and decoder: firmware/Gatekeeper/src/CloudSync.h. Little-endian.
+ *
+ *   header   u32 magic "SYN1"
+ *   section  u8 kind | u32 length | length bytes
+ *            1 LOGS       JSON reply of /api/logs ({ success, count, duplicates, acked? })
+ *            2 CONFIG     u8 etagLen | etag | JSON body of /api/config
+ *            3 WHITELIST  u8 etagLen | etag | u8 wire (0 JSON, 1 WLB1) | /api/whitelist body
+ *            0 END        length 0 - a body without it was cut short
+ */
+export const SYNC_CONTENT_TYPE = "application/octet-stream";
+
+const SYNC_MAGIC = 0x314e5953; // "SYN1"
+const SYNC_SECTION_END = 0;
+const SYNC_SECTION_LOGS = 1;
+const SYNC_SECTION_CONFIG = 2;
+const SYNC_SECTION_WHITELIST = 3;
+
+/**
+ * Counters accepted in X-Device-Health (others are ignored); stored on the
+ * device as `health`
+ */
+export const deviceHealth = v.object({
+  uptime: v.optional(v.number()),     // Seconds since boot
+  heap: v.optional(v.number()),       // Free heap, bytes
+  heapMin: v.optional(v.number()),    // Lowest free heap since boot, bytes
+  backlog: v.optional(v.number()),    // Taps waiting for upload
+  queueFull: v.optional(v.number()),  // Taps written in place because the log queue was full
+  badReads: v.optional(v.number()),   // Log frames that failed their CRC
+  handshakes: v.optional(v.number()), // TLS handshakes since boot
+  rssi: v.optional(v.number()),       // WiFi signal, dBm
+});
+
+export type SyncHealth = Infer<typeof deviceHealth>;
+
+/**
+ * X-Device-Health ("uptime=3600;heap=81234;...") to known integer counters
+ */
+export function parseHealthHeader(value: string | null): SyncHealth | undefined {
+  if (!value) return undefined;
+  const health: SyncHealth = {};
+  for (const pair of value.split(";")) {
+    const [key, raw] = pair.trim().split("=");
+    if (!(key in deviceHealth.fields) || !/^-?\d{1,10}$/.test(raw ?? "")) continue;
+    health[key as keyof SyncHealth] = Number(raw);
+  }
+  return Object.keys(health).length > 0 ? health : undefined;
+}
+
+/**
+ * Builds the response envelope. `whitelist.body` is already encoded
+ * (JSON text or encodeWhitelistBinary output).
+ */
+export function encodeSyncResponse(parts: {
+  logs?: object;
+  config?: { etag: string; data: object };
+  whitelist?: { etag: string; binary: boolean; body: string | Uint8Array };
+}): Uint8Array {
+  const encoder = new TextEncoder();
+  const bytes = (body: string | Uint8Array) => (typeof body === "string" ? encoder.encode(body) : body);
+  const validator = (etag: string) => {
+    const e = encoder.encode(etag);
+    if (e.length > 255) throw new Error("ETag too long");
+    return [e.length, ...e];
+  };
+
+  const sections: { kind: number; chunks: (Uint8Array | number[])[] }[] = [];
+  if (parts.logs) {
+    sections.push({ kind: SYNC_SECTION_LOGS, chunks: [bytes(JSON.stringify(parts.logs))] });
+  }
+  if (parts.config) {
+    sections.push({
+      kind: SYNC_SECTION_CONFIG,
+      chunks: [validator(parts.config.etag), bytes(JSON.stringify(parts.config.data))],
+    });
+  }
+  if (parts.whitelist) {
+    sections.push({
+      kind: SYNC_SECTION_WHITELIST,
+      chunks: [validator(parts.whitelist.etag), [parts.whitelist.binary ? 1 : 0], bytes(parts.whitelist.body)],
+    });
+  }
+  sections.push({ kind: SYNC_SECTION_END, chunks: [] });
+
+  let size = 4;
+  for (const section of sections) {
+    size += 5;
+    for (const chunk of section.chunks) size += chunk.length;
+  }
+  const out = new Uint8Array(size);
+  const view = new DataView(out.buffer);
+  view.setUint32(0, SYNC_MAGIC, true);
+  let offset = 4;
+  for (const section of sections) {
+    const length = section.chunks.reduce((n, chunk) => n + chunk.length, 0);
+    out[offset] = section.kind;
+    view.setUint32(offset + 1, length, true);
+    offset += 5;
+    for (const chunk of section.chunks) {
+      out.set(chunk, offset);
+      offset += chunk.length;
+    }
+  }
+  return out;
+}
@@ -11,6 +11,17 @@ export async function hashToken(token: string) {
   return hashArray.map((b) => b.toString(16).padStart(2, "0")).join("");
 }
 
+/**
+ * If-None-Match check with weak comparison (RFC 9110): true if any listed
+ * tag, or "*", matches `etag`.
+ */
+export function etagMatches(ifNoneMatch: string | null | undefined, etag: string): boolean {
+  if (!ifNoneMatch) return false;
+  const opaque = (tag: string) => tag.trim().replace(/^W\//, "");
+  const wanted = opaque(etag);
+  return ifNoneMatch.split(",").some((tag) => tag.trim() === "*" || opaque(tag) === wanted);
+}
+
 /**
  * Constant-time string comparison to prevent timing attacks.
  * Returns true if strings are equal.
@@ -0,0 +1,512 @@
+import { MutationCtx, QueryCtx } from "../_generated/server";
+import { Doc, Id } from "../_generated/dataModel";
+import { internal } from "../_generated/api";
+
+/**
+ * Devices further behind than this many changes get a full roster instead of a delta.
+ * Also caps adds/removes per delta - gatekeepers buffer at most
+ * WHITELIST_DELTA_MAX_ENTRIES (firmware config.h) of each.
+ */
+export const MAX_WHITELIST_DELTA = 128;
+
+/**
+ * Change rows older than this are pruned; devices behind the pruned range resync fully.
+ */
+export const WHITELIST_CHANGE_RETENTION_MS = 30 * 24 * 60 * 60 * 1000;
+
+/**
+ * Rooms with more entries than this are not snapshotted (a Convex document
+ * holds at most 1 MB) and are built live on each full sync instead.
+ */
+export const MAX_WHITELIST_SNAPSHOT_ENTRIES = 8000;
+
+/**
+ * Delay before snapshots are refreshed after a change, so a bulk enrollment
+ * is folded into one refresh.
+ */
+export const WHITELIST_SNAPSHOT_DELAY_MS = 2000;
+
+export type WhitelistEntry = {
+  uid: string;
+  sid: Id<"users">;
+  role: Doc<"users">["role"];
+  bioId: number;
+};
+
+const STAFF_ROLES = ["admin", "teacher", "staff"];
+
+export function isStaff(user: Doc<"users">) {
+  return !!user.role && STAFF_ROLES.includes(user.role);
+}
+
+export function toWhitelistEntry(user: Doc<"users">): WhitelistEntry {
+  return {
+    uid: user.cardUID!,
+    sid: user._id,
+    role: user.role,
+    bioId: user.biometricId || 0,
+  };
+}
+
+/**
+ * Sort key matching the gatekeeper image order: raw UID bytes zero-padded
+ * to 7, then length. Separators (":" or " ") are ignored.
+ */
+function cardSortKey(uid: string) {
+  const hex = uid.replace(/[: ]/g, "").toUpperCase();
+  return hex.padEnd(14, "0") + String(hex.length).padStart(2, "0");
+}
+
+/**
+ * Sorts entries into the order gatekeepers write them to flash, so a full
+ * roster can be streamed into the image without sorting on the device.
+ */
+export function sortWhitelistEntries(entries: WhitelistEntry[]) {
+  const keyed = entries.map((entry) => ({ key: cardSortKey(entry.uid), entry }));
+  keyed.sort((a, b) => (a.key < b.key ? -1 : a.key > b.key ? 1 : 0));
+  return keyed.map(({ entry }) => entry);
+}
+
+/**
+ * Records a change that may affect device whitelists. Devices pull every
+ * change after the last version they applied (see hardware.getWhitelist).
+ * - userId: re-evaluate this user (card, role, biometric or enrollment changed)
+ * - prevCardUID: card the user held before the change; removed if no longer valid
+ * - fullResync: the roster changed wholesale (roomId scopes it, omit for all rooms)
+ */
+export async function recordWhitelistChange(
+  ctx: MutationCtx,
+  change: {
+    userId?: Id<"users">;
+    prevCardUID?: string;
+    roomId?: Id<"rooms">;
+    fullResync?: boolean;
+  }
+) {
+  const last = await ctx.db
+    .query("whitelistChanges")
+    .withIndex("by_seq")
+    .order("desc")
+    .first();
+
+  await ctx.db.insert("whitelistChanges", {
+    ...change,
+    seq: (last?.seq ?? 0) + 1,
+    createdAt: Date.now(),
+  });
+
+  // A refresh is already pending if an earlier change was not dispatched yet
+  const state = await ctx.db.query("whitelistSnapshotState").first();
+  if ((last?.seq ?? 0) <= (state?.version ?? 0)) {
+    await ctx.scheduler.runAfter(
+      WHITELIST_SNAPSHOT_DELAY_MS,
+      internal.crons.refreshWhitelistSnapshots,
+      {}
+    );
+  }
+}
+
+/**
+ * Current whitelist version (the newest change sequence number).
+ */
+export async function getWhitelistVersion(ctx: QueryCtx | MutationCtx) {
+  const last = await ctx.db
+    .query("whitelistChanges")
+    .withIndex("by_seq")
+    .order("desc")
+    .first();
+  return last?.seq ?? 0;
+}
+
+/**
+ * Validator for the whitelist a device holds: the change-log version plus
+ * the room it was built for. Weak, because every response that leads to
+ * that state (full or delta, JSON or binary) shares it. Cheap to compute,
+ * so an unchanged device is answered without building the roster.
+ */
+export function whitelistEtag(version: number, roomId?: Id<"rooms">) {
+  return `W/"wl-${version}-${roomId ?? "none"}"`;
+}
+
+/**
+ * Finds the homeroom that owns a room in the active semester, if any.
+ */
+export async function getActiveHomeroom(ctx: QueryCtx | MutationCtx, roomId: Id<"rooms">) {
+  const semester = await ctx.db
+    .query("semesters")
+    .withIndex("by_status", (q) => q.eq("status", "active"))
+    .unique();
+  if (!semester) return null;
+
+  return await ctx.db
+    .query("homerooms")
+    .withIndex("by_room", (q) => q.eq("roomId", roomId))
+    .filter((q) => q.eq(q.field("semesterId"), semester._id))
+    .first();
+}
+
+/**
+ * Whether a user's card should open doors in a room.
+ * Staff have universal access; students only their active homeroom.
+ */
+export async function isWhitelistedFor(
+  ctx: QueryCtx | MutationCtx,
+  user: Doc<"users">,
+  homeroom: Doc<"homerooms"> | null
+) {
+  if (!user.cardUID) return false;
+  if (isStaff(user)) return true;
+  if (!homeroom) return false;
+
+  const enrollment = await ctx.db
+    .query("homeroomStudents")
+    .withIndex("by_homeroom_student", (q) =>
+      q.eq("homeroomId", homeroom._id).eq("studentId", user._id)
+    )
+    .filter((q) => q.eq(q.field("status"), "active"))
+    .first();
+  return !!enrollment;
+}
+
+/**
+ * Staff entries, on every room's roster (universal access).
+ */
+export async function buildStaffWhitelist(ctx: QueryCtx | MutationCtx): Promise<WhitelistEntry[]> {
+  const staff: Doc<"users">[] = [];
+  for (const role of STAFF_ROLES) {
+    staff.push(...await ctx.db
+      .query("users")
+      .withIndex("by_role", (q) => q.eq("role", role as Doc<"users">["role"]))
+      .collect());
+  }
+  return staff.filter(u => !!u.cardUID).map(toWhitelistEntry);
+}
+
+/**
+ * Builds the full whitelist for a room based on homeroom enrollment.
+ * Full syncs read the room's snapshot instead; this rebuilds it, and serves
+ * rooms too large to snapshot. `staff` (buildStaffWhitelist) saves the staff
+ * scan when the caller already has them.
+ */
+export async function buildFullWhitelist(
+  ctx: QueryCtx | MutationCtx,
+  roomId: Id<"rooms">,
+  staff?: WhitelistEntry[]
+): Promise<WhitelistEntry[]> {
+  // 1. Get Active Semester
+  const semester = await ctx.db
+    .query("semesters")
+    .withIndex("by_status", (q) => q.eq("status", "active"))
+    .unique();
+
+  if (!semester) return [];
+
+  // 2. Find Homeroom associated with this room for the active semester
+  const homeroom = await getActiveHomeroom(ctx, roomId);
+
+  // 3. Get All Staff
+  const staffEntries = staff ?? await buildStaffWhitelist(ctx);
+
+  // If no homeroom, only allow staff/admin access
+  if (!homeroom) {
+    return staffEntries;
+  }
+
+  // 4. Get Enrolled Students
+  const enrollments = await ctx.db
+    .query("homeroomStudents")
+    .withIndex("by_homeroom", (q) => q.eq("homeroomId", homeroom._id))
+    .filter((q) => q.eq(q.field("status"), "active"))
+    .collect();
+
+  const students = await Promise.all(enrollments.map(enroll => ctx.db.get(enroll.studentId)));
+
+  const enrolled = students.filter((u): u is Doc<"users"> => !!u && !!u.cardUID);
+  return [...staffEntries, ...enrolled.map(toWhitelistEntry)];
+}
+
+/**
+ * Computes adds/removes for a room from the change log after `since`.
+ * Returns null when the device must do a full resync instead (version gap,
+ * pruned history, too many changes, or a room-wide change).
+ */
+export async function buildWhitelistDelta(
+  ctx: QueryCtx | MutationCtx,
+  roomId: Id<"rooms">,
+  since: number,
+  version: number
+): Promise<{ adds: WhitelistEntry[]; removes: string[] } | null> {
+  if (since > version) return null; // Device is ahead of us (e.g. server reset)
+
+  // History before `since` must still be retained to replay from it
+  const oldest = await ctx.db
+    .query("whitelistChanges")
+    .withIndex("by_seq")
+    .order("asc")
+    .first();
+  if (oldest && oldest.seq > since + 1) return null;
+
+  const changes = await ctx.db
+    .query("whitelistChanges")
+    .withIndex("by_seq", (q) => q.gt("seq", since))
+    .take(MAX_WHITELIST_DELTA + 1);
+  if (changes.length > MAX_WHITELIST_DELTA) return null;
+  if (changes.some(c => c.fullResync && (!c.roomId || c.roomId === roomId))) return null;
+
+  const semester = await ctx.db
+    .query("semesters")
+    .withIndex("by_status", (q) => q.eq("status", "active"))
+    .unique();
+  if (!semester) return null;
+
+  const homeroom = await getActiveHomeroom(ctx, roomId);
+
+  const adds: WhitelistEntry[] = [];
+  const removes = new Set<string>();
+  const seen = new Set<string>();
+
+  for (const change of changes) {
+    if (change.prevCardUID) removes.add(change.prevCardUID);
+    if (!change.userId || seen.has(change.userId)) continue;
+    seen.add(change.userId);
+
+    const user = await ctx.db.get(change.userId);
+    if (user && await isWhitelistedFor(ctx, user, homeroom)) {
+      adds.push(toWhitelistEntry(user));
+    } else if (user?.cardUID) {
+      removes.add(user.cardUID);
+    }
+  }
+
+  if (adds.length > MAX_WHITELIST_DELTA || removes.size > MAX_WHITELIST_DELTA) return null;
+
+  // Device applies removes before adds, so a card that moved is re-added
+  return { adds: sortWhitelistEntries(adds), removes: [...removes] };
+}
+
+/**
+ * A roster with a delta applied, in the order the device applies it:
+ * removes, then adds.
+ */
+export function applyWhitelistDelta(
+  entries: WhitelistEntry[],
+  delta: { adds: WhitelistEntry[]; removes: string[] }
+) {
+  const removed = new Set([...delta.removes, ...delta.adds.map(e => e.uid)]);
+  return sortWhitelistEntries([...entries.filter(e => !removed.has(e.uid)), ...delta.adds]);
+}
+
+/**
+ * Materialized per-room roster: the sorted entries a full sync returns.
+ * Each snapshot records the whitelist version it reflects. One that lags
+ * `version` is brought forward with the same delta a device would get, so
+ * a change elsewhere costs a full sync the change-log read, not a rebuild.
+ * Returns null when the room has no snapshot or the delta is not possible;
+ * the caller then builds the roster live.
+ */
+export async function getWhitelistSnapshot(
+  ctx: QueryCtx | MutationCtx,
+  roomId: Id<"rooms">,
+  version: number
+): Promise<WhitelistEntry[] | null> {
+  const snapshot = await ctx.db
+    .query("whitelistSnapshots")
+    .withIndex("by_room", (q) => q.eq("roomId", roomId))
+    .unique();
+  if (!snapshot || snapshot.version === undefined) return null;
+  if (snapshot.version === version) return snapshot.entries;
+
+  const delta = await buildWhitelistDelta(ctx, roomId, snapshot.version, version);
+  return delta ? applyWhitelistDelta(snapshot.entries, delta) : null;
+}
+
+/**
+ * Starts a snapshot refresh: records the rooms with a gatekeeper and the
+ * staff entries (read once here, shared by every room's rebuild), then
+ * schedules refreshRoomWhitelistSnapshot per room - each room is its own
+ * transaction, so the refresh stays within the per-mutation read limits
+ * however many rooms there are. Rooms that lost their gatekeeper are
+ * scheduled too, to drop their snapshot.
+ */
+export async function refreshWhitelistSnapshots(ctx: MutationCtx) {
+  const version = await getWhitelistVersion(ctx);
+  const state = await ctx.db.query("whitelistSnapshotState").first();
+
+  const rooms = new Set<Id<"rooms">>();
+  for (const device of await ctx.db.query("devices").collect()) {
+    if (device.roomId) rooms.add(device.roomId);
+  }
+  const previous = new Set(state?.rooms ?? []);
+  const current = state !== null && !!state.staff && state.version === version;
+
+  // Every room when the version moved, else only rooms that gained or lost a device
+  const targets = current
+    ? [...rooms].filter(r => !previous.has(r)).concat([...previous].filter(r => !rooms.has(r)))
+    : [...new Set([...rooms, ...previous])];
+  if (current && targets.length === 0) return;
+
+  const fields = {
+    version,
+    staff: current ? state!.staff : await buildStaffWhitelist(ctx),
+    rooms: [...rooms],
+    updatedAt: Date.now(),
+  };
+  if (state) {
+    await ctx.db.patch(state._id, fields);
+  } else {
+    await ctx.db.insert("whitelistSnapshotState", fields);
+  }
+
+  for (const roomId of targets) {
+    await ctx.scheduler.runAfter(0, internal.crons.refreshRoomWhitelistSnapshot, { roomId });
+  }
+}
+
+/**
+ * Brings one room's snapshot up to the current whitelist version. Replays
+ * the change log like a device delta sync; a room the changes did not touch
+ * only has its version moved. When a delta is not possible the roster is
+ * rebuilt from the staff entries refreshWhitelistSnapshots stored plus the
+ * room's enrollments, and stamped with the version of that staff list, so
+ * later changes are replayed on top of it.
+ */
+export async function refreshRoomWhitelistSnapshot(ctx: MutationCtx, roomId: Id<"rooms">) {
+  const state = await ctx.db.query("whitelistSnapshotState").first();
+  const snapshot = await ctx.db
+    .query("whitelistSnapshots")
+    .withIndex("by_room", (q) => q.eq("roomId", roomId))
+    .unique();
+
+  if (!state || !state.rooms?.includes(roomId)) {
+    if (snapshot) await ctx.db.delete(snapshot._id);
+    return;
+  }
+
+  const version = await getWhitelistVersion(ctx);
+  if (snapshot?.version === version) return;
+
+  const now = Date.now();
+  const delta = snapshot?.version !== undefined
+    ? await buildWhitelistDelta(ctx, roomId, snapshot.version, version)
+    : null;
+
+  let entries: WhitelistEntry[];
+  let at = version;
+  if (snapshot && delta) {
+    entries = applyWhitelistDelta(snapshot.entries, delta);
+    if (JSON.stringify(entries) === JSON.stringify(snapshot.entries)) {
+      await ctx.db.patch(snapshot._id, { version, updatedAt: now });
+      return;
+    }
+  } else {
+    entries = sortWhitelistEntries(await buildFullWhitelist(ctx, roomId, state.staff));
+    if (state.staff) at = state.version;
+  }
+
+  if (entries.length > MAX_WHITELIST_SNAPSHOT_ENTRIES) {
+    if (snapshot) await ctx.db.delete(snapshot._id);
+  } else if (snapshot) {
+    await ctx.db.patch(snapshot._id, { entries, version: at, updatedAt: now });
+  } else {
+    await ctx.db.insert("whitelistSnapshots", { roomId, entries, version: at, updatedAt: now });
+  }
+}
+
+/**
+ * Binary wire format for /api/whitelist, sent when the device asks for it
+ * (Accept: application/octet-stream). Layout and decoder:
+ * firmware/Gatekeeper/src/WhitelistBinary.h. Raw UID bytes, a role enum and
+ * an interned user-ID table replace the per-row JSON keys and hex strings.
+ */
+export const WHITELIST_BINARY_CONTENT_TYPE = "application/octet-stream";
+
+const WIRE_MAGIC = 0x31424c57; // "WLB1"
+const WIRE_FORMAT = 1;
+const WIRE_HEADER_LEN = 24;
+const WIRE_FLAG_FULL = 0x01;
+const WIRE_ROLES: Record<string, number> = { student: 1, teacher: 2, staff: 3, admin: 4 };
+
+function parseCardUID(uid: string): number[] | null {
+  const hex = uid.replace(/[: ]/g, "");
+  if (hex.length === 0 || hex.length % 2 || hex.length > 14 || !/^[0-9a-fA-F]+$/.test(hex)) {
+    return null;
+  }
+  const bytes: number[] = [];
+  for (let i = 0; i < hex.length; i += 2) bytes.push(parseInt(hex.slice(i, i + 2), 16));
+  return bytes;
+}
+
+export function encodeWhitelistBinary(data: {
+  version: number;
+  full: boolean;
+  entries?: WhitelistEntry[];
+  adds?: WhitelistEntry[];
+  removes?: string[];
+}): Uint8Array {
+  const rows = (data.full ? data.entries : data.adds) ?? [];
+  const encoder = new TextEncoder();
+
+  // Users are interned in order of first use, so a full roster writes them sequentially
+  const users: Uint8Array[] = [];
+  const userIndex = new Map<string, number>();
+  const entries: { uid: number[]; role: number; bioId: number; userIdx: number }[] = [];
+  for (const row of rows) {
+    const uid = parseCardUID(row.uid);
+    const sid = encoder.encode(row.sid);
+    if (!uid || sid.length === 0 || sid.length > 31) continue;
+
+    let userIdx = userIndex.get(row.sid);
+    if (userIdx === undefined) {
+      userIdx = users.length;
+      userIndex.set(row.sid, userIdx);
+      users.push(sid);
+    }
+    entries.push({
+      uid,
+      role: WIRE_ROLES[row.role ?? ""] ?? 0,
+      bioId: row.bioId > 0xffff ? 0 : row.bioId,
+      userIdx,
+    });
+  }
+  const removes = (data.full ? [] : data.removes ?? [])
+    .map(parseCardUID)
+    .filter((uid): uid is number[] => uid !== null);
+
+  let size = WIRE_HEADER_LEN;
+  for (const user of users) size += 1 + user.length;
+  for (const entry of entries) size += 1 + entry.uid.length + 5;
+  for (const uid of removes) size += 1 + uid.length;
+
+  const out = new Uint8Array(size);
+  const view = new DataView(out.buffer);
+  view.setUint32(0, WIRE_MAGIC, true);
+  view.setUint16(4, WIRE_HEADER_LEN, true);
+  view.setUint8(6, WIRE_FORMAT);
+  view.setUint8(7, data.full ? WIRE_FLAG_FULL : 0);
+  view.setUint32(8, data.version, true);
+  view.setUint32(12, users.length, true);
+  view.setUint32(16, entries.length, true);
+  view.setUint32(20, removes.length, true);
+
+  let offset = WIRE_HEADER_LEN;
+  for (const user of users) {
+    out[offset++] = user.length;
+    out.set(user, offset);
+    offset += user.length;
+  }
+  for (const entry of entries) {
+    out[offset++] = entry.uid.length;
+    out.set(entry.uid, offset);
+    offset += entry.uid.length;
+    view.setUint8(offset, entry.role);
+    view.setUint16(offset + 1, entry.bioId, true);
+    view.setUint16(offset + 3, entry.userIdx, true);
+    offset += 5;
+  }
+  for (const uid of removes) {
+    out[offset++] = uid.length;
+    out.set(uid, offset);
+    offset += uid.length;
+  }
+  return out;
+}
@@ -1,6 +1,20 @@
 import { defineSchema, defineTable } from "convex/server";
 import { authTables } from "@convex-dev/auth/server";
 import { v } from "convex/values";
+import { deviceHealth } from "./lib/sync";
+
+// One card on a room's whitelist (lib/whitelist.ts WhitelistEntry)
+const whitelistEntry = v.object({
+  uid: v.string(),
+  sid: v.id("users"),
+  role: v.optional(v.union(
+    v.literal("student"),
+    v.literal("teacher"),
+    v.literal("admin"),
+    v.literal("staff")
+  )),
+  bioId: v.number(),
+});
 
 export default defineSchema({
   ...authTables,
@@ -187,6 +201,7 @@ export default defineSchema({
     name: v.string(),
     firmwareVersion: v.optional(v.string()),
     lastSeen: v.optional(v.number()),
+    health: v.optional(deviceHealth), // Last counters reported by /api/sync
     status: v.union(
       v.literal("pending"),
       v.literal("active"),
@@ -213,10 +228,14 @@ export default defineSchema({
     deviceId: v.optional(v.string()),
     gps: v.optional(v.object({ lat: v.number(), lng: v.number() })),
     scanOrder: v.optional(v.number()),
+    // Gatekeeper uploads: uploading device and its log sequence number (dedupe key)
+    sourceDevice: v.optional(v.id("devices")),
+    deviceSeq: v.optional(v.number()),
   })
     .index("by_user", ["userId"])
     .index("by_timestamp", ["timestamp"])
-    .index("by_room_timestamp", ["roomId", "timestamp"]),
+    .index("by_room_timestamp", ["roomId", "timestamp"])
+    .index("by_device_seq", ["sourceDevice", "deviceSeq"]),
 
   staffTasks: defineTable({
     roomId: v.id("rooms"),
@@ -258,6 +277,35 @@ export default defineSchema({
     .index("by_type", ["type"])
     .index("by_user_status", ["userId", "status"]),
 
+  // Ordered log of roster changes; devices sync deltas after their last seq
+  whitelistChanges: defineTable({
+    seq: v.number(),                           // Whitelist version after this change
+    userId: v.optional(v.id("users")),         // User to re-evaluate
+    prevCardUID: v.optional(v.string()),       // Card held before the change
+    roomId: v.optional(v.id("rooms")),         // Scope of a fullResync (all rooms if unset)
+    fullResync: v.optional(v.boolean()),
+    createdAt: v.number(),
+  })
+    .index("by_seq", ["seq"])
+    .index("by_createdAt", ["createdAt"]),
+
+  // Materialized full roster per room, kept current by refreshRoomWhitelistSnapshot
+  whitelistSnapshots: defineTable({
+    roomId: v.id("rooms"),
+    entries: v.array(whitelistEntry),          // Sorted in gatekeeper image order
+    version: v.optional(v.number()),           // Whitelist version reflected (unset: written before per-room versions)
+    updatedAt: v.number(),
+  })
+    .index("by_room", ["roomId"]),
+
+  // Single row: the last snapshot refresh dispatched (refreshWhitelistSnapshots)
+  whitelistSnapshotState: defineTable({
+    version: v.number(),                       // Whitelist version it was dispatched for
+    staff: v.optional(v.array(whitelistEntry)), // Staff entries at that version, shared by room rebuilds
+    rooms: v.optional(v.array(v.id("rooms"))), // Rooms with a gatekeeper (snapshotted)
+    updatedAt: v.number(),
+  }),
+
   rateLimits: defineTable({
     key: v.string(),        // e.g., "register:chipId:ABC123"
     attempts: v.number(),
@@ -3,6 +3,7 @@ import { createAccount } from "@convex-dev/auth/server";
 import { v } from "convex/values";
 import { api, internal } from "./_generated/api";
 import { getCurrentUser, mustBeAdmin, mustBeAuthenticated, logActivity, touchRoom } from "./lib/permissions";
+import { recordWhitelistChange } from "./lib/whitelist";
 
 export const viewer = query({
   args: {},
@@ -146,6 +147,7 @@ export const linkCard = mutation({
 
     await ctx.db.patch(user!._id, { cardUID: args.cardUID });
     await logActivity(ctx, user!, "CARD_LINK", `Linked card ${args.cardUID}`);
+    await recordWhitelistChange(ctx, { userId: user!._id, prevCardUID: user!.cardUID });
 
     // If student, touch their homeroom so hardware re-syncs
     if (user!.role === "student" && user!.currentHomeroomId) {
@@ -170,6 +172,7 @@ export const remove = mutation({
 
     // 1. Delete user profile
     await ctx.db.delete(args.id);
+    await recordWhitelistChange(ctx, { prevCardUID: user.cardUID });
 
     // 2. Delete related auth accounts
     const accounts = await ctx.db
@@ -225,6 +228,7 @@ export const update = mutation({
 
     const { id, ...updates } = args;
     await ctx.db.patch(id, updates);
+    await recordWhitelistChange(ctx, { userId: id });
 
     // If homeroom changed, touch the rooms
     if (args.currentHomeroomId) {